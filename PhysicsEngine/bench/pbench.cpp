@@ -0,0 +1,561 @@
+/*
+* Benchmarks of the particle engine. Each scenario builds a world from a seed,
+* so runs are reproducible, steps it and times each phase separately: force
+* generation, integration, link filling and contact resolution. Results are
+* reported in nanoseconds per particle per step, as JSON, to be tracked across commits.
+*
+* Usage: cyclone_bench [--particles N] [--steps N] [--seed N] [--iterations N] [--scenario name] [--output file] [--trace file]
+*
+* The resolver is given twice as many iterations as there are contacts, as the world
+* does, unless --iterations is given. Each iteration scans every contact, so the resolve
+* phase of the chains scenario grows with the square of the particles.
+*
+* --trace writes the phases of the world as a Chrome trace, when the engine is built
+* with CYCLONE_PROFILE
+*/
+#include <include/pworld.h>
+#include <include/pbuoyancy.h>
+#include <include/pfield.h>
+#include <include/pfluid.h>
+#include <include/pneighbors.h>
+#include <memory>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace cyclone;
+
+/*
+* Small deterministic random number generator, the same on every platform
+*/
+class BenchRandom
+{
+public:
+	BenchRandom(unsigned seed) : state(seed ? seed : 1) {}
+
+	real next(real min, real max) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return min + (max - min) * ((state & 0xFFFFFF) * ((real)1.0 / 0x1000000));
+	}
+
+	unsigned nextIndex(unsigned count) {
+		return (unsigned)next(0, (real)count) % count;
+	}
+
+private:
+	unsigned state;
+};
+
+/*
+* Holds what a scenario creates besides the world particles and generators
+*/
+struct BenchScene
+{
+	std::vector<ParticleCable> cables;
+	std::vector<ParticleRod> rods;
+
+	/*
+	* Contacts given to the resolver every step on top of the ones generated by the links
+	*/
+	std::vector<ParticleContact> contacts;
+
+	/*
+	* The fluid whose forces are added to the forces phase, if any, and the threads of its passes
+	*/
+	std::unique_ptr<ParticleJobPool> fluidJobs;
+	std::unique_ptr<ParticleFluid> fluid;
+
+	/*
+	* The neighbor lists and the soft-sphere force added to the forces phase, if any
+	*/
+	std::unique_ptr<ParticleNeighborList> neighbors;
+	std::unique_ptr<ParticleNeighborForce> neighborForce;
+};
+
+/*
+* Holds the time spent in each phase, in seconds
+*/
+struct BenchTimes
+{
+	double forces;
+	double integrate;
+	double links;
+	double resolve;
+	unsigned long long contacts;
+};
+
+typedef void (*BenchBuild)(ParticleWorld& world, BenchScene& scene, unsigned particles, unsigned seed);
+
+/*
+* Creates a particle of unit mass at the given position
+*/
+static Particle* createParticle(ParticleWorld& world, real x, real y, real z) {
+	Particle* particle = world.createParticle();
+	particle->setMass(1);
+	particle->setDamping(0.99f);
+	particle->setPosition(x, y, z);
+	particle->setVelocity(0, 0, 0);
+	particle->setAcceleration(0, 0, 0);
+	return particle;
+}
+
+/*
+* Particles falling freely under a single shared gravity generator
+*/
+static void buildFreefall(ParticleWorld& world, BenchScene& scene, unsigned particles, unsigned seed) {
+	BenchRandom random(seed);
+	Vector3 gravity(0, -9.81f, 0);
+	ParticleGravity* generator = world.createGenerator<ParticleGravity>(gravity);
+
+	world.reserveParticles(particles);
+	for (unsigned i = 0; i < particles; i++)
+	{
+		Particle* particle = createParticle(world, random.next(-100, 100), random.next(0, 100), random.next(-100, 100));
+		world.getForceRegistry().add(particle, generator);
+	}
+}
+
+/*
+* A square cloth of particles joined by springs to their right and lower neighbours,
+* hanging from its top row
+*/
+static void buildCloth(ParticleWorld& world, BenchScene& scene, unsigned particles, unsigned seed) {
+	unsigned side = 2;
+	while ((side + 1) * (side + 1) <= particles) side++;
+
+	Vector3 gravity(0, -9.81f, 0);
+	ParticleGravity* generator = world.createGenerator<ParticleGravity>(gravity);
+
+	world.reserveParticles(side * side);
+	for (unsigned y = 0; y < side; y++)
+	{
+		for (unsigned x = 0; x < side; x++)
+		{
+			Particle* particle = createParticle(world, (real)x, (real)(side - y), 0);
+			if (y == 0) particle->setInverseMass(0);
+			else world.getForceRegistry().add(particle, generator);
+		}
+	}
+
+	ParticleWorld::Particles& all = world.getParticles();
+	for (unsigned y = 0; y < side; y++)
+	{
+		for (unsigned x = 0; x < side; x++)
+		{
+			Particle* particle = all[y * side + x];
+			if (x + 1 < side)
+			{
+				Particle* right = all[y * side + x + 1];
+				world.getForceRegistry().add(particle, world.createGenerator<ParticleSpring>(right, 50.0f, 1.0f));
+				world.getForceRegistry().add(right, world.createGenerator<ParticleSpring>(particle, 50.0f, 1.0f));
+			}
+			if (y + 1 < side)
+			{
+				Particle* below = all[(y + 1) * side + x];
+				world.getForceRegistry().add(particle, world.createGenerator<ParticleSpring>(below, 50.0f, 1.0f));
+				world.getForceRegistry().add(below, world.createGenerator<ParticleSpring>(particle, 50.0f, 1.0f));
+			}
+		}
+	}
+}
+
+/*
+* Chains of 32 particles hanging from a fixed particle, joined alternately by cables and rods
+*/
+static void buildChains(ParticleWorld& world, BenchScene& scene, unsigned particles, unsigned seed) {
+	const unsigned length = 32;
+	unsigned chains = particles / length > 0 ? particles / length : 1;
+
+	BenchRandom random(seed);
+	Vector3 gravity(0, -9.81f, 0);
+	ParticleGravity* generator = world.createGenerator<ParticleGravity>(gravity);
+
+	world.reserveParticles(chains * length);
+	scene.cables.reserve(chains * length / 2);
+	scene.rods.reserve(chains * length / 2);
+
+	for (unsigned c = 0; c < chains; c++)
+	{
+		real x = random.next(-100, 100), z = random.next(-100, 100);
+		Particle* previous = NULL;
+		for (unsigned i = 0; i < length; i++)
+		{
+			// Slightly off the rest length so both kinds of link generate contacts
+			Particle* particle = createParticle(world, x + random.next(-0.1f, 0.1f), 100 - i * 1.05f, z);
+			if (i == 0) particle->setInverseMass(0);
+			else world.getForceRegistry().add(particle, generator);
+
+			if (previous)
+			{
+				ParticleLink* link;
+				if (i % 2)
+				{
+					scene.cables.push_back(ParticleCable());
+					scene.cables.back().maxLength = 1;
+					scene.cables.back().restitution = 0.3f;
+					link = &scene.cables.back();
+				}
+				else
+				{
+					scene.rods.push_back(ParticleRod());
+					scene.rods.back().length = 1;
+					link = &scene.rods.back();
+				}
+				link->particle[0] = previous;
+				link->particle[1] = particle;
+				world.getLinks().push_back(link);
+			}
+			previous = particle;
+		}
+	}
+}
+
+/*
+* A dense pile of particles with three contacts per particle against random neighbours
+*/
+static void buildPile(ParticleWorld& world, BenchScene& scene, unsigned particles, unsigned seed) {
+	BenchRandom random(seed);
+	Vector3 gravity(0, -9.81f, 0);
+	ParticleGravity* generator = world.createGenerator<ParticleGravity>(gravity);
+
+	world.reserveParticles(particles);
+	for (unsigned i = 0; i < particles; i++)
+	{
+		Particle* particle = createParticle(world, random.next(-10, 10), random.next(0, 10), random.next(-10, 10));
+		particle->setVelocity(random.next(-1, 1), random.next(-1, 1), random.next(-1, 1));
+		world.getForceRegistry().add(particle, generator);
+	}
+
+	ParticleWorld::Particles& all = world.getParticles();
+	scene.contacts.resize(particles * 3);
+	for (unsigned i = 0; i < scene.contacts.size(); i++)
+	{
+		ParticleContact& contact = scene.contacts[i];
+		contact.particle[0] = all[i / 3];
+		contact.particle[1] = all[random.nextIndex(particles)];
+		if (contact.particle[1] == contact.particle[0]) contact.particle[1] = NULL;
+
+		Vector3 normal(random.next(-1, 1), random.next(-1, 1), random.next(-1, 1));
+		normal.normalize();
+		contact.contactNormal = normal;
+		contact.penetration = random.next(0, 0.01f);
+		contact.restitution = 0.5f;
+	}
+}
+
+/*
+* Particles floating around the water plane, half of them under a buoyancy generator
+*/
+static void buildBuoyancy(ParticleWorld& world, BenchScene& scene, unsigned particles, unsigned seed) {
+	BenchRandom random(seed);
+	Vector3 gravity(0, -9.81f, 0);
+	ParticleGravity* generator = world.createGenerator<ParticleGravity>(gravity);
+	ParticleBuoyancy* buoyancy = world.createGenerator<ParticleBuoyancy>(0.5f, 0.002f, 0.0f);
+
+	world.reserveParticles(particles);
+	for (unsigned i = 0; i < particles; i++)
+	{
+		Particle* particle = createParticle(world, random.next(-100, 100), random.next(-1, 1), random.next(-100, 100));
+		world.getForceRegistry().add(particle, generator);
+		world.getForceRegistry().add(particle, buoyancy);
+	}
+}
+
+/*
+* Particles floating on four waves under the batch buoyancy generator. The registrations
+* of each generator are consecutive, so the registry hands them over in batches
+*/
+static void buildOcean(ParticleWorld& world, BenchScene& scene, unsigned particles, unsigned seed) {
+	static ParticleWaterWaves water(0);
+	if (water.getWaves().empty())
+	{
+		ParticleWaterWaves::Wave waves[4] = {
+			{ 0.5f, 0.3f, 1, 0, 1.7f, 0 },
+			{ 0.3f, 0.5f, 0.6f, 0.8f, 2.2f, 1 },
+			{ 0.2f, 0.9f, -0.8f, 0.6f, 3.0f, 2 },
+			{ 0.1f, 1.7f, 0, -1, 4.1f, 3 },
+		};
+		for (unsigned i = 0; i < 4; i++) water.addWave(waves[i]);
+	}
+
+	BenchRandom random(seed);
+	Vector3 gravity(0, -9.81f, 0);
+	ParticleGravity* generator = world.createGenerator<ParticleGravity>(gravity);
+	ParticleBatchBuoyancy* buoyancy = world.createGenerator<ParticleBatchBuoyancy>(&water, 0.5f, 0.002f);
+
+	world.reserveParticles(particles);
+	for (unsigned i = 0; i < particles; i++)
+	{
+		createParticle(world, random.next(-100, 100), random.next(-1, 1), random.next(-100, 100));
+	}
+
+	ParticleWorld::Particles& all = world.getParticles();
+	for (unsigned i = 0; i < particles; i++) world.getForceRegistry().add(all[i], generator);
+	for (unsigned i = 0; i < particles; i++) world.getForceRegistry().add(all[i], buoyancy);
+}
+
+/*
+* Particles drifting through a force field made of dozens of overlapping explosions,
+* winds and vortices. The field is rasterized once, so the forces phase only measures
+* the batched trilinear sampling
+*/
+static void buildFields(ParticleWorld& world, BenchScene& scene, unsigned particles, unsigned seed) {
+	static ParticleForceField field(0.5f);
+	static std::vector<ParticleExplosionSource> explosions;
+	static std::vector<ParticleWindSource> winds;
+	static std::vector<ParticleVortexSource> vortices;
+
+	BenchRandom random(seed);
+	if (explosions.empty())
+	{
+		for (unsigned i = 0; i < 24; i++)
+		{
+			explosions.push_back(ParticleExplosionSource(Vector3(random.next(-40, 40), random.next(0, 40), random.next(-40, 40)), random.next(4, 12), random.next(5, 20)));
+		}
+		for (unsigned i = 0; i < 12; i++)
+		{
+			Vector3 min(random.next(-50, 20), random.next(0, 20), random.next(-50, 20));
+			winds.push_back(ParticleWindSource(min, min + Vector3(30, 20, 30), Vector3(random.next(-3, 3), 0, random.next(-3, 3))));
+		}
+		for (unsigned i = 0; i < 12; i++)
+		{
+			vortices.push_back(ParticleVortexSource(Vector3(random.next(-40, 40), random.next(0, 40), random.next(-40, 40)), random.next(4, 10), 10, random.next(2, 8)));
+		}
+		for (unsigned i = 0; i < explosions.size(); i++) field.addSource(&explosions[i]);
+		for (unsigned i = 0; i < winds.size(); i++) field.addSource(&winds[i]);
+		for (unsigned i = 0; i < vortices.size(); i++) field.addSource(&vortices[i]);
+		field.update();
+	}
+
+	world.reserveParticles(particles);
+	for (unsigned i = 0; i < particles; i++)
+	{
+		Particle* particle = createParticle(world, random.next(-50, 50), random.next(0, 40), random.next(-50, 50));
+		world.getForceRegistry().add(particle, &field);
+	}
+}
+
+/*
+* Particles held around an anchor by a single fake spring generator
+*/
+static void buildFakeSpring(ParticleWorld& world, BenchScene& scene, unsigned particles, unsigned seed) {
+	static Vector3 anchor(0, 10, 0);
+	BenchRandom random(seed);
+	ParticleFakeSpring* spring = world.createGenerator<ParticleFakeSpring>(&anchor, 20.0f, 0.5f);
+
+	world.reserveParticles(particles);
+	for (unsigned i = 0; i < particles; i++)
+	{
+		Particle* particle = createParticle(world, random.next(-10, 10), random.next(0, 20), random.next(-10, 10));
+		world.getForceRegistry().add(particle, spring);
+	}
+}
+
+/*
+* A block of SPH fluid falling under gravity, spaced at half the smoothing radius
+* around the rest density, with jittered positions
+*/
+static void buildFluid(ParticleWorld& world, BenchScene& scene, unsigned particles, unsigned seed) {
+	const real spacing = 0.05f;
+	BenchRandom random(seed);
+	Vector3 gravity(0, -9.81f, 0);
+	ParticleGravity* generator = world.createGenerator<ParticleGravity>(gravity);
+	scene.fluidJobs.reset(new ParticleJobPool());
+	scene.fluid.reset(new ParticleFluid(2 * spacing, 1000, 3, 0.1f, scene.fluidJobs.get()));
+
+	unsigned side = 1;
+	while (side * side * side < particles) side++;
+
+	world.reserveParticles(particles);
+	for (unsigned i = 0; i < particles; i++)
+	{
+		real x = (i % side) * spacing, y = (i / side % side) * spacing, z = (i / (side * side)) * spacing;
+		Particle* particle = createParticle(world, x + random.next(0, 0.005f), y + random.next(0, 0.005f), z + random.next(0, 0.005f));
+		particle->setMass(1000 * spacing * spacing * spacing);
+		world.getForceRegistry().add(particle, generator);
+		scene.fluid->addParticle(particle);
+	}
+}
+
+/*
+* Dense granular matter: soft spheres packed touching in a cube, jostling
+* with random velocities. The pairs come from Verlet lists with a skin of half
+* the diameter, which are only rebuilt when a sphere has moved half of it
+*/
+static void buildGranular(ParticleWorld& world, BenchScene& scene, unsigned particles, unsigned seed) {
+	const real radius = 0.05f;
+	const real spacing = 2 * radius;
+	BenchRandom random(seed);
+	scene.neighbors.reset(new ParticleNeighborList(2 * radius, radius));
+	scene.neighborForce.reset(new ParticleNeighborForce(scene.neighbors.get(), radius, 200, 2));
+
+	unsigned side = 1;
+	while (side * side * side < particles) side++;
+
+	world.reserveParticles(particles);
+	for (unsigned i = 0; i < particles; i++)
+	{
+		real x = (i % side) * spacing, y = (i / side % side) * spacing, z = (i / (side * side)) * spacing;
+		Particle* particle = createParticle(world, x, y, z);
+		particle->setVelocity(random.next(-0.05f, 0.05f), random.next(-0.05f, 0.05f), random.next(-0.05f, 0.05f));
+		scene.neighbors->addParticle(particle);
+	}
+}
+
+/*
+* Returns the current time in seconds
+*/
+static double now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+* Runs the given number of steps, timing each phase
+*/
+static BenchTimes run(ParticleWorld& world, BenchScene& scene, unsigned steps, real duration, unsigned iterations) {
+	BenchTimes times;
+	memset(&times, 0, sizeof(times));
+
+	ParticleContactResolver& resolver = world.getContactResolver();
+	for (unsigned step = 0; step < steps; step++)
+	{
+		world.startFrame();
+
+		double start = now();
+		world.applyForces(duration);
+		if (scene.fluid) scene.fluid->applyForces(duration);
+		if (scene.neighborForce) scene.neighborForce->applyForces();
+		double forces = now();
+		world.integrate(duration);
+		double integrate = now();
+		unsigned generated = world.generateContacts();
+		double links = now();
+
+		if (generated > 0)
+		{
+			resolver.setIterations(iterations ? iterations : generated * 2);
+			resolver.resolveContacts(world.getContacts(), generated, duration);
+		}
+		if (!scene.contacts.empty())
+		{
+			resolver.setIterations(iterations ? iterations : (unsigned)scene.contacts.size() * 2);
+			resolver.resolveContacts(&scene.contacts[0], (unsigned)scene.contacts.size(), duration);
+		}
+		double resolve = now();
+
+		times.forces += forces - start;
+		times.integrate += integrate - forces;
+		times.links += links - integrate;
+		times.resolve += resolve - links;
+		times.contacts += generated + scene.contacts.size();
+	}
+	return times;
+}
+
+int main(int argc, char** argv) {
+	unsigned particles = 10000;
+	unsigned steps = 30;
+	unsigned seed = 12345;
+	unsigned iterations = 0;
+	const char* only = NULL;
+	const char* outputPath = NULL;
+	const char* tracePath = NULL;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (strcmp(argv[i], "--particles") == 0) particles = (unsigned)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--steps") == 0) steps = (unsigned)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--seed") == 0) seed = (unsigned)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--iterations") == 0) iterations = (unsigned)atoi(argv[i + 1]);
+		else if (strcmp(argv[i], "--scenario") == 0) only = argv[i + 1];
+		else if (strcmp(argv[i], "--output") == 0) outputPath = argv[i + 1];
+		else if (strcmp(argv[i], "--trace") == 0) tracePath = argv[i + 1];
+		else
+		{
+			fprintf(stderr, "Usage: %s [--particles N] [--steps N] [--seed N] [--iterations N] [--scenario name] [--output file] [--trace file]\n", argv[0]);
+			return 1;
+		}
+	}
+	if (particles == 0 || steps == 0)
+	{
+		fprintf(stderr, "The number of particles and steps must be positive\n");
+		return 1;
+	}
+
+	struct {
+		const char* name;
+		BenchBuild build;
+	} scenarios[] = {
+		{ "freefall", buildFreefall },
+		{ "cloth", buildCloth },
+		{ "chains", buildChains },
+		{ "pile", buildPile },
+		{ "buoyancy", buildBuoyancy },
+		{ "ocean", buildOcean },
+		{ "fakespring", buildFakeSpring },
+		{ "fields", buildFields },
+		{ "fluid", buildFluid },
+		{ "granular", buildGranular },
+	};
+	const unsigned scenarioCount = sizeof(scenarios) / sizeof(scenarios[0]);
+
+	FILE* output = outputPath ? fopen(outputPath, "w") : stdout;
+	if (!output)
+	{
+		fprintf(stderr, "Can't write %s\n", outputPath);
+		return 1;
+	}
+
+	fprintf(output, "{\n  \"benchmark\": \"cyclone\",\n  \"real_size\": %u,\n  \"seed\": %u,\n  \"steps\": %u,\n  \"iterations\": %u,\n  \"scenarios\": [",
+		(unsigned)sizeof(real), seed, steps, iterations);
+
+	ParticleProfiler profiler;
+	bool first = true;
+	for (unsigned s = 0; s < scenarioCount; s++)
+	{
+		if (only && strcmp(only, scenarios[s].name) != 0) continue;
+
+		ParticleWorld world(particles * 2);
+		BenchScene scene;
+		scenarios[s].build(world, scene, particles, seed);
+		if (tracePath) world.setProfiler(&profiler);
+
+		// Warm up the caches and the frame arena before timing
+		const real duration = 1.0f / 60;
+		run(world, scene, 3, duration, iterations);
+		BenchTimes times = run(world, scene, steps, duration, iterations);
+
+		double perStep = 1e9 / ((double)world.getParticles().size() * steps);
+		fprintf(output, "%s\n    {\n      \"name\": \"%s\",\n      \"particles\": %u,\n      \"contacts_per_step\": %.1f,\n",
+			first ? "" : ",", scenarios[s].name, (unsigned)world.getParticles().size(), (double)times.contacts / steps);
+		if (scene.neighbors)
+		{
+			const ParticleNeighborStats& neighborStats = scene.neighbors->getStats();
+			fprintf(output, "      \"neighbor_builds\": %u,\n      \"neighbor_updates\": %u,\n", neighborStats.builds, neighborStats.updates);
+		}
+		fprintf(output, "      \"ns_per_particle_step\": {\n        \"forces\": %.3f,\n        \"integrate\": %.3f,\n        \"links\": %.3f,\n        \"resolve\": %.3f,\n        \"total\": %.3f\n      }\n    }",
+			times.forces * perStep, times.integrate * perStep, times.links * perStep, times.resolve * perStep,
+			(times.forces + times.integrate + times.links + times.resolve) * perStep);
+		first = false;
+	}
+
+	fprintf(output, "\n  ]\n}\n");
+	if (output != stdout) fclose(output);
+
+	if (tracePath)
+	{
+#ifndef CYCLONE_PROFILE
+		fprintf(stderr, "The engine is built without CYCLONE_PROFILE, the trace is empty\n");
+#endif
+		if (!profiler.exportTrace(tracePath))
+		{
+			fprintf(stderr, "Can't write %s\n", tracePath);
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -5,28 +5,29 @@
 namespace cyclone
 {
 	/**
-	* Holds a vector in 3 dimensions. Four data members are allocated
-	* to ensure alignment in an array.
+	* Holds a vector in 3 dimensions, of the given scalar type. Four data members
+	* are allocated to ensure alignment in an array.
 	*/
-	class Vector3 {
+	template<class Scalar>
+	class Vector3T {
 
 		//Public variable
 	public:
 
-		/* Hold the real value of the x axis */
-		real x;
+		/* Hold the value of the x axis */
+		Scalar x;
 
-		/* Hold the real value of the y axis */
-		real y;
+		/* Hold the value of the y axis */
+		Scalar y;
 
-		/* Hold the real value of the z axis */
-		real z;
+		/* Hold the value of the z axis */
+		Scalar z;
 
 		//Private variable
 	private:
 
 		/** Padding to ensure 4-word alignment*/
-		real pad;
+		Scalar pad;
 
 
 		//Public methods
@@ -34,53 +35,59 @@ namespace cyclone
 		/**
 		* The default constructor initializes each value to zero
 		*/
-		Vector3() : x(0), y(0), z(0) {}
+		Vector3T() : x(0), y(0), z(0) {}
 
 		/**
 		* The explicit constructor initializes the vector with the values in input
 		*/
-		Vector3(const real x, const real y, const real z) : x(x), y(y), z(z) {}
+		Vector3T(const Scalar x, const Scalar y, const Scalar z) : x(x), y(y), z(z) {}
+
+		/**
+		* Converts a vector of another precision. It is explicit so that precision is never lost silently
+		*/
+		template<class Other>
+		explicit Vector3T(const Vector3T<Other>& vector) : x((Scalar)vector.x), y((Scalar)vector.y), z((Scalar)vector.z) {}
 
 		/** Adds the given vector to this*/
-		void operator+=(const Vector3& vector) {
+		void operator+=(const Vector3T& vector) {
 			x += vector.x;
 			y += vector.y;
 			z += vector.z;
 		}
 
 		/** Returns the value of the given vector added to this*/
-		Vector3 operator+(const Vector3& vector) const{
-			return Vector3(x + vector.x, y + vector.y, z + vector.z);
+		Vector3T operator+(const Vector3T& vector) const{
+			return Vector3T(x + vector.x, y + vector.y, z + vector.z);
 		}
 
 
 		/** Removes the given vector to this*/
-		void operator-=(const Vector3& vector) {
+		void operator-=(const Vector3T& vector) {
 			x -= vector.x;
 			y -= vector.y;
 			z -= vector.z;
 		}
 
 		/** Return the value of the given vector subtracted to this*/
-		Vector3 operator-(const Vector3& vector) const {
-			return Vector3(x - vector.x, y - vector.y, z - vector.z);
+		Vector3T operator-(const Vector3T& vector) const {
+			return Vector3T(x - vector.x, y - vector.y, z - vector.z);
 		}
 		
 		
 		/** Multiplies this vector by the given scalar */
-		void operator*=(const real value) {
+		void operator*=(const Scalar value) {
 			x *= value;
 			y *= value;
 			z *= value;
 		}
 
 		/** Returns a copy of this vector scaled to the given scalar */
-		Vector3 operator*(const real value) const{
-			return Vector3(x * value, y * value, z * value);
+		Vector3T operator*(const Scalar value) const{
+			return Vector3T(x * value, y * value, z * value);
 		}
 
 		/** Calculate the scalar product between this vector and the given vector*/
-		real operator* (const Vector3& vector) const {
+		Scalar operator* (const Vector3T& vector) const {
 			return x * vector.x + y * vector.y + z * vector.z;
 		}
 
@@ -98,53 +105,53 @@ namespace cyclone
 		}
 
 		/** Get the magnitude of the vector*/
-		real magnitude() const {
+		Scalar magnitude() const {
 			return real_sqrt(x * x + y * y + z * z);
 		}
 
 		/** Get the squared magnitude of the vector */
-		real squareMagnitude() const {
+		Scalar squareMagnitude() const {
 			return x * x + y * y + z * z;
 		}
 
 		/** Turn a non-zero vector into a vector of unit length*/
 		void normalize() {
-			real l = magnitude();
+			Scalar l = magnitude();
 			if (l > 0)
-				(*this) *= ((real)1) / l;
+				(*this) *= ((Scalar)1) / l;
 		}
 
 		/** Add the given vector to this, scaled by the given amount*/
-		void addScaledVector(const Vector3& vector, real scale) {
+		void addScaledVector(const Vector3T& vector, Scalar scale) {
 			x += vector.x * scale;
 			y += vector.y * scale;
 			z += vector.z * scale;
 		}
 
 		/** Calculates and returns the component-wise product of this vector with the given vector*/
-		Vector3 componentProduct(const Vector3& vector) const{
-			return Vector3(x * vector.x, y * vector.y, z * vector.z);
+		Vector3T componentProduct(const Vector3T& vector) const{
+			return Vector3T(x * vector.x, y * vector.y, z * vector.z);
 		}
 
 		/** Calculate the component-wise product of this vector with the given vector 
 		* and sets this vector to its result
 		*/
-		void componentProductUpdate(const Vector3& vector) {
+		void componentProductUpdate(const Vector3T& vector) {
 			x *= vector.x;
 			y *= vector.y;
 			z *= vector.z;
 		}
 
 		/** Calculate the scalar product between this vector and the given vector*/
-		real scalarProduct(const Vector3& vector) const {
+		Scalar scalarProduct(const Vector3T& vector) const {
 			return x * vector.x + y * vector.y + z * vector.z;
 		}
 
 		/*
 		* Calculate and returns the vector product of this vector with the given vector
 		*/
-		Vector3 vectorProduct(const Vector3& vector) const {
-			return Vector3(
+		Vector3T vectorProduct(const Vector3T& vector) const {
+			return Vector3T(
 				y * vector.z - z * vector.y,
 				z * vector.x - x * vector.z,
 				x * vector.y - y * vector.x
@@ -154,15 +161,15 @@ namespace cyclone
 		/*
 		* Updates this vector to be the vector product between this and the given vector
 		*/
-		void operator%=(const Vector3& vector) {
+		void operator%=(const Vector3T& vector) {
 			*this = vectorProduct(vector);
 		}
 
 		/*
 		* Calculates and return the vector product of this vector with the given vector
 		*/
-		Vector3 operator%(const Vector3& vector) const {
-			return Vector3(
+		Vector3T operator%(const Vector3T& vector) const {
+			return Vector3T(
 				y * vector.z - z * vector.y,
 				z * vector.x - x * vector.z,
 				x * vector.y - y * vector.x
@@ -176,4 +183,9 @@ namespace cyclone
 			x = y = z = 0;
 		}
 	};
+
+	/**
+	* The vector of the precision of the engine
+	*/
+	typedef Vector3T<real> Vector3;
 }
@@ -0,0 +1,183 @@
+#pragma once
+#include <include/pfgen.h>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Holds the measurements of an anchor set for the last application of its forces
+*/
+struct ParticleAnchorStats
+{
+	/*
+	* Holds the number of constraints, and of those that applied a force
+	*/
+	unsigned constraints;
+	unsigned active;
+
+	/*
+	* Holds the number of anchors of the table moved since the previous application
+	*/
+	unsigned anchorsMoved;
+};
+
+/*
+* Springs and tethers from particles to fixed or kinematic anchors, such as moorings,
+* held in arrays and applied in batches instead of as one generator per spring. A
+* tether only pulls, when it is longer than its length, as a bungee does.
+*
+* Each constraint keeps the position of its anchor inline, so applying the forces reads
+* the constraints in order and never follows a pointer to an anchor. An anchor of its
+* own is moved with setAnchor. Anchors shared by several constraints, or moved by a
+* kinematic body every step, live in a table: moveAnchors updates it in bulk, and the
+* inline copies are refreshed once, in a single pass, at the next application.
+*
+* The particle of each constraint is kept inline too, so a constraint costs a single
+* load of a random address, its particle, which is fetched a few constraints ahead.
+* sortByParticle orders the constraints by the address of their particle, so the
+* particles are read in memory order.
+*
+* The set is a force generator applying all its constraints at once: register it once
+* in the registry, with any particle, and the world, the timestep and the pipeline apply
+* it and the reorders remap its particles like those of the other generators
+*/
+class ParticleAnchorSet : public ParticleForceGenerator
+{
+public:
+	/*
+	* The anchor of a constraint that isn't in the table
+	*/
+	static const unsigned noAnchor = 0xffffffff;
+
+protected:
+	/*
+	* Holds the anchors of the table, and whether one moved since the last refresh
+	*/
+	std::vector<Vector3> anchors;
+	bool anchorsDirty;
+	unsigned anchorsMoved;
+
+	/*
+	* Holds the constraints, one entry each: the particle, the anchor in the table or
+	* noAnchor, the inline position of the anchor, the stiffness, the rest length, the
+	* damping of the speed along the constraint, and the smallest extension giving a
+	* force, zero for a tether and -REAL_MAX for a spring
+	*/
+	std::vector<Particle*> particles;
+	std::vector<unsigned> anchorIndices;
+	std::vector<real> anchorX;
+	std::vector<real> anchorY;
+	std::vector<real> anchorZ;
+	std::vector<real> stiffness;
+	std::vector<real> restLengths;
+	std::vector<real> dampings;
+	std::vector<real> minExtensions;
+
+	/*
+	* Holds the measurements
+	*/
+	ParticleAnchorStats stats;
+
+public:
+	/*
+	* Creates an empty set
+	*/
+	ParticleAnchorSet();
+
+	/*
+	* Adds an anchor to the table and returns its index
+	*/
+	unsigned addAnchor(const Vector3& position);
+
+	/*
+	* Moves count anchors of the table from first
+	*/
+	void moveAnchors(unsigned first, unsigned count, const Vector3* positions);
+
+	/*
+	* Adds a spring from a particle to an anchor of the table, or to a position of its
+	* own. The spring pushes and pulls toward its rest length. Returns its index
+	*/
+	unsigned addSpring(Particle* particle, unsigned anchor, real stiffness, real restLength, real damping = 0);
+	unsigned addSpring(Particle* particle, const Vector3& anchor, real stiffness, real restLength, real damping = 0);
+
+	/*
+	* Adds a tether from a particle to an anchor of the table, or to a position of its
+	* own. The tether only pulls, when it is longer than its length. Returns its index
+	*/
+	unsigned addTether(Particle* particle, unsigned anchor, real stiffness, real length, real damping = 0);
+	unsigned addTether(Particle* particle, const Vector3& anchor, real stiffness, real length, real damping = 0);
+
+	/*
+	* Moves the anchor of its own of a constraint
+	*/
+	void setAnchor(unsigned constraint, const Vector3& position);
+
+	/*
+	* Removes a constraint. The last constraint takes its index
+	*/
+	void remove(unsigned constraint);
+
+	/*
+	* Orders the constraints by the address of their particle, keeping their order for a particle
+	*/
+	void sortByParticle();
+
+	/*
+	* Adds the forces of every constraint to their particles, whatever the particle given
+	*/
+	virtual void updateForce(Particle* particle, real duration);
+
+	/*
+	* Returns false: a single call writes the forces of all the particles of the set, so
+	* it must not run alongside generators applied to the same particles
+	*/
+	virtual bool isConcurrent() const;
+
+	/*
+	* Updates the particles after they have been moved in memory
+	*/
+	virtual void remapParticles(const ParticleRemap& remap);
+
+	/*
+	* Returns the number of constraints and of anchors in the table
+	*/
+	unsigned getConstraintCount() const;
+	unsigned getAnchorCount() const;
+
+	/*
+	* Returns an anchor of the table. Named apart from getAnchor, which stays the single
+	* anchor of the generator interface and is left at NULL here
+	*/
+	const Vector3& getTableAnchor(unsigned anchor) const;
+
+	/*
+	* Returns the particle of a constraint
+	*/
+	Particle* getParticle(unsigned constraint) const;
+
+	/*
+	* Returns the measurements
+	*/
+	const ParticleAnchorStats& getStats() const;
+
+protected:
+	/*
+	* Adds a constraint with the given anchor, noAnchor for one of its own at the position
+	*/
+	unsigned addConstraint(Particle* particle, unsigned anchor, const Vector3& position, real stiffness,
+		real restLength, real damping, bool tether);
+
+	/*
+	* Copies the anchors of the table into the constraints using them
+	*/
+	void refreshAnchors();
+
+	/*
+	* Computes and adds the forces of count constraints from first
+	*/
+	void applyBatch(unsigned first, unsigned count);
+
+};
+
+}
@@ -6,33 +6,40 @@ namespace cyclone {
 
 
 /*
-* A particle is the simplest object that can be simulated in the physics system
+* A particle is the simplest object that can be simulated in the physics system.
+* It is templated on its precision (see Precision): the position is stored with
+* the position scalar, everything else with the scalar
 */
-class Particle
+template<class P>
+class ParticleT
 {
 public:
+	typedef typename P::Scalar Scalar;
+	typedef typename P::Position PositionScalar;
+	typedef Vector3T<Scalar> Vector;
+	typedef Vector3T<PositionScalar> PositionVector;
 
 	/*
 	* Holds the linear position of the particle in the world space
 	*/
-	Vector3 position;
+	PositionVector position;
 
 	/*
 	* Holds the linear velocity of the particle in the world space
 	*/
-	Vector3 velocity;
+	Vector velocity;
 
 	/*
 	* Holds the linear acceleration of the particle. This value can be used
 	* to set acceleration due to gravity or any other constant acceleration
 	*/
-	Vector3 acceleration;
+	Vector acceleration;
 
 	/*
 	* Holds the amount of damping applied to linear motion. 
 	* Damping is required to remove energy added through numerical instability in the integrator
 	*/
-	real damping;
+	Scalar damping;
 
 
 
@@ -42,14 +49,14 @@ protected:
 	* Holds the inverse of the mass of the particle. It is more useful because integration is simplier
 	* and because it is easier to represent infinite (immovable object) mass than zero mass
 	*/
-	real inverseMass;
+	Scalar inverseMass;
 
 
 	/*
 	* Holds the accumulated force to be applied to the next integration step only.
 	* Get reset to zero after each integration step
 	*/
-	Vector3 forceAccum;
+	Vector forceAccum;
 
 
 public:
@@ -58,28 +65,28 @@ public:
 	* 
 	* @param mass The new mass of the particle
 	*/
-	void setMass(const real mass);
+	void setMass(const Scalar mass);
 
 	/*
 	* Get the mass of the particle
 	* 
 	* @return The current mass of the particle
 	*/
-	real getMass() const;
+	Scalar getMass() const;
 
 	/*
 	* Set the value of inverse mass to the inverse mass passed
 	* 
 	* @param inverseMass The new inverse mass of the particle
 	*/
-	void setInverseMass(const real inverseMass);
+	void setInverseMass(const Scalar inverseMass);
 
 	/*
 	* Gets the inverse mass of the particle
 	* 
 	* @return The current inverse mass of the particle
 	*/
-	real getInverseMass() const;
+	Scalar getInverseMass() const;
 
 	/*
 	* Returns true if the particle has non-infinite mass
@@ -89,14 +96,14 @@ public:
 	/*
 	* Set the value of the damping of the particle
 	*/
-	void setDamping(const real damping);
+	void setDamping(const Scalar damping);
 
 	/*
 	* Gets the current damping of the particle
 	* 
 	* @return The current damping of the particle
 	*/
-	real getDamping() const;
+	Scalar getDamping() const;
 
 
 	/*
@@ -104,21 +111,28 @@ public:
 	* This function uses a Newton-Euler integration method, which is a linear
 	* aproximation and may be inaccurate in some cases
 	*/
-	void integrate(real duration);
+	void integrate(Scalar duration);
+
+	/*
+	* Integrates the particle forward in time by the given amount, scaling the velocity by
+	* the given drag factor, which must be damping^duration. This lets the caller compute
+	* the factors of many particles at once with batchPow
+	*/
+	void integrate(Scalar duration, Scalar dragFactor);
 
 	/*
 	* Get the position of the particle
 	* 
 	* @return The current position of the particle
 	*/
-	Vector3 getPosition() const;
+	PositionVector getPosition() const;
 
 	/*
 	* Set the position of the particle
 	* 
 	* @param position The new position of the particle
 	*/
-	void setPosition(const Vector3& position);
+	void setPosition(const PositionVector& position);
 
 	/*
 	* Set the position of the particle
@@ -127,21 +141,21 @@ public:
 	* @param y The y coordinate of the position
 	* @param z The z coordinate of the position
 	*/
-	void setPosition(const real x, const real y, const real z);
+	void setPosition(const PositionScalar x, const PositionScalar y, const PositionScalar z);
 
 	/**
 	* Fill the given vector with the position of the particle
 	* 
 	* @param position A pointer to a vector into which to write the position of the particle
 	*/
-	void getPosition(Vector3* position) const;
+	void getPosition(PositionVector* position) const;
 
 	/*
 	* Set the velocity of the particle
 	* 
 	* @param velocity The new velocity of the particle
 	*/
-	void setVelocity(const Vector3& velocity);
+	void setVelocity(const Vector& velocity);
 
 	/*
 	* Set the velocity of the particle
@@ -150,28 +164,28 @@ public:
 	* @param y The y value of the new velocity of the particle
 	* @param z The z value of the new velocity of the particle
 	*/
-	void setVelocity(const real x, const real y, const real z);
+	void setVelocity(const Scalar x, const Scalar y, const Scalar z);
 
 	/*
 	* Get the velocity of the particle
 	* 
 	* @return The velocity of the particle
 	*/
-	Vector3 getVelocity() const;
+	Vector getVelocity() const;
 
 	/*
 	* Fills the given vector with the current velocity of the particle
 	*
 	* @param velocity The vector in which to put the velocity of the particle
 	*/
-	void getVelocity(Vector3 *velocity) const;
+	void getVelocity(Vector *velocity) const;
 
 	/*
 	* Sets the constant acceleration of the particle
 	* 
 	* @param acceleration The new acceleration of the particle
 	*/
-	void setAcceleration(const Vector3& acceleration);
+	void setAcceleration(const Vector& acceleration);
 
 	/*
 	* Sets the constant acceleration of the particle
@@ -180,21 +194,21 @@ public:
 	* @param y the y value of the new acceleration of the particle
 	* @param z the z value of the new acceleration of the particle
 	*/
-	void setAcceleration(const real x, const real y, const real z);
+	void setAcceleration(const Scalar x, const Scalar y, const Scalar z);
 
 	/*
 	* Get the acceleration of the particle
 	* 
 	* @return The acceleration of the particle
 	*/
-	Vector3 getAcceleration() const;
+	Vector getAcceleration() const;
 
 	/*
 	* Fills the given vector with the current acceleration of the particle
 	* 
 	* @param acceleration The vector in which to put the acceleration
 	*/
-	void getAcceleration(Vector3* acceleration) const;
+	void getAcceleration(Vector* acceleration) const;
 
 	/*
 	* Clears the forces applied to the particle. This will be called automatically after each integration step
@@ -204,11 +218,23 @@ public:
 	/*
 	* Adds the given force to the particle, to be applied only the next integration step
 	*/
-	void addForce(const Vector3 &force);
+	void addForce(const Vector &force);
+
+	/*
+	* Gets the force accumulated for the next integration step
+	* 
+	* @return The force accumulated so far
+	*/
+	Vector getAccumulatedForce() const;
 
 
 private:
 
 };
 
+/*
+* The particle of the precision of the engine
+*/
+typedef ParticleT<RealPrecision> Particle;
+
 }
\ No newline at end of file
@@ -0,0 +1,228 @@
+#pragma once
+#include <include/pfgen.h>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* A water surface, giving the height of the water at points of the xz plane
+*/
+template<class P>
+class ParticleWaterT
+{
+public:
+	typedef typename P::Scalar Scalar;
+
+	/*
+	* Fills heights with the height of the water at each of the given points
+	*/
+	virtual void sampleHeights(const Scalar* x, const Scalar* z, Scalar* heights, unsigned count) const = 0;
+
+};
+
+/*
+* Water given by a grid of heights over the xz plane, interpolated bilinearly between
+* the nodes. Points outside the grid take the height of the nearest edge. The heights
+* can be changed every frame to animate the surface
+*/
+template<class P>
+class ParticleWaterGridT : public ParticleWaterT<P>
+{
+public:
+	typedef typename P::Scalar Scalar;
+
+protected:
+	/*
+	* Holds the number of nodes along x and z
+	*/
+	unsigned width;
+	unsigned depth;
+
+	/*
+	* Holds the position of the first node and the distance between two nodes
+	*/
+	Scalar originX;
+	Scalar originZ;
+	Scalar spacing;
+
+	/*
+	* Holds the heights of the nodes, row after row along x
+	*/
+	std::vector<Scalar> heights;
+
+public:
+	/*
+	* Creates a flat grid of the given size at the given height
+	*/
+	ParticleWaterGridT(unsigned width, unsigned depth, Scalar originX, Scalar originZ, Scalar spacing, Scalar height = 0);
+
+	/*
+	* Samples the grid at the given points
+	*/
+	virtual void sampleHeights(const Scalar* x, const Scalar* z, Scalar* heights, unsigned count) const;
+
+	/*
+	* Sets the height of a node
+	*/
+	void setHeight(unsigned i, unsigned j, Scalar height);
+
+	/*
+	* Returns the height of a node
+	*/
+	Scalar getHeight(unsigned i, unsigned j) const;
+
+	/*
+	* Returns the heights of all the nodes, row after row along x, to update them in bulk
+	*/
+	std::vector<Scalar>& getHeights();
+
+	/*
+	* Returns the number of nodes along x and z
+	*/
+	unsigned getWidth() const;
+	unsigned getDepth() const;
+
+};
+
+/*
+* Water made of a sum of sine waves travelling over a base height. Each wave has an
+* amplitude, a wave number (2 pi over the wavelength), a direction in the xz plane, an
+* angular frequency and a phase. The waves are evaluated for a batch of points with
+* the vectorized sine, so positions must stay within 8192 radians of phase of the
+* origin (a few kilometres for waves of a few metres)
+*/
+template<class P>
+class ParticleWaterWavesT : public ParticleWaterT<P>
+{
+public:
+	typedef typename P::Scalar Scalar;
+
+	/*
+	* Holds a wave. The direction must be of unit length
+	*/
+	struct Wave {
+		Scalar amplitude;
+		Scalar waveNumber;
+		Scalar directionX;
+		Scalar directionZ;
+		Scalar frequency;
+		Scalar phase;
+	};
+
+protected:
+	/*
+	* Holds the height of the water at rest
+	*/
+	Scalar baseHeight;
+
+	/*
+	* Holds the waves
+	*/
+	std::vector<Wave> waves;
+
+	/*
+	* Holds the time the waves are evaluated at
+	*/
+	double time;
+
+public:
+	/*
+	* Creates calm water at the given height
+	*/
+	ParticleWaterWavesT(Scalar baseHeight = 0);
+
+	/*
+	* Adds a wave
+	*/
+	void addWave(const Wave& wave);
+
+	/*
+	* Sets the time the waves are evaluated at
+	*/
+	void setTime(double time);
+
+	/*
+	* Moves the time forward by the given duration
+	*/
+	void advance(double duration);
+
+	/*
+	* Samples the waves at the given points
+	*/
+	virtual void sampleHeights(const Scalar* x, const Scalar* z, Scalar* heights, unsigned count) const;
+
+	/*
+	* Returns the waves
+	*/
+	std::vector<Wave>& getWaves();
+
+};
+
+/*
+* A buoyancy force following a water surface, computed for a batch of particles at
+* a time: the water is sampled once for the whole batch, and the submersion and the
+* force are computed in flat loops over arrays.
+*
+* As with ParticleBuoyancy, a particle is fully submerged maxDepth below the surface
+* and out of the water maxDepth above it, and the force grows linearly in between
+*/
+template<class P>
+class ParticleBatchBuoyancyT : public ParticleForceGeneratorT<P>
+{
+public:
+	typedef typename P::Scalar Scalar;
+	typedef Vector3T<Scalar> Vector;
+
+protected:
+	/*
+	* Holds the water surface
+	*/
+	const ParticleWaterT<P>* water;
+
+	/*
+	* The maximum submersion depth of the object before it generates the maximum buoyancy force
+	*/
+	Scalar maxDepth;
+
+	/*
+	* The volume of the object
+	*/
+	Scalar volume;
+
+	/*
+	* Density of the liquid, 1000 kg per cubic meter for pure water
+	*/
+	Scalar liquidDensity;
+
+public:
+	/*
+	* Creates the generator with the given parameters
+	*/
+	ParticleBatchBuoyancyT(const ParticleWaterT<P>* water, Scalar maxDepth, Scalar volume, Scalar liquidDensity = 1000.0f);
+
+	/*
+	* Applies the force to a single particle
+	*/
+	virtual void updateForce(ParticleT<P>* particle, Scalar duration);
+
+	/*
+	* Applies the force to a batch of particles
+	*/
+	virtual void updateForces(ParticleT<P>* const* particles, unsigned count, Scalar duration);
+
+	/*
+	* Returns true, the water is only read by the updates
+	*/
+	virtual bool isConcurrent() const;
+
+};
+
+/*
+* The water surfaces and the batch buoyancy of the precision of the engine
+*/
+typedef ParticleWaterT<RealPrecision> ParticleWater;
+typedef ParticleWaterGridT<RealPrecision> ParticleWaterGrid;
+typedef ParticleWaterWavesT<RealPrecision> ParticleWaterWaves;
+typedef ParticleBatchBuoyancyT<RealPrecision> ParticleBatchBuoyancy;
+
+}
@@ -0,0 +1,175 @@
+#pragma once
+#include <include/ptimestep.h>
+#include <stdint.h>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* The state shared by the particles of a compact set that use it
+*/
+struct ParticleMaterial
+{
+	/*
+	* Holds the constant acceleration of the particles, such as gravity
+	*/
+	Vector3 acceleration;
+
+	/*
+	* Holds the damping of the particles
+	*/
+	real damping;
+};
+
+/*
+* The state of a particle in a compact set, in 20 bytes. The position is the integer
+* coordinates of a cell and the offset in it in 1/65536 of a cell, the velocity is in
+* half precision floats, and the acceleration and damping are those of a material
+*/
+struct ParticleCompactState
+{
+	int16_t cell[3];
+	uint16_t offset[3];
+	uint16_t velocity[3];
+	uint8_t material;
+	uint8_t padding;
+};
+
+/*
+* Holds particles, such as those of visual effects, in a compact form that takes less
+* than a third of the memory of Particle: 20 bytes per particle against 72 in
+* float. Positions keep 16 bits per cell, so a cell of 1 gives a resolution of 15
+* micrometers over 65536 cells per axis around the origin. Velocities keep the 11 bits
+* of precision of half floats, up to 65504. The particles have no mass, no forces
+* and no links: they only follow the acceleration and damping of their material.
+*
+* Integration decodes a batch of particles into floats, integrates them as Particle
+* does, and encodes them back. The values are rounded up or down at random in
+* proportion to their distance, so small steps of the velocity and position aren't
+* lost to the rounding but add up right on average. The particles are kept dense:
+* removing one moves the last one into its index
+*/
+class ParticleCompactSet : public ParticleSubsystem
+{
+public:
+	/*
+	* The largest number of materials
+	*/
+	static const unsigned maxMaterials = 256;
+
+protected:
+	/*
+	* Holds the particles
+	*/
+	std::vector<ParticleCompactState> states;
+
+	/*
+	* Holds the materials
+	*/
+	std::vector<ParticleMaterial> materials;
+
+	/*
+	* Holds the width of the cells and its inverse
+	*/
+	real cellSize;
+	real inverseCellSize;
+
+	/*
+	* Holds the seed of the random rounding of the next integration
+	*/
+	unsigned seed;
+
+public:
+	/*
+	* Creates an empty set with the given width of the position cells
+	*/
+	ParticleCompactSet(real cellSize = 1);
+
+	/*
+	* Adds a material and returns its index
+	*/
+	unsigned addMaterial(const Vector3& acceleration, real damping);
+
+	/*
+	* Changes a material, for every particle using it
+	*/
+	void setMaterial(unsigned material, const Vector3& acceleration, real damping);
+
+	/*
+	* Returns a material
+	*/
+	const ParticleMaterial& getMaterial(unsigned material) const;
+
+	/*
+	* Adds a particle and returns its index
+	*/
+	unsigned add(const Vector3& position, const Vector3& velocity, unsigned material);
+
+	/*
+	* Removes a particle. The last particle takes its index
+	*/
+	void remove(unsigned index);
+
+	/*
+	* Removes every particle
+	*/
+	void clear();
+
+	/*
+	* Makes sure the given number of particles can be held without allocating memory
+	*/
+	void reserve(unsigned count);
+
+	/*
+	* Returns the number of particles
+	*/
+	unsigned getCount() const;
+
+	/*
+	* Writes the positions and velocities of count particles from begin. Either array can be NULL
+	*/
+	void decode(unsigned begin, unsigned count, Vector3* positions, Vector3* velocities) const;
+
+	/*
+	* Sets the positions and velocities of count particles from begin, rounded to the
+	* nearest value held. Either array can be NULL to keep the current values
+	*/
+	void encode(unsigned begin, unsigned count, const Vector3* positions, const Vector3* velocities);
+
+	/*
+	* Returns the position and the velocity of a particle
+	*/
+	Vector3 getPosition(unsigned index) const;
+	Vector3 getVelocity(unsigned index) const;
+
+	/*
+	* Sets the material of a particle
+	*/
+	void setParticleMaterial(unsigned index, unsigned material);
+
+	/*
+	* Returns the particles, for copying them in bulk
+	*/
+	const ParticleCompactState* getStates() const;
+
+	/*
+	* Integrates the particles forward in time by the given duration
+	*/
+	void integrate(real duration);
+
+	/*
+	* Integrates the particles
+	*/
+	virtual void step(real duration);
+
+protected:
+	/*
+	* Encodes a position and a velocity into a state. The dither is added below the
+	* precision kept, from 0 to 0xffff for the position and to 0x1fff for the velocity
+	*/
+	void encodeState(ParticleCompactState* state, const real* position, const real* velocity,
+		const unsigned* positionDither, const unsigned* velocityDither) const;
+
+};
+
+}
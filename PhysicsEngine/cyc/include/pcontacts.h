@@ -1,8 +1,12 @@
 #pragma once
 #include "particle.h"	
+#include <vector>
 
 namespace cyclone
 {
+	template<class P>
+	class ParticleContactResolverT;
+
 	/*
 	* A contact represents two object in contact (in this case
 	* ParticleContact representing two particle). Resolving a contact
@@ -12,53 +16,58 @@ namespace cyclone
 	* The contact has no collable function, to resolve a contact use
 	* the contact resolver class
 	*/
-	class ParticleContact
+	template<class P>
+	class ParticleContactT
 	{
 
-		friend class ParticleContactResolver;
+		friend class ParticleContactResolverT<P>;
 	public:
+		typedef typename P::Scalar Scalar;
+		typedef Vector3T<Scalar> Vector;
+		typedef Vector3T<typename P::Position> PositionVector;
+
 		/*
 		* Holds the particle that are involved in the contact. The 
 		* second of these can be NULL for contact with scenery
 		*/
-		Particle* particle[2];
+		ParticleT<P>* particle[2];
 
 		/*
 		* Holds the normal restituion of the contact
 		*/
-		real restitution;
+		Scalar restitution;
 
 		/*
 		* Holds the direction of the contact in world coordinates
 		*/
-		Vector3 contactNormal;
+		Vector contactNormal;
 
 		/*
 		* Holds the depth of penetration at the contact
 		*/
-		real penetration;
+		Scalar penetration;
 
 	protected:
 		/*
 		* Resolves the contact, for both velocity and interpenetration
 		*/
-		void resolve(real duration);
+		void resolve(Scalar duration);
 
 		/*
 		* Calculate the separating velocity at this contact
 		*/
-		real calculateSeparatingVelocity() const;
+		Scalar calculateSeparatingVelocity() const;
 
 	private:
 		/*
 		* Handles the impulse calculation for this collision
 		*/
-		void resolveVelocity(real duration);
+		void resolveVelocity(Scalar duration);
 
 		/*
 		* Handles the interpenetration resolution for this contact
 		*/
-		void resolveInterpenetration(real duration);
+		void resolveInterpenetration(Scalar duration);
 	};
 
 
@@ -66,8 +75,12 @@ namespace cyclone
 	* The contact resolution routine for particle contacts. One
 	* resolver instance can be shared for whole simulation.
 	*/
-	class ParticleContactResolver
+	template<class P>
+	class ParticleContactResolverT
 	{
+	public:
+		typedef typename P::Scalar Scalar;
+
 	protected:
 		/*
 		* Holds the number of iterationg allowed
@@ -80,25 +93,51 @@ namespace cyclone
 		*/
 		unsigned iterationsUsed;
 
+		/*
+		* Holds the number of different contacts resolved by the last call to
+		* resolveContacts, and which ones were, kept to avoid allocating
+		*/
+		unsigned contactsResolved;
+		std::vector<bool> resolved;
 
 	public:
 		/*
 		* Creates a new contact resolver
 		*/
-		ParticleContactResolver(unsigned iterations);
+		ParticleContactResolverT(unsigned iterations);
 
 		/*
 		* Set the number of iterations that can be used
 		*/
 		void setIterations(unsigned iterations);
 
+		/*
+		* Gets the number of iterations that can be used
+		*/
+		unsigned getIterations() const;
+
+		/*
+		* Gets the number of iterations used by the last call to resolveContacts
+		*/
+		unsigned getIterationsUsed() const;
+
+		/*
+		* Gets the number of different contacts resolved by the last call to resolveContacts.
+		* A contact resolved in several iterations is counted once
+		*/
+		unsigned getContactsResolved() const;
+
 		/*
 		* Resolves a set of particle contact for both penetrations and velocity
 		*/
-		void resolveContacts(ParticleContact* contactArray, unsigned numContacts, real duration);
+		void resolveContacts(ParticleContactT<P>* contactArray, unsigned numContacts, Scalar duration);
 
 
 	};
 
-	
+	/*
+	* The contacts of the precision of the engine
+	*/
+	typedef ParticleContactT<RealPrecision> ParticleContact;
+	typedef ParticleContactResolverT<RealPrecision> ParticleContactResolver;
 }
\ No newline at end of file
@@ -0,0 +1,428 @@
+#pragma once
+#include <include/pworld.h>
+#include <stddef.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* A named block of memory shared between the processes of a machine, such as the
+* processes of a decomposed world. One process creates it, the others open it by name
+*/
+class ParticleSharedMemory
+{
+protected:
+	/*
+	* Holds the mapped memory, its size and its name
+	*/
+	void* memory;
+	size_t size;
+	std::string name;
+
+	/*
+	* True if this process created the memory, and removes its name when done
+	*/
+	bool owner;
+
+	/*
+	* Holds the handle of the mapping
+	*/
+	void* handle;
+
+public:
+	/*
+	* Creates or opens the memory of the given name and size. The name is global to the
+	* machine, such as "/cyclone-world"
+	*/
+	ParticleSharedMemory(const char* name, size_t size, bool create);
+
+	/*
+	* Unmaps the memory, and removes its name if this process created it
+	*/
+	~ParticleSharedMemory();
+
+	/*
+	* Returns the memory, or NULL if it couldn't be created or opened
+	*/
+	void* getMemory() const;
+
+	/*
+	* Returns the size of the memory
+	*/
+	size_t getSize() const;
+
+private:
+	ParticleSharedMemory(const ParticleSharedMemory&);
+	ParticleSharedMemory& operator=(const ParticleSharedMemory&);
+
+};
+
+/*
+* The state of a particle sent from a domain to its neighbor, either because it moved
+* into the neighbor or as a ghost of a particle near their boundary
+*/
+struct ParticleDomainRecord
+{
+	/*
+	* Identifies the kinds of records
+	*/
+	enum Kind {
+		RECORD_MIGRATE,
+		RECORD_GHOST,
+		RECORD_END
+	};
+
+	unsigned id;
+	unsigned kind;
+	Vector3 position;
+	Vector3 velocity;
+	Vector3 acceleration;
+	real inverseMass;
+	real damping;
+};
+
+/*
+* A ring buffer of records from one producer to one consumer, which can be different
+* threads or different processes. It lives in memory given by the caller, laid out
+* the same way in every process, and uses no lock
+*/
+class ParticleRing
+{
+protected:
+	/*
+	* Holds the indices of the shared memory, and the records
+	*/
+	struct Header;
+	Header* header;
+	ParticleDomainRecord* records;
+
+	/*
+	* Holds the number of records, a power of two
+	*/
+	unsigned capacity;
+
+public:
+	/*
+	* Returns the memory needed for a ring of the given capacity
+	*/
+	static size_t requiredSize(unsigned capacity);
+
+	/*
+	* Uses the given memory for a ring of the given capacity, a power of two. Only one
+	* side must initialize it, before the other side uses it
+	*/
+	ParticleRing(void* memory, unsigned capacity, bool initialize);
+
+	/*
+	* Adds a record. Returns false if the ring is full
+	*/
+	bool push(const ParticleDomainRecord& record);
+
+	/*
+	* Takes the oldest record. Returns false if the ring is empty
+	*/
+	bool pop(ParticleDomainRecord* record);
+
+};
+
+/*
+* Holds the measurements of a domain for the last exchange
+*/
+struct ParticleDomainStats
+{
+	/*
+	* Holds the number of particles owned and of ghosts
+	*/
+	unsigned owned;
+	unsigned ghosts;
+
+	/*
+	* Holds the number of particles that left and entered the domain
+	*/
+	unsigned departed;
+	unsigned arrived;
+
+	/*
+	* Holds the number of records sent and received
+	*/
+	unsigned sent;
+	unsigned received;
+
+	/*
+	* Holds the number of times the domain waited on a full or empty ring
+	*/
+	unsigned waits;
+
+	/*
+	* Holds the number of rebalances since the start
+	*/
+	unsigned rebalances;
+};
+
+/*
+* One subdomain of a world decomposed in slabs along an axis, simulated by its own
+* process or thread. Each domain owns the particles inside its slab and simulates them
+* in its own world. Before each step, exchange sends the particles that left the slab
+* to the neighbor slab, and copies the particles within the halo of a boundary into the
+* neighbor as ghosts, whose state is overwritten at each exchange. Neighbors talk
+* through rings in a shared region, so the domains can be processes of one machine
+* using a ParticleSharedMemory, or threads sharing plain memory.
+*
+* Springs and rods that may cross boundaries are bonds, given by particle ids and
+* added in the same order to every domain: a spring adds its force to the ends owned
+* by the domain, using the ghost of the other end, and a rod fills a contact when one
+* end is owned, each side resolving it on its copy. Every few exchanges the slabs are
+* rebalanced so each holds the same number of particles.
+*
+* A step of a domain runs exchange, then the world with applyForces called after the
+* forces of the world, and getLink added to the links of the world. Particles and
+* ghosts are created and destroyed by the world: getAdded and getRemoved list those of
+* the last exchange, the removed ones staying valid until the next exchange, for the
+* caller to update its own structures. A particle that crosses into a neighbor stays
+* as a ghost, and a ghost that crosses in becomes owned, keeping their addresses
+*/
+class ParticleDomain
+{
+public:
+	typedef std::vector<Particle*> Particles;
+
+	/*
+	* The largest number of domains sharing a region
+	*/
+	static const unsigned maxDomains = 64;
+
+	/*
+	* The number of bins of the histograms of the rebalances
+	*/
+	static const unsigned histogramBins = 256;
+
+	/*
+	* The start of a shared region, laid out the same way in every process
+	*/
+	struct Region;
+
+	/*
+	* Links the rods of a domain to its world
+	*/
+	class Link : public ParticleLink
+	{
+	public:
+		ParticleDomain* domain;
+		virtual unsigned fillContact(ParticleContact* contact, unsigned limit) const;
+		virtual void remapParticles(const ParticleRemap& remap);
+	};
+
+protected:
+	/*
+	* Holds a particle of the domain, owned or ghost, with the last exchange that refreshed a ghost
+	*/
+	struct Entry {
+		Particle* particle;
+		bool owned;
+		unsigned seen;
+	};
+
+	/*
+	* Holds a spring or rod between two particles
+	*/
+	struct Bond {
+		unsigned first;
+		unsigned second;
+		real stiffness;
+		real length;
+		bool rod;
+	};
+
+	/*
+	* Holds the shared region
+	*/
+	Region* region;
+
+	/*
+	* Holds the world of the domain and the rank of the domain, its slab from the lowest
+	*/
+	ParticleWorld* world;
+	unsigned rank;
+
+	/*
+	* Holds the rings to and from the lower and higher neighbors, NULL at the ends
+	*/
+	ParticleRing* toLower;
+	ParticleRing* fromLower;
+	ParticleRing* toHigher;
+	ParticleRing* fromHigher;
+
+	/*
+	* Holds the boundaries between the slabs, the same in every domain
+	*/
+	std::vector<real> boundaries;
+
+	/*
+	* Holds the particles by id, the bonds, and the number of exchanges
+	*/
+	std::unordered_map<unsigned, Entry> entries;
+	std::vector<Bond> bonds;
+	unsigned exchanges;
+
+	/*
+	* Holds the particles added and removed by the last exchange
+	*/
+	Particles added;
+	Particles removed;
+
+	/*
+	* Holds the removed particles sorted, to find them while taking them out
+	*/
+	Particles sortedRemoved;
+
+	/*
+	* Holds the records to send, kept to avoid allocating
+	*/
+	std::vector<ParticleDomainRecord> outLower;
+	std::vector<ParticleDomainRecord> outHigher;
+
+	/*
+	* Holds the link of the rods
+	*/
+	Link link;
+
+	/*
+	* Holds the measurements
+	*/
+	ParticleDomainStats stats;
+
+public:
+	/*
+	* Returns the memory needed for a region of the given number of domains, with rings
+	* of the given capacity, a power of two
+	*/
+	static size_t regionSize(unsigned domains, unsigned ringCapacity);
+
+	/*
+	* Initializes a region, once and before any domain uses it. The slabs start evenly
+	* spread between low and high along the axis (0, 1 or 2). The halo is the distance
+	* from a boundary within which particles are copied as ghosts, and should cover the
+	* reach of the forces and links across boundaries. The slabs are rebalanced every
+	* given number of exchanges, never if zero
+	*/
+	static void initializeRegion(void* memory, unsigned domains, unsigned ringCapacity, unsigned axis,
+		real low, real high, real halo, unsigned rebalanceInterval);
+
+	/*
+	* Creates the domain of the given rank in an initialized region, simulated by the given world
+	*/
+	ParticleDomain(void* memory, unsigned rank, ParticleWorld* world);
+
+	/*
+	* Deletes the rings. The particles belong to the world
+	*/
+	~ParticleDomain();
+
+	/*
+	* Creates a particle owned by the domain with the given id, unique over all the
+	* domains. If it is outside the slab it moves to the right domain at the next exchanges
+	*/
+	Particle* createParticle(unsigned id);
+
+	/*
+	* Adds a spring or a rod between the particles of the given ids. Bonds must be added
+	* to every domain in the same order
+	*/
+	void addSpring(unsigned first, unsigned second, real stiffness, real restLength);
+	void addRod(unsigned first, unsigned second, real length);
+
+	/*
+	* Sends and receives the particles that moved between slabs and the ghosts, and
+	* rebalances the slabs when due. Every domain must call it once per step
+	*/
+	void exchange();
+
+	/*
+	* Adds the forces of the springs to the particles owned
+	*/
+	void applyForces();
+
+	/*
+	* Returns the link filling the contacts of the rods
+	*/
+	ParticleLink* getLink();
+
+	/*
+	* Returns the particle of the given id, owned or ghost, or NULL if the domain doesn't have it
+	*/
+	Particle* getParticle(unsigned id) const;
+
+	/*
+	* Returns true if the particle of the given id is owned by the domain
+	*/
+	bool isOwned(unsigned id) const;
+
+	/*
+	* Returns the particles added and removed by the last exchange
+	*/
+	const Particles& getAdded() const;
+	const Particles& getRemoved() const;
+
+	/*
+	* Returns the rank of the domain, and the lowest and highest coordinates of its slab
+	*/
+	unsigned getRank() const;
+	real getLow() const;
+	real getHigh() const;
+
+	/*
+	* Returns the measurements
+	*/
+	const ParticleDomainStats& getStats() const;
+
+protected:
+	/*
+	* Returns the coordinate of a particle along the axis
+	*/
+	real coordinate(const Particle* particle) const;
+
+	/*
+	* Fills a record with the state of a particle
+	*/
+	void fillRecord(ParticleDomainRecord* record, unsigned id, const Particle* particle, unsigned kind) const;
+
+	/*
+	* Sends the records to a neighbor followed by an end, receiving while the ring is full
+	*/
+	void send(ParticleRing* ring, const std::vector<ParticleDomainRecord>& records, bool* lowerDone, bool* higherDone);
+
+	/*
+	* Receives the records waiting from the neighbors. Sets the flags when their end is received
+	*/
+	void receive(bool* lowerDone, bool* higherDone);
+
+	/*
+	* Applies a record received
+	*/
+	void apply(const ParticleDomainRecord& record);
+
+	/*
+	* Takes the particles removed by the exchange out of the world, to be destroyed at
+	* the next exchange
+	*/
+	void retire();
+
+	/*
+	* Waits for every domain to reach the barrier
+	*/
+	void barrier();
+
+	/*
+	* Moves the boundaries so every slab holds the same number of particles
+	*/
+	void rebalance();
+
+private:
+	ParticleDomain(const ParticleDomain&);
+	ParticleDomain& operator=(const ParticleDomain&);
+
+};
+
+}
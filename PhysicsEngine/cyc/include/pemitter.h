@@ -0,0 +1,203 @@
+#pragma once
+#include <include/ptimestep.h>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Spawns short lived particles, such as fireworks or sparks, from a preallocated pool.
+* The live particles are always the first ones of the pool: when a particle expires the
+* last live one is moved into its slot, so the live set stays dense and spawning or
+* retiring never allocates memory.
+*
+* The force generators added to the emitter apply to every live particle. They are
+* kept by the emitter rather than by a registry, so they follow the particles as they
+* are compacted without any registration to fix up
+*/
+class ParticleEmitter : public ParticleSubsystem
+{
+protected:
+	/*
+	* Holds the pool of particles, the first liveCount are alive
+	*/
+	std::vector<Particle> particles;
+
+	/*
+	* Holds the time each particle has been alive, indexed as the particles
+	*/
+	std::vector<real> ages;
+
+	/*
+	* Holds the time each particle will live, indexed as the particles
+	*/
+	std::vector<real> lifetimes;
+
+	/*
+	* Holds the number of live particles
+	*/
+	unsigned liveCount;
+
+	/*
+	* Holds the force generators applied to every live particle
+	*/
+	std::vector<ParticleForceGenerator*> generators;
+
+	/*
+	* Holds the number of particles spawned per second
+	*/
+	real rate;
+
+	/*
+	* Holds the fraction of particle that should have been spawned but wasn't yet
+	*/
+	real pendingSpawn;
+
+	/*
+	* Holds the range of the lifetime of the particles
+	*/
+	real minLifetime;
+	real maxLifetime;
+
+	/*
+	* Holds the position the particles are spawned at
+	*/
+	Vector3 origin;
+
+	/*
+	* Holds the mean velocity of the spawned particles
+	*/
+	Vector3 velocity;
+
+	/*
+	* Holds the radius of the sphere the random part of the velocity is picked in
+	*/
+	real velocitySpread;
+
+	/*
+	* Holds the constant acceleration of the spawned particles
+	*/
+	Vector3 acceleration;
+
+	/*
+	* Holds the mass of the spawned particles
+	*/
+	real mass;
+
+	/*
+	* Holds the damping of the spawned particles
+	*/
+	real damping;
+
+	/*
+	* Holds the state of the random number generator
+	*/
+	unsigned seed;
+
+	/*
+	* Holds the number of particles that couldn't be spawned because the pool was full
+	*/
+	unsigned dropped;
+
+public:
+	/*
+	* Creates an emitter with a pool of the given number of particles
+	*/
+	ParticleEmitter(unsigned capacity, unsigned seed = 1);
+
+	/*
+	* Sets the number of particles spawned per second
+	*/
+	void setRate(real rate);
+
+	/*
+	* Sets the range the lifetime of each particle is uniformly picked from
+	*/
+	void setLifetime(real minLifetime, real maxLifetime);
+
+	/*
+	* Sets the position the particles are spawned at
+	*/
+	void setOrigin(const Vector3& origin);
+
+	/*
+	* Sets the velocity of the particles: the mean velocity plus a random
+	* vector picked uniformly in the sphere of the given radius
+	*/
+	void setVelocity(const Vector3& velocity, real spread);
+
+	/*
+	* Sets the constant acceleration of the spawned particles
+	*/
+	void setAcceleration(const Vector3& acceleration);
+
+	/*
+	* Sets the mass of the spawned particles
+	*/
+	void setMass(real mass);
+
+	/*
+	* Sets the damping of the spawned particles
+	*/
+	void setDamping(real damping);
+
+	/*
+	* Adds a force generator applied to every live particle
+	*/
+	void addGenerator(ParticleForceGenerator* fg);
+
+	/*
+	* Removes the given force generator. If it was not added this method has no effect
+	*/
+	void removeGenerator(ParticleForceGenerator* fg);
+
+	/*
+	* Spawns the given number of particles at once.
+	* Returns the number actually spawned, which is lower when the pool is full
+	*/
+	unsigned spawn(unsigned count);
+
+	/*
+	* Ages and retires the particles, spawns the new ones,
+	* applies the forces and integrates the live particles
+	*/
+	virtual void step(real duration);
+
+	/*
+	* Removes every live particle
+	*/
+	void clear();
+
+	/*
+	* Returns the pool of particles, only the first getLiveCount are alive
+	*/
+	Particle* getParticles();
+
+	/*
+	* Returns the number of live particles
+	*/
+	unsigned getLiveCount() const;
+
+	/*
+	* Returns the number of particles the pool can hold
+	*/
+	unsigned getCapacity() const;
+
+	/*
+	* Returns the number of particles that couldn't be spawned because the pool was full
+	*/
+	unsigned getDroppedCount() const;
+
+protected:
+	/*
+	* Removes the expired particles, moving the last live particle in their slot
+	*/
+	void retire(real duration);
+
+	/*
+	* Returns a random number between min and max
+	*/
+	real random(real min, real max);
+
+};
+
+}
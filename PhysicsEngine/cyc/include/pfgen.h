@@ -5,49 +5,189 @@
 namespace cyclone {
 
 
-class ParticleForceGenerator
+/*
+* Tells where particles have been moved in memory, so that whoever holds
+* a pointer to a particle can update it
+*/
+template<class P>
+class ParticleRemapT
+{
+public:
+	/*
+	* Returns the new location of the given particle, or the particle itself if it hasn't moved
+	*/
+	virtual ParticleT<P>* map(ParticleT<P>* particle) const = 0;
+
+};
+
+/*
+* The inputs a force can depend on. Generators declare theirs so the registry can
+* apply their last force again while the inputs don't change
+*/
+enum ParticleForceInput {
+	FORCE_POSITION = 1,
+	FORCE_VELOCITY = 2,
+	FORCE_MASS = 4,
+	FORCE_DURATION = 8,
+	FORCE_ANCHOR = 16,
+	FORCE_VOLATILE = 32
+};
+
+template<class P>
+class ParticleForceGeneratorT
 {
 public:
+	typedef typename P::Scalar Scalar;
+	typedef Vector3T<Scalar> Vector;
+	typedef Vector3T<typename P::Position> PositionVector;
+
 	/*
 	* Overload this in implementations of the interface to calculate and update the force applied to a particle
 	*/
-	virtual void updateForce(Particle* particle, real duration) = 0;
+	virtual void updateForce(ParticleT<P>* particle, Scalar duration) = 0;
+
+	/*
+	* Updates the forces of a batch of particles registered to this generator. Overload
+	* this to compute what is the same for every particle only once per batch, the default
+	* calls updateForce for each particle
+	*/
+	virtual void updateForces(ParticleT<P>* const* particles, unsigned count, Scalar duration);
+
+	/*
+	* Returns the stiffness of the force, the derivative of its magnitude with respect
+	* to the position of the particle. It is used to pick a stable timestep, generators
+	* that don't behave like a spring can keep the default of zero
+	*/
+	virtual Scalar getStiffness() const;
+
+	/*
+	* Returns the inputs of the force, a combination of ParticleForceInput: the position,
+	* velocity and mass of the particle, the duration and the anchor. The default is
+	* FORCE_VOLATILE, for forces that depend on anything else, such as another particle
+	* or state the generator changes, which are computed at every update
+	*/
+	virtual unsigned getInputs() const;
+
+	/*
+	* Returns the anchor of the force, for generators declaring FORCE_ANCHOR
+	*/
+	virtual const PositionVector* getAnchor() const;
+
+	/*
+	* Returns true if the generator can be called from several threads at once for
+	* different particles. The default is false, for generators that change their own
+	* state when called
+	*/
+	virtual bool isConcurrent() const;
+
+	/*
+	* Overload this in generators holding pointers to particles, to update
+	* them when the particles are moved in memory
+	*/
+	virtual void remapParticles(const ParticleRemapT<P>& remap);
 
 private:
 
 };
 
+/*
+* Holds the measurements of the force cache of a registry for the last update
+*/
+struct ParticleForceCacheStats
+{
+	/*
+	* Holds the number of registrations whose last force was applied again, computed
+	* again because their inputs changed, and computed because their generator is volatile
+	*/
+	unsigned hits;
+	unsigned misses;
+	unsigned uncached;
+
+	/*
+	* Returns the share of the cached registrations whose last force was applied again
+	*/
+	float getHitRate() const;
+};
+
 /*
 * Holds all the force generators and all the particle they apply to
 */
-class ParticleForceRegistry
+template<class P>
+class ParticleForceRegistryT
 {
-protected:
+public:
+	typedef typename P::Scalar Scalar;
+
 	/*
 	* Keeps track of one force generator and the particle it applies to
 	*/
 	struct ParticleForceRegistration {
-		Particle* particle;
-		ParticleForceGenerator* fg;
+		ParticleT<P>* particle;
+		ParticleForceGeneratorT<P>* fg;
+		unsigned cache;
 	};
 
 	/*
 	* Holds the list of registration
 	*/
 	typedef std::vector<ParticleForceRegistration> Registry;
+
+	/*
+	* The cache of a registration whose force hasn't been kept yet
+	*/
+	static const unsigned noCache = 0xffffffff;
+
+protected:
+	typedef Vector3T<Scalar> Vector;
+	typedef Vector3T<typename P::Position> PositionVector;
+
+	/*
+	* Holds the last force of a registration and the inputs it was computed from
+	*/
+	struct ForceCache {
+		Vector force;
+		PositionVector position;
+		Vector velocity;
+		PositionVector anchor;
+		Scalar inverseMass;
+		Scalar duration;
+	};
+
 	Registry registrations;
 
+	/*
+	* Holds the forces kept, indexed by the registrations
+	*/
+	std::vector<ForceCache> caches;
+
+	/*
+	* True if the forces are kept, and the largest change of the position, velocity and
+	* anchor for which a force is applied again
+	*/
+	bool caching;
+	Scalar tolerance;
+
+	/*
+	* Holds the measurements of the last update
+	*/
+	ParticleForceCacheStats stats;
+
 public:
+	/*
+	* Creates an empty registry, which computes every force until caching is turned on
+	*/
+	ParticleForceRegistryT();
+
 	/*
 	* Register the given force generator to apply to the given particle
 	*/
-	void add(Particle* particle, ParticleForceGenerator* fg);
+	void add(ParticleT<P>* particle, ParticleForceGeneratorT<P>* fg);
 
 	/*
 	* Removes the given registered pairs from the registry.
 	* If the pair is not registered this method has no effect
 	*/
-	void remove(Particle* particle, ParticleForceGenerator* fg);
+	void remove(ParticleT<P>* particle, ParticleForceGeneratorT<P>* fg);
 
 	/*
 	* Clears all registrations from the registry. This will not delete the particle or the force
@@ -57,218 +197,384 @@ public:
 
 	/*
 	* Calls all the force generators to update the forces of their 
-	* corresponding particle
+	* corresponding particle. Consecutive registrations of the same
+	* generator are given to it as a batch
 	*/
-	void updateForces(real duration);
+	void updateForces(Scalar duration);
+
+	/*
+	* Turns the keeping of forces on or off. A force applied again costs a comparison of
+	* its inputs and a cache line per registration, so it pays for generators that cost
+	* more than that on particles that rest
+	*/
+	void setCaching(bool caching);
+
+	/*
+	* Sets the largest change of each coordinate of the position, velocity and anchor of
+	* a registration for which its last force is applied again. With no tolerance the
+	* forces are the same as if they were all computed
+	*/
+	void setTolerance(Scalar tolerance);
+
+	/*
+	* Forgets the forces kept, so they are all computed at the next update. Call it after
+	* changing a generator declaring its inputs
+	*/
+	void invalidateCache();
+
+	/*
+	* Returns the measurements of the last update
+	*/
+	const ParticleForceCacheStats& getStats() const;
+
+	/*
+	* Returns the list of registrations
+	*/
+	Registry& getRegistrations();
+
+protected:
+	/*
+	* Applies the force of a registration whose generator declares its inputs, computing
+	* it only if the inputs changed since it was kept
+	*/
+	void updateCachedForce(ParticleForceRegistration* registration, unsigned inputs, const PositionVector* anchor, Scalar duration);
 
 };
 
-class ParticleGravity : public ParticleForceGenerator
+template<class P>
+class ParticleGravityT : public ParticleForceGeneratorT<P>
 {
 public:
+	typedef typename P::Scalar Scalar;
+	typedef Vector3T<Scalar> Vector;
+
 	/*
 	* Creates the generator with the given vector
 	*/
-	ParticleGravity(Vector3& gravity);
+	ParticleGravityT(Vector& gravity);
 
 	/*
 	* Applies the gravity to the particle it is assigned to
 	*/
-	virtual void updateForce(Particle* particle, real duration);
+	virtual void updateForce(ParticleT<P>* particle, Scalar duration);
+
+	/*
+	* Returns true, the generator keeps no state changed by the updates
+	*/
+	virtual bool isConcurrent() const;
 
 	
 private:
 
 	/* Holds the acceleration of the gravity*/
-	Vector3 gravity;
+	Vector gravity;
 
 };
 
-class ParticleDrag : public ParticleForceGenerator
+template<class P>
+class ParticleDragT : public ParticleForceGeneratorT<P>
 {
 public:
+	typedef typename P::Scalar Scalar;
+	typedef Vector3T<Scalar> Vector;
+
 	/* Creates the generator with the given velocity coefficient */
-	ParticleDrag(real k1, real k2);
+	ParticleDragT(Scalar k1, Scalar k2);
 
 	/* Applies the drag force to the given particle*/
-	virtual void updateForce(Particle* particle, real duration);
+	virtual void updateForce(ParticleT<P>* particle, Scalar duration);
+
+	/* Returns true, the drag can be applied from several threads */
+	virtual bool isConcurrent() const;
+
+	/* Returns the velocity, the only input of the drag */
+	virtual unsigned getInputs() const;
 private:
 
 	/* Hold the velocity drag coefficient */
-	real k1;
+	Scalar k1;
 
 	/* Hold the velocity squared drag coefficient */
-	real k2;
+	Scalar k2;
 
 };
 
-class ParticleSpring : public ParticleForceGenerator
+template<class P>
+class ParticleSpringT : public ParticleForceGeneratorT<P>
 {
 public:
+	typedef typename P::Scalar Scalar;
+	typedef Vector3T<Scalar> Vector;
+
 	/*
 	* Creates a new spring with the given parameters
 	*/
-	ParticleSpring(Particle* other, real springConstant, real restLength);
+	ParticleSpringT(ParticleT<P>* other, Scalar springConstant, Scalar restLength);
 
 	/*
 	* Applies the spring force to the given particle
 	*/
-	virtual void updateForce(Particle* particle, real duration);
+	virtual void updateForce(ParticleT<P>* particle, Scalar duration);
+
+	/*
+	* Returns true, the generator keeps no state changed by the updates
+	*/
+	virtual bool isConcurrent() const;
+
+	/*
+	* Returns the spring constant
+	*/
+	virtual Scalar getStiffness() const;
+
+	/*
+	* Updates the pointer to the other particle
+	*/
+	virtual void remapParticles(const ParticleRemapT<P>& remap);
 
 private:
 	/*
 	* The particle at the other end of the spring
 	*/
-	Particle* other;
+	ParticleT<P>* other;
 
 	/*
 	Holds the spring constant
 	*/
-	real springConstant;
+	Scalar springConstant;
 
 	/*
 	Holds the rest length of the spring
 	*/
-	real restLength;
+	Scalar restLength;
 
 };
 
-class ParticleAnchoredSpring : public ParticleForceGenerator
+template<class P>
+class ParticleAnchoredSpringT : public ParticleForceGeneratorT<P>
 {
 public:
+	typedef typename P::Scalar Scalar;
+	typedef Vector3T<Scalar> Vector;
+	typedef Vector3T<typename P::Position> PositionVector;
+
 	/*
 	* Create a particle anchored spring with the given values
 	*/
-	ParticleAnchoredSpring(Vector3* anchor, real springConstant, real restLength);
+	ParticleAnchoredSpringT(PositionVector* anchor, Scalar springConstant, Scalar restLength);
 
 	/*
 	* Applies the spring force to the given particle
 	*/
-	virtual void updateForce(Particle* particle, real duration);
+	virtual void updateForce(ParticleT<P>* particle, Scalar duration);
+
+	/*
+	* Returns true, the generator keeps no state changed by the updates
+	*/
+	virtual bool isConcurrent() const;
+
+	/*
+	* Returns the spring constant
+	*/
+	virtual Scalar getStiffness() const;
+
+	/*
+	* Returns the position and the anchor, the inputs of the spring
+	*/
+	virtual unsigned getInputs() const;
+	virtual const PositionVector* getAnchor() const;
 
 
 private:
 	/*
 	* The location of the anchored end of the spring
 	*/
-	Vector3* anchor;
+	PositionVector* anchor;
 
 	/*
 	* The spring constant
 	*/
-	real springConstant;
+	Scalar springConstant;
 
 	/*
 	The rest length of the spring
 	*/
-	real restLength;
+	Scalar restLength;
 
 };
 
-class ParticleBungee : public ParticleForceGenerator
+template<class P>
+class ParticleBungeeT : public ParticleForceGeneratorT<P>
 {
 public:
+	typedef typename P::Scalar Scalar;
+	typedef Vector3T<Scalar> Vector;
+
 	/*
 	* Creates the particle bungee with the given parameters
 	*/
-	ParticleBungee(Particle* other, real springConstant, real restLength);
+	ParticleBungeeT(ParticleT<P>* other, Scalar springConstant, Scalar restLength);
 
 	/*
 	* Applies the force to the given particle
 	*/
-	virtual void updateForce(Particle* particle, real duration);
+	virtual void updateForce(ParticleT<P>* particle, Scalar duration);
+
+	/*
+	* Returns true, the generator keeps no state changed by the updates
+	*/
+	virtual bool isConcurrent() const;
+
+	/*
+	* Returns the spring constant
+	*/
+	virtual Scalar getStiffness() const;
+
+	/*
+	* Updates the pointer to the other particle
+	*/
+	virtual void remapParticles(const ParticleRemapT<P>& remap);
 
 private:
 
 	/*
 	* Location of the other particle
 	*/
-	Particle* other;
+	ParticleT<P>* other;
 
 	/*
 	* Value of the spring constant
 	*/
-	real springConstant;
+	Scalar springConstant;
 
 	/*
 	* Rest length of the spring
 	*/
-	real restLength;
+	Scalar restLength;
 
 };
 
-class ParticleBuoyancy : public ParticleForceGenerator
+template<class P>
+class ParticleBuoyancyT : public ParticleForceGeneratorT<P>
 {
 public:
+	typedef typename P::Scalar Scalar;
+	typedef Vector3T<Scalar> Vector;
+
 	/*
 	* Creates the generator with the given parameters
 	*/
-	ParticleBuoyancy(real maxDepth, real volume, real waterHeight, real liquidDensity = 1000.0f);
+	ParticleBuoyancyT(Scalar maxDepth, Scalar volume, Scalar waterHeight, Scalar liquidDensity = 1000.0f);
 
 	/*
 	* Applies the force to the particle
 	*/
-	virtual void updateForce(Particle* particle, real duration);
+	virtual void updateForce(ParticleT<P>* particle, Scalar duration);
+
+	/*
+	* Returns true, the generator keeps no state changed by the updates
+	*/
+	virtual bool isConcurrent() const;
+
+	/*
+	* Returns the position, the only input of the buoyancy
+	*/
+	virtual unsigned getInputs() const;
 
 private:
 
 	/*
 	* The maximum submersion depth of the object before it generates the maximum buoyancy force
 	*/
-	real maxDepth;
+	Scalar maxDepth;
 
 	/*
 	* The volume of the object
 	*/
-	real volume;
+	Scalar volume;
 
 	/*
 	* The height of the water plane above y=0. The plane will be parallel to the xz plane
 	*/
-	real waterHeight;
+	Scalar waterHeight;
 
 	/*
 	* Density of the liquid the object is submerged in
 	* Pure water has a density of 1000 kg per cubic meter
 	*/
-	real liquidDensity;
+	Scalar liquidDensity;
 
 };
 
 /*
 * A force generator that fakes a stiff spring force, and where one end is attached to a fixed point in space
 */
-class ParticleFakeSpring : public ParticleForceGenerator
+template<class P>
+class ParticleFakeSpringT : public ParticleForceGeneratorT<P>
 {
 public:
+	typedef typename P::Scalar Scalar;
+	typedef Vector3T<Scalar> Vector;
+	typedef Vector3T<typename P::Position> PositionVector;
+
 	
 	/*
 	* Creates a new spring with the given parameters
 	*/
-	ParticleFakeSpring(Vector3* anchor, real springContant, real damping);
+	ParticleFakeSpringT(PositionVector* anchor, Scalar springContant, Scalar damping);
 
 	/*
 	* Applies the spring force to the given particle
 	*/
-	virtual void updateForce(Particle* particle, real duration);
+	virtual void updateForce(ParticleT<P>* particle, Scalar duration);
+
+	/*
+	* Returns true, the generator keeps no state changed by the updates
+	*/
+	virtual bool isConcurrent() const;
+
+	/*
+	* Applies the spring force to a batch of particles. The sine, cosine and
+	* exponential only depend on the spring and the duration, so they are
+	* computed once for the batch
+	*/
+	virtual void updateForces(ParticleT<P>* const* particles, unsigned count, Scalar duration);
+
+	/*
+	* Returns the spring constant
+	*/
+	virtual Scalar getStiffness() const;
 
 private:
 	/*
 	* The location of the anchored end of the spring
 	*/
-	Vector3* anchor;
+	PositionVector* anchor;
 
 	/*
 	* The spring constant
 	*/
-	real springConstant;
+	Scalar springConstant;
 
 	/*
 	* The damping of the oscillation of the spring
 	*/
-	real damping;
+	Scalar damping;
 
 
 };
 
+/*
+* The force generators of the precision of the engine
+*/
+typedef ParticleRemapT<RealPrecision> ParticleRemap;
+typedef ParticleForceGeneratorT<RealPrecision> ParticleForceGenerator;
+typedef ParticleForceRegistryT<RealPrecision> ParticleForceRegistry;
+typedef ParticleGravityT<RealPrecision> ParticleGravity;
+typedef ParticleDragT<RealPrecision> ParticleDrag;
+typedef ParticleSpringT<RealPrecision> ParticleSpring;
+typedef ParticleAnchoredSpringT<RealPrecision> ParticleAnchoredSpring;
+typedef ParticleBungeeT<RealPrecision> ParticleBungee;
+typedef ParticleBuoyancyT<RealPrecision> ParticleBuoyancy;
+typedef ParticleFakeSpringT<RealPrecision> ParticleFakeSpring;
+
 }
\ No newline at end of file
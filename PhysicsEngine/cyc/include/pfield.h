@@ -0,0 +1,241 @@
+#pragma once
+#include <include/pfgen.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* A source of acceleration in a force field, such as an explosion or a gust of
+* wind. It only acts inside its bounds
+*/
+class ParticleFieldSource
+{
+public:
+	/*
+	* Overload this to give the box outside of which the source is zero
+	*/
+	virtual void getBounds(Vector3* min, Vector3* max) const = 0;
+
+	/*
+	* Overload this to give the acceleration of the source at the given point
+	*/
+	virtual Vector3 evaluate(const Vector3& position) const = 0;
+
+};
+
+/*
+* Pushes away from a center, with an acceleration going down linearly from
+* strength at the center to zero at the radius
+*/
+class ParticleExplosionSource : public ParticleFieldSource
+{
+public:
+	Vector3 center;
+	real radius;
+	real strength;
+
+	ParticleExplosionSource(const Vector3& center, real radius, real strength);
+
+	virtual void getBounds(Vector3* min, Vector3* max) const;
+	virtual Vector3 evaluate(const Vector3& position) const;
+
+};
+
+/*
+* A constant acceleration inside a box, such as wind or a current
+*/
+class ParticleWindSource : public ParticleFieldSource
+{
+public:
+	Vector3 min;
+	Vector3 max;
+	Vector3 acceleration;
+
+	ParticleWindSource(const Vector3& min, const Vector3& max, const Vector3& acceleration);
+
+	virtual void getBounds(Vector3* min, Vector3* max) const;
+	virtual Vector3 evaluate(const Vector3& position) const;
+
+};
+
+/*
+* Turns around a vertical axis through the center, with a tangential acceleration
+* going down linearly from strength at the axis to zero at the radius. The vortex
+* spans height above and below the center
+*/
+class ParticleVortexSource : public ParticleFieldSource
+{
+public:
+	Vector3 center;
+	real radius;
+	real height;
+	real strength;
+
+	ParticleVortexSource(const Vector3& center, real radius, real height, real strength);
+
+	virtual void getBounds(Vector3* min, Vector3* max) const;
+	virtual Vector3 evaluate(const Vector3& position) const;
+
+};
+
+/*
+* Holds the statistics of a force field
+*/
+struct ParticleFieldStats
+{
+	/*
+	* Holds the number of blocks allocated
+	*/
+	unsigned blocks;
+
+	/*
+	* Holds the number of blocks recomputed by the last update, and in total
+	*/
+	unsigned lastBlocksUpdated;
+	unsigned long long blocksUpdated;
+};
+
+/*
+* A force field made of any number of sources, sampled from a sparse voxel grid.
+*
+* The sources are summed on the nodes of a regular grid, which is only stored
+* where some source is not zero: space is split into blocks of 8x8x8 cells, kept
+* contiguously and found through a hash map. Each block also holds the nodes on its
+* far faces, so the eight nodes around any point are always in a single block, which
+* sampling looks up once and interpolates trilinearly. The cost of sampling doesn't
+* depend on the number of sources.
+*
+* Adding, removing or changing a source only marks the blocks under its old and new
+* bounds as dirty, and the next update recomputes just those. Blocks left without
+* any source are freed.
+*
+* The field is a force generator applying mass times the sampled acceleration.
+* Its particles should be registered consecutively, so the registry hands them
+* over in batches; sample() fills accelerations for any number of positions
+*/
+class ParticleForceField : public ParticleForceGenerator
+{
+public:
+	/*
+	* The number of cells along each side of a block, and the number of nodes it holds
+	*/
+	static const int blockSide = 8;
+	static const int blockNodeSide = blockSide + 1;
+	static const int blockNodes = blockNodeSide * blockNodeSide * blockNodeSide;
+
+protected:
+	/*
+	* Holds a block of nodes
+	*/
+	struct Block {
+		int32_t x, y, z;
+		bool dirty;
+		Vector3 nodes[blockNodes];
+	};
+
+	/*
+	* Holds a source and the bounds it was last rasterized with
+	*/
+	struct SourceEntry {
+		ParticleFieldSource* source;
+		Vector3 min;
+		Vector3 max;
+	};
+
+	typedef std::unordered_map<uint64_t, unsigned> BlockMap;
+
+	/*
+	* Holds the position of the node (0, 0, 0) and the distance between nodes
+	*/
+	Vector3 origin;
+	real spacing;
+
+	/*
+	* Holds the sources
+	*/
+	std::vector<SourceEntry> sources;
+
+	/*
+	* Holds the blocks, the free slots, and the index of the block at each block coordinate
+	*/
+	std::vector<Block> blocks;
+	std::vector<unsigned> freeBlocks;
+	BlockMap blockMap;
+
+	/*
+	* Holds the blocks to recompute at the next update
+	*/
+	std::vector<unsigned> dirtyBlocks;
+
+	/*
+	* Holds the statistics
+	*/
+	ParticleFieldStats stats;
+
+public:
+	/*
+	* Creates an empty field with the given distance between nodes
+	*/
+	ParticleForceField(real spacing, const Vector3& origin = Vector3());
+
+	/*
+	* Adds a source to the field. The source is owned by the caller
+	*/
+	void addSource(ParticleFieldSource* source);
+
+	/*
+	* Removes a source from the field
+	*/
+	void removeSource(ParticleFieldSource* source);
+
+	/*
+	* Tells the field that a source has changed, so it is rasterized again at the next update
+	*/
+	void markDirty(ParticleFieldSource* source);
+
+	/*
+	* Recomputes the dirty blocks. It is called by sample when needed
+	*/
+	void update();
+
+	/*
+	* Fills accelerations with the field sampled at each of the given positions
+	*/
+	void sample(const Vector3* positions, Vector3* accelerations, unsigned count);
+
+	/*
+	* Applies the field to a single particle
+	*/
+	virtual void updateForce(Particle* particle, real duration);
+
+	/*
+	* Applies the field to a batch of particles
+	*/
+	virtual void updateForces(Particle* const* particles, unsigned count, real duration);
+
+	/*
+	* Returns the statistics
+	*/
+	const ParticleFieldStats& getStats() const;
+
+protected:
+	/*
+	* Marks the blocks overlapping the given box as dirty, creating them if asked
+	*/
+	void markBlocks(const Vector3& min, const Vector3& max, bool create);
+
+	/*
+	* Recomputes a block from the sources overlapping it. Returns false if none does
+	*/
+	bool computeBlock(Block& block);
+
+	/*
+	* Returns the key of a block coordinate in the block map
+	*/
+	static uint64_t blockKey(int32_t x, int32_t y, int32_t z);
+
+};
+
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <stddef.h>
+
+namespace cyclone {
+
+/*
+* A file mapped in memory. Reading a mapped file doesn't copy it, the pages
+* are loaded by the system when they are first touched, and writing to a file
+* created mapped is a single bulk write the system flushes when it is closed
+*/
+class ParticleMappedFile
+{
+protected:
+	/*
+	* Holds the address the file is mapped at, NULL if no file is mapped
+	*/
+	void* data;
+
+	/*
+	* Holds the size of the mapping
+	*/
+	size_t size;
+
+	/*
+	* Holds the system handles of the file and the mapping
+	*/
+#ifdef _WIN32
+	void* file;
+	void* mapping;
+#else
+	int file;
+#endif
+
+public:
+	/*
+	* Creates an object with no file mapped
+	*/
+	ParticleMappedFile();
+
+	/*
+	* Unmaps the file if one is mapped
+	*/
+	~ParticleMappedFile();
+
+	/*
+	* Maps the given file for reading. Returns false if it can't be opened or is empty
+	*/
+	bool open(const char* path);
+
+	/*
+	* Creates the given file with the given size, replacing it if it exists,
+	* and maps it for writing. Returns false if it can't be created
+	*/
+	bool create(const char* path, size_t size);
+
+	/*
+	* Unmaps the file, flushing what was written to it
+	*/
+	void close();
+
+	/*
+	* Returns true if a file is mapped
+	*/
+	bool isOpen() const;
+
+	/*
+	* Returns the mapped memory
+	*/
+	void* getData();
+	const void* getData() const;
+
+	/*
+	* Returns the size of the mapped file
+	*/
+	size_t getSize() const;
+
+private:
+	/*
+	* Mapped files can't be copied
+	*/
+	ParticleMappedFile(const ParticleMappedFile&);
+	ParticleMappedFile& operator=(const ParticleMappedFile&);
+};
+
+}
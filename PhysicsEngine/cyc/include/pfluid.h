@@ -0,0 +1,251 @@
+#pragma once
+#include <include/pjobs.h>
+#include <include/ptimestep.h>
+#include <atomic>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Holds the measurements of the last step of a fluid
+*/
+struct ParticleFluidStats
+{
+	/*
+	* Holds the number of pairs closer than the smoothing radius, each counted from both sides
+	*/
+	unsigned long long neighbors;
+
+	/*
+	* Holds the number of pairs tested against the smoothing radius
+	*/
+	unsigned long long candidates;
+
+	/*
+	* Holds the number of non-empty cells
+	*/
+	unsigned cells;
+
+	/*
+	* Holds the smallest, largest and average density
+	*/
+	real minDensity;
+	real maxDensity;
+	real averageDensity;
+};
+
+/*
+* A smoothed-particle hydrodynamics fluid made of particles of the world. Each step
+* computes the density of every particle from its neighbors, turns it into a pressure,
+* and adds the pressure and viscosity forces to the particles. Gravity and the other
+* forces still come from the force registry, and the world integrates the particles.
+*
+* Neighbors are found with a cell-linked list rebuilt every step: the particles are
+* hashed into cells as wide as the smoothing radius and counting-sorted by cell, and
+* their positions, velocities and masses are copied into arrays in that order. The
+* neighbors of a particle are then the contiguous runs of the 27 cells around it, so
+* the kernels run four pairs at a time with SSE2 over flat arrays, and the particles
+* of a cell are read by all their neighbors while they are still in cache.
+* Both the rebuild and the passes run on the job pool given by the caller, if any.
+*
+* The kernels are the ones of Müller et al. 2003: poly6 for the density, spiky for
+* the pressure and the viscosity laplacian. The pressure is k (density - rest density),
+* clamped at zero so the fluid doesn't clump
+*/
+class ParticleFluid
+{
+public:
+	typedef std::vector<Particle*> Particles;
+
+protected:
+	/*
+	* Holds the particles of the fluid
+	*/
+	Particles particles;
+
+	/*
+	* Holds the radius of the kernels, the density at rest, the stiffness of the pressure
+	* and the viscosity
+	*/
+	real smoothingRadius;
+	real restDensity;
+	real stiffness;
+	real viscosity;
+
+	/*
+	* Holds the threads running the passes, or NULL to run them on the calling thread.
+	* The pool is owned by the caller
+	*/
+	ParticleJobPool* jobs;
+
+	/*
+	* Holds the cell of each particle, in the order of the particle list
+	*/
+	std::vector<unsigned> cellOf;
+
+	/*
+	* Holds the number of cells of the hash table, a power of two, and the first sorted
+	* particle of each cell. The particles of cell c are from cellStart[c] to cellStart[c + 1]
+	*/
+	unsigned cellCount;
+	std::vector<unsigned> cellStart;
+
+	/*
+	* Holds the number of particles of each cell while sorting, then the next free slot
+	*/
+	std::atomic<unsigned>* cellFill;
+	unsigned cellFillSize;
+
+	/*
+	* Holds the index in the particle list of each sorted particle
+	*/
+	std::vector<unsigned> order;
+
+	/*
+	* Holds the state of the particles in sorted order
+	*/
+	std::vector<real> x, y, z;
+	std::vector<real> vx, vy, vz;
+	std::vector<real> mass;
+	std::vector<real> density;
+
+	/*
+	* Holds the pressure over the square of the density, and the mass over the density,
+	* of each sorted particle, as used by the force pass
+	*/
+	std::vector<real> pressure;
+	std::vector<real> volume;
+
+	/*
+	* Holds the density of each particle, in the order of the particle list
+	*/
+	std::vector<real> densities;
+
+	/*
+	* Holds the measurements of the last step, and the pair counts added up by the threads
+	*/
+	ParticleFluidStats stats;
+	std::atomic<unsigned long long> neighborCount;
+	std::atomic<unsigned long long> candidateCount;
+
+public:
+	/*
+	* Creates an empty fluid. The passes run on the given job pool, owned by the caller,
+	* or on the calling thread if it is NULL
+	*/
+	ParticleFluid(real smoothingRadius, real restDensity, real stiffness, real viscosity, ParticleJobPool* jobs = NULL);
+
+	/*
+	* Frees the cell counters
+	*/
+	~ParticleFluid();
+
+	/*
+	* Adds a particle to the fluid. It must be a particle of finite mass
+	*/
+	void addParticle(Particle* particle);
+
+	/*
+	* Removes a particle from the fluid. The last particle takes its place in the list
+	*/
+	void removeParticle(Particle* particle);
+
+	/*
+	* Computes the densities and adds the pressure and viscosity forces to the particles.
+	* Call it after the force accumulators are cleared and before the particles are integrated
+	*/
+	void applyForces(real duration);
+
+	/*
+	* Updates the pointers to the particles after they have been moved in memory
+	*/
+	void remapParticles(const ParticleRemap& remap);
+
+	/*
+	* Returns the particles of the fluid
+	*/
+	Particles& getParticles();
+
+	/*
+	* Returns the density of each particle computed by the last step, in the order of the particle list
+	*/
+	const std::vector<real>& getDensities() const;
+
+	/*
+	* Returns the measurements of the last step
+	*/
+	const ParticleFluidStats& getStats() const;
+
+	/*
+	* Sets and gets the parameters of the fluid
+	*/
+	void setSmoothingRadius(real smoothingRadius);
+	real getSmoothingRadius() const;
+	void setRestDensity(real restDensity);
+	real getRestDensity() const;
+	void setStiffness(real stiffness);
+	real getStiffness() const;
+	void setViscosity(real viscosity);
+	real getViscosity() const;
+
+	/*
+	* Sets the job pool running the passes, NULL for the calling thread
+	*/
+	void setJobPool(ParticleJobPool* jobs);
+
+protected:
+	/*
+	* Returns the cell of the given cell coordinates
+	*/
+	unsigned hashCell(int cx, int cy, int cz) const;
+
+	/*
+	* Fills the given array with the distinct cells around the given cell coordinates.
+	* Returns their number
+	*/
+	unsigned neighborCells(int cx, int cy, int cz, unsigned* cells) const;
+
+	/*
+	* Runs a pass over the given number of items, on the job pool or the calling thread
+	*/
+	void run(ParticleJob job, unsigned count, unsigned grain);
+
+	/*
+	* The passes, run over ranges of particles
+	*/
+	static void gatherJob(void* context, unsigned begin, unsigned end);
+	static void scatterJob(void* context, unsigned begin, unsigned end);
+	static void sortCellsJob(void* context, unsigned begin, unsigned end);
+	static void copyJob(void* context, unsigned begin, unsigned end);
+	static void densityJob(void* context, unsigned begin, unsigned end);
+	static void forceJob(void* context, unsigned begin, unsigned end);
+
+};
+
+/*
+* Advances the dynamics of a world holding a fluid: clears the accumulators, applies
+* the forces of the registry and of the fluid, and integrates the particles
+*/
+class ParticleFluidSubsystem : public ParticleSubsystem
+{
+public:
+	/*
+	* Creates the subsystem for the given world and fluid
+	*/
+	ParticleFluidSubsystem(ParticleWorld* world, ParticleFluid* fluid);
+
+	/*
+	* Applies the forces and integrates the particles of the world
+	*/
+	virtual void step(real duration);
+
+private:
+	/*
+	* The world being advanced and its fluid
+	*/
+	ParticleWorld* world;
+	ParticleFluid* fluid;
+
+};
+
+}
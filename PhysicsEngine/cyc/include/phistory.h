@@ -0,0 +1,148 @@
+#pragma once
+#include <include/pworld.h>
+#include <stdint.h>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Applies the inputs of a frame while resimulating, such as the corrected
+* forces or velocities given by the player
+*/
+class ParticleHistoryInput
+{
+public:
+	/*
+	* Overload this to apply the inputs of the given frame, before it is simulated
+	*/
+	virtual void applyInput(unsigned frame) = 0;
+
+};
+
+/*
+* Keeps the recent history of the particles of a world, to rewind to a past
+* frame and resimulate it with corrected inputs.
+*
+* The history is a ring of frames. Positions and velocities are quantized to a
+* fixed quantum, and each frame only stores the particles whose quantized state
+* changed since the previous frame. Every keyframeInterval frames a keyframe
+* stores every particle, so a rewind applies at most one keyframe and
+* keyframeInterval deltas, whatever the length of the history.
+*
+* Only positions and velocities are captured: masses, damping and constant
+* accelerations are assumed not to change, and the particles of the world must
+* stay the same. A rewound state is within half a quantum of the captured one
+*/
+class ParticleHistory
+{
+public:
+	/*
+	* Holds the quantized state of a particle that changed in a frame
+	*/
+	struct Record {
+		uint32_t particle;
+		int32_t position[3];
+		int32_t velocity[3];
+	};
+
+protected:
+	/*
+	* Holds a frame of the history
+	*/
+	struct Frame {
+		unsigned number;
+		bool keyframe;
+		std::vector<Record> records;
+	};
+
+	/*
+	* Holds the world captured
+	*/
+	ParticleWorld* world;
+
+	/*
+	* Holds the ring of frames, indexed by frame number modulo its size
+	*/
+	std::vector<Frame> frames;
+
+	/*
+	* Holds the number of frames between two keyframes
+	*/
+	unsigned keyframeInterval;
+
+	/*
+	* Holds the size of a quantization step
+	*/
+	real quantum;
+
+	/*
+	* Holds the oldest and newest frame numbers stored, and whether anything is stored
+	*/
+	unsigned oldest;
+	unsigned newest;
+	bool empty;
+
+	/*
+	* Holds the quantized state of every particle in the newest frame,
+	* six values per particle, to find the ones that changed
+	*/
+	std::vector<int32_t> reference;
+
+public:
+	/*
+	* Creates a history of the given number of frames for the given world
+	*/
+	ParticleHistory(ParticleWorld* world, unsigned capacity = 64, unsigned keyframeInterval = 16, real quantum = 1e-4f);
+
+	/*
+	* Stores the current state of the world as the given frame, which must follow the newest
+	* frame stored. The first frame captured, and every frame after a clear, is a keyframe
+	*/
+	void capture(unsigned frame);
+
+	/*
+	* Puts the world back in the state of the given frame and forgets the frames after it.
+	* Returns false if the frame is not in the history any more
+	*/
+	bool rewind(unsigned frame);
+
+	/*
+	* Rewinds to the given frame, then simulates the given number of steps, applying
+	* the inputs before each step and capturing each new frame
+	*/
+	bool resimulate(unsigned frame, unsigned steps, real duration, ParticleHistoryInput* input = NULL);
+
+	/*
+	* Forgets every frame
+	*/
+	void clear();
+
+	/*
+	* Returns true if the given frame can be rewound to
+	*/
+	bool canRewind(unsigned frame) const;
+
+	/*
+	* Returns the newest frame stored
+	*/
+	unsigned getNewestFrame() const;
+
+	/*
+	* Returns the number of particle records stored across all the frames
+	*/
+	unsigned getRecordCount() const;
+
+protected:
+	/*
+	* Returns the oldest keyframe stored, that rewinds can start from
+	*/
+	unsigned getOldestKeyframe() const;
+
+	/*
+	* Quantizes a value
+	*/
+	int32_t quantize(real value) const;
+
+};
+
+}
@@ -0,0 +1,125 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* A job run over a range of items: it processes the items from begin to end
+*/
+typedef void (*ParticleJob)(void* context, unsigned begin, unsigned end);
+
+/*
+* A pool of worker threads running jobs over ranges of items. The items are handed
+* out in chunks of the given grain from a shared counter, so threads that finish early
+* take more work. The calling thread works too, and run only returns once every item
+* has been processed.
+*
+* The threads are created once and sleep between jobs. Only one job runs at a time,
+* and run must always be called from the same thread.
+*
+* runStatic instead gives each thread the same range of items every time, so a thread
+* keeps touching the same memory from job to job. With the workers pinned to their own
+* processors, memory first written in a static job lives on the node of the thread
+* that processes it afterwards
+*/
+class ParticleJobPool
+{
+protected:
+	/*
+	* Holds the worker threads
+	*/
+	std::vector<std::thread> workers;
+
+	/*
+	* Holds the current job
+	*/
+	ParticleJob job;
+	void* context;
+	unsigned count;
+	unsigned grain;
+
+	/*
+	* True if the current job is split in one fixed range per thread
+	*/
+	bool partitioned;
+
+	/*
+	* Holds the next item to hand out, and the number of workers still in the job
+	*/
+	std::atomic<unsigned> next;
+	std::atomic<unsigned> busy;
+
+	/*
+	* Holds the number of the current job, to wake the workers, and whether they should exit
+	*/
+	unsigned generation;
+	bool stopping;
+
+	std::mutex mutex;
+	std::condition_variable started;
+	std::condition_variable finished;
+
+public:
+	/*
+	* Creates a pool with the given number of threads, the calling thread included.
+	* Zero uses one thread per hardware thread. If pinned, worker i only runs on the
+	* i-th of the processors the calling thread may run on, the first one being left to
+	* the calling thread, thread 0, whose own affinity is never changed
+	*/
+	ParticleJobPool(unsigned threads = 0, bool pinned = false);
+
+	/*
+	* Stops and joins the worker threads
+	*/
+	~ParticleJobPool();
+
+	/*
+	* Runs the job over the items from 0 to count, in chunks of grain items
+	*/
+	void run(ParticleJob job, void* context, unsigned count, unsigned grain);
+
+	/*
+	* Runs the job over the items from 0 to count, thread i taking the i-th of as many
+	* equal ranges as there are threads
+	*/
+	void runStatic(ParticleJob job, void* context, unsigned count);
+
+	/*
+	* Returns the number of threads, the calling thread included
+	*/
+	unsigned getThreadCount() const;
+
+protected:
+	/*
+	* Starts the current job on the workers, works on it and waits for them
+	*/
+	void dispatch();
+
+	/*
+	* Takes chunks of the current job until there are none left, or the range of the
+	* thread of the given index for a static job
+	*/
+	void work(unsigned index);
+
+	/*
+	* The body of the worker threads
+	*/
+	void workerLoop(unsigned index, int processor);
+
+	/*
+	* Fills the list with the processors the calling thread may run on
+	*/
+	static void getAllowedProcessors(std::vector<unsigned>* processors);
+
+	/*
+	* Restricts the calling thread to the given processor
+	*/
+	static void pin(unsigned processor);
+
+};
+
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <include/particle.h>
 #include <include/pcontacts.h>
+#include <include/pfgen.h>
 
 
 namespace cyclone {
@@ -10,19 +11,23 @@ namespace cyclone {
 	* the constraints of their link. It is used as a base class for cables and rods, and could
 	* be used as a base class for spring with a limit to their extension.
 	*/
-	class ParticleLink
+	template<class P>
+	class ParticleLinkT
 	{
 	public:
+		typedef typename P::Scalar Scalar;
+		typedef Vector3T<Scalar> Vector;
+
 		/*
 		* Holds the pair of particle that are connected by this link
 		*/
-		Particle* particle[2];
+		ParticleT<P>* particle[2];
 
 	protected:
 		/*
 		* Returns the current length of the cable.
 		*/
-		real currentLength() const;
+		Scalar currentLength() const;
 
 	public:
 		/*
@@ -39,30 +44,42 @@ namespace cyclone {
 		* and the return value is either 0, if the cable wasnt
 		* overextended, or one if a contact was needed.
 		*/
-		virtual unsigned fillContact(ParticleContact* contact, unsigned limit) const = 0;
+		virtual unsigned fillContact(ParticleContactT<P>* contact, unsigned limit) const = 0;
+
+		/*
+		* Updates the pointers to the particles after they have been moved in memory.
+		* The world calls it on its links; overload it in links holding other pointers
+		*/
+		virtual void remapParticles(const ParticleRemapT<P>& remap);
 
 	};
 
 	/*
 	* Cable links a pair of particle, generating a contact if they stray too far apart
 	*/
-	class ParticleCable : public ParticleLink
+	template<class P>
+	class ParticleCableT : public ParticleLinkT<P>
 	{
 	public:
+		typedef typename P::Scalar Scalar;
+		typedef Vector3T<Scalar> Vector;
+		using ParticleLinkT<P>::particle;
+		using ParticleLinkT<P>::currentLength;
+
 		/*
 		* Holds the max length of the cable
 		*/
-		real maxLength;
+		Scalar maxLength;
 
 		/*
 		* Holds the restitution of the cable (bounciness)
 		*/
-		real restitution;
+		Scalar restitution;
 
 		/*
 		* Fills the given contact structure with the contact need to keep the cable from overextending
 		*/
-		virtual unsigned fillContact(ParticleContact* contact, unsigned limit) const;
+		virtual unsigned fillContact(ParticleContactT<P>* contact, unsigned limit) const;
 
 	};
 
@@ -70,28 +87,39 @@ namespace cyclone {
 	* Rods links a pair of particle, generating a contact if they stray too far apart
 	* or if they get too close
 	*/
-	class ParticleRod : public ParticleLink
-
+	template<class P>
+	class ParticleRodT : public ParticleLinkT<P>
 	{
 	public:
+		typedef typename P::Scalar Scalar;
+		typedef Vector3T<Scalar> Vector;
+		using ParticleLinkT<P>::particle;
+
 		/*
 		* Holds the length of the rod
 		*/
-		real length;
+		Scalar length;
 
 		/*
 		* Returns the current length of the rod
 		*/
-		real currentLength() const;
+		Scalar currentLength() const;
 
 		/*
 		* Fills the given structure with the contact needed to keep the rod from extending or compressing
 		*/
-		virtual unsigned fillContact(ParticleContact* contact, unsigned limit) const;
+		virtual unsigned fillContact(ParticleContactT<P>* contact, unsigned limit) const;
 		
 
 	private:
 
 	};
 
+	/*
+	* The links of the precision of the engine
+	*/
+	typedef ParticleLinkT<RealPrecision> ParticleLink;
+	typedef ParticleCableT<RealPrecision> ParticleCable;
+	typedef ParticleRodT<RealPrecision> ParticleRod;
+
 }
\ No newline at end of file
@@ -0,0 +1,66 @@
+#pragma once
+#include <include/precision.h>
+
+namespace cyclone {
+
+/*
+* Batch math kernels, applying an operator to count values of an array and writing
+* the results to another one, which can be the same array.
+*
+* The float versions are polynomial approximations (after the Cephes library) that
+* work on four values at a time with SSE2 when it is available, and one at a time
+* with the same polynomials otherwise, so they give the same results on every
+* platform. Their error bounds below were measured against the double precision
+* functions of the C library over the whole domain given. An ulp is the distance
+* between two consecutive floats around the exact result.
+*
+* The double versions call the C library, they are there so that templated code can
+* call the kernels whatever its precision.
+*/
+
+/*
+* Sine and cosine. Absolute error under 1e-7 for |x| <= 8192,
+* the argument reduction loses accuracy beyond that
+*/
+void batchSin(const float* values, float* results, unsigned count);
+void batchCos(const float* values, float* results, unsigned count);
+void batchSin(const double* values, double* results, unsigned count);
+void batchCos(const double* values, double* results, unsigned count);
+
+/*
+* Sine and cosine of the same values, cheaper than calling both
+*/
+void batchSinCos(const float* values, float* sines, float* cosines, unsigned count);
+void batchSinCos(const double* values, double* sines, double* cosines, unsigned count);
+
+/*
+* Exponential. Relative error under 1 ulp. Values are clamped to [-87.3, 88.3],
+* so the results stay normal floats
+*/
+void batchExp(const float* values, float* results, unsigned count);
+void batchExp(const double* values, double* results, unsigned count);
+
+/*
+* Natural logarithm of positive values. Error under 1 ulp of the result,
+* or 3e-8 near 1 where the result goes to zero
+*/
+void batchLog(const float* values, float* results, unsigned count);
+void batchLog(const double* values, double* results, unsigned count);
+
+/*
+* Raises bases to the same positive exponent, as exp(exponent * log(base)). Bases
+* that aren't positive give 0. Relative error under 2.5e-7 + 1.2e-7 * |exponent * log(base)|,
+* up to 9e-6 (150 ulp) for the largest results, as the product is rounded to a float
+* before the exponential. For damping factors from 0.001 to 1 and steps up to 0.1,
+* it is under 1.1e-7 (2 ulp). Results may be the bases array
+*/
+void batchPow(const float* bases, float exponent, float* results, unsigned count);
+void batchPow(const double* bases, double exponent, double* results, unsigned count);
+
+/*
+* Inverse square root of positive values. Relative error under 2.5e-7 (2 ulp)
+*/
+void batchRsqrt(const float* values, float* results, unsigned count);
+void batchRsqrt(const double* values, double* results, unsigned count);
+
+}
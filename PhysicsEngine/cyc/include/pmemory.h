@@ -0,0 +1,334 @@
+#pragma once
+#include <include/pjobs.h>
+#include <include/precision.h>
+#include <stddef.h>
+#include <new>
+#include <utility>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Holds the allocation statistics of a pool or an arena
+*/
+struct ParticleAllocationStats
+{
+	/*
+	* Holds the number of bytes currently held from the system
+	*/
+	size_t bytesReserved;
+
+	/*
+	* Holds the number of bytes currently handed out
+	*/
+	size_t bytesInUse;
+
+	/*
+	* Holds the highest number of bytes handed out at the same time
+	*/
+	size_t peakBytesInUse;
+
+	/*
+	* Holds the number of allocations served
+	*/
+	unsigned allocations;
+
+	/*
+	* Holds the number of deallocations (or resets, for an arena)
+	*/
+	unsigned deallocations;
+
+	/*
+	* Holds the number of times memory had to be requested from the system
+	*/
+	unsigned systemAllocations;
+
+	/*
+	* Adds the given statistics to these ones
+	*/
+	void operator+=(const ParticleAllocationStats& stats);
+};
+
+/*
+* Requests memory from the system in whole pages. The pages are only given physical
+* memory when first written, on the NUMA node of the thread writing them, so memory
+* written first by the thread that uses it most stays local to it.
+*
+* With huge pages the size is rounded up to 2 MB pages, which cover the particles with
+* far fewer TLB entries: explicit huge pages if the system has some reserved, and
+* otherwise pages the system is asked to back with transparent huge pages. Physical
+* memory then comes in whole huge pages, each on the node of its first writer
+*/
+class ParticlePages
+{
+public:
+	/*
+	* The size of a huge page
+	*/
+	static const size_t hugePageSize = 2 * 1024 * 1024;
+
+	/*
+	* Returns at least size bytes of zeroed memory aligned to a page, and sets size to
+	* the bytes actually reserved, to give back to release. Returns NULL if the system
+	* has no memory left
+	*/
+	static void* allocate(size_t* size, bool hugePages);
+
+	/*
+	* Gives back memory returned by allocate, with the size it set
+	*/
+	static void release(void* memory, size_t size);
+};
+
+/*
+* A pool of fixed size objects. Memory is requested from the system in blocks
+* of many objects, and freed objects go to a free list to be reused, so after
+* the pool has grown to its working size no more system allocations happen.
+*
+* The blocks come from ParticlePages and are handed out in memory order, only
+* written when handed out, so firstTouch can place the pages of the objects to come
+* on the nodes of the threads that will process them
+*/
+class ParticleBlockPool
+{
+protected:
+	/*
+	* Holds the size of each object, rounded up to hold the free list link and keep the alignment
+	*/
+	size_t objectSize;
+
+	/*
+	* Holds the number of objects in each block
+	*/
+	unsigned objectsPerBlock;
+
+	/*
+	* Holds the blocks requested from the system and their sizes
+	*/
+	std::vector<char*> blocks;
+	std::vector<size_t> blockSizes;
+
+	/*
+	* Holds the first free object, each free object holds the next one
+	*/
+	void* freeList;
+
+	/*
+	* Holds the block objects are taken from once the free list is empty, and the
+	* offset of the next object in it, never handed out before
+	*/
+	unsigned carveBlock;
+	size_t carveOffset;
+
+	/*
+	* Holds the number of objects the blocks can hold
+	*/
+	size_t capacity;
+
+	/*
+	* True if the blocks are requested in huge pages
+	*/
+	bool hugePages;
+
+	/*
+	* Holds the statistics of the pool
+	*/
+	ParticleAllocationStats stats;
+
+public:
+	/*
+	* Creates a pool of objects of the given size
+	*/
+	ParticleBlockPool(size_t objectSize, unsigned objectsPerBlock = 1024);
+
+	/*
+	* Returns all the blocks to the system. Objects still allocated are not destroyed
+	*/
+	~ParticleBlockPool();
+
+	/*
+	* Returns the memory for a single object
+	*/
+	void* allocate();
+
+	/*
+	* Puts the given object back in the free list
+	*/
+	void deallocate(void* object);
+
+	/*
+	* Makes sure at least the given number of objects can be allocated without requesting memory from the system
+	*/
+	void reserve(unsigned count);
+
+	/*
+	* Writes the memory of the next count objects to be handed out on the threads of
+	* the pool, so the object handed out i-th from now lives on the node of the thread
+	* processing item firstItem + i of a static job over firstItem + count items. Call
+	* it after reserve, with the number of items already processed by the static jobs
+	*/
+	void firstTouch(ParticleJobPool* jobs, unsigned firstItem, unsigned count);
+
+	/*
+	* Sets whether the next blocks are requested in huge pages. A block then holds as
+	* many objects as fit in whole huge pages
+	*/
+	void setHugePages(bool hugePages);
+
+	/*
+	* Gets the statistics of the pool
+	*/
+	const ParticleAllocationStats& getStats() const;
+
+private:
+	/*
+	* Requests a new block from the system
+	*/
+	void grow();
+
+	/*
+	* Writes the objects of a static job over the objects never handed out
+	*/
+	static void touchJob(void* context, unsigned begin, unsigned end);
+
+	/*
+	* Pools can't be copied
+	*/
+	ParticleBlockPool(const ParticleBlockPool&);
+	ParticleBlockPool& operator=(const ParticleBlockPool&);
+};
+
+/*
+* A typed pool, constructing and destroying the objects it hands out
+*/
+template<class T>
+class ParticlePool : public ParticleBlockPool
+{
+public:
+	/*
+	* Creates a pool of objects of type T
+	*/
+	ParticlePool(unsigned objectsPerBlock = 1024) : ParticleBlockPool(sizeof(T), objectsPerBlock) {}
+
+	/*
+	* Creates a new object with the given constructor arguments
+	*/
+	template<class... Args>
+	T* create(Args&&... args) {
+		return new (allocate()) T(std::forward<Args>(args)...);
+	}
+
+	/*
+	* Destroys the given object and puts its memory back in the pool
+	*/
+	void destroy(T* object) {
+		object->~T();
+		deallocate(object);
+	}
+};
+
+/*
+* A linear allocator for data that only lives for a single step, such as contacts.
+* Allocation moves an offset forward and reset moves it back to zero in O(1).
+* When a step needs more than the capacity the extra memory is served from
+* overflow chunks, and the next reset grows the arena to the peak, so a
+* steady state simulation stops requesting memory from the system
+*/
+class ParticleArena
+{
+protected:
+	/*
+	* Holds the main buffer
+	*/
+	char* memory;
+
+	/*
+	* Holds the size of the main buffer
+	*/
+	size_t capacity;
+
+	/*
+	* True if the main buffer should be in huge pages, and if it is
+	*/
+	bool hugePages;
+	bool bufferHugePages;
+
+	/*
+	* Holds the offset of the first free byte of the main buffer
+	*/
+	size_t offset;
+
+	/*
+	* Holds the chunks allocated when the main buffer ran out, freed on reset
+	*/
+	std::vector<char*> overflow;
+
+	/*
+	* Holds the bytes used since the last reset, including the overflow, and the bytes
+	* of the overflow chunks
+	*/
+	size_t used;
+	size_t overflowBytes;
+
+	/*
+	* Holds the statistics of the arena
+	*/
+	ParticleAllocationStats stats;
+
+public:
+	/*
+	* Creates an arena with the given initial capacity in bytes
+	*/
+	ParticleArena(size_t capacity = 64 * 1024);
+
+	/*
+	* Returns the memory to the system
+	*/
+	~ParticleArena();
+
+	/*
+	* Returns size bytes aligned to the given power of two
+	*/
+	void* allocate(size_t size, size_t alignment = 16);
+
+	/*
+	* Returns an array of count default constructed objects. The destructors are never
+	* called, so this must only be used for types that don't need them
+	*/
+	template<class T>
+	T* allocateArray(unsigned count) {
+		T* array = (T*)allocate(sizeof(T) * count, alignof(T) > 16 ? alignof(T) : 16);
+		for (unsigned i = 0; i < count; i++) new (array + i) T();
+		return array;
+	}
+
+	/*
+	* Releases everything allocated since the last reset
+	*/
+	void reset();
+
+	/*
+	* Sets whether the main buffer is in huge pages. It is replaced at once if nothing
+	* is allocated, and at the next reset otherwise
+	*/
+	void setHugePages(bool hugePages);
+
+	/*
+	* Gets the statistics of the arena
+	*/
+	const ParticleAllocationStats& getStats() const;
+
+private:
+	/*
+	* Replaces the main buffer with one of the given size
+	*/
+	void replaceBuffer(size_t capacity);
+
+	/*
+	* Arenas can't be copied
+	*/
+	ParticleArena(const ParticleArena&);
+	ParticleArena& operator=(const ParticleArena&);
+};
+
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <include/pworld.h>
+#include <utility>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Multirate integrator for the particles of a world. Each particle is put
+* in a bin whose timestep is the world step divided by a power of two, picked
+* from its velocity, its acceleration and the stiffness of the springs acting on it.
+* Bin L is stepped 2^L times per world step, so slow particles are integrated
+* only once while fast or stiff ones get the substeps they need.
+*
+* Forces are synchronized across bins: at every substep the forces of all the bins
+* that start a step there are evaluated before any of them is integrated, and the
+* boundaries of a coarse bin always line up with the boundaries of the finer ones
+*/
+class ParticleMultirate
+{
+protected:
+	/*
+	* Holds the world whose particles are integrated
+	*/
+	ParticleWorld* world;
+
+	/*
+	* Holds the deepest bin allowed, particles are never stepped more than 2^maxLevel times per step
+	*/
+	unsigned maxLevel;
+
+	/*
+	* Holds the fraction of the spring period a single step can cover
+	*/
+	real accuracy;
+
+	/*
+	* Holds the maximum distance a particle can travel in a single step
+	*/
+	real maxDisplacement;
+
+	/*
+	* Holds the deepest bin used in the current step
+	*/
+	unsigned deepestLevel;
+
+	/*
+	* Holds the bin of each particle of the world, indexed as the world particles
+	*/
+	std::vector<unsigned> levels;
+
+	/*
+	* Holds the particles of each bin
+	*/
+	std::vector<ParticleWorld::Particles> binParticles;
+
+	/*
+	* Holds the force registrations of each bin, by the bin of the particle they apply to
+	*/
+	std::vector<ParticleForceRegistry::Registry> binRegistrations;
+
+	/*
+	* Holds the stiffness acting on each particle, used while assigning the bins
+	*/
+	std::vector<real> stiffness;
+
+	/*
+	* Maps a particle to its index in the world, sorted by particle so it can be searched.
+	* It is rebuilt when the bins are assigned and keeps its capacity, so stepping doesn't allocate
+	*/
+	typedef std::pair<Particle*, unsigned> ParticleIndex;
+	std::vector<ParticleIndex> indices;
+
+	/*
+	* Holds the number of particle integrations done in the last step
+	*/
+	unsigned integrations;
+
+public:
+	/*
+	* Creates a multirate integrator for the given world
+	*
+	* @param maxLevel The deepest bin allowed
+	* @param accuracy The fraction of the period of a spring a step can cover
+	* @param maxDisplacement The maximum distance a particle can travel in one step
+	*/
+	ParticleMultirate(ParticleWorld* world, unsigned maxLevel = 4, real accuracy = 0.05f, real maxDisplacement = 0.1f);
+
+	/*
+	* Processes all the physics of the world for one step, integrating each bin at its own rate.
+	* Contacts are resolved once at the end of the step
+	*/
+	void runPhysics(real duration);
+
+	/*
+	* Gets the bin of the given particle, by its index in the world
+	*/
+	unsigned getLevel(unsigned index) const;
+
+	/*
+	* Gets the number of particles in the given bin
+	*/
+	unsigned getBinSize(unsigned level) const;
+
+	/*
+	* Gets the number of particle integrations done in the last step.
+	* A single rate integration at the deepest bin would have done 2^deepest per particle
+	*/
+	unsigned getIntegrationCount() const;
+
+protected:
+	/*
+	* Puts every particle in its bin, using the forces accumulated at the start of the step
+	*/
+	void assignBins(real duration);
+
+	/*
+	* Returns the bin for a particle that needs a step no longer than maxStep
+	*/
+	unsigned levelFor(real duration, real maxStep) const;
+
+	/*
+	* Returns the index of the given particle in the world, or -1 if it is not in the world
+	*/
+	int findIndex(Particle* particle) const;
+
+};
+
+}
@@ -0,0 +1,235 @@
+#pragma once
+#include <include/pfgen.h>
+#include <include/plinks.h>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Holds the measurements of a neighbor list
+*/
+struct ParticleNeighborStats
+{
+	/*
+	* Holds the number of updates, and the number of them that rebuilt the lists
+	*/
+	unsigned updates;
+	unsigned builds;
+
+	/*
+	* Holds the number of updates since the last build
+	*/
+	unsigned updatesSinceBuild;
+
+	/*
+	* Holds the number of pairs in the lists
+	*/
+	unsigned pairs;
+
+	/*
+	* Holds the largest displacement since the last build, as of the last update
+	*/
+	real maxDisplacement;
+};
+
+/*
+* Verlet neighbor lists: for each particle, the particles closer than the cutoff plus
+* a skin when the lists were built. As long as no particle has moved more than half
+* the skin since, every pair closer than the cutoff is still in the lists, so they are
+* only rebuilt when some particle goes further. A larger skin rebuilds less often but
+* gives longer lists.
+*
+* The lists are in compressed sparse rows: the neighbors of particle i are from
+* getOffsets()[i] to getOffsets()[i + 1] in getNeighbors(), as indices in the particle
+* list. Each pair is stored once, in the list of its lower index, so a pass over the
+* lists visits every pair once.
+*
+* Builds hash the particles into cells as wide as the cutoff plus the skin and test
+* the 27 cells around each particle
+*/
+class ParticleNeighborList
+{
+public:
+	typedef std::vector<Particle*> Particles;
+
+protected:
+	/*
+	* Holds the particles
+	*/
+	Particles particles;
+
+	/*
+	* Holds the distance within which pairs must be found, and the margin added to it
+	*/
+	real cutoff;
+	real skin;
+
+	/*
+	* Holds the lists
+	*/
+	std::vector<unsigned> offsets;
+	std::vector<unsigned> neighbors;
+
+	/*
+	* Holds the positions of the particles when the lists were built
+	*/
+	std::vector<Vector3> buildPositions;
+
+	/*
+	* True if the particles have changed since the last build
+	*/
+	bool changed;
+
+	/*
+	* Holds the hash table of the cells used by the builds: the first sorted particle
+	* of each cell, the cell of each particle, and the particles sorted by cell
+	*/
+	std::vector<unsigned> cellStart;
+	std::vector<unsigned> cellOf;
+	std::vector<unsigned> sorted;
+
+	/*
+	* Holds the measurements
+	*/
+	ParticleNeighborStats stats;
+
+public:
+	/*
+	* Creates empty lists for the given cutoff and skin
+	*/
+	ParticleNeighborList(real cutoff, real skin);
+
+	/*
+	* Adds a particle. The lists are rebuilt at the next update
+	*/
+	void addParticle(Particle* particle);
+
+	/*
+	* Removes a particle. The last particle takes its place, and the lists are rebuilt at the next update
+	*/
+	void removeParticle(Particle* particle);
+
+	/*
+	* Rebuilds the lists if some particle has moved more than half the skin since the
+	* last build, or if the particles have changed. Returns true if it did
+	*/
+	bool update();
+
+	/*
+	* Rebuilds the lists now
+	*/
+	void build();
+
+	/*
+	* Updates the pointers to the particles after they have been moved in memory
+	*/
+	void remapParticles(const ParticleRemap& remap);
+
+	/*
+	* Returns the particles
+	*/
+	Particles& getParticles();
+
+	/*
+	* Returns the offsets of the lists, one more than the number of particles
+	*/
+	const unsigned* getOffsets() const;
+
+	/*
+	* Returns the neighbors of all the particles, list after list
+	*/
+	const unsigned* getNeighbors() const;
+
+	/*
+	* Returns the cutoff
+	*/
+	real getCutoff() const;
+
+	/*
+	* Sets and gets the skin. A new skin is used from the next build
+	*/
+	void setSkin(real skin);
+	real getSkin() const;
+
+	/*
+	* Returns the measurements
+	*/
+	const ParticleNeighborStats& getStats() const;
+
+};
+
+/*
+* Generates a contact for each pair of particles of a neighbor list closer than twice
+* the radius, as if they were spheres. It updates the list before filling the contacts,
+* so it should be added to the links of the world after the particles are integrated.
+* The cutoff of the list must be at least twice the radius. The world remaps the list
+* through the link, so a list should be used by a single one of them
+*/
+class ParticleSphereContacts : public ParticleLink
+{
+public:
+	/*
+	* Holds the list of the particles
+	*/
+	ParticleNeighborList* list;
+
+	/*
+	* Holds the radius of the particles and the restitution of their contacts
+	*/
+	real radius;
+	real restitution;
+
+	/*
+	* Creates the contacts for the particles of the given list
+	*/
+	ParticleSphereContacts(ParticleNeighborList* list, real radius, real restitution);
+
+	/*
+	* Fills a contact for each pair of overlapping spheres, up to the limit
+	*/
+	virtual unsigned fillContact(ParticleContact* contact, unsigned limit) const;
+
+	/*
+	* Remaps the particles of the list
+	*/
+	virtual void remapParticles(const ParticleRemap& remap);
+
+};
+
+/*
+* A soft-sphere repulsion between the particles of a neighbor list, as used for dense
+* granular matter: pairs closer than twice the radius are pushed apart by a spring on
+* their overlap and a damper on their normal velocity, and are never pulled together.
+* It updates the list before applying the forces, so it can be used alone. The cutoff
+* of the list must be at least twice the radius
+*/
+class ParticleNeighborForce
+{
+protected:
+	/*
+	* Holds the list of the particles
+	*/
+	ParticleNeighborList* list;
+
+	/*
+	* Holds the radius of the particles, and the stiffness and damping of the contacts
+	*/
+	real radius;
+	real stiffness;
+	real damping;
+
+public:
+	/*
+	* Creates the force for the particles of the given list
+	*/
+	ParticleNeighborForce(ParticleNeighborList* list, real radius, real stiffness, real damping);
+
+	/*
+	* Adds the forces to the particles. Call it after the force accumulators are cleared
+	* and before the particles are integrated
+	*/
+	void applyForces();
+
+};
+
+}
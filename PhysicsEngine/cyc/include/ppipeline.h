@@ -0,0 +1,201 @@
+#pragma once
+#include <include/ptaskgraph.h>
+#include <include/pworld.h>
+#include <unordered_map>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Holds the measurements of a pipeline
+*/
+struct ParticlePipelineStats
+{
+	/*
+	* Holds the number of islands, the number of particles of the largest, and the
+	* number of groups of islands simulated by the same tasks
+	*/
+	unsigned islands;
+	unsigned largestIsland;
+	unsigned groups;
+
+	/*
+	* Holds the number of registrations of generators that can't run concurrently, and
+	* of links that aren't between two particles of the world
+	*/
+	unsigned serialRegistrations;
+	unsigned globalLinks;
+
+	/*
+	* Holds the number of contacts resolved by the last step
+	*/
+	unsigned contacts;
+
+	/*
+	* Holds the number of times the islands were found
+	*/
+	unsigned rebuilds;
+};
+
+/*
+* Runs the steps of a world as a graph of tasks on a job pool, instead of one phase
+* after another over the whole world. The particles are split into islands, the sets
+* of particles joined by links or by generators referring to other particles, found
+* through remapParticles. Small islands are grouped so each group has about the grain
+* of particles, and large ones are split in chunks of about the grain.
+*
+* For each group, the forces of each chunk are applied, then once every force of the
+* group is final its chunks are integrated, then the contacts of its links are generated
+* and resolved. Nothing waits for the other groups, so the contacts of one group are
+* resolved while another is still integrating. Generators that aren't concurrent are
+* applied first, in one task, and links that aren't between two particles of the world,
+* such as sphere contacts, are generated and resolved last, in one task.
+*
+* The contacts of each group are resolved on their own, with twice their number of
+* iterations if the world calculates them, so the result can differ from runPhysics of
+* the world, which resolves every contact together. The force cache of the registry
+* isn't used. The islands are found again when the number of particles, registrations
+* or links changes; invalidate must be called after other changes, such as particles
+* reordered in memory or a registration replaced by another
+*/
+class ParticlePipeline
+{
+protected:
+	/*
+	* Holds the registrations applied by a chunk, or the links and the contacts of a group
+	*/
+	struct Span {
+		ParticlePipeline* pipeline;
+		unsigned registrationBegin;
+		unsigned registrationEnd;
+		unsigned linkBegin;
+		unsigned linkEnd;
+		unsigned contactCount;
+	};
+
+	/*
+	* Holds the world, the job pool running the tasks, and the grain
+	*/
+	ParticleWorld* world;
+	ParticleJobPool* jobs;
+	unsigned grain;
+
+	/*
+	* Holds the graph of a step
+	*/
+	ParticleTaskGraph graph;
+
+	/*
+	* Holds the particles island after island, the registrations of each chunk and of
+	* the serial task, the links of each group and the global links
+	*/
+	std::vector<Particle*> ordered;
+	ParticleForceRegistry::Registry registrations;
+	ParticleForceRegistry::Registry serialRegistrations;
+	ParticleWorld::Links links;
+	ParticleWorld::Links globalLinks;
+
+	/*
+	* Holds the spans of the chunks and of the groups
+	*/
+	std::vector<Span> spans;
+
+	/*
+	* Holds the contacts of the current step, those of the groups then the global ones
+	*/
+	ParticleContact* contacts;
+	unsigned globalContactCount;
+
+	/*
+	* Holds the duration of the current step
+	*/
+	real duration;
+
+	/*
+	* True if the islands are up to date, and the sizes they were found for
+	*/
+	bool valid;
+	size_t particleCount;
+	size_t registrationCount;
+	size_t linkCount;
+	Particle* firstParticle;
+
+	/*
+	* Holds the index of each particle and the particles each generator refers to,
+	* kept to avoid allocating
+	*/
+	std::unordered_map<Particle*, unsigned> indices;
+	std::vector<unsigned> parents;
+	std::vector<Particle*> referenced;
+
+	/*
+	* Holds the measurements
+	*/
+	ParticlePipelineStats stats;
+
+public:
+	/*
+	* Creates a pipeline for the given world, running its tasks on the given pool, or on
+	* the calling thread if it is NULL
+	*/
+	ParticlePipeline(ParticleWorld* world, ParticleJobPool* jobs = NULL, unsigned grain = 1024);
+
+	/*
+	* Finds the islands again at the next step
+	*/
+	void invalidate();
+
+	/*
+	* Processes all the physics of the world for one step: forces, integration and
+	* constraints, each group as soon as it can
+	*/
+	void runPhysics(real duration);
+
+	/*
+	* Returns the graph of the steps, to measure and trace the last one
+	*/
+	const ParticleTaskGraph& getGraph() const;
+
+	/*
+	* Returns the measurements
+	*/
+	const ParticlePipelineStats& getStats() const;
+
+protected:
+	/*
+	* Finds the islands and builds the graph of the steps
+	*/
+	void build();
+
+	/*
+	* Returns the island of a particle, by its index
+	*/
+	unsigned findIsland(unsigned index);
+
+	/*
+	* Applies the forces of the given registrations
+	*/
+	void applyForces(const ParticleForceRegistry::ParticleForceRegistration* registrations, unsigned count);
+
+	/*
+	* Resolves the given contacts with the iterations of the world
+	*/
+	void resolve(ParticleContact* contacts, unsigned count);
+
+	/*
+	* The jobs of the tasks
+	*/
+	static void serialForcesJob(void* context, unsigned begin, unsigned end);
+	static void forcesJob(void* context, unsigned begin, unsigned end);
+	static void integrateJob(void* context, unsigned begin, unsigned end);
+	static void contactsJob(void* context, unsigned begin, unsigned end);
+	static void resolveJob(void* context, unsigned begin, unsigned end);
+	static void globalJob(void* context, unsigned begin, unsigned end);
+
+private:
+	ParticlePipeline(const ParticlePipeline&);
+	ParticlePipeline& operator=(const ParticlePipeline&);
+
+};
+
+}
@@ -0,0 +1,216 @@
+#pragma once
+#include <include/precision.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Holds the profiling statistics gathered over a number of frames
+*/
+struct ParticleProfileStats
+{
+	/*
+	* The phases of a frame that are timed
+	*/
+	enum Phase {
+		PhaseForces,
+		PhaseIntegrate,
+		PhaseContacts,
+		PhaseResolve,
+		PhaseCount
+	};
+
+	/*
+	* The values counted every frame
+	*/
+	enum Counter {
+		CounterRegistrations,
+		CounterContactsGenerated,
+		CounterContactsResolved,
+		CounterIterations,
+		CounterParticlesResting,
+		CounterForcesReused,
+		CounterCount
+	};
+
+	/*
+	* Bucket i of a histogram counts the phases that took from 2^i to 2^(i+1) nanoseconds
+	*/
+	static const unsigned histogramBuckets = 32;
+
+	/*
+	* Holds the number of frames profiled
+	*/
+	uint64_t frames;
+
+	/*
+	* Holds the total, last and longest time of each phase, in nanoseconds
+	*/
+	uint64_t totalTime[PhaseCount];
+	uint64_t lastTime[PhaseCount];
+	uint64_t maxTime[PhaseCount];
+
+	/*
+	* Holds the total of each counter, and its value in the last frame
+	*/
+	uint64_t totalCount[CounterCount];
+	uint64_t lastCount[CounterCount];
+
+	/*
+	* Holds the histogram of the times of each phase
+	*/
+	uint32_t histogram[PhaseCount][histogramBuckets];
+
+	/*
+	* Returns the average time of the given phase per frame, in nanoseconds
+	*/
+	double getAverageTime(Phase phase) const;
+
+	/*
+	* Returns the average value of the given counter per frame
+	*/
+	double getAverageCount(Counter counter) const;
+};
+
+/*
+* Gathers the timers, counters and histograms of the world, and records them
+* as trace events that can be exported to the Chrome trace format (viewed in
+* chrome://tracing or Perfetto).
+*
+* The world only feeds a profiler when the engine is compiled with CYCLONE_PROFILE
+* defined. Otherwise the profiling macros are empty and cost nothing, and a profiler
+* given to the world stays empty.
+*
+* The events are kept in a buffer allocated up front, and the ones that don't fit
+* are dropped, so profiling doesn't allocate while the simulation runs
+*/
+class ParticleProfiler
+{
+protected:
+	/*
+	* Holds a trace event: a phase with its duration or a counter with its value
+	*/
+	struct Event {
+		uint64_t start;
+		uint64_t value;
+		uint8_t phase;
+		uint8_t isCounter;
+	};
+
+	/*
+	* Holds the statistics
+	*/
+	ParticleProfileStats stats;
+
+	/*
+	* Holds the trace events, up to maxEvents
+	*/
+	std::vector<Event> events;
+	size_t maxEvents;
+
+	/*
+	* Holds the number of events dropped because the buffer was full
+	*/
+	uint64_t droppedEvents;
+
+	/*
+	* Holds the time the profiler was created or reset, the origin of the trace
+	*/
+	uint64_t origin;
+
+public:
+	/*
+	* Creates a profiler that keeps up to the given number of trace events
+	*/
+	ParticleProfiler(size_t maxEvents = 1 << 16);
+
+	/*
+	* Returns the current time in nanoseconds, from a monotonic clock
+	*/
+	static uint64_t now();
+
+	/*
+	* Starts a new frame
+	*/
+	void beginFrame();
+
+	/*
+	* Records the time spent in a phase between the given times, from now()
+	*/
+	void recordPhase(ParticleProfileStats::Phase phase, uint64_t start, uint64_t end);
+
+	/*
+	* Records the value of a counter for the current frame
+	*/
+	void recordCount(ParticleProfileStats::Counter counter, uint64_t value);
+
+	/*
+	* Returns the statistics
+	*/
+	const ParticleProfileStats& getStats() const;
+
+	/*
+	* Returns the number of trace events recorded, and the number dropped
+	*/
+	size_t getEventCount() const;
+	uint64_t getDroppedEvents() const;
+
+	/*
+	* Forgets the statistics and the trace events
+	*/
+	void reset();
+
+	/*
+	* Writes the trace events to the given file as Chrome trace JSON.
+	* Returns false if the file can't be written
+	*/
+	bool exportTrace(const char* path) const;
+
+	/*
+	* Returns the name of a phase or a counter
+	*/
+	static const char* getPhaseName(ParticleProfileStats::Phase phase);
+	static const char* getCounterName(ParticleProfileStats::Counter counter);
+
+};
+
+/*
+* Times the phase it is created for, until it goes out of scope
+*/
+class ParticleProfileScope
+{
+protected:
+	ParticleProfiler* profiler;
+	ParticleProfileStats::Phase phase;
+	uint64_t start;
+
+public:
+	ParticleProfileScope(ParticleProfiler* profiler, ParticleProfileStats::Phase phase) {
+		ParticleProfileScope::profiler = profiler;
+		ParticleProfileScope::phase = phase;
+		start = profiler ? ParticleProfiler::now() : 0;
+	}
+
+	~ParticleProfileScope() {
+		if (profiler) profiler->recordPhase(phase, start, ParticleProfiler::now());
+	}
+
+};
+
+}
+
+/*
+* The profiling hooks of the engine, which compile to nothing unless CYCLONE_PROFILE is defined.
+* The profiler given can be NULL
+*/
+#ifdef CYCLONE_PROFILE
+#define CYCLONE_PROFILE_FRAME(profiler) do { if (profiler) (profiler)->beginFrame(); } while (0)
+#define CYCLONE_PROFILE_SCOPE(profiler, phase) cyclone::ParticleProfileScope profileScope(profiler, cyclone::ParticleProfileStats::phase)
+#define CYCLONE_PROFILE_COUNT(profiler, counter, value) do { if (profiler) (profiler)->recordCount(cyclone::ParticleProfileStats::counter, value); } while (0)
+#else
+#define CYCLONE_PROFILE_FRAME(profiler) ((void)0)
+#define CYCLONE_PROFILE_SCOPE(profiler, phase) ((void)0)
+#define CYCLONE_PROFILE_COUNT(profiler, counter, value) ((void)0)
+#endif
@@ -0,0 +1,220 @@
+#pragma once
+#include <include/pfgen.h>
+#include <include/pjobs.h>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* A ray cast against the particles. The direction doesn't need to be of unit length,
+* distances are measured along it in world units
+*/
+struct ParticleRay
+{
+	Vector3 origin;
+	Vector3 direction;
+	real maxDistance;
+};
+
+/*
+* The first particle hit by a ray, as an index in the particle list of the index,
+* ParticleQueryIndex::none if the ray hit nothing, and the distance to the hit
+*/
+struct ParticleRayHit
+{
+	unsigned particle;
+	real distance;
+};
+
+/*
+* Holds the measurements of a query index
+*/
+struct ParticleQueryStats
+{
+	/*
+	* Holds the number of cells holding particles
+	*/
+	unsigned cells;
+
+	/*
+	* Holds the number of particles that changed cell in the last update
+	*/
+	unsigned moved;
+};
+
+/*
+* Answers spatial queries over a list of particles: the particles within a radius of
+* a point, the k nearest particles of a point, and the first particle hit by a ray,
+* the particles being spheres of the given radius for rays.
+*
+* The particles are kept in a sparse grid of cells found through a hash map. Each cell
+* holds the indices of its particles and their positions in flat arrays, so a cell is
+* tested in a single loop over contiguous values. The grid is updated incrementally:
+* update refreshes the positions in place and only moves the particles that changed cell.
+* Cells should be about as wide as the typical query radius, and at least as wide as a
+* particle.
+*
+* The queries only read the index, so any number of threads can run them at once
+* between updates. The batched versions run on a job pool if one is given
+*/
+class ParticleQueryIndex
+{
+public:
+	typedef std::vector<Particle*> Particles;
+
+	/*
+	* The index given for no particle
+	*/
+	static const unsigned none = ~0u;
+
+protected:
+	/*
+	* Holds the particles of a cell
+	*/
+	struct Cell {
+		std::vector<unsigned> indices;
+		std::vector<real> x, y, z;
+	};
+
+	typedef std::unordered_map<uint64_t, Cell> Cells;
+
+	/*
+	* Holds the particles
+	*/
+	Particles particles;
+
+	/*
+	* Holds the width of the cells and the radius of the particles
+	*/
+	real cellSize;
+	real particleRadius;
+
+	/*
+	* Holds the cells, the cell of each particle and its slot in the cell
+	*/
+	Cells cells;
+	std::vector<uint64_t> cellOf;
+	std::vector<unsigned> slotOf;
+
+	/*
+	* Holds the smallest and largest coordinates of the cells holding particles
+	*/
+	int minCell[3];
+	int maxCell[3];
+
+	/*
+	* Holds the measurements
+	*/
+	ParticleQueryStats stats;
+
+public:
+	/*
+	* Creates an empty index with the given cell width, for particles of the given radius
+	*/
+	ParticleQueryIndex(real cellSize, real particleRadius);
+
+	/*
+	* Adds a particle at its current position
+	*/
+	void addParticle(Particle* particle);
+
+	/*
+	* Removes a particle. The last particle takes its index
+	*/
+	void removeParticle(Particle* particle);
+
+	/*
+	* Brings the index up to date with the positions of the particles
+	*/
+	void update();
+
+	/*
+	* Updates the pointers to the particles after they have been moved in memory
+	*/
+	void remapParticles(const ParticleRemap& remap);
+
+	/*
+	* Returns the particles
+	*/
+	Particles& getParticles();
+
+	/*
+	* Appends the particles within the radius of the center to results, and returns their number
+	*/
+	unsigned queryRadius(const Vector3& center, real radius, std::vector<unsigned>* results) const;
+
+	/*
+	* Fills results with up to k particles nearest to the center, nearest first, and
+	* distances with their distances if not NULL. Returns their number
+	*/
+	unsigned queryNearest(const Vector3& center, unsigned k, unsigned* results, real* distances = NULL) const;
+
+	/*
+	* Finds the first particle hit by the ray. Returns false if it hit nothing
+	*/
+	bool raycast(const ParticleRay& ray, ParticleRayHit* hit) const;
+
+	/*
+	* Runs a radius query for each center, with the radius of the same index. The results
+	* are in compressed rows: those of query i are from offsets[i] to offsets[i + 1]
+	*/
+	void queryRadius(const Vector3* centers, const real* radii, unsigned count,
+		std::vector<unsigned>* offsets, std::vector<unsigned>* results, ParticleJobPool* jobs = NULL) const;
+
+	/*
+	* Runs a nearest query for each center. Results holds k indices per query, nearest
+	* first, padded with none when there are fewer than k particles
+	*/
+	void queryNearest(const Vector3* centers, unsigned count, unsigned k, unsigned* results, ParticleJobPool* jobs = NULL) const;
+
+	/*
+	* Casts each ray, filling the hit of the same index
+	*/
+	void raycast(const ParticleRay* rays, unsigned count, ParticleRayHit* hits, ParticleJobPool* jobs = NULL) const;
+
+	/*
+	* Returns the measurements
+	*/
+	const ParticleQueryStats& getStats() const;
+
+protected:
+	/*
+	* Returns the cell coordinates of a position
+	*/
+	int cellCoordinate(real value) const;
+
+	/*
+	* Puts a particle in the given cell and removes it from its cell
+	*/
+	void insert(unsigned index, uint64_t key, const Vector3& position);
+	void erase(unsigned index);
+
+	/*
+	* Returns the cell of the given coordinates, or NULL if it holds no particle
+	*/
+	const Cell* findCell(int x, int y, int z) const;
+
+	/*
+	* Calls the visitor with the index of each particle within the radius of the center
+	*/
+	template<class Visitor>
+	void visitRadius(const Vector3& center, real radius, Visitor& visitor) const;
+
+	/*
+	* Tests the spheres of a cell against a ray, keeping the nearest hit
+	*/
+	void raycastCell(const Cell& cell, const Vector3& origin, const Vector3& direction, ParticleRayHit* hit) const;
+
+	/*
+	* The batched queries, run over ranges of queries
+	*/
+	static void countRadiusJob(void* context, unsigned begin, unsigned end);
+	static void fillRadiusJob(void* context, unsigned begin, unsigned end);
+	static void nearestJob(void* context, unsigned begin, unsigned end);
+	static void raycastJob(void* context, unsigned begin, unsigned end);
+
+};
+
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <float.h>
+#include <math.h>
 
 /** Define the precision of the square root operator */
 
@@ -15,16 +16,56 @@ namespace cyclone
 	*/
 	typedef float real;
 
-#define real_sqrt sqrtf
 #define REAL_MAX FLT_MAX
-#define real_pow powf
+
+	/**
+	* The math operators, overloaded for each precision so that templated
+	* code calls the function matching its scalar type
+	*/
+	inline float real_sqrt(float value) { return sqrtf(value); }
+	inline double real_sqrt(double value) { return sqrt(value); }
+
+	inline float real_pow(float base, float exponent) { return powf(base, exponent); }
+	inline double real_pow(double base, double exponent) { return pow(base, exponent); }
+
 	// Defines the precision of the absolute magnitude operator
-#define real_abs fabsf
+	inline float real_abs(float value) { return fabsf(value); }
+	inline double real_abs(double value) { return fabs(value); }
 
 	// Defines the precision of the sine operator
-#define real_sin sinf
+	inline float real_sin(float value) { return sinf(value); }
+	inline double real_sin(double value) { return sin(value); }
+
 	// Defines the precision of the cosine operator
-#define real_cos cosf
+	inline float real_cos(float value) { return cosf(value); }
+	inline double real_cos(double value) { return cos(value); }
+
 	// Defines the precision of the exponent operator
-#define real_exp expf
-}
\ No newline at end of file
+	inline float real_exp(float value) { return expf(value); }
+	inline double real_exp(double value) { return exp(value); }
+
+	/**
+	* Picks the precision of the particles, the force generators, the contacts
+	* and the links. Scalar is the type forces, velocities and every other quantity
+	* are computed in, Position the type positions are stored in.
+	*
+	* A mixed precision stores positions in double, so that particles far from the
+	* origin keep their accuracy, and computes everything else in float: forces only
+	* depend on relative positions, which are computed in double and then fit in float
+	*/
+	template<class ScalarType, class PositionType = ScalarType>
+	struct Precision
+	{
+		typedef ScalarType Scalar;
+		typedef PositionType Position;
+	};
+
+	typedef Precision<float> SinglePrecision;
+	typedef Precision<double> DoublePrecision;
+	typedef Precision<float, double> MixedPrecision;
+
+	/**
+	* The precision of the engine, used by the world and everything built on it
+	*/
+	typedef Precision<real> RealPrecision;
+}
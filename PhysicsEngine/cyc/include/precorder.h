@@ -0,0 +1,253 @@
+#pragma once
+#include <include/pworld.h>
+#include <include/pfile.h>
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Describes a trajectory recording file. The file starts with a header, followed
+* by the chunks and by the index of the chunks. Each chunk holds a run of frames:
+* the values of every frame are quantized to integer multiples of the quantum,
+* and each one is stored as the zigzag varint of its difference with the same value
+* in the previous frame of the chunk (or with zero for the first frame), so any
+* chunk can be decoded on its own and a frame is found without reading the whole file.
+* Each frame starts with the number of the step it was recorded at, stored the same
+* way, so the steps whose frames were dropped show up as gaps
+*/
+struct ParticleRecordingFormat
+{
+	static const uint32_t magic = 0x4A525943;
+	static const uint32_t version = 2;
+
+	/*
+	* Identifies the fields that can be recorded
+	*/
+	enum Field {
+		RECORD_POSITION = 1,
+		RECORD_VELOCITY = 2
+	};
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+
+		/* The fields recorded, a combination of Field */
+		uint32_t fields;
+
+		/* The number of values per frame: three for each field, for each particle */
+		uint32_t valuesPerFrame;
+		uint32_t particleCount;
+		uint32_t frameCount;
+		uint32_t chunkCount;
+		uint32_t pad;
+		double quantum;
+		uint64_t indexOffset;
+	};
+
+	struct ChunkEntry {
+		uint64_t offset;
+		uint64_t size;
+		uint32_t firstFrame;
+		uint32_t frameCount;
+	};
+};
+
+/*
+* Records the trajectories of a list of particles without stalling the simulation.
+* At the end of each step record copies the selected fields into a ring buffer of
+* frames shared with a background thread, with no lock: the simulation only writes the
+* frames the writer has released, and the writer only reads the frames the simulation
+* has published. The writer compresses the frames in chunks and writes them to the file.
+* When the ring is full the frame is dropped rather than waiting for the writer
+*/
+class ParticleRecorder
+{
+protected:
+	/*
+	* Holds the particles recorded
+	*/
+	ParticleWorld::Particles* particles;
+
+	/*
+	* Holds the fields recorded
+	*/
+	unsigned fields;
+
+	/*
+	* Holds the number of values per frame
+	*/
+	unsigned valuesPerFrame;
+
+	/*
+	* Holds the ring of frames, each of valuesPerFrame values
+	*/
+	std::vector<real> ring;
+	unsigned ringFrames;
+
+	/*
+	* Holds the step of each frame of the ring, and the number of steps recorded or dropped
+	*/
+	std::vector<uint32_t> ringSteps;
+	uint32_t steps;
+
+	/*
+	* Holds the number of frames published by the simulation and consumed by the writer.
+	* Each one is only written by one thread
+	*/
+	std::atomic<unsigned> published;
+	std::atomic<unsigned> consumed;
+
+	/*
+	* Set to ask the writer to flush and stop
+	*/
+	std::atomic<bool> stopping;
+
+	/*
+	* Holds the number of frames dropped because the ring was full
+	*/
+	unsigned dropped;
+
+	/*
+	* Holds the writer thread
+	*/
+	std::thread writer;
+
+	/*
+	* Holds the output file, only used by the writer
+	*/
+	FILE* output;
+
+	/*
+	* Holds the header, completed when the recording stops
+	*/
+	ParticleRecordingFormat::Header header;
+
+	/*
+	* Holds the number of frames per chunk
+	*/
+	unsigned chunkFrames;
+
+	/*
+	* Holds the state of the writer: the chunk being encoded, the quantized previous frame and the index
+	*/
+	std::vector<unsigned char> chunk;
+	std::vector<int32_t> previous;
+	uint32_t previousStep;
+	std::vector<ParticleRecordingFormat::ChunkEntry> index;
+
+public:
+	/*
+	* Creates a recorder with a ring of the given number of frames,
+	* writing the given number of frames per chunk
+	*/
+	ParticleRecorder(unsigned ringFrames = 8, unsigned chunkFrames = 64);
+
+	/*
+	* Stops the recording if it is running
+	*/
+	~ParticleRecorder();
+
+	/*
+	* Starts recording the given fields of the given particles to the given file.
+	* Values are stored to the given precision. The list must not change size while recording.
+	* Returns false if the file can't be created
+	*/
+	bool start(const char* path, ParticleWorld::Particles* particles, unsigned fields, double quantum = 1e-4);
+
+	/*
+	* Copies the current frame in the ring, to be called at the end of each step.
+	* Returns false if the frame was dropped because the writer is behind
+	*/
+	bool record();
+
+	/*
+	* Waits for the writer to write every frame recorded, and completes the file
+	*/
+	void stop();
+
+	/*
+	* Returns true while recording
+	*/
+	bool isRecording() const;
+
+	/*
+	* Returns the number of frames dropped because the ring was full
+	*/
+	unsigned getDroppedFrames() const;
+
+protected:
+	/*
+	* The body of the writer thread
+	*/
+	void writeFrames();
+
+	/*
+	* Compresses a frame recorded at the given step in the current chunk
+	*/
+	void encodeFrame(uint32_t step, const real* values);
+
+	/*
+	* Writes the current chunk to the file and adds it to the index
+	*/
+	void flushChunk();
+
+};
+
+/*
+* Reads back a trajectory recording, mapping the file and decoding a single chunk to get a frame
+*/
+class ParticleRecording
+{
+protected:
+	/*
+	* Holds the mapped file
+	*/
+	ParticleMappedFile file;
+
+	/*
+	* Holds the header, NULL when no valid recording is open
+	*/
+	const ParticleRecordingFormat::Header* header;
+
+	/*
+	* Holds the index of the chunks
+	*/
+	const ParticleRecordingFormat::ChunkEntry* index;
+
+	/*
+	* Holds the quantized values of the last frame decoded
+	*/
+	std::vector<int32_t> values;
+
+public:
+	/*
+	* Creates an object with no recording open
+	*/
+	ParticleRecording();
+
+	/*
+	* Maps the given recording. Returns false if it can't be read or isn't a valid recording
+	*/
+	bool open(const char* path);
+
+	/*
+	* Returns the header of the open recording
+	*/
+	const ParticleRecordingFormat::Header* getHeader() const;
+
+	/*
+	* Decodes the given frame into the given array of valuesPerFrame values. For each particle
+	* the values are its position then its velocity, for the fields recorded. The step the
+	* frame was recorded at, counted from the start of the recording, is returned in step if
+	* it isn't NULL. Returns false if the frame isn't in the recording
+	*/
+	bool readFrame(unsigned frame, real* output, unsigned* step = NULL);
+
+};
+
+}
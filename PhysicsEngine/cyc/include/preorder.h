@@ -0,0 +1,162 @@
+#pragma once
+#include <include/ptimestep.h>
+#include <include/pworld.h>
+#include <utility>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Holds the measurements of the Morton reordering pass
+*/
+struct ParticleReorderStats
+{
+	/*
+	* Holds the number of reorders done
+	*/
+	unsigned reorders;
+
+	/*
+	* Holds the time taken by the last reorder, in seconds
+	*/
+	double lastReorderTime;
+
+	/*
+	* Holds the average step time before the last reorder, in seconds
+	*/
+	double stepTimeBefore;
+
+	/*
+	* Holds the average step time after the last reorder, in seconds
+	*/
+	double stepTimeAfter;
+
+	/*
+	* Holds the number of steps between two reorders currently used
+	*/
+	unsigned interval;
+};
+
+/*
+* Periodically reorders the particles of a world in memory by the Z-order (Morton)
+* code of their position, so that particles close in space are close in memory.
+*
+* The particles stay at the same addresses, their contents are moved between the
+* slots: the slot lowest in memory gets the particle with the lowest code. Every
+* pointer held by the world (particle list, registrations, generators, links and
+* contacts) is remapped, and the particle list of the world is put in memory order.
+* Pointers and indices of particles held outside the world are not updated, so they
+* must be read back from the world after a reorder, except for the previous positions
+* of a timestep given with setTimestep.
+*
+* The pass times the world steps before and after each reorder. When the time
+* saved over an interval doesn't pay back the reorder, the interval is doubled,
+* and when it pays back quickly it is halved, within the given limits
+*/
+class ParticleMortonReorder : public ParticleRemap
+{
+protected:
+	/*
+	* Holds the world whose particles are reordered
+	*/
+	ParticleWorld* world;
+
+	/*
+	* Holds the limits of the number of steps between two reorders
+	*/
+	unsigned minInterval;
+	unsigned maxInterval;
+
+	/*
+	* Holds the number of steps since the last reorder
+	*/
+	unsigned stepsSinceReorder;
+
+	/*
+	* Holds the total time of the steps since the last reorder
+	*/
+	double stepTimeSinceReorder;
+
+	/*
+	* Holds a moving average of the step time
+	*/
+	double recentStepTime;
+
+	/*
+	* Holds the timestep interpolating the particles, can be NULL
+	*/
+	ParticleTimestep* timestep;
+
+	/*
+	* Holds the measurements
+	*/
+	ParticleReorderStats stats;
+
+	/*
+	* Holds the Morton code of each particle with its index in the world
+	*/
+	typedef std::pair<unsigned, unsigned> ParticleCode;
+	std::vector<ParticleCode> codes;
+
+	/*
+	* Holds the slots of the particles, sorted by address
+	*/
+	std::vector<Particle*> slots;
+
+	/*
+	* Holds the old and new location of every moved particle, sorted by old location
+	*/
+	typedef std::pair<Particle*, Particle*> ParticleMove;
+	std::vector<ParticleMove> moves;
+
+	/*
+	* Holds a copy of the particles while they are moved
+	*/
+	std::vector<Particle> scratch;
+
+public:
+	/*
+	* Creates a reordering pass for the given world, reordering every interval steps
+	*/
+	ParticleMortonReorder(ParticleWorld* world, unsigned interval = 1000,
+		unsigned minInterval = 100, unsigned maxInterval = 100000);
+
+	/*
+	* Runs a step of the world, timing it, and reorders the particles when it is due
+	*/
+	void runPhysics(real duration);
+
+	/*
+	* Sets the timestep whose previous positions follow the particles, NULL for none
+	*/
+	void setTimestep(ParticleTimestep* timestep);
+
+	/*
+	* Reorders the particles of the world now
+	*/
+	void reorder();
+
+	/*
+	* Returns the new location of a particle moved by the last reorder
+	*/
+	virtual Particle* map(Particle* particle) const;
+
+	/*
+	* Gets the measurements of the pass
+	*/
+	const ParticleReorderStats& getStats() const;
+
+	/*
+	* Returns the Morton code of a position already scaled to the 0-1023 range on each axis
+	*/
+	static unsigned mortonCode(unsigned x, unsigned y, unsigned z);
+
+protected:
+	/*
+	* Compares the step time before and after the reorder and adapts the interval
+	*/
+	void adaptInterval();
+
+};
+
+}
@@ -0,0 +1,144 @@
+#pragma once
+#include <include/pworld.h>
+#include <include/pfile.h>
+#include <stdint.h>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Loads scenes of particles, springs, cables and rods into a world.
+*
+* Scenes are authored as text, one element per line, with # starting a comment:
+*
+*	particle x y z vx vy vz mass damping	(a mass of zero makes the particle immovable)
+*	spring a b springConstant restLength	(a and b are particle indices)
+*	cable a b maxLength restitution
+*	rod a b length
+*
+* and compiled to a binary form: a header followed by one array per type of element,
+* each aligned to 64 bytes. A compiled scene is mapped and the arrays are read in place
+* to fill the world, so the load time is bound by reading the file.
+*
+* The scene owns the springs, cables and rods it creates, in contiguous arrays, so it
+* must outlive the world they are added to. The arrays can't grow once the world points
+* into them, so a scene object can only be loaded once
+*/
+class ParticleScene
+{
+public:
+	static const uint32_t magic = 0x43535943;
+	static const uint32_t version = 1;
+	static const uint32_t alignment = 64;
+
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+
+		/* The size of real the file was compiled with */
+		uint32_t realSize;
+
+		uint32_t particleCount;
+		uint32_t springCount;
+		uint32_t cableCount;
+		uint32_t rodCount;
+		uint32_t pad;
+
+		uint64_t particleOffset;
+		uint64_t springOffset;
+		uint64_t cableOffset;
+		uint64_t rodOffset;
+		uint64_t fileSize;
+	};
+
+	struct ParticleRecord {
+		real position[3];
+		real velocity[3];
+		real inverseMass;
+		real damping;
+	};
+
+	/*
+	* A spring, a cable or a rod between two particles. The first parameter is the
+	* spring constant, the maximum length or the length, the second one the rest length
+	* or the restitution (unused for rods)
+	*/
+	struct EdgeRecord {
+		uint32_t particle[2];
+		real parameter[2];
+	};
+
+protected:
+	/*
+	* Holds the springs created, two for each spring edge, one acting on each end
+	*/
+	std::vector<ParticleSpring> springs;
+
+	/*
+	* Holds the cables created
+	*/
+	std::vector<ParticleCable> cables;
+
+	/*
+	* Holds the rods created
+	*/
+	std::vector<ParticleRod> rods;
+
+public:
+	/*
+	* Compiles the given text scene to the given binary file.
+	* Returns false if the text can't be read or parsed, or the file can't be written
+	*/
+	static bool compile(const char* textPath, const char* binaryPath);
+
+	/*
+	* Loads the given compiled scene in the world, after the particles it already has.
+	* Returns false if the file can't be read or isn't a valid scene, or if this scene was already loaded
+	*/
+	bool load(const char* binaryPath, ParticleWorld& world);
+
+	/*
+	* Parses the given text scene and loads it in the world, without going through a file.
+	* Returns false if the text can't be read or parsed, or if this scene was already loaded
+	*/
+	bool loadText(const char* textPath, ParticleWorld& world);
+
+	/*
+	* Returns true if nothing has been loaded in this scene yet
+	*/
+	bool isEmpty() const;
+
+	/*
+	* Returns the springs created
+	*/
+	std::vector<ParticleSpring>& getSprings();
+
+	/*
+	* Returns the cables created
+	*/
+	std::vector<ParticleCable>& getCables();
+
+	/*
+	* Returns the rods created
+	*/
+	std::vector<ParticleRod>& getRods();
+
+protected:
+	/*
+	* Parses a text scene into the binary form. Returns false if it can't be read or parsed
+	*/
+	static bool parse(const char* textPath, std::vector<char>& binary);
+
+	/*
+	* Checks that the given memory holds a valid compiled scene
+	*/
+	static bool validate(const void* data, size_t size);
+
+	/*
+	* Fills the world from a valid compiled scene
+	*/
+	void populate(const void* data, ParticleWorld& world);
+
+};
+
+}
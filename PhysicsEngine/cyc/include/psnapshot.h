@@ -0,0 +1,171 @@
+#pragma once
+#include <include/pworld.h>
+#include <include/pfile.h>
+#include <stdint.h>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Binary snapshot of a particle world, to checkpoint and restart a simulation.
+*
+* The file starts with a header followed by three sections, each aligned to
+* 64 bytes: the particles, the force registrations and the links. Registrations
+* and links refer to particles by their index in the world. Generators can't be
+* stored, so registrations refer to them by their index in a table the caller
+* provides both when saving and when restoring.
+*
+* A snapshot is written through a mapped file in a single pass, and read back
+* by mapping it: the sections are used in place, without copying
+*/
+class ParticleSnapshot
+{
+public:
+	/*
+	* Identifies the format, and its version. The version changes whenever the layout does
+	*/
+	static const uint32_t magic = 0x4E535943;
+	static const uint32_t version = 1;
+
+	/*
+	* Holds the alignment of the sections
+	*/
+	static const uint32_t alignment = 64;
+
+	/*
+	* Identifies the type of a link
+	*/
+	enum LinkType {
+		LINK_CABLE = 0,
+		LINK_ROD = 1
+	};
+
+	/*
+	* Describes the file and where its sections are
+	*/
+	struct Header {
+		uint32_t magic;
+		uint32_t version;
+
+		/* The size of real the file was written with */
+		uint32_t realSize;
+
+		uint32_t particleCount;
+		uint32_t registrationCount;
+		uint32_t linkCount;
+
+		/* The resolver iterations, zero if calculated each frame */
+		uint32_t iterations;
+		uint32_t maxContacts;
+
+		uint64_t particleOffset;
+		uint64_t registrationOffset;
+		uint64_t linkOffset;
+		uint64_t fileSize;
+	};
+
+	/*
+	* Holds the state of a single particle
+	*/
+	struct ParticleRecord {
+		Vector3 position;
+		Vector3 velocity;
+		Vector3 acceleration;
+		Vector3 forceAccum;
+		real inverseMass;
+		real damping;
+		real pad[2];
+	};
+
+	/*
+	* Holds a force registration, by particle index and generator index
+	*/
+	struct RegistrationRecord {
+		uint32_t particle;
+		uint32_t generator;
+	};
+
+	/*
+	* Holds a link
+	*/
+	struct LinkRecord {
+		uint32_t type;
+		uint32_t particle[2];
+
+		/* The maximum length of a cable, or the length of a rod */
+		real length;
+
+		/* The restitution of a cable */
+		real restitution;
+	};
+
+	/*
+	* Holds the generators registrations refer to, by index
+	*/
+	typedef std::vector<ParticleForceGenerator*> Generators;
+
+protected:
+	/*
+	* Holds the mapped file
+	*/
+	ParticleMappedFile file;
+
+	/*
+	* Holds the header, NULL when no valid snapshot is open
+	*/
+	const Header* header;
+
+public:
+	/*
+	* Creates an object with no snapshot open
+	*/
+	ParticleSnapshot();
+
+	/*
+	* Writes the state of the world to the given file. Returns false if the file can't be
+	* written, or if a registration uses a generator missing from the table, or a link
+	* that isn't a cable or a rod
+	*/
+	static bool save(const char* path, ParticleWorld& world, const Generators& generators);
+
+	/*
+	* Maps the given snapshot file. Returns false if it can't be read, or isn't a valid
+	* snapshot of this version and precision
+	*/
+	bool open(const char* path);
+
+	/*
+	* Unmaps the snapshot
+	*/
+	void close();
+
+	/*
+	* Restores the state of the snapshot into the world. The world is given the particles
+	* it is missing, its registrations are replaced, and its links must be the same number and
+	* type as in the snapshot. Returns false if the world doesn't match the snapshot
+	*/
+	bool restore(ParticleWorld& world, const Generators& generators) const;
+
+	/*
+	* Returns the header of the open snapshot
+	*/
+	const Header* getHeader() const;
+
+	/*
+	* Returns the particles of the open snapshot, in place in the mapped file
+	*/
+	const ParticleRecord* getParticles() const;
+
+	/*
+	* Returns the registrations of the open snapshot, in place in the mapped file
+	*/
+	const RegistrationRecord* getRegistrations() const;
+
+	/*
+	* Returns the links of the open snapshot, in place in the mapped file
+	*/
+	const LinkRecord* getLinks() const;
+
+};
+
+}
@@ -0,0 +1,183 @@
+#pragma once
+#include <include/ptimestep.h>
+#include <atomic>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* A read-only copy of the state of the particles at the end of a step. The values
+* are in the order of the particle list of the world at that step, and only the
+* fields subscribed to when it was published are filled
+*/
+struct ParticleStateFrame
+{
+	/*
+	* Holds the number of the step, counted from one, and the simulated time at its end
+	*/
+	unsigned long long step;
+	double time;
+
+	/*
+	* Holds the fields filled, a combination of ParticleStatePublisher::Field
+	*/
+	unsigned fields;
+
+	/*
+	* Holds the number of particles
+	*/
+	unsigned count;
+
+	/*
+	* Holds the values of the fields filled
+	*/
+	std::vector<Vector3> positions;
+	std::vector<Vector3> velocities;
+
+	/*
+	* Holds the number of readers using the frame. The publisher doesn't write a frame
+	* while it is not zero
+	*/
+	std::atomic<unsigned> readers;
+};
+
+/*
+* Publishes the state of the particles of a world for other threads, such as rendering
+* or networking, without locking. At the end of each step publish copies the fields
+* subscribed to into a frame that no reader is using and swaps the pointer to the
+* latest frame atomically. A reader acquires the latest frame, which stays unchanged
+* until it releases it, and never sees a frame being written.
+*
+* With three frames the simulation can always publish while readers hold the previous
+* latest frame. If readers hold every other frame, the step is skipped rather than
+* waiting for them, and readers keep getting the last frame published.
+*
+* The publisher is also a subsystem, so it can be added last to the fixed timestep
+* scheduler. Publish and subscribe can be called from any thread, but publish only
+* from one thread at a time
+*/
+class ParticleStatePublisher : public ParticleSubsystem
+{
+public:
+	/*
+	* Identifies the fields that can be subscribed to
+	*/
+	enum Field {
+		STATE_POSITION = 1,
+		STATE_VELOCITY = 2
+	};
+
+	/*
+	* The largest number of frames
+	*/
+	static const unsigned maxFrames = 4;
+
+protected:
+	/*
+	* Holds the world published
+	*/
+	ParticleWorld* world;
+
+	/*
+	* Holds the frames
+	*/
+	ParticleStateFrame frames[maxFrames];
+	unsigned frameCount;
+
+	/*
+	* Holds the latest frame published, NULL before the first one
+	*/
+	std::atomic<ParticleStateFrame*> latest;
+
+	/*
+	* Holds the number of subscribers of each field
+	*/
+	std::atomic<unsigned> subscribers[2];
+
+	/*
+	* Holds the number of steps, the simulated time, and the number of steps skipped
+	* because readers held every frame
+	*/
+	unsigned long long steps;
+	double time;
+	unsigned long long skipped;
+
+public:
+	/*
+	* Creates a publisher for the given world with the given number of frames, from 2 to
+	* maxFrames. With two frames a reader holding the latest frame makes the steps be skipped
+	*/
+	ParticleStatePublisher(ParticleWorld* world, unsigned frameCount = 3);
+
+	/*
+	* Adds a subscriber to the given fields, which are copied from the next publish on
+	*/
+	void subscribe(unsigned fields);
+
+	/*
+	* Removes a subscriber from the given fields
+	*/
+	void unsubscribe(unsigned fields);
+
+	/*
+	* Copies the fields subscribed to into a free frame and makes it the latest one.
+	* The duration is the duration of the step, added to the time of the frames.
+	* Returns false if every frame was in use and the step was skipped
+	*/
+	bool publish(real duration);
+
+	/*
+	* Publishes the state at the end of the step
+	*/
+	virtual void step(real duration);
+
+	/*
+	* Returns the latest frame and marks it as in use, or NULL if none has been published.
+	* The frame must be given back to release
+	*/
+	const ParticleStateFrame* acquire();
+
+	/*
+	* Gives back a frame returned by acquire
+	*/
+	void release(const ParticleStateFrame* frame);
+
+	/*
+	* Returns the number of steps skipped because readers held every frame
+	*/
+	unsigned long long getSkipped() const;
+
+};
+
+/*
+* Holds the latest frame of a publisher for as long as it lives
+*/
+class ParticleStateView
+{
+protected:
+	ParticleStatePublisher* publisher;
+	const ParticleStateFrame* frame;
+
+public:
+	/*
+	* Acquires the latest frame of the publisher
+	*/
+	ParticleStateView(ParticleStatePublisher* publisher);
+
+	/*
+	* Releases the frame
+	*/
+	~ParticleStateView();
+
+	/*
+	* Returns the frame, or NULL if none has been published
+	*/
+	const ParticleStateFrame* get() const;
+
+private:
+	ParticleStateView(const ParticleStateView&);
+	ParticleStateView& operator=(const ParticleStateView&);
+
+};
+
+}
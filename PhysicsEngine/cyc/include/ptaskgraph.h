@@ -0,0 +1,216 @@
+#pragma once
+#include <include/pjobs.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Holds the measurements of the last run of a task graph
+*/
+struct ParticleTaskGraphStats
+{
+	/*
+	* Holds the number of tasks run, and the number taken from the queue of another thread
+	*/
+	unsigned tasks;
+	unsigned steals;
+
+	/*
+	* Holds the time from the start to the end of the run, the time of all the tasks
+	* added up, and the time of the tasks on the critical path, in nanoseconds. The work
+	* over the critical path is the most threads the graph could keep busy
+	*/
+	uint64_t wallTime;
+	uint64_t workTime;
+	uint64_t criticalTime;
+};
+
+/*
+* A graph of tasks run over the threads of a job pool as soon as the tasks they depend
+* on are done, so independent work overlaps instead of waiting at the end of each phase.
+* A task is a job over a range of items. Tasks must be added after the tasks they depend
+* on, and a task with no job only joins its dependencies.
+*
+* Each thread keeps a queue of the tasks made ready by the tasks it ran. It runs the
+* newest of its own, which likely use the memory just touched, and when it has none it
+* steals the oldest of another thread. The graph can be run again every step without
+* being rebuilt. Each run measures the time of every task, from which it finds the
+* critical path, the chain of dependent tasks that took the longest, and can write the
+* run as a Chrome trace with the critical path highlighted
+*/
+class ParticleTaskGraph
+{
+public:
+	/*
+	* Holds a task
+	*/
+	struct Task {
+		ParticleJob job;
+		void* context;
+		unsigned begin;
+		unsigned end;
+		const char* name;
+	};
+
+protected:
+	/*
+	* Holds the queue of ready tasks of a thread. The owner takes from the back, the
+	* thieves from the front. A task is queued once per run, so the queue never wraps
+	*/
+	struct Queue {
+		std::vector<unsigned> tasks;
+		unsigned front;
+		unsigned back;
+		std::atomic_flag lock;
+	};
+
+	/*
+	* Holds the time and the thread of a task in the last run
+	*/
+	struct Timing {
+		uint64_t start;
+		uint64_t end;
+		unsigned thread;
+	};
+
+	/*
+	* Holds the tasks, and the dependencies as pairs of the task before and the task after
+	*/
+	std::vector<Task> tasks;
+	std::vector<unsigned> edges;
+
+	/*
+	* Holds the tasks each task makes ready, in compressed rows, and the number of
+	* dependencies of each task. They are built at the first run after a change
+	*/
+	std::vector<unsigned> successorOffsets;
+	std::vector<unsigned> successors;
+	std::vector<unsigned> dependencies;
+	bool built;
+
+	/*
+	* Holds the dependencies left of each task, and the number of tasks left, in a run
+	*/
+	std::unique_ptr<std::atomic<unsigned>[]> pending;
+	unsigned pendingCapacity;
+	std::atomic<unsigned> remaining;
+
+	/*
+	* Holds the queue of each thread
+	*/
+	std::unique_ptr<Queue[]> queues;
+	unsigned queueCount;
+
+	/*
+	* Holds the timings of the last run, the tasks on its critical path, and the start of the run
+	*/
+	std::vector<Timing> timings;
+	std::vector<unsigned> criticalPath;
+	uint64_t origin;
+
+	/*
+	* Holds the number of steals of the current run
+	*/
+	std::atomic<unsigned> steals;
+
+	/*
+	* Holds the measurements
+	*/
+	ParticleTaskGraphStats stats;
+
+public:
+	/*
+	* Creates an empty graph
+	*/
+	ParticleTaskGraph();
+
+	/*
+	* Adds a task running the job over the items from begin to end, and returns its index.
+	* The name is shown in the trace and must outlive the graph
+	*/
+	unsigned addTask(ParticleJob job, void* context, unsigned begin, unsigned end, const char* name);
+
+	/*
+	* Makes a task wait for another, added before it
+	*/
+	void addDependency(unsigned before, unsigned after);
+
+	/*
+	* Removes every task
+	*/
+	void clear();
+
+	/*
+	* Runs every task over the threads of the pool, or in order on the calling thread if
+	* the pool is NULL, and returns once they are all done
+	*/
+	void run(ParticleJobPool* jobs);
+
+	/*
+	* Returns the number of tasks
+	*/
+	unsigned getTaskCount() const;
+
+	/*
+	* Returns a task
+	*/
+	const Task& getTask(unsigned index) const;
+
+	/*
+	* Returns the tasks on the critical path of the last run, first to last
+	*/
+	const std::vector<unsigned>& getCriticalPath() const;
+
+	/*
+	* Returns the measurements of the last run
+	*/
+	const ParticleTaskGraphStats& getStats() const;
+
+	/*
+	* Writes the last run as a Chrome trace, one row per thread, with the tasks on the
+	* critical path highlighted. Returns false if the file couldn't be written
+	*/
+	bool exportTrace(const char* path) const;
+
+protected:
+	/*
+	* Builds the successors and the dependency counts of the tasks
+	*/
+	void build();
+
+	/*
+	* Runs a task and queues the tasks it makes ready on the queue of the thread
+	*/
+	void execute(unsigned task, unsigned thread);
+
+	/*
+	* Takes the newest task of the queue of the thread, or steals the oldest task of
+	* another. Returns false if none was found
+	*/
+	bool take(unsigned thread, unsigned* task);
+
+	/*
+	* Runs tasks until they are all done, the job of each thread of the pool
+	*/
+	static void workerJob(void* context, unsigned begin, unsigned end);
+
+	/*
+	* Finds the critical path of the last run and fills the measurements
+	*/
+	void measure(uint64_t end);
+
+	/*
+	* Returns the time in nanoseconds
+	*/
+	static uint64_t now();
+
+private:
+	ParticleTaskGraph(const ParticleTaskGraph&);
+	ParticleTaskGraph& operator=(const ParticleTaskGraph&);
+
+};
+
+}
@@ -0,0 +1,204 @@
+#pragma once
+#include <include/pworld.h>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* A subsystem is a part of the simulation that the timestep scheduler
+* advances in time. Each subsystem can run several substeps for each fixed step
+*/
+class ParticleSubsystem
+{
+public:
+	/*
+	* Overload this to advance the subsystem by the given duration
+	*/
+	virtual void step(real duration) = 0;
+
+};
+
+/*
+* Advances the dynamics of a world: clears the accumulators, applies the forces
+* and integrates the particles
+*/
+class ParticleDynamicsSubsystem : public ParticleSubsystem
+{
+public:
+	/*
+	* Creates the subsystem for the given world
+	*/
+	ParticleDynamicsSubsystem(ParticleWorld* world);
+
+	/*
+	* Applies the forces and integrates the particles of the world
+	*/
+	virtual void step(real duration);
+
+private:
+	/*
+	* The world being advanced
+	*/
+	ParticleWorld* world;
+
+};
+
+/*
+* Generates and resolves the contacts of the links of a world
+*/
+class ParticleConstraintSubsystem : public ParticleSubsystem
+{
+public:
+	/*
+	* Creates the subsystem for the given world
+	*/
+	ParticleConstraintSubsystem(ParticleWorld* world);
+
+	/*
+	* Generates and resolves the contacts of the world
+	*/
+	virtual void step(real duration);
+
+private:
+	/*
+	* The world being advanced
+	*/
+	ParticleWorld* world;
+
+};
+
+/*
+* Fixed timestep scheduler. The caller feeds it the elapsed wall time of each
+* frame, the scheduler accumulates it and runs as many fixed steps as fit, up to
+* a maximum number of steps per frame to avoid the spiral of death.
+* The time left in the accumulator is used to interpolate the positions of
+* the particles between the last two steps, so renderers don't need extra steps
+*/
+class ParticleTimestep
+{
+protected:
+	/*
+	* Keeps track of one subsystem and the number of substeps it runs per fixed step
+	*/
+	struct SubsystemRegistration {
+		ParticleSubsystem* subsystem;
+		unsigned substeps;
+	};
+
+	/*
+	* Holds the list of subsystems, in the order they run
+	*/
+	typedef std::vector<SubsystemRegistration> Subsystems;
+	Subsystems subsystems;
+
+	/*
+	* Holds the duration of a fixed step
+	*/
+	real fixedDuration;
+
+	/*
+	* Holds the maximum number of fixed steps run in a single frame
+	*/
+	unsigned maxSteps;
+
+	/*
+	* Holds the time accumulated and not simulated yet. Always smaller than a fixed step after advance
+	*/
+	real accumulator;
+
+	/*
+	* Holds the time that has been discarded because the step cap was reached
+	*/
+	real droppedTime;
+
+	/*
+	* Holds the number of ticks per fixed step, the least common multiple of the substeps
+	*/
+	unsigned ticks;
+
+	/*
+	* Holds the particles whose position is interpolated, can be NULL
+	*/
+	ParticleWorld::Particles* interpolated;
+
+	/*
+	* Holds the position of the interpolated particles before the last fixed step,
+	* and the particle each was read from
+	*/
+	std::vector<Vector3> previousPositions;
+	std::vector<Particle*> previousParticles;
+
+public:
+	/*
+	* Creates a scheduler running steps of the given duration,
+	* and never more than maxSteps steps per frame
+	*/
+	ParticleTimestep(real fixedDuration, unsigned maxSteps = 5);
+
+	/*
+	* Registers the given subsystem to run the given number of substeps for each fixed step.
+	* Subsystems run in the order they are added
+	*/
+	void add(ParticleSubsystem* subsystem, unsigned substeps = 1);
+
+	/*
+	* Removes the given subsystem. If the subsystem is not registered this method has no effect
+	*/
+	void remove(ParticleSubsystem* subsystem);
+
+	/*
+	* Sets the list of particles whose positions are interpolated, NULL to disable interpolation.
+	* The list must not change size between two calls to advance
+	*/
+	void setInterpolatedParticles(ParticleWorld::Particles* particles);
+
+	/*
+	* Moves the previous positions with the particles after they have been moved in
+	* memory. Must be called once the interpolated list is up to date, so that each
+	* particle of the list gets its own previous position back
+	*/
+	void remapParticles(const ParticleRemap& remap);
+
+	/*
+	* Accumulates the given frame duration and runs the fixed steps that fit in it.
+	* Returns the number of fixed steps run
+	*/
+	unsigned advance(real frameDuration);
+
+	/*
+	* Returns the fraction of a fixed step left in the accumulator, between 0 and 1
+	*/
+	real getInterpolationAlpha() const;
+
+	/*
+	* Returns the position of the given interpolated particle, blended between
+	* the last two steps by the interpolation alpha
+	*
+	* @param index The index of the particle in the interpolated list
+	*/
+	Vector3 getInterpolatedPosition(unsigned index) const;
+
+	/*
+	* Gets the duration of a fixed step
+	*/
+	real getFixedDuration() const;
+
+	/*
+	* Gets the total time discarded because the step cap was reached
+	*/
+	real getDroppedTime() const;
+
+private:
+	/*
+	* Runs a single fixed step of every subsystem
+	*/
+	void runStep();
+
+	/*
+	* Recalculates the number of ticks per fixed step
+	*/
+	void updateTicks();
+
+};
+
+}
@@ -0,0 +1,299 @@
+#pragma once
+#include <include/pfgen.h>
+#include <include/plinks.h>
+#include <include/pmemory.h>
+#include <include/pprofile.h>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+namespace cyclone {
+
+/*
+* Keeps track of a set of particles, the forces applied to them and the
+* links between them, and provides the means to update them all
+*/
+class ParticleWorld
+{
+public:
+	typedef std::vector<Particle*> Particles;
+	typedef std::vector<ParticleLink*> Links;
+
+protected:
+	/*
+	* Holds the particles
+	*/
+	Particles particles;
+
+	/*
+	* Holds the force generators for the particles in this world
+	*/
+	ParticleForceRegistry registry;
+
+	/*
+	* Holds the links that generate contacts between particles
+	*/
+	Links links;
+
+	/*
+	* Holds the resolver for the contacts
+	*/
+	ParticleContactResolver resolver;
+
+	/*
+	* Holds the list of contacts, filled by the links every step.
+	* It lives in the frame arena and is only valid until the next frame
+	*/
+	ParticleContact* contacts;
+
+	/*
+	* Holds the number of contacts generated in the current frame
+	*/
+	unsigned contactCount;
+
+	/*
+	* Holds the maximum number of contacts allowed (the size of the contacts array)
+	*/
+	unsigned maxContacts;
+
+	/*
+	* True if the world should calculate the number of iterations
+	* to give the contact resolver at each frame
+	*/
+	bool calculateIterations;
+
+	/*
+	* Holds the particles created by the world
+	*/
+	ParticlePool<Particle> particlePool;
+
+	/*
+	* Holds a pool for each type of force generator created by the world
+	*/
+	typedef std::unordered_map<std::type_index, ParticleBlockPool*> GeneratorPools;
+	GeneratorPools generatorPools;
+
+	/*
+	* Holds the data that only lives for a single frame, such as the contacts.
+	* It is reset at the start of every frame
+	*/
+	ParticleArena frameArena;
+
+	/*
+	* Holds the generators found while remapping particles, kept to avoid allocating
+	*/
+	std::vector<ParticleForceGenerator*> remapGenerators;
+
+	/*
+	* Holds the profiler fed with the timers and counters of each frame, if any
+	*/
+	ParticleProfiler* profiler;
+
+	/*
+	* Holds the job pool integrating the particles, if any
+	*/
+	ParticleJobPool* jobs;
+
+public:
+	/*
+	* Holds the speed under which a particle is counted as resting by the profiler
+	*/
+	static const real restingSpeed;
+
+	/*
+	* Creates a new particle simulation that can handle up to the given
+	* number of contacts per frame. If the number of iterations is zero,
+	* twice the number of contacts will be used
+	*/
+	ParticleWorld(unsigned maxContacts, unsigned iterations = 0);
+
+	/*
+	* Deletes the generator pools. Particles and generators added
+	* by the caller rather than created by the world are owned by the caller
+	*/
+	~ParticleWorld();
+
+	/*
+	* Creates a new particle from the particle pool and adds it to the world
+	*/
+	Particle* createParticle();
+
+	/*
+	* Removes the given particle, created by the world, and all its force registrations,
+	* and puts it back in the particle pool
+	*/
+	void destroyParticle(Particle* particle);
+
+	/*
+	* Puts a particle back in the particle pool without searching for it. The caller
+	* must already have taken it out of the particle list and the force registry
+	*/
+	void releaseParticle(Particle* particle);
+
+	/*
+	* Creates a new force generator of type T from the pool of that type,
+	* with the given constructor arguments
+	*/
+	template<class T, class... Args>
+	T* createGenerator(Args&&... args) {
+		return new (getGeneratorPool(typeid(T), sizeof(T))->allocate()) T(std::forward<Args>(args)...);
+	}
+
+	/*
+	* Destroys the given force generator, created by the world, and puts it back in its pool.
+	* The generator must not be registered anymore
+	*/
+	template<class T>
+	void destroyGenerator(T* generator) {
+		generator->~T();
+		getGeneratorPool(typeid(T), sizeof(T))->deallocate(generator);
+	}
+
+	/*
+	* Makes sure the given number of particles can be created without allocating memory.
+	* With a job pool, the memory of the particles to come is first written by the threads
+	* that will integrate them
+	*/
+	void reserveParticles(unsigned count);
+
+	/*
+	* Sets the job pool integrating the particles, or NULL to integrate them on the calling
+	* thread. Each thread always integrates the same range of the particle list, so with
+	* pinned threads and the particles reserved after the pool is set, each thread mostly
+	* touches memory of its own node. The pool is owned by the caller
+	*/
+	void setJobPool(ParticleJobPool* jobs);
+
+	/*
+	* Sets whether the particles and the contacts are stored in huge pages, for the
+	* memory requested from then on
+	*/
+	void setHugePages(bool hugePages);
+
+	/*
+	* Updates every pointer to a particle held by the world after the particles have
+	* been moved in memory: the particle list, the force registrations, the generators
+	* registered, the links and the contacts of the current frame
+	*/
+	void remapParticles(const ParticleRemap& remap);
+
+	/*
+	* Initializes the world for a simulation frame. This clears the
+	* force accumulators of the particles
+	*/
+	void startFrame();
+
+	/*
+	* Calls all the registered force generators
+	*/
+	void applyForces(real duration);
+
+	/*
+	* Integrates all the particles in this world forward in time by the given duration
+	*/
+	void integrate(real duration);
+
+	/*
+	* Integrates the given particles forward in time by the given duration, as integrate
+	* does, on the calling thread
+	*/
+	static void integrateParticles(Particle* const* particles, unsigned count, real duration);
+
+	/*
+	* Calls each of the links to fill the contact array.
+	* Returns the number of contacts generated
+	*/
+	unsigned generateContacts();
+
+	/*
+	* Generates the contacts from the links and resolves them
+	*/
+	void resolveConstraints(real duration);
+
+	/*
+	* Processes all the physics of the world for one step: forces, integration and constraints
+	*/
+	void runPhysics(real duration);
+
+	/*
+	* Returns the list of particles
+	*/
+	Particles& getParticles();
+
+	/*
+	* Returns the list of links
+	*/
+	Links& getLinks();
+
+	/*
+	* Returns the force registry
+	*/
+	ParticleForceRegistry& getForceRegistry();
+
+	/*
+	* Returns the contact resolver
+	*/
+	ParticleContactResolver& getContactResolver();
+
+	/*
+	* Sets the number of iterations given to the contact resolver.
+	* Zero means twice the number of contacts of each frame
+	*/
+	void setIterations(unsigned iterations);
+
+	/*
+	* Gets the number of iterations given to the contact resolver, zero if it is calculated each frame
+	*/
+	unsigned getIterations() const;
+
+	/*
+	* Gets the maximum number of contacts per frame
+	*/
+	unsigned getMaxContacts() const;
+
+	/*
+	* Returns the contacts generated in the current frame
+	*/
+	ParticleContact* getContacts();
+
+	/*
+	* Returns the number of contacts generated in the current frame
+	*/
+	unsigned getContactCount() const;
+
+	/*
+	* Returns the arena for the data that lives only for the current frame
+	*/
+	ParticleArena& getFrameArena();
+
+	/*
+	* Returns the allocation statistics of the particle pool, the generator pools and the frame arena
+	*/
+	ParticleAllocationStats getAllocationStats() const;
+
+	/*
+	* Sets the profiler fed by the world, or NULL for none. The profiler is owned by
+	* the caller, and is only fed when the engine is compiled with CYCLONE_PROFILE
+	*/
+	void setProfiler(ParticleProfiler* profiler);
+
+	/*
+	* Returns the profiler fed by the world, if any
+	*/
+	ParticleProfiler* getProfiler();
+
+protected:
+	/*
+	* Returns the pool for the generators of the given type, creating it the first time
+	*/
+	ParticleBlockPool* getGeneratorPool(const std::type_info& type, size_t size);
+
+	/*
+	* Integrates the particles of a range, the job of integrate
+	*/
+	static void integrateJob(void* context, unsigned begin, unsigned end);
+
+};
+
+}
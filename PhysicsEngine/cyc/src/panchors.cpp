@@ -0,0 +1,274 @@
+#include <include/panchors.h>
+#include <assert.h>
+#include <math.h>
+#include <algorithm>
+#include <utility>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CYCLONE_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace cyclone;
+
+ParticleAnchorSet::ParticleAnchorSet() {
+	ParticleAnchorSet::anchorsDirty = false;
+	ParticleAnchorSet::anchorsMoved = 0;
+	stats = ParticleAnchorStats();
+}
+
+unsigned ParticleAnchorSet::addAnchor(const Vector3& position) {
+	anchors.push_back(position);
+	return (unsigned)anchors.size() - 1;
+}
+
+void ParticleAnchorSet::moveAnchors(unsigned first, unsigned count, const Vector3* positions) {
+	assert(first + count <= anchors.size());
+
+	std::copy(positions, positions + count, anchors.begin() + first);
+	anchorsDirty = true;
+	anchorsMoved += count;
+}
+
+unsigned ParticleAnchorSet::addSpring(Particle* particle, unsigned anchor, real stiffness, real restLength, real damping) {
+	assert(anchor < anchors.size());
+	return addConstraint(particle, anchor, anchors[anchor], stiffness, restLength, damping, false);
+}
+
+unsigned ParticleAnchorSet::addSpring(Particle* particle, const Vector3& anchor, real stiffness, real restLength, real damping) {
+	return addConstraint(particle, noAnchor, anchor, stiffness, restLength, damping, false);
+}
+
+unsigned ParticleAnchorSet::addTether(Particle* particle, unsigned anchor, real stiffness, real length, real damping) {
+	assert(anchor < anchors.size());
+	return addConstraint(particle, anchor, anchors[anchor], stiffness, length, damping, true);
+}
+
+unsigned ParticleAnchorSet::addTether(Particle* particle, const Vector3& anchor, real stiffness, real length, real damping) {
+	return addConstraint(particle, noAnchor, anchor, stiffness, length, damping, true);
+}
+
+unsigned ParticleAnchorSet::addConstraint(Particle* particle, unsigned anchor, const Vector3& position, real stiffness,
+	real restLength, real damping, bool tether) {
+	assert(particle);
+
+	particles.push_back(particle);
+	anchorIndices.push_back(anchor);
+	anchorX.push_back(position.x);
+	anchorY.push_back(position.y);
+	anchorZ.push_back(position.z);
+	ParticleAnchorSet::stiffness.push_back(stiffness);
+	restLengths.push_back(restLength);
+	dampings.push_back(damping);
+	minExtensions.push_back(tether ? 0 : -REAL_MAX);
+	return (unsigned)particles.size() - 1;
+}
+
+void ParticleAnchorSet::setAnchor(unsigned constraint, const Vector3& position) {
+	assert(anchorIndices[constraint] == noAnchor);
+
+	anchorX[constraint] = position.x;
+	anchorY[constraint] = position.y;
+	anchorZ[constraint] = position.z;
+}
+
+void ParticleAnchorSet::remove(unsigned constraint) {
+	assert(constraint < particles.size());
+
+	unsigned last = (unsigned)particles.size() - 1;
+	particles[constraint] = particles[last];
+	anchorIndices[constraint] = anchorIndices[last];
+	anchorX[constraint] = anchorX[last];
+	anchorY[constraint] = anchorY[last];
+	anchorZ[constraint] = anchorZ[last];
+	stiffness[constraint] = stiffness[last];
+	restLengths[constraint] = restLengths[last];
+	dampings[constraint] = dampings[last];
+	minExtensions[constraint] = minExtensions[last];
+
+	particles.pop_back();
+	anchorIndices.pop_back();
+	anchorX.pop_back();
+	anchorY.pop_back();
+	anchorZ.pop_back();
+	stiffness.pop_back();
+	restLengths.pop_back();
+	dampings.pop_back();
+	minExtensions.pop_back();
+}
+
+/*
+* Moves the entries of an array into the given order
+*/
+template<class T>
+static void permute(std::vector<T>& values, const std::vector<unsigned>& order, std::vector<T>& scratch) {
+	scratch.resize(values.size());
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		scratch[i] = values[order[i]];
+	}
+	values.swap(scratch);
+}
+
+void ParticleAnchorSet::sortByParticle() {
+	unsigned count = (unsigned)particles.size();
+	std::vector<std::pair<Particle*, unsigned> > keys(count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		keys[i] = std::make_pair(particles[i], i);
+	}
+
+	// The index breaks the ties, so the constraints of a particle keep their order
+	std::sort(keys.begin(), keys.end());
+	std::vector<unsigned> order(count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		order[i] = keys[i].second;
+	}
+
+	std::vector<Particle*> pointers;
+	permute(particles, order, pointers);
+	std::vector<unsigned> indices;
+	permute(anchorIndices, order, indices);
+	std::vector<real> values;
+	permute(anchorX, order, values);
+	permute(anchorY, order, values);
+	permute(anchorZ, order, values);
+	permute(stiffness, order, values);
+	permute(restLengths, order, values);
+	permute(dampings, order, values);
+	permute(minExtensions, order, values);
+}
+
+void ParticleAnchorSet::remapParticles(const ParticleRemap& remap) {
+	std::vector<Particle*>::iterator p = particles.begin();
+	for (; p != particles.end(); p++)
+	{
+		*p = remap.map(*p);
+	}
+}
+
+void ParticleAnchorSet::updateForce(Particle* particle, real duration) {
+	stats.constraints = (unsigned)particles.size();
+	stats.active = 0;
+	stats.anchorsMoved = anchorsMoved;
+	anchorsMoved = 0;
+	if (anchorsDirty) refreshAnchors();
+
+	const unsigned batchSize = 256;
+	unsigned count = (unsigned)particles.size();
+	for (unsigned start = 0; start < count; start += batchSize)
+	{
+		applyBatch(start, count - start < batchSize ? count - start : batchSize);
+	}
+}
+
+bool ParticleAnchorSet::isConcurrent() const {
+	return false;
+}
+
+void ParticleAnchorSet::refreshAnchors() {
+	unsigned count = (unsigned)particles.size();
+	for (unsigned i = 0; i < count; i++)
+	{
+		unsigned anchor = anchorIndices[i];
+		if (anchor == noAnchor) continue;
+		anchorX[i] = anchors[anchor].x;
+		anchorY[i] = anchors[anchor].y;
+		anchorZ[i] = anchors[anchor].z;
+	}
+	anchorsDirty = false;
+}
+
+void ParticleAnchorSet::applyBatch(unsigned first, unsigned count) {
+	const unsigned batchSize = 256;
+	const unsigned prefetchDistance = 8;
+	real dx[batchSize], dy[batchSize], dz[batchSize];
+	real vx[batchSize], vy[batchSize], vz[batchSize];
+	real scales[batchSize];
+
+	// Gather the particles, fetching those of the next constraints ahead of time
+	Particle* const* batch = &particles[first];
+	unsigned total = (unsigned)particles.size();
+	for (unsigned i = 0; i < count; i++)
+	{
+#ifdef CYCLONE_SSE2
+		if (first + i + prefetchDistance < total) _mm_prefetch((const char*)batch[i + prefetchDistance], _MM_HINT_T0);
+#endif
+		Particle* particle = batch[i];
+		dx[i] = particle->position.x - anchorX[first + i];
+		dy[i] = particle->position.y - anchorY[first + i];
+		dz[i] = particle->position.z - anchorZ[first + i];
+		vx[i] = particle->velocity.x;
+		vy[i] = particle->velocity.y;
+		vz[i] = particle->velocity.z;
+	}
+
+	// The force is -(k * extension + damping * speed along the constraint) along it,
+	// zero under the smallest extension, kept as a scale of the offset from the anchor
+	const real* k = &stiffness[first];
+	const real* rest = &restLengths[first];
+	const real* damping = &dampings[first];
+	const real* minExtension = &minExtensions[first];
+	unsigned i = 0;
+
+#ifdef CYCLONE_SSE2
+	const __m128 zero = _mm_setzero_ps();
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(dx + i), y = _mm_loadu_ps(dy + i), z = _mm_loadu_ps(dz + i);
+		__m128 length2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, x), _mm_mul_ps(y, y)), _mm_mul_ps(z, z));
+		__m128 apart = _mm_cmpgt_ps(length2, zero);
+		__m128 length = _mm_sqrt_ps(length2);
+		__m128 inverse = _mm_and_ps(apart, _mm_div_ps(_mm_set1_ps(1), _mm_or_ps(length, _mm_andnot_ps(apart, _mm_set1_ps(1)))));
+
+		__m128 extension = _mm_sub_ps(length, _mm_loadu_ps(rest + i));
+		__m128 pulling = _mm_cmpgt_ps(extension, _mm_loadu_ps(minExtension + i));
+		__m128 speed = _mm_mul_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(x, _mm_loadu_ps(vx + i)), _mm_mul_ps(y, _mm_loadu_ps(vy + i))),
+			_mm_mul_ps(z, _mm_loadu_ps(vz + i))), inverse);
+		__m128 magnitude = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(k + i), extension), _mm_mul_ps(_mm_loadu_ps(damping + i), speed));
+		_mm_storeu_ps(scales + i, _mm_and_ps(pulling, _mm_sub_ps(zero, _mm_mul_ps(magnitude, inverse))));
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		real length = real_sqrt(dx[i] * dx[i] + dy[i] * dy[i] + dz[i] * dz[i]);
+		real extension = length - rest[i];
+		if (length <= 0 || !(extension > minExtension[i]))
+		{
+			scales[i] = 0;
+			continue;
+		}
+		real inverse = 1 / length;
+		real speed = (dx[i] * vx[i] + dy[i] * vy[i] + dz[i] * vz[i]) * inverse;
+		scales[i] = -(k[i] * extension + damping[i] * speed) * inverse;
+	}
+
+	for (i = 0; i < count; i++)
+	{
+		if (scales[i] == 0) continue;
+		batch[i]->addForce(Vector3(dx[i] * scales[i], dy[i] * scales[i], dz[i] * scales[i]));
+		stats.active++;
+	}
+}
+
+unsigned ParticleAnchorSet::getConstraintCount() const {
+	return (unsigned)particles.size();
+}
+
+unsigned ParticleAnchorSet::getAnchorCount() const {
+	return (unsigned)anchors.size();
+}
+
+const Vector3& ParticleAnchorSet::getTableAnchor(unsigned anchor) const {
+	return anchors[anchor];
+}
+
+Particle* ParticleAnchorSet::getParticle(unsigned constraint) const {
+	return particles[constraint];
+}
+
+const ParticleAnchorStats& ParticleAnchorSet::getStats() const {
+	return stats;
+}
@@ -1,123 +1,161 @@
 #include <include/particle.h>
 #include <assert.h>
-#include <float.h>
+#include <limits>
 
 using namespace cyclone;
 
-void Particle::setInverseMass(const real inverseMass) {
-	Particle::inverseMass = inverseMass;
+template<class P>
+void ParticleT<P>::setInverseMass(const Scalar inverseMass) {
+	ParticleT::inverseMass = inverseMass;
 }
 
-void Particle::setMass(const real mass) {
+template<class P>
+void ParticleT<P>::setMass(const Scalar mass) {
 	assert(mass != 0);
-	Particle::inverseMass = ((real)1.0)/mass;
+	ParticleT::inverseMass = ((Scalar)1.0)/mass;
 }
 
-real Particle::getInverseMass() const {
-	return inverseMass;	
+template<class P>
+typename ParticleT<P>::Scalar ParticleT<P>::getInverseMass() const {
+	return inverseMass;
 }
 
-real Particle::getMass() const {
+template<class P>
+typename ParticleT<P>::Scalar ParticleT<P>::getMass() const {
 	if (inverseMass == 0)
 	{
-		return REAL_MAX;
+		return std::numeric_limits<Scalar>::max();
 	}
 	else
 	{
-		return ((real)1.0) / inverseMass;
+		return ((Scalar)1.0) / inverseMass;
 	}
 }
 
-void Particle::integrate(real duration) {
+template<class P>
+void ParticleT<P>::integrate(Scalar duration) {
+	integrate(duration, real_pow(damping, duration));
+}
+
+template<class P>
+void ParticleT<P>::integrate(Scalar duration, Scalar dragFactor) {
 	assert(duration > 0.0);
-	
-	// Update linear position
-	position.addScaledVector(velocity, duration);
+
+	// Update linear position, in the precision of the position
+	position.addScaledVector(PositionVector(velocity), duration);
 
 	// Work out the acceleration from the force
-	Vector3 resultingAcceleration = acceleration;
+	Vector resultingAcceleration = acceleration;
 	resultingAcceleration.addScaledVector(forceAccum, inverseMass);
 
 	// Update linear velocity
 	velocity.addScaledVector(resultingAcceleration, duration);
 
 	// Impose drag
-	velocity *= real_pow(damping, duration);
+	velocity *= dragFactor;
 
 	forceAccum.clear();
 
 }
 
-bool Particle::hasFiniteMass() const{
+template<class P>
+bool ParticleT<P>::hasFiniteMass() const{
 	return inverseMass >= 0.0f;
 }
 
-void Particle::setDamping(const real damping) {
-	Particle::damping = damping;
+template<class P>
+void ParticleT<P>::setDamping(const Scalar damping) {
+	ParticleT::damping = damping;
 }
 
-real Particle::getDamping() const {
+template<class P>
+typename ParticleT<P>::Scalar ParticleT<P>::getDamping() const {
 	return damping;
 }
 
-Vector3 Particle::getPosition() const {
+template<class P>
+typename ParticleT<P>::PositionVector ParticleT<P>::getPosition() const {
 	return position;
 }
 
-void Particle::setPosition(const Vector3& position) {
-	Particle::position = position;
+template<class P>
+void ParticleT<P>::setPosition(const PositionVector& position) {
+	ParticleT::position = position;
 }
 
-void Particle::setPosition(const real x, const real y, const real z) {
-	Particle::position.x = x;
-	Particle::position.y = y;
-	Particle::position.z = z;
+template<class P>
+void ParticleT<P>::setPosition(const PositionScalar x, const PositionScalar y, const PositionScalar z) {
+	ParticleT::position.x = x;
+	ParticleT::position.y = y;
+	ParticleT::position.z = z;
 }
 
-void Particle::getPosition(Vector3* position) const {
-	*position = Particle::position;
+template<class P>
+void ParticleT<P>::getPosition(PositionVector* position) const {
+	*position = ParticleT::position;
 }
 
-void Particle::setVelocity(const Vector3& velocity) {
-	Particle::velocity = velocity;
+template<class P>
+void ParticleT<P>::setVelocity(const Vector& velocity) {
+	ParticleT::velocity = velocity;
 }
 
-void Particle::setVelocity(const real x, const real y, const real z) {
+template<class P>
+void ParticleT<P>::setVelocity(const Scalar x, const Scalar y, const Scalar z) {
 	velocity.x = x;
 	velocity.y = y;
 	velocity.z = z;
 }
 
-Vector3 Particle::getVelocity() const {
+template<class P>
+typename ParticleT<P>::Vector ParticleT<P>::getVelocity() const {
 	return velocity;
 }
 
-void Particle::getVelocity(Vector3* velocity) const {
-	*velocity = Particle::velocity;
+template<class P>
+void ParticleT<P>::getVelocity(Vector* velocity) const {
+	*velocity = ParticleT::velocity;
 }
 
-void Particle::setAcceleration(const Vector3& acceleration) {
-	Particle::acceleration = acceleration;
+template<class P>
+void ParticleT<P>::setAcceleration(const Vector& acceleration) {
+	ParticleT::acceleration = acceleration;
 }
 
-void Particle::setAcceleration(const real x, const real y, const real z) {
+template<class P>
+void ParticleT<P>::setAcceleration(const Scalar x, const Scalar y, const Scalar z) {
 	acceleration.x = x;
 	acceleration.y = y;
 	acceleration.z = z;
 }
 
-Vector3 Particle::getAcceleration() const {
+template<class P>
+typename ParticleT<P>::Vector ParticleT<P>::getAcceleration() const {
 	return acceleration;
 }
 
-void Particle::getAcceleration(Vector3 *acceleration) const {
-	*acceleration = Particle::acceleration;
+template<class P>
+void ParticleT<P>::getAcceleration(Vector *acceleration) const {
+	*acceleration = ParticleT::acceleration;
 }
 
-void Particle::clearAccumulator() {
+template<class P>
+void ParticleT<P>::clearAccumulator() {
 	forceAccum.clear();
 }
 
-void Particle::addForce(const Vector3& force) {
+template<class P>
+void ParticleT<P>::addForce(const Vector& force) {
 	forceAccum += force;
-}
\ No newline at end of file
+}
+
+template<class P>
+typename ParticleT<P>::Vector ParticleT<P>::getAccumulatedForce() const {
+	return forceAccum;
+}
+
+namespace cyclone {
+	template class ParticleT<SinglePrecision>;
+	template class ParticleT<DoublePrecision>;
+	template class ParticleT<MixedPrecision>;
+}
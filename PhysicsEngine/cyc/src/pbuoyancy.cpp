@@ -0,0 +1,214 @@
+#include <include/pbuoyancy.h>
+#include <include/pmath.h>
+#include <assert.h>
+#include <math.h>
+
+using namespace cyclone;
+
+/*
+* The number of particles processed at a time, so the working arrays live on the stack
+*/
+static const unsigned batchSize = 256;
+
+template<class P>
+ParticleWaterGridT<P>::ParticleWaterGridT(unsigned width, unsigned depth, Scalar originX, Scalar originZ, Scalar spacing, Scalar height) {
+	assert(width >= 2 && depth >= 2 && spacing > 0);
+
+	ParticleWaterGridT::width = width;
+	ParticleWaterGridT::depth = depth;
+	ParticleWaterGridT::originX = originX;
+	ParticleWaterGridT::originZ = originZ;
+	ParticleWaterGridT::spacing = spacing;
+	heights.assign(width * depth, height);
+}
+
+template<class P>
+void ParticleWaterGridT<P>::sampleHeights(const Scalar* x, const Scalar* z, Scalar* results, unsigned count) const {
+	const Scalar inverseSpacing = 1 / spacing;
+	const Scalar maxU = (Scalar)(width - 1);
+	const Scalar maxV = (Scalar)(depth - 1);
+	const Scalar* grid = &heights[0];
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		// Grid coordinates, clamped to the grid
+		Scalar u = (x[i] - originX) * inverseSpacing;
+		Scalar v = (z[i] - originZ) * inverseSpacing;
+		u = u < 0 ? 0 : (u > maxU ? maxU : u);
+		v = v < 0 ? 0 : (v > maxV ? maxV : v);
+
+		// The cell, kept inside the grid so the far edge uses the last cell
+		unsigned cellU = (unsigned)u;
+		unsigned cellV = (unsigned)v;
+		if (cellU > width - 2) cellU = width - 2;
+		if (cellV > depth - 2) cellV = depth - 2;
+		Scalar fu = u - cellU;
+		Scalar fv = v - cellV;
+
+		const Scalar* row = grid + cellV * width + cellU;
+		Scalar nearHeight = row[0] + (row[1] - row[0]) * fu;
+		Scalar farHeight = row[width] + (row[width + 1] - row[width]) * fu;
+		results[i] = nearHeight + (farHeight - nearHeight) * fv;
+	}
+}
+
+template<class P>
+void ParticleWaterGridT<P>::setHeight(unsigned i, unsigned j, Scalar height) {
+	assert(i < width && j < depth);
+	heights[j * width + i] = height;
+}
+
+template<class P>
+typename ParticleWaterGridT<P>::Scalar ParticleWaterGridT<P>::getHeight(unsigned i, unsigned j) const {
+	assert(i < width && j < depth);
+	return heights[j * width + i];
+}
+
+template<class P>
+std::vector<typename ParticleWaterGridT<P>::Scalar>& ParticleWaterGridT<P>::getHeights() {
+	return heights;
+}
+
+template<class P>
+unsigned ParticleWaterGridT<P>::getWidth() const {
+	return width;
+}
+
+template<class P>
+unsigned ParticleWaterGridT<P>::getDepth() const {
+	return depth;
+}
+
+template<class P>
+ParticleWaterWavesT<P>::ParticleWaterWavesT(Scalar baseHeight) {
+	ParticleWaterWavesT::baseHeight = baseHeight;
+	ParticleWaterWavesT::time = 0;
+}
+
+template<class P>
+void ParticleWaterWavesT<P>::addWave(const Wave& wave) {
+	waves.push_back(wave);
+}
+
+template<class P>
+void ParticleWaterWavesT<P>::setTime(double time) {
+	ParticleWaterWavesT::time = time;
+}
+
+template<class P>
+void ParticleWaterWavesT<P>::advance(double duration) {
+	time += duration;
+}
+
+template<class P>
+void ParticleWaterWavesT<P>::sampleHeights(const Scalar* x, const Scalar* z, Scalar* results, unsigned count) const {
+	Scalar arguments[batchSize];
+	Scalar sines[batchSize];
+
+	for (unsigned start = 0; start < count; start += batchSize)
+	{
+		unsigned size = count - start < batchSize ? count - start : batchSize;
+		Scalar* heights = results + start;
+		for (unsigned i = 0; i < size; i++)
+		{
+			heights[i] = baseHeight;
+		}
+
+		typename std::vector<Wave>::const_iterator w = waves.begin();
+		for (; w != waves.end(); w++)
+		{
+			// The part of the phase that only depends on time is reduced to a turn in double,
+			// so the sine keeps its accuracy however long the simulation runs
+			double turn = 6.283185307179586;
+			double timePhase = fmod(w->phase - w->frequency * time, turn);
+			Scalar offset = (Scalar)timePhase;
+			Scalar kx = w->waveNumber * w->directionX;
+			Scalar kz = w->waveNumber * w->directionZ;
+
+			for (unsigned i = 0; i < size; i++)
+			{
+				arguments[i] = kx * x[start + i] + kz * z[start + i] + offset;
+			}
+			batchSin(arguments, sines, size);
+			for (unsigned i = 0; i < size; i++)
+			{
+				heights[i] += w->amplitude * sines[i];
+			}
+		}
+	}
+}
+
+template<class P>
+std::vector<typename ParticleWaterWavesT<P>::Wave>& ParticleWaterWavesT<P>::getWaves() {
+	return waves;
+}
+
+template<class P>
+ParticleBatchBuoyancyT<P>::ParticleBatchBuoyancyT(const ParticleWaterT<P>* water, Scalar maxDepth, Scalar volume, Scalar liquidDensity) {
+	assert(maxDepth > 0);
+
+	ParticleBatchBuoyancyT::water = water;
+	ParticleBatchBuoyancyT::maxDepth = maxDepth;
+	ParticleBatchBuoyancyT::volume = volume;
+	ParticleBatchBuoyancyT::liquidDensity = liquidDensity;
+}
+
+template<class P>
+void ParticleBatchBuoyancyT<P>::updateForce(ParticleT<P>* particle, Scalar duration) {
+	updateForces(&particle, 1, duration);
+}
+
+template<class P>
+void ParticleBatchBuoyancyT<P>::updateForces(ParticleT<P>* const* particles, unsigned count, Scalar duration) {
+	Scalar x[batchSize];
+	Scalar y[batchSize];
+	Scalar z[batchSize];
+	Scalar heights[batchSize];
+
+	const Scalar maxForce = liquidDensity * volume;
+	const Scalar inverseRange = 1 / (2 * maxDepth);
+
+	for (unsigned start = 0; start < count; start += batchSize)
+	{
+		unsigned size = count - start < batchSize ? count - start : batchSize;
+		ParticleT<P>* const* batch = particles + start;
+
+		for (unsigned i = 0; i < size; i++)
+		{
+			x[i] = (Scalar)batch[i]->position.x;
+			y[i] = (Scalar)batch[i]->position.y;
+			z[i] = (Scalar)batch[i]->position.z;
+		}
+		water->sampleHeights(x, z, heights, size);
+
+		// The submerged fraction goes from 0 at maxDepth above the surface to 1 at maxDepth below it
+		for (unsigned i = 0; i < size; i++)
+		{
+			Scalar fraction = (heights[i] + maxDepth - y[i]) * inverseRange;
+			fraction = fraction < 0 ? 0 : (fraction > 1 ? 1 : fraction);
+			heights[i] = maxForce * fraction;
+		}
+
+		for (unsigned i = 0; i < size; i++)
+		{
+			if (heights[i] > 0) batch[i]->addForce(Vector(0, heights[i], 0));
+		}
+	}
+}
+
+template<class P>
+bool ParticleBatchBuoyancyT<P>::isConcurrent() const {
+	return true;
+}
+
+namespace cyclone {
+	template class ParticleWaterGridT<SinglePrecision>;
+	template class ParticleWaterGridT<DoublePrecision>;
+	template class ParticleWaterGridT<MixedPrecision>;
+	template class ParticleWaterWavesT<SinglePrecision>;
+	template class ParticleWaterWavesT<DoublePrecision>;
+	template class ParticleWaterWavesT<MixedPrecision>;
+	template class ParticleBatchBuoyancyT<SinglePrecision>;
+	template class ParticleBatchBuoyancyT<DoublePrecision>;
+	template class ParticleBatchBuoyancyT<MixedPrecision>;
+}
@@ -0,0 +1,448 @@
+#include <include/pcompact.h>
+#include <include/pmath.h>
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CYCLONE_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace cyclone;
+
+/*
+* The dithers rounding to the nearest value
+*/
+static const unsigned nearestPosition = 0x8000;
+static const unsigned nearestVelocity = 0x0fff;
+
+/*
+* Converts a float to a half float, adding the dither to the 13 bits dropped before
+* truncating them. Values too large for a half become the largest half
+*/
+static uint16_t floatToHalf(float value, unsigned dither) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = (bits >> 16) & 0x8000;
+	uint32_t magnitude = bits & 0x7fffffff;
+
+	// Past the largest half, or not a number
+	if (magnitude >= 0x47800000) return (uint16_t)(sign | 0x7bff);
+
+	// Under the smallest normal half, 2^-14: a multiple of 2^-24
+	if (magnitude < 0x38800000)
+	{
+		float scaled = fabsf(value) * 16777216.0f + dither * (1.0f / 8192.0f);
+		return (uint16_t)(sign | (uint32_t)scaled);
+	}
+
+	// Move the exponent from a bias of 127 to 15, the dither carrying into it if it must
+	uint32_t half = (magnitude + dither - (112u << 23)) >> 13;
+	if (half > 0x7bff) half = 0x7bff;
+	return (uint16_t)(sign | half);
+}
+
+/*
+* Converts a half float to a float. Moving the bits into a float and multiplying by
+* 2^112 moves the exponent from a bias of 15 to 127, and turns subnormal halves into
+* normal floats
+*/
+static float halfToFloat(uint16_t half) {
+	uint32_t bits = (uint32_t)(half & 0x7fff) << 13;
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	value *= 5.192296858534828e33f;
+	return half & 0x8000 ? -value : value;
+}
+
+/*
+* Mixes the bits of a value, for the dithers
+*/
+static uint32_t mixBits(uint32_t value) {
+	value ^= value >> 16;
+	value *= 0x7feb352d;
+	value ^= value >> 15;
+	value *= 0x846ca68b;
+	value ^= value >> 16;
+	return value;
+}
+
+/*
+* Holds the dithers of the integration: the low 16 bits for a position, the next 13
+* bits for a velocity. Each takes its high 12 bits from a shuffle of every value, so
+* the table has no bias, and the rest at random
+*/
+static const unsigned ditherCount = 4096;
+
+struct DitherTable {
+	uint32_t values[ditherCount];
+
+	DitherTable() {
+		unsigned positions[ditherCount], velocities[ditherCount];
+		for (unsigned i = 0; i < ditherCount; i++)
+		{
+			positions[i] = i;
+			velocities[i] = i;
+		}
+		for (unsigned i = ditherCount - 1; i > 0; i--)
+		{
+			std::swap(positions[i], positions[mixBits(i) % (i + 1)]);
+			std::swap(velocities[i], velocities[mixBits(i + ditherCount) % (i + 1)]);
+		}
+		for (unsigned i = 0; i < ditherCount; i++)
+		{
+			uint32_t bits = mixBits(i + 2 * ditherCount);
+			values[i] = (positions[i] << 4) | (bits & 0xf) | (velocities[i] << 17) | (bits & 0x10000);
+		}
+	}
+};
+
+static const uint32_t* getDithers() {
+	static DitherTable table;
+	return table.values;
+}
+
+/*
+* Converts count half floats, one per 32 bits, to floats
+*/
+static void decodeHalves(const uint32_t* halves, float* values, unsigned count) {
+	unsigned i = 0;
+
+#ifdef CYCLONE_SSE2
+	const __m128i magnitudeMask = _mm_set1_epi32(0x7fff), signMask = _mm_set1_epi32(0x8000);
+	const __m128 rebias = _mm_set1_ps(5.192296858534828e33f);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i half = _mm_loadu_si128((const __m128i*)(halves + i));
+		__m128 magnitude = _mm_mul_ps(_mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(half, magnitudeMask), 13)), rebias);
+		__m128i sign = _mm_slli_epi32(_mm_and_si128(half, signMask), 16);
+		_mm_storeu_ps(values + i, _mm_or_ps(magnitude, _mm_castsi128_ps(sign)));
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		values[i] = halfToFloat((uint16_t)halves[i]);
+	}
+}
+
+/*
+* Converts count floats to half floats, one per 32 bits, with bits 16 to 28 of the dithers
+*/
+static void encodeHalves(const float* values, const uint32_t* dithers, uint32_t* halves, unsigned count) {
+	unsigned i = 0;
+
+#ifdef CYCLONE_SSE2
+	const __m128i magnitudeMask = _mm_set1_epi32(0x7fffffff), signMask = _mm_set1_epi32(0x8000);
+	const __m128i ditherMask = _mm_set1_epi32(0x1fff), largest = _mm_set1_epi32(0x7bff);
+	const __m128i rebias = _mm_set1_epi32(112 << 23), smallestNormal = _mm_set1_epi32(0x38800000);
+	const __m128 subnormalScale = _mm_set1_ps(16777216.0f), ditherScale = _mm_set1_ps(1.0f / 8192.0f);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i bits = _mm_castps_si128(_mm_loadu_ps(values + i));
+		__m128i dither = _mm_and_si128(_mm_srli_epi32(_mm_loadu_si128((const __m128i*)(dithers + i)), 16), ditherMask);
+		__m128i sign = _mm_and_si128(_mm_srli_epi32(bits, 16), signMask);
+		__m128i magnitude = _mm_and_si128(bits, magnitudeMask);
+
+		// Normal halves, capped at the largest
+		__m128i normal = _mm_srli_epi32(_mm_sub_epi32(_mm_add_epi32(magnitude, dither), rebias), 13);
+		__m128i over = _mm_cmpgt_epi32(normal, largest);
+		normal = _mm_or_si128(_mm_and_si128(over, largest), _mm_andnot_si128(over, normal));
+
+		// Subnormal halves, multiples of 2^-24
+		__m128 scaled = _mm_add_ps(_mm_mul_ps(_mm_castsi128_ps(magnitude), subnormalScale), _mm_mul_ps(_mm_cvtepi32_ps(dither), ditherScale));
+		__m128i subnormal = _mm_cvttps_epi32(scaled);
+
+		__m128i small = _mm_cmplt_epi32(magnitude, smallestNormal);
+		__m128i half = _mm_or_si128(_mm_and_si128(small, subnormal), _mm_andnot_si128(small, normal));
+		_mm_storeu_si128((__m128i*)(halves + i), _mm_or_si128(half, sign));
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		halves[i] = floatToHalf(values[i], (dithers[i] >> 16) & 0x1fff);
+	}
+}
+
+/*
+* Splits count positions, in cells from the origin of their cell, into the number of
+* cells moved and the offset in 1/65536 of a cell, with the low 16 bits of the dithers
+*/
+static void splitOffsets(const float* local, const uint32_t* dithers, int32_t* moves, uint32_t* offsets, unsigned count) {
+	unsigned i = 0;
+
+#ifdef CYCLONE_SSE2
+	const __m128i one = _mm_set1_epi32(1), ditherMask = _mm_set1_epi32(0xffff), cellOffsets = _mm_set1_epi32(65536);
+	const __m128 offsetScale = _mm_set1_ps(65536.0f), ditherScale = _mm_set1_ps(1.0f / 65536.0f);
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(local + i);
+
+		// Truncation rounds toward zero, one less below zero gives the floor
+		__m128i whole = _mm_cvttps_epi32(x);
+		whole = _mm_sub_epi32(whole, _mm_and_si128(_mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(whole), x)), one));
+		__m128 fraction = _mm_sub_ps(x, _mm_cvtepi32_ps(whole));
+
+		__m128 dither = _mm_mul_ps(_mm_cvtepi32_ps(_mm_and_si128(_mm_loadu_si128((const __m128i*)(dithers + i)), ditherMask)), ditherScale);
+		__m128i offset = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(fraction, offsetScale), dither));
+
+		// Rounded up to the next cell
+		__m128i carry = _mm_cmpgt_epi32(offset, _mm_sub_epi32(cellOffsets, one));
+		offset = _mm_sub_epi32(offset, _mm_and_si128(carry, cellOffsets));
+		whole = _mm_sub_epi32(whole, carry);
+
+		_mm_storeu_si128((__m128i*)(moves + i), whole);
+		_mm_storeu_si128((__m128i*)(offsets + i), offset);
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		float whole = floorf(local[i]);
+		unsigned offset = (unsigned)((local[i] - whole) * 65536.0f + (dithers[i] & 0xffff) * (1.0f / 65536.0f));
+		int move = (int)whole;
+		if (offset >= 65536)
+		{
+			offset -= 65536;
+			move++;
+		}
+		moves[i] = move;
+		offsets[i] = offset;
+	}
+}
+
+ParticleCompactSet::ParticleCompactSet(real cellSize) {
+	assert(cellSize > 0);
+
+	ParticleCompactSet::cellSize = cellSize;
+	ParticleCompactSet::inverseCellSize = 1 / cellSize;
+	ParticleCompactSet::seed = 1;
+}
+
+unsigned ParticleCompactSet::addMaterial(const Vector3& acceleration, real damping) {
+	assert(materials.size() < maxMaterials);
+
+	ParticleMaterial material;
+	material.acceleration = acceleration;
+	material.damping = damping;
+	materials.push_back(material);
+	return (unsigned)materials.size() - 1;
+}
+
+void ParticleCompactSet::setMaterial(unsigned material, const Vector3& acceleration, real damping) {
+	materials[material].acceleration = acceleration;
+	materials[material].damping = damping;
+}
+
+const ParticleMaterial& ParticleCompactSet::getMaterial(unsigned material) const {
+	return materials[material];
+}
+
+unsigned ParticleCompactSet::add(const Vector3& position, const Vector3& velocity, unsigned material) {
+	assert(material < materials.size());
+
+	ParticleCompactState state = ParticleCompactState();
+	state.material = (uint8_t)material;
+	const unsigned positionDither[3] = { nearestPosition, nearestPosition, nearestPosition };
+	const unsigned velocityDither[3] = { nearestVelocity, nearestVelocity, nearestVelocity };
+	encodeState(&state, &position.x, &velocity.x, positionDither, velocityDither);
+	states.push_back(state);
+	return (unsigned)states.size() - 1;
+}
+
+void ParticleCompactSet::remove(unsigned index) {
+	states[index] = states.back();
+	states.pop_back();
+}
+
+void ParticleCompactSet::clear() {
+	states.clear();
+}
+
+void ParticleCompactSet::reserve(unsigned count) {
+	states.reserve(count);
+}
+
+unsigned ParticleCompactSet::getCount() const {
+	return (unsigned)states.size();
+}
+
+void ParticleCompactSet::decode(unsigned begin, unsigned count, Vector3* positions, Vector3* velocities) const {
+	assert(begin + count <= states.size());
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		const ParticleCompactState& state = states[begin + i];
+		if (positions)
+		{
+			real* position = &positions[i].x;
+			for (unsigned a = 0; a < 3; a++)
+			{
+				position[a] = (state.cell[a] + state.offset[a] * (1.0f / 65536.0f)) * cellSize;
+			}
+		}
+		if (velocities)
+		{
+			real* velocity = &velocities[i].x;
+			for (unsigned a = 0; a < 3; a++)
+			{
+				velocity[a] = halfToFloat(state.velocity[a]);
+			}
+		}
+	}
+}
+
+void ParticleCompactSet::encode(unsigned begin, unsigned count, const Vector3* positions, const Vector3* velocities) {
+	assert(begin + count <= states.size());
+
+	const unsigned positionDither[3] = { nearestPosition, nearestPosition, nearestPosition };
+	const unsigned velocityDither[3] = { nearestVelocity, nearestVelocity, nearestVelocity };
+	for (unsigned i = 0; i < count; i++)
+	{
+		ParticleCompactState& state = states[begin + i];
+		Vector3 position = positions ? positions[i] : getPosition(begin + i);
+		Vector3 velocity = velocities ? velocities[i] : getVelocity(begin + i);
+		encodeState(&state, &position.x, &velocity.x, positionDither, velocityDither);
+	}
+}
+
+Vector3 ParticleCompactSet::getPosition(unsigned index) const {
+	// Built again from its components, the padding of the decoded vector isn't written
+	Vector3 position;
+	decode(index, 1, &position, NULL);
+	return Vector3(position.x, position.y, position.z);
+}
+
+Vector3 ParticleCompactSet::getVelocity(unsigned index) const {
+	// Built again from its components, the padding of the decoded vector isn't written
+	Vector3 velocity;
+	decode(index, 1, NULL, &velocity);
+	return Vector3(velocity.x, velocity.y, velocity.z);
+}
+
+void ParticleCompactSet::setParticleMaterial(unsigned index, unsigned material) {
+	assert(material < materials.size());
+	states[index].material = (uint8_t)material;
+}
+
+const ParticleCompactState* ParticleCompactSet::getStates() const {
+	return states.empty() ? NULL : &states[0];
+}
+
+void ParticleCompactSet::integrate(real duration) {
+	assert(duration > 0);
+	if (states.empty()) return;
+
+	// The drag factors damping^duration of the materials, and their velocity changes
+	unsigned materialCount = (unsigned)materials.size();
+	real dampings[maxMaterials];
+	real drags[maxMaterials];
+	Vector3 deltas[maxMaterials];
+	for (unsigned m = 0; m < materialCount; m++)
+	{
+		dampings[m] = materials[m].damping;
+		deltas[m] = materials[m].acceleration * duration;
+	}
+	batchPow(dampings, duration, drags, materialCount);
+
+	// The positions are integrated in cells from the origin of their cell, so they keep
+	// their precision however far from the world origin
+	const unsigned batchSize = 256;
+	real local[3][batchSize];
+	real velocity[3][batchSize];
+	real delta[3][batchSize];
+	real drag[batchSize];
+	uint32_t halves[3][batchSize];
+	uint32_t dithers[3][batchSize];
+	int32_t moves[3][batchSize];
+	uint32_t offsets[3][batchSize];
+
+	const uint32_t* table = getDithers();
+	unsigned base = seed;
+	real step = duration * inverseCellSize;
+	unsigned count = (unsigned)states.size();
+	for (unsigned start = 0; start < count; start += batchSize)
+	{
+		unsigned size = count - start < batchSize ? count - start : batchSize;
+		ParticleCompactState* batch = &states[start];
+
+		// Decode into arrays of floats
+		for (unsigned i = 0; i < size; i++)
+		{
+			unsigned m = batch[i].material;
+			for (unsigned a = 0; a < 3; a++)
+			{
+				local[a][i] = batch[i].offset[a] * (1.0f / 65536.0f);
+				halves[a][i] = batch[i].velocity[a];
+				dithers[a][i] = table[(base + (start + i) * 3 + a) & (ditherCount - 1)];
+			}
+			delta[0][i] = deltas[m].x;
+			delta[1][i] = deltas[m].y;
+			delta[2][i] = deltas[m].z;
+			drag[i] = drags[m];
+		}
+
+		// Integrate as Particle does: the position with the old velocity, then the velocity
+		for (unsigned a = 0; a < 3; a++)
+		{
+			decodeHalves(halves[a], velocity[a], size);
+			for (unsigned i = 0; i < size; i++)
+			{
+				local[a][i] += velocity[a][i] * step;
+				velocity[a][i] = (velocity[a][i] + delta[a][i]) * drag[i];
+			}
+
+			// Encode, rounding at random so the rounding errors average out
+			splitOffsets(local[a], dithers[a], moves[a], offsets[a], size);
+			encodeHalves(velocity[a], dithers[a], halves[a], size);
+		}
+
+		for (unsigned i = 0; i < size; i++)
+		{
+			for (unsigned a = 0; a < 3; a++)
+			{
+				int cell = batch[i].cell[a] + moves[a][i];
+				unsigned offset = offsets[a][i];
+				if (cell < -32768 || cell > 32767)
+				{
+					offset = cell < 0 ? 0 : 65535;
+					cell = cell < 0 ? -32768 : 32767;
+				}
+				batch[i].cell[a] = (int16_t)cell;
+				batch[i].offset[a] = (uint16_t)offset;
+				batch[i].velocity[a] = (uint16_t)halves[a][i];
+			}
+		}
+	}
+
+	seed = mixBits(seed + 0x9e3779b9u);
+}
+
+void ParticleCompactSet::step(real duration) {
+	integrate(duration);
+}
+
+void ParticleCompactSet::encodeState(ParticleCompactState* state, const real* position, const real* velocity,
+	const unsigned* positionDither, const unsigned* velocityDither) const {
+	for (unsigned a = 0; a < 3; a++)
+	{
+		// Split the position in the cell and the offset in it, keeping the cells in range
+		double scaled = (double)position[a] * inverseCellSize;
+		if (scaled < -32768) scaled = -32768;
+		if (scaled > 32767.99998) scaled = 32767.99998;
+		double whole = floor(scaled);
+		int cell = (int)whole;
+		unsigned quantized = (unsigned)((scaled - whole) * 65536.0 + positionDither[a] * (1.0 / 65536.0));
+		if (quantized >= 65536)
+		{
+			quantized -= 65536;
+			cell++;
+		}
+		state->cell[a] = (int16_t)cell;
+		state->offset[a] = (uint16_t)quantized;
+		state->velocity[a] = floatToHalf(velocity[a], velocityDither[a]);
+	}
+}
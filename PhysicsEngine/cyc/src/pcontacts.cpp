@@ -1,19 +1,22 @@
 #include <include/pcontacts.h>
 
-void ParticleContact::resolve(real duration) {
+template<class P>
+void ParticleContactT<P>::resolve(Scalar duration) {
 	resolveVelocity(duration);
 	resolveInterpenetration(duration);
 }
 
-real ParticleContact::calculateSeparatingVelocity() const {
-	Vector3 relativeVelocity = particle[0]->getVelocity();
+template<class P>
+typename ParticleContactT<P>::Scalar ParticleContactT<P>::calculateSeparatingVelocity() const {
+	Vector relativeVelocity = particle[0]->getVelocity();
 	if (particle[1]) relativeVelocity -= particle[1]->getVelocity();
 	return relativeVelocity * contactNormal;
 }
 
-void ParticleContact::resolveVelocity(real duration) {
+template<class P>
+void ParticleContactT<P>::resolveVelocity(Scalar duration) {
 	// Find the velocity in the direction of the contact
-	real separatingVelocity = calculateSeparatingVelocity();
+	Scalar separatingVelocity = calculateSeparatingVelocity();
 	if (separatingVelocity > 0)
 	{
 		// The contact is either stationary or is separatingd
@@ -21,13 +24,13 @@ void ParticleContact::resolveVelocity(real duration) {
 		return;
 	}
 	// Calculate the new separating velocity
-	real newSeparatingVelocity = -separatingVelocity * restitution;
+	Scalar newSeparatingVelocity = -separatingVelocity * restitution;
 
 	// Check the velocity build up due to acceleration only
-	Vector3 accCausedVelocity = particle[0]->getAcceleration();
+	Vector accCausedVelocity = particle[0]->getAcceleration();
 	if (particle[1]) accCausedVelocity -= particle[1]->getAcceleration();
 
-	real accCausedSeparatingVelocity = accCausedVelocity * contactNormal * duration;
+	Scalar accCausedSeparatingVelocity = accCausedVelocity * contactNormal * duration;
 
 	// If we have a closing velocity due to acceleration buildup, remove it from the new separating velocity
 	if (accCausedSeparatingVelocity < 0)
@@ -39,19 +42,19 @@ void ParticleContact::resolveVelocity(real duration) {
 	}
 
 	// Get the velocity after contact
-	real deltaVelocity = newSeparatingVelocity - separatingVelocity;
+	Scalar deltaVelocity = newSeparatingVelocity - separatingVelocity;
 
-	real totalInverseMass = particle[0]->getInverseMass();
+	Scalar totalInverseMass = particle[0]->getInverseMass();
 	if (particle[1]) totalInverseMass += particle[1]->getInverseMass();
 
 	// No impulse to apply, the two object are stationary
 	if (totalInverseMass <= 0) return;
 
 	// Calculate the impulse
-	real impulse = deltaVelocity / totalInverseMass;
+	Scalar impulse = deltaVelocity / totalInverseMass;
 
 	// Find the amount of impulse per unit of inverse mass
-	Vector3 impulsePerMass = contactNormal * impulse;
+	Vector impulsePerMass = contactNormal * impulse;
 
 	// Apply the impulse in the direction of the contact and proportional to the mass
 	particle[0]->setVelocity(particle[0]->getVelocity() + impulsePerMass * particle[0]->getInverseMass());
@@ -65,11 +68,12 @@ void ParticleContact::resolveVelocity(real duration) {
 }
 
 
-void ParticleContact::resolveInterpenetration(real duration) {
+template<class P>
+void ParticleContactT<P>::resolveInterpenetration(Scalar duration) {
 	if (penetration <= 0) return;
 
 	// The movement for each object is based on its inverse mass, so total that
-	real totalInverseMass = particle[0]->getInverseMass();
+	Scalar totalInverseMass = particle[0]->getInverseMass();
 
 	if (particle[1]) totalInverseMass += particle[1]->getInverseMass();
 
@@ -77,35 +81,57 @@ void ParticleContact::resolveInterpenetration(real duration) {
 	if (totalInverseMass <= 0) return;
 	
 	// Find the movement per inverse mass unit
-	Vector3 movePerIMass = contactNormal * (-penetration / totalInverseMass);
+	Vector movePerIMass = contactNormal * (-penetration / totalInverseMass);
 
 	// Apply the correction
-	particle[0]->setPosition(particle[0]->getPosition() + movePerIMass * particle[0]->getInverseMass());
+	particle[0]->setPosition(particle[0]->getPosition() + PositionVector(movePerIMass * particle[0]->getInverseMass()));
 
-	if (particle[1]) particle[1]->setPosition(particle[1]->getPosition() + movePerIMass * particle[1]->getInverseMass());
+	if (particle[1]) particle[1]->setPosition(particle[1]->getPosition() + PositionVector(movePerIMass * particle[1]->getInverseMass()));
 
 }
 
-ParticleContactResolver::ParticleContactResolver(unsigned iterations) {
-	ParticleContactResolver::iterations = iterations;
+template<class P>
+ParticleContactResolverT<P>::ParticleContactResolverT(unsigned iterations) {
+	ParticleContactResolverT::iterations = iterations;
+	ParticleContactResolverT::iterationsUsed = 0;
+	ParticleContactResolverT::contactsResolved = 0;
 }
 
-void ParticleContactResolver::setIterations(unsigned iterations) {
-	ParticleContactResolver::iterations = iterations;
+template<class P>
+void ParticleContactResolverT<P>::setIterations(unsigned iterations) {
+	ParticleContactResolverT::iterations = iterations;
 }
 
-void ParticleContactResolver::resolveContacts(ParticleContact* contactArray, unsigned numContacts, real duration) {
+template<class P>
+unsigned ParticleContactResolverT<P>::getIterations() const {
+	return iterations;
+}
+
+template<class P>
+unsigned ParticleContactResolverT<P>::getIterationsUsed() const {
+	return iterationsUsed;
+}
+
+template<class P>
+unsigned ParticleContactResolverT<P>::getContactsResolved() const {
+	return contactsResolved;
+}
+
+template<class P>
+void ParticleContactResolverT<P>::resolveContacts(ParticleContactT<P>* contactArray, unsigned numContacts, Scalar duration) {
 	iterationsUsed = 0;
+	contactsResolved = 0;
+	resolved.assign(numContacts, false);
 
 	while (iterationsUsed < iterations)
 	{
 		// Find the contact with the largest closing velocity
-		real max = 0;
+		Scalar max = 0;
 		unsigned maxIndex = numContacts;
 
 		for (unsigned i = 0; i < numContacts; i++)
 		{
-			real sepVel = contactArray[i].calculateSeparatingVelocity();
+			Scalar sepVel = contactArray[i].calculateSeparatingVelocity();
 			if (sepVel < max)
 			{
 				max = sepVel;
@@ -113,12 +139,28 @@ void ParticleContactResolver::resolveContacts(ParticleContact* contactArray, uns
 			}	
 		}
 
+		// Nothing is closing anymore, we are done
+		if (maxIndex == numContacts) break;
+
 		// Resolve the contact
 		contactArray[maxIndex].resolve(duration);
-
+		if (!resolved[maxIndex])
+		{
+			resolved[maxIndex] = true;
+			contactsResolved++;
+		}
 
 		iterationsUsed++;
 
 	}
 
-}
\ No newline at end of file
+}
+
+namespace cyclone {
+	template class ParticleContactT<SinglePrecision>;
+	template class ParticleContactT<DoublePrecision>;
+	template class ParticleContactT<MixedPrecision>;
+	template class ParticleContactResolverT<SinglePrecision>;
+	template class ParticleContactResolverT<DoublePrecision>;
+	template class ParticleContactResolverT<MixedPrecision>;
+}
@@ -0,0 +1,654 @@
+#include <include/pdomain.h>
+#include <assert.h>
+#include <algorithm>
+#include <atomic>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace cyclone;
+
+/*
+* The alignment of the parts of the shared memory, a cache line so the indices of the
+* rings written by different sides don't share one
+*/
+static const size_t sharedAlignment = 64;
+
+static size_t alignShared(size_t size) {
+	return (size + sharedAlignment - 1) & ~(sharedAlignment - 1);
+}
+
+ParticleSharedMemory::ParticleSharedMemory(const char* name, size_t size, bool create) {
+	ParticleSharedMemory::memory = NULL;
+	ParticleSharedMemory::size = size;
+	ParticleSharedMemory::name = name;
+	ParticleSharedMemory::owner = create;
+	ParticleSharedMemory::handle = NULL;
+
+#ifdef _WIN32
+	HANDLE mapping;
+	if (create)
+	{
+		unsigned long long wide = size;
+		mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(wide >> 32), (DWORD)wide, name);
+	}
+	else
+	{
+		mapping = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name);
+	}
+	if (!mapping) return;
+
+	memory = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+	if (!memory)
+	{
+		CloseHandle(mapping);
+		return;
+	}
+	handle = mapping;
+#else
+	// A name left by a process that didn't exit cleanly is replaced
+	if (create) shm_unlink(name);
+	int file = shm_open(name, create ? O_CREAT | O_EXCL | O_RDWR : O_RDWR, 0600);
+	if (file < 0) return;
+	if (create && ftruncate(file, (off_t)size) != 0)
+	{
+		close(file);
+		shm_unlink(name);
+		return;
+	}
+
+	void* mapped = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	close(file);
+	if (mapped == MAP_FAILED)
+	{
+		if (create) shm_unlink(name);
+		return;
+	}
+	memory = mapped;
+#endif
+}
+
+ParticleSharedMemory::~ParticleSharedMemory() {
+	if (!memory) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(memory);
+	CloseHandle((HANDLE)handle);
+#else
+	munmap(memory, size);
+	if (owner) shm_unlink(name.c_str());
+#endif
+}
+
+void* ParticleSharedMemory::getMemory() const {
+	return memory;
+}
+
+size_t ParticleSharedMemory::getSize() const {
+	return size;
+}
+
+/*
+* The producer writes the tail and the consumer the head, on their own cache lines.
+* Both only grow, the records being at their values modulo the capacity
+*/
+struct ParticleRing::Header {
+	std::atomic<unsigned> head;
+	char headPadding[sharedAlignment - sizeof(std::atomic<unsigned>)];
+	std::atomic<unsigned> tail;
+	char tailPadding[sharedAlignment - sizeof(std::atomic<unsigned>)];
+};
+
+size_t ParticleRing::requiredSize(unsigned capacity) {
+	return alignShared(sizeof(Header) + capacity * sizeof(ParticleDomainRecord));
+}
+
+ParticleRing::ParticleRing(void* memory, unsigned capacity, bool initialize) {
+	assert(capacity > 0 && (capacity & (capacity - 1)) == 0);
+
+	ParticleRing::capacity = capacity;
+	ParticleRing::header = initialize ? new (memory) Header() : (Header*)memory;
+	ParticleRing::records = (ParticleDomainRecord*)((char*)memory + sizeof(Header));
+	if (initialize)
+	{
+		header->head = 0;
+		header->tail = 0;
+	}
+}
+
+bool ParticleRing::push(const ParticleDomainRecord& record) {
+	unsigned tail = header->tail.load(std::memory_order_relaxed);
+	if (tail - header->head.load(std::memory_order_acquire) == capacity) return false;
+
+	records[tail & (capacity - 1)] = record;
+	header->tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+bool ParticleRing::pop(ParticleDomainRecord* record) {
+	unsigned head = header->head.load(std::memory_order_relaxed);
+	if (head == header->tail.load(std::memory_order_acquire)) return false;
+
+	*record = records[head & (capacity - 1)];
+	header->head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+/*
+* The start of a shared region, followed by the histograms of the domains and by the
+* rings, two per boundary: ring 2b from domain b to b + 1, and ring 2b + 1 back
+*/
+struct ParticleDomain::Region {
+	unsigned domains;
+	unsigned ringCapacity;
+	unsigned axis;
+	unsigned rebalanceInterval;
+	real halo;
+
+	/*
+	* Holds the boundaries the slabs start with
+	*/
+	real boundaries[maxDomains + 1];
+
+	/*
+	* Holds the barrier: the number of domains arrived and the number of barriers passed
+	*/
+	std::atomic<unsigned> arrived;
+	std::atomic<unsigned> generation;
+
+	/*
+	* Holds the extent and number of the particles of each domain during a rebalance
+	*/
+	real low[maxDomains];
+	real high[maxDomains];
+	unsigned counts[maxDomains];
+};
+
+static unsigned* regionHistograms(void* memory) {
+	return (unsigned*)((char*)memory + alignShared(sizeof(ParticleDomain::Region)));
+}
+
+static char* regionRings(void* memory, unsigned domains) {
+	return (char*)regionHistograms(memory) + alignShared(domains * ParticleDomain::histogramBins * sizeof(unsigned));
+}
+
+size_t ParticleDomain::regionSize(unsigned domains, unsigned ringCapacity) {
+	size_t rings = 2 * (domains - 1) * ParticleRing::requiredSize(ringCapacity);
+	return alignShared(sizeof(Region)) + alignShared(domains * histogramBins * sizeof(unsigned)) + rings;
+}
+
+void ParticleDomain::initializeRegion(void* memory, unsigned domains, unsigned ringCapacity, unsigned axis,
+	real low, real high, real halo, unsigned rebalanceInterval) {
+	assert(domains >= 1 && domains <= maxDomains && axis < 3 && high > low);
+
+	Region* region = new (memory) Region();
+	region->domains = domains;
+	region->ringCapacity = ringCapacity;
+	region->axis = axis;
+	region->rebalanceInterval = rebalanceInterval;
+	region->halo = halo;
+	region->arrived = 0;
+	region->generation = 0;
+
+	region->boundaries[0] = -REAL_MAX;
+	region->boundaries[domains] = REAL_MAX;
+	for (unsigned d = 1; d < domains; d++)
+	{
+		region->boundaries[d] = low + (high - low) * d / domains;
+	}
+
+	char* rings = regionRings(memory, domains);
+	size_t ringSize = ParticleRing::requiredSize(ringCapacity);
+	for (unsigned r = 0; r < 2 * (domains - 1); r++)
+	{
+		ParticleRing(rings + r * ringSize, ringCapacity, true);
+	}
+}
+
+ParticleDomain::ParticleDomain(void* memory, unsigned rank, ParticleWorld* world) {
+	ParticleDomain::region = (Region*)memory;
+	ParticleDomain::rank = rank;
+	ParticleDomain::world = world;
+	ParticleDomain::exchanges = 0;
+	ParticleDomain::stats = ParticleDomainStats();
+	assert(rank < region->domains);
+
+	unsigned domains = region->domains;
+	boundaries.assign(region->boundaries, region->boundaries + domains + 1);
+
+	char* rings = regionRings(memory, domains);
+	size_t ringSize = ParticleRing::requiredSize(region->ringCapacity);
+	toLower = fromLower = toHigher = fromHigher = NULL;
+	if (rank > 0)
+	{
+		fromLower = new ParticleRing(rings + (2 * (rank - 1)) * ringSize, region->ringCapacity, false);
+		toLower = new ParticleRing(rings + (2 * (rank - 1) + 1) * ringSize, region->ringCapacity, false);
+	}
+	if (rank + 1 < domains)
+	{
+		toHigher = new ParticleRing(rings + (2 * rank) * ringSize, region->ringCapacity, false);
+		fromHigher = new ParticleRing(rings + (2 * rank + 1) * ringSize, region->ringCapacity, false);
+	}
+
+	link.domain = this;
+	link.particle[0] = NULL;
+	link.particle[1] = NULL;
+}
+
+ParticleDomain::~ParticleDomain() {
+	delete toLower;
+	delete fromLower;
+	delete toHigher;
+	delete fromHigher;
+}
+
+Particle* ParticleDomain::createParticle(unsigned id) {
+	assert(entries.find(id) == entries.end());
+
+	Entry entry;
+	entry.particle = world->createParticle();
+	entry.owned = true;
+	entry.seen = exchanges;
+	entries[id] = entry;
+	return entry.particle;
+}
+
+void ParticleDomain::addSpring(unsigned first, unsigned second, real stiffness, real restLength) {
+	Bond bond = { first, second, stiffness, restLength, false };
+	bonds.push_back(bond);
+}
+
+void ParticleDomain::addRod(unsigned first, unsigned second, real length) {
+	Bond bond = { first, second, 0, length, true };
+	bonds.push_back(bond);
+}
+
+void ParticleDomain::exchange() {
+	// The particles removed by the previous exchange are already out of the world, so they
+	// only go back to the pool
+	Particles::iterator r = removed.begin();
+	for (; r != removed.end(); r++)
+	{
+		world->releaseParticle(*r);
+	}
+	removed.clear();
+	added.clear();
+
+	exchanges++;
+	stats.departed = 0;
+	stats.arrived = 0;
+	stats.sent = 0;
+	stats.received = 0;
+	stats.waits = 0;
+
+	unsigned domains = region->domains;
+	if (domains > 1 && region->rebalanceInterval > 0 && exchanges % region->rebalanceInterval == 0) rebalance();
+
+	// Sort the particles owned: those out of the slab move, those near a boundary are copied
+	real low = boundaries[rank], high = boundaries[rank + 1], halo = region->halo;
+	outLower.clear();
+	outHigher.clear();
+	std::unordered_map<unsigned, Entry>::iterator i = entries.begin();
+	for (; i != entries.end(); i++)
+	{
+		Entry& entry = i->second;
+		if (!entry.owned) continue;
+
+		ParticleDomainRecord record;
+		real c = coordinate(entry.particle);
+		if (c < low || c >= high)
+		{
+			// It stays here as a ghost until the next exchange
+			fillRecord(&record, i->first, entry.particle, ParticleDomainRecord::RECORD_MIGRATE);
+			if (c < low) outLower.push_back(record);
+			else outHigher.push_back(record);
+			entry.owned = false;
+			entry.seen = exchanges;
+			stats.departed++;
+			continue;
+		}
+
+		if (toLower && c < low + halo)
+		{
+			fillRecord(&record, i->first, entry.particle, ParticleDomainRecord::RECORD_GHOST);
+			outLower.push_back(record);
+		}
+		if (toHigher && c >= high - halo)
+		{
+			fillRecord(&record, i->first, entry.particle, ParticleDomainRecord::RECORD_GHOST);
+			outHigher.push_back(record);
+		}
+	}
+
+	bool lowerDone = fromLower == NULL;
+	bool higherDone = fromHigher == NULL;
+	if (toLower) send(toLower, outLower, &lowerDone, &higherDone);
+	if (toHigher) send(toHigher, outHigher, &lowerDone, &higherDone);
+	while (!lowerDone || !higherDone)
+	{
+		receive(&lowerDone, &higherDone);
+		if (lowerDone && higherDone) break;
+		stats.waits++;
+		std::this_thread::yield();
+	}
+
+	// The ghosts not refreshed are gone from the halo
+	stats.owned = 0;
+	stats.ghosts = 0;
+	i = entries.begin();
+	while (i != entries.end())
+	{
+		if (!i->second.owned && i->second.seen != exchanges)
+		{
+			removed.push_back(i->second.particle);
+			i = entries.erase(i);
+			continue;
+		}
+		if (i->second.owned) stats.owned++;
+		else stats.ghosts++;
+		i++;
+	}
+	retire();
+}
+
+void ParticleDomain::applyForces() {
+	std::vector<Bond>::iterator b = bonds.begin();
+	for (; b != bonds.end(); b++)
+	{
+		if (b->rod) continue;
+
+		std::unordered_map<unsigned, Entry>::const_iterator first = entries.find(b->first);
+		std::unordered_map<unsigned, Entry>::const_iterator second = entries.find(b->second);
+		if (first == entries.end() || second == entries.end()) continue;
+		if (!first->second.owned && !second->second.owned) continue;
+
+		Vector3 d = first->second.particle->position - second->second.particle->position;
+		real length = d.magnitude();
+		if (length <= 0) continue;
+
+		Vector3 force = d * (-b->stiffness * (length - b->length) / length);
+		if (first->second.owned) first->second.particle->addForce(force);
+		if (second->second.owned) second->second.particle->addForce(force * -1);
+	}
+}
+
+unsigned ParticleDomain::Link::fillContact(ParticleContact* contact, unsigned limit) const {
+	unsigned used = 0;
+	std::vector<Bond>::const_iterator b = domain->bonds.begin();
+	for (; b != domain->bonds.end() && used < limit; b++)
+	{
+		if (!b->rod) continue;
+
+		std::unordered_map<unsigned, Entry>::const_iterator first = domain->entries.find(b->first);
+		std::unordered_map<unsigned, Entry>::const_iterator second = domain->entries.find(b->second);
+		if (first == domain->entries.end() || second == domain->entries.end()) continue;
+		if (!first->second.owned && !second->second.owned) continue;
+
+		ParticleRod rod;
+		rod.particle[0] = first->second.particle;
+		rod.particle[1] = second->second.particle;
+		rod.length = b->length;
+		used += rod.fillContact(contact + used, limit - used);
+	}
+	return used;
+}
+
+void ParticleDomain::Link::remapParticles(const ParticleRemap& remap) {
+	// The domain finds its particles by id, so the entries follow the world
+	std::unordered_map<unsigned, Entry>::iterator e = domain->entries.begin();
+	for (; e != domain->entries.end(); e++)
+	{
+		e->second.particle = remap.map(e->second.particle);
+	}
+
+	Particles::iterator p = domain->added.begin();
+	for (; p != domain->added.end(); p++)
+	{
+		*p = remap.map(*p);
+	}
+}
+
+ParticleLink* ParticleDomain::getLink() {
+	return &link;
+}
+
+Particle* ParticleDomain::getParticle(unsigned id) const {
+	std::unordered_map<unsigned, Entry>::const_iterator found = entries.find(id);
+	return found == entries.end() ? NULL : found->second.particle;
+}
+
+bool ParticleDomain::isOwned(unsigned id) const {
+	std::unordered_map<unsigned, Entry>::const_iterator found = entries.find(id);
+	return found != entries.end() && found->second.owned;
+}
+
+const ParticleDomain::Particles& ParticleDomain::getAdded() const {
+	return added;
+}
+
+const ParticleDomain::Particles& ParticleDomain::getRemoved() const {
+	return removed;
+}
+
+unsigned ParticleDomain::getRank() const {
+	return rank;
+}
+
+real ParticleDomain::getLow() const {
+	return boundaries[rank];
+}
+
+real ParticleDomain::getHigh() const {
+	return boundaries[rank + 1];
+}
+
+const ParticleDomainStats& ParticleDomain::getStats() const {
+	return stats;
+}
+
+real ParticleDomain::coordinate(const Particle* particle) const {
+	return (&particle->position.x)[region->axis];
+}
+
+void ParticleDomain::fillRecord(ParticleDomainRecord* record, unsigned id, const Particle* particle, unsigned kind) const {
+	record->id = id;
+	record->kind = kind;
+	record->position = particle->position;
+	record->velocity = particle->velocity;
+	record->acceleration = particle->acceleration;
+	record->inverseMass = particle->getInverseMass();
+	record->damping = particle->damping;
+}
+
+void ParticleDomain::send(ParticleRing* ring, const std::vector<ParticleDomainRecord>& records, bool* lowerDone, bool* higherDone) {
+	ParticleDomainRecord end = ParticleDomainRecord();
+	end.kind = ParticleDomainRecord::RECORD_END;
+
+	// Receiving while the ring is full lets a neighbor sending to us at the same time go on
+	unsigned count = (unsigned)records.size();
+	for (unsigned i = 0; i <= count; i++)
+	{
+		const ParticleDomainRecord& record = i < count ? records[i] : end;
+		while (!ring->push(record))
+		{
+			receive(lowerDone, higherDone);
+			stats.waits++;
+			std::this_thread::yield();
+		}
+	}
+	stats.sent += count;
+}
+
+void ParticleDomain::receive(bool* lowerDone, bool* higherDone) {
+	ParticleDomainRecord record;
+	while (!*lowerDone && fromLower->pop(&record))
+	{
+		if (record.kind == ParticleDomainRecord::RECORD_END) *lowerDone = true;
+		else apply(record);
+	}
+	while (!*higherDone && fromHigher->pop(&record))
+	{
+		if (record.kind == ParticleDomainRecord::RECORD_END) *higherDone = true;
+		else apply(record);
+	}
+}
+
+void ParticleDomain::apply(const ParticleDomainRecord& record) {
+	stats.received++;
+
+	std::unordered_map<unsigned, Entry>::iterator found = entries.find(record.id);
+	if (found == entries.end())
+	{
+		Entry entry;
+		entry.particle = world->createParticle();
+		entry.owned = false;
+		entry.seen = exchanges;
+		found = entries.insert(std::make_pair(record.id, entry)).first;
+		added.push_back(entry.particle);
+	}
+
+	Entry& entry = found->second;
+	entry.seen = exchanges;
+	if (record.kind == ParticleDomainRecord::RECORD_MIGRATE)
+	{
+		entry.owned = true;
+		stats.arrived++;
+	}
+
+	Particle* particle = entry.particle;
+	particle->position = record.position;
+	particle->velocity = record.velocity;
+	particle->acceleration = record.acceleration;
+	particle->setInverseMass(record.inverseMass);
+	particle->damping = record.damping;
+}
+
+/*
+* Finds the particles, and the registrations of the particles, in a sorted list
+*/
+struct IsRemoved {
+	const ParticleDomain::Particles* sorted;
+
+	bool operator()(Particle* particle) const {
+		return std::binary_search(sorted->begin(), sorted->end(), particle);
+	}
+
+	bool operator()(const ParticleForceRegistry::ParticleForceRegistration& registration) const {
+		return (*this)(registration.particle);
+	}
+};
+
+void ParticleDomain::retire() {
+	if (removed.empty()) return;
+
+	// Takes them all out in one pass over the registrations and the particles
+	sortedRemoved.assign(removed.begin(), removed.end());
+	std::sort(sortedRemoved.begin(), sortedRemoved.end());
+
+	IsRemoved isRemoved = { &sortedRemoved };
+
+	ParticleForceRegistry::Registry& registrations = world->getForceRegistry().getRegistrations();
+	registrations.erase(std::remove_if(registrations.begin(), registrations.end(), isRemoved), registrations.end());
+
+	ParticleWorld::Particles& particles = world->getParticles();
+	particles.erase(std::remove_if(particles.begin(), particles.end(), isRemoved), particles.end());
+}
+
+void ParticleDomain::barrier() {
+	unsigned generation = region->generation.load();
+	if (region->arrived.fetch_add(1) + 1 == region->domains)
+	{
+		region->arrived.store(0);
+		region->generation.fetch_add(1);
+		return;
+	}
+	while (region->generation.load() == generation)
+	{
+		std::this_thread::yield();
+	}
+}
+
+void ParticleDomain::rebalance() {
+	unsigned domains = region->domains;
+	unsigned* histograms = regionHistograms(region);
+
+	// Publish the extent of the particles owned, and find that of all of them
+	real low = REAL_MAX, high = -REAL_MAX;
+	unsigned count = 0;
+	std::unordered_map<unsigned, Entry>::const_iterator i = entries.begin();
+	for (; i != entries.end(); i++)
+	{
+		if (!i->second.owned) continue;
+		real c = coordinate(i->second.particle);
+		if (c < low) low = c;
+		if (c > high) high = c;
+		count++;
+	}
+	region->low[rank] = low;
+	region->high[rank] = high;
+	region->counts[rank] = count;
+	barrier();
+
+	unsigned total = 0;
+	low = REAL_MAX;
+	high = -REAL_MAX;
+	for (unsigned d = 0; d < domains; d++)
+	{
+		if (region->counts[d] == 0) continue;
+		if (region->low[d] < low) low = region->low[d];
+		if (region->high[d] > high) high = region->high[d];
+		total += region->counts[d];
+	}
+
+	// Every domain reads the same values, so they all take the same branch
+	if (total == 0 || high <= low)
+	{
+		barrier();
+		return;
+	}
+
+	// Publish the histogram of the particles owned
+	real width = (high - low) / histogramBins;
+	unsigned* histogram = histograms + rank * histogramBins;
+	for (unsigned b = 0; b < histogramBins; b++) histogram[b] = 0;
+	for (i = entries.begin(); i != entries.end(); i++)
+	{
+		if (!i->second.owned) continue;
+		int b = (int)((coordinate(i->second.particle) - low) / width);
+		if (b < 0) b = 0;
+		if (b >= (int)histogramBins) b = histogramBins - 1;
+		histogram[b]++;
+	}
+	barrier();
+
+	// Place each boundary where the running count reaches its share
+	unsigned boundary = 1;
+	unsigned before = 0;
+	for (unsigned b = 0; b < histogramBins && boundary < domains; b++)
+	{
+		unsigned inBin = 0;
+		for (unsigned d = 0; d < domains; d++) inBin += histograms[d * histogramBins + b];
+
+		while (boundary < domains && (unsigned long long)(before + inBin) * domains >= (unsigned long long)total * boundary)
+		{
+			real target = (real)total * boundary / domains;
+			real fraction = inBin > 0 ? (target - before) / inBin : 0;
+			boundaries[boundary] = low + (b + fraction) * width;
+			boundary++;
+		}
+		before += inBin;
+	}
+
+	// The histograms are only written again once every domain has read them
+	barrier();
+	stats.rebalances++;
+}
@@ -0,0 +1,199 @@
+#include <include/pemitter.h>
+#include <include/pmath.h>
+#include <assert.h>
+
+using namespace cyclone;
+
+ParticleEmitter::ParticleEmitter(unsigned capacity, unsigned seed) {
+	particles.resize(capacity);
+	ages.resize(capacity);
+	lifetimes.resize(capacity);
+
+	ParticleEmitter::liveCount = 0;
+	ParticleEmitter::rate = 0;
+	ParticleEmitter::pendingSpawn = 0;
+	ParticleEmitter::minLifetime = 1;
+	ParticleEmitter::maxLifetime = 1;
+	ParticleEmitter::velocitySpread = 0;
+	ParticleEmitter::mass = 1;
+	ParticleEmitter::damping = 0.99f;
+	ParticleEmitter::seed = seed ? seed : 1;
+	ParticleEmitter::dropped = 0;
+}
+
+void ParticleEmitter::setRate(real rate) {
+	ParticleEmitter::rate = rate;
+}
+
+void ParticleEmitter::setLifetime(real minLifetime, real maxLifetime) {
+	assert(minLifetime <= maxLifetime);
+	ParticleEmitter::minLifetime = minLifetime;
+	ParticleEmitter::maxLifetime = maxLifetime;
+}
+
+void ParticleEmitter::setOrigin(const Vector3& origin) {
+	ParticleEmitter::origin = origin;
+}
+
+void ParticleEmitter::setVelocity(const Vector3& velocity, real spread) {
+	ParticleEmitter::velocity = velocity;
+	ParticleEmitter::velocitySpread = spread;
+}
+
+void ParticleEmitter::setAcceleration(const Vector3& acceleration) {
+	ParticleEmitter::acceleration = acceleration;
+}
+
+void ParticleEmitter::setMass(real mass) {
+	assert(mass != 0);
+	ParticleEmitter::mass = mass;
+}
+
+void ParticleEmitter::setDamping(real damping) {
+	ParticleEmitter::damping = damping;
+}
+
+void ParticleEmitter::addGenerator(ParticleForceGenerator* fg) {
+	generators.push_back(fg);
+}
+
+void ParticleEmitter::removeGenerator(ParticleForceGenerator* fg) {
+	std::vector<ParticleForceGenerator*>::iterator i = generators.begin();
+	for (; i != generators.end(); i++)
+	{
+		if (*i == fg)
+		{
+			generators.erase(i);
+			return;
+		}
+	}
+}
+
+unsigned ParticleEmitter::spawn(unsigned count) {
+	unsigned capacity = (unsigned)particles.size();
+	unsigned spawned = count;
+	if (liveCount + spawned > capacity) spawned = capacity - liveCount;
+	dropped += count - spawned;
+
+	for (unsigned i = liveCount; i < liveCount + spawned; i++)
+	{
+		// Pick the random part of the velocity uniformly inside the sphere
+		Vector3 offset;
+		if (velocitySpread > 0)
+		{
+			do
+			{
+				offset = Vector3(random(-1, 1), random(-1, 1), random(-1, 1));
+			} while (offset.squareMagnitude() > 1);
+			offset *= velocitySpread;
+		}
+
+		Particle& particle = particles[i];
+		particle.setPosition(origin);
+		particle.setVelocity(velocity + offset);
+		particle.setAcceleration(acceleration);
+		particle.setMass(mass);
+		particle.setDamping(damping);
+		particle.clearAccumulator();
+
+		ages[i] = 0;
+		lifetimes[i] = random(minLifetime, maxLifetime);
+	}
+
+	liveCount += spawned;
+	return spawned;
+}
+
+void ParticleEmitter::step(real duration) {
+	retire(duration);
+
+	// Spawn the particles due in this step, carrying the fraction over to the next
+	pendingSpawn += rate * duration;
+	unsigned due = (unsigned)pendingSpawn;
+	pendingSpawn -= due;
+	if (due > 0) spawn(due);
+
+	// Apply the forces to the dense live set, then integrate it
+	std::vector<ParticleForceGenerator*>::iterator g = generators.begin();
+	for (; g != generators.end(); g++)
+	{
+		for (unsigned i = 0; i < liveCount; i++)
+		{
+			(*g)->updateForce(&particles[i], duration);
+		}
+	}
+
+	// The drag factors are computed a batch at a time with the vectorized pow
+	const unsigned batchSize = 256;
+	real dampings[batchSize];
+	real dragFactors[batchSize];
+	for (unsigned start = 0; start < liveCount; start += batchSize)
+	{
+		unsigned count = liveCount - start < batchSize ? liveCount - start : batchSize;
+		for (unsigned i = 0; i < count; i++)
+		{
+			dampings[i] = particles[start + i].damping;
+		}
+		batchPow(dampings, duration, dragFactors, count);
+		for (unsigned i = 0; i < count; i++)
+		{
+			particles[start + i].integrate(duration, dragFactors[i]);
+		}
+	}
+}
+
+void ParticleEmitter::clear() {
+	liveCount = 0;
+	pendingSpawn = 0;
+}
+
+Particle* ParticleEmitter::getParticles() {
+	return particles.empty() ? NULL : &particles[0];
+}
+
+unsigned ParticleEmitter::getLiveCount() const {
+	return liveCount;
+}
+
+unsigned ParticleEmitter::getCapacity() const {
+	return (unsigned)particles.size();
+}
+
+unsigned ParticleEmitter::getDroppedCount() const {
+	return dropped;
+}
+
+void ParticleEmitter::retire(real duration) {
+	for (unsigned i = 0; i < liveCount; i++)
+	{
+		ages[i] += duration;
+	}
+
+	unsigned i = 0;
+	while (i < liveCount)
+	{
+		if (ages[i] < lifetimes[i])
+		{
+			i++;
+			continue;
+		}
+
+		// Move the last live particle in this slot and check it again
+		liveCount--;
+		if (i == liveCount) break;
+
+		particles[i] = particles[liveCount];
+		ages[i] = ages[liveCount];
+		lifetimes[i] = lifetimes[liveCount];
+	}
+}
+
+real ParticleEmitter::random(real min, real max) {
+	// Xorshift, good enough for visual effects and the same on every platform
+	seed ^= seed << 13;
+	seed ^= seed >> 17;
+	seed ^= seed << 5;
+
+	real unit = (seed & 0xFFFFFF) * ((real)1.0 / 0x1000000);
+	return min + (max - min) * unit;
+}
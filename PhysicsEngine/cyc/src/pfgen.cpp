@@ -2,20 +2,212 @@
 
 using namespace cyclone;
 
-void ParticleForceRegistry::updateForces(real duration) {
-	Registry::iterator i = registrations.begin();
+template<class P>
+typename ParticleForceGeneratorT<P>::Scalar ParticleForceGeneratorT<P>::getStiffness() const {
+	return 0;
+}
+
+template<class P>
+void ParticleForceGeneratorT<P>::updateForces(ParticleT<P>* const* particles, unsigned count, Scalar duration) {
+	for (unsigned i = 0; i < count; i++)
+	{
+		updateForce(particles[i], duration);
+	}
+}
+
+template<class P>
+unsigned ParticleForceGeneratorT<P>::getInputs() const {
+	return FORCE_VOLATILE;
+}
+
+template<class P>
+const typename ParticleForceGeneratorT<P>::PositionVector* ParticleForceGeneratorT<P>::getAnchor() const {
+	return NULL;
+}
+
+template<class P>
+bool ParticleForceGeneratorT<P>::isConcurrent() const {
+	return false;
+}
+
+template<class P>
+void ParticleForceGeneratorT<P>::remapParticles(const ParticleRemapT<P>& remap) {
+}
+
+float ParticleForceCacheStats::getHitRate() const {
+	unsigned cached = hits + misses;
+	return cached ? (float)hits / cached : 0.0f;
+}
+
+/*
+* Returns true if no coordinate of the vectors differs by more than the tolerance
+*/
+template<class T, class S>
+static bool isClose(const Vector3T<T>& a, const Vector3T<T>& b, S tolerance) {
+	T x = a.x - b.x, y = a.y - b.y, z = a.z - b.z;
+	return x <= tolerance && x >= -tolerance && y <= tolerance && y >= -tolerance && z <= tolerance && z >= -tolerance;
+}
+
+template<class P>
+ParticleForceRegistryT<P>::ParticleForceRegistryT() {
+	ParticleForceRegistryT::caching = false;
+	ParticleForceRegistryT::tolerance = 0;
+	stats.hits = 0;
+	stats.misses = 0;
+	stats.uncached = 0;
+}
+
+template<class P>
+void ParticleForceRegistryT<P>::add(ParticleT<P>* particle, ParticleForceGeneratorT<P>* fg) {
+	ParticleForceRegistration registration;
+	registration.particle = particle;
+	registration.fg = fg;
+	registration.cache = noCache;
+	registrations.push_back(registration);
+}
+
+template<class P>
+void ParticleForceRegistryT<P>::remove(ParticleT<P>* particle, ParticleForceGeneratorT<P>* fg) {
+	typename Registry::iterator i = registrations.begin();
 	for (; i != registrations.end(); i++)
 	{
-		i->fg->updateForce(i->particle, duration);
+		if (i->particle == particle && i->fg == fg)
+		{
+			registrations.erase(i);
+			return;
+		}
+	}
+}
+
+template<class P>
+void ParticleForceRegistryT<P>::clear() {
+	registrations.clear();
+	caches.clear();
+}
+
+template<class P>
+void ParticleForceRegistryT<P>::updateForces(Scalar duration) {
+	const unsigned batchSize = 64;
+	ParticleT<P>* batch[batchSize];
+
+	stats.hits = 0;
+	stats.misses = 0;
+	stats.uncached = 0;
+
+	// The forces of removed registrations are dropped once they pile up
+	if (caches.size() > 2 * registrations.size() + batchSize) invalidateCache();
+
+	typename Registry::iterator i = registrations.begin();
+	while (i != registrations.end())
+	{
+		ParticleForceGeneratorT<P>* fg = i->fg;
+		unsigned inputs = caching ? fg->getInputs() : (unsigned)FORCE_VOLATILE;
+		if (!(inputs & FORCE_VOLATILE))
+		{
+			const PositionVector* anchor = inputs & FORCE_ANCHOR ? fg->getAnchor() : NULL;
+			for (; i != registrations.end() && i->fg == fg; i++)
+			{
+				updateCachedForce(&*i, inputs, anchor, duration);
+			}
+			continue;
+		}
+
+		// Gather the run of registrations of the same generator
+		unsigned count = 0;
+		for (; i != registrations.end() && i->fg == fg && count < batchSize; i++)
+		{
+			batch[count++] = i->particle;
+		}
+		stats.uncached += count;
+
+		if (count == 1) fg->updateForce(batch[0], duration);
+		else fg->updateForces(batch, count, duration);
+	}
+}
+
+template<class P>
+void ParticleForceRegistryT<P>::updateCachedForce(ParticleForceRegistration* registration, unsigned inputs,
+	const PositionVector* anchor, Scalar duration) {
+	ParticleT<P>* particle = registration->particle;
+
+	if (registration->cache == noCache)
+	{
+		registration->cache = (unsigned)caches.size();
+		caches.push_back(ForceCache());
 	}
+	else
+	{
+		// Apply the last force again if none of its inputs changed
+		const ForceCache& cache = caches[registration->cache];
+		if ((!(inputs & FORCE_POSITION) || isClose(particle->position, cache.position, tolerance)) &&
+			(!(inputs & FORCE_VELOCITY) || isClose(particle->velocity, cache.velocity, tolerance)) &&
+			(!anchor || isClose(*anchor, cache.anchor, tolerance)) &&
+			(!(inputs & FORCE_MASS) || particle->getInverseMass() == cache.inverseMass) &&
+			(!(inputs & FORCE_DURATION) || duration == cache.duration))
+		{
+			particle->addForce(cache.force);
+			stats.hits++;
+			return;
+		}
+	}
+
+	// Compute the force alone to keep it, then add it to the forces accumulated so far
+	Vector accumulated = particle->getAccumulatedForce();
+	particle->clearAccumulator();
+	registration->fg->updateForce(particle, duration);
+
+	ForceCache& cache = caches[registration->cache];
+	cache.force = particle->getAccumulatedForce();
+	cache.position = particle->position;
+	cache.velocity = particle->velocity;
+	if (anchor) cache.anchor = *anchor;
+	cache.inverseMass = particle->getInverseMass();
+	cache.duration = duration;
+
+	particle->clearAccumulator();
+	particle->addForce(accumulated);
+	particle->addForce(cache.force);
+	stats.misses++;
+}
+
+template<class P>
+void ParticleForceRegistryT<P>::setCaching(bool caching) {
+	ParticleForceRegistryT::caching = caching;
+}
+
+template<class P>
+void ParticleForceRegistryT<P>::setTolerance(Scalar tolerance) {
+	ParticleForceRegistryT::tolerance = tolerance;
 }
 
-ParticleGravity::ParticleGravity(Vector3& gravity) {
+template<class P>
+void ParticleForceRegistryT<P>::invalidateCache() {
+	caches.clear();
+	typename Registry::iterator i = registrations.begin();
+	for (; i != registrations.end(); i++)
+	{
+		i->cache = noCache;
+	}
+}
 
-	ParticleGravity::gravity = gravity;
+template<class P>
+const ParticleForceCacheStats& ParticleForceRegistryT<P>::getStats() const {
+	return stats;
 }
 
-void ParticleGravity::updateForce(Particle* particle, real duration) {
+template<class P>
+typename ParticleForceRegistryT<P>::Registry& ParticleForceRegistryT<P>::getRegistrations() {
+	return registrations;
+}
+
+template<class P>
+ParticleGravityT<P>::ParticleGravityT(Vector& gravity) {
+
+	ParticleGravityT::gravity = gravity;
+}
+
+template<class P>
+void ParticleGravityT<P>::updateForce(ParticleT<P>* particle, Scalar duration) {
 
 	// Is immovable
 	if (!particle->hasFiniteMass()) return;
@@ -24,42 +216,58 @@ void ParticleGravity::updateForce(Particle* particle, real duration) {
 	particle->addForce(gravity * particle->getMass());
 }
 
-ParticleDrag::ParticleDrag(real k1, real k2)
+template<class P>
+bool ParticleGravityT<P>::isConcurrent() const {
+	return true;
+}
+
+template<class P>
+ParticleDragT<P>::ParticleDragT(Scalar k1, Scalar k2)
 {
-	ParticleDrag::k1 = k1;
-	ParticleDrag::k2 = k2;
+	ParticleDragT::k1 = k1;
+	ParticleDragT::k2 = k2;
 }
 
-void ParticleDrag::updateForce(Particle* particle, real duration) {
+template<class P>
+void ParticleDragT<P>::updateForce(ParticleT<P>* particle, Scalar duration) {
 
-	Vector3 force;
+	Vector force;
 	particle->getVelocity(&force);
 
 	// Calculate the total drag force
-	real dragCoeff = force.magnitude();
+	Scalar dragCoeff = force.magnitude();
 	dragCoeff = k1 * dragCoeff + k2 * dragCoeff * dragCoeff;
 
-	// Calculate the final force and apply it	
+	// Calculate the final force and apply it
 	force.normalize();
 	force *= -dragCoeff;
 	particle->addForce(force);
 }
 
-ParticleSpring::ParticleSpring(Particle* other, real springConstant, real restLength) {
-	ParticleSpring::other = other;
-	ParticleSpring::springConstant = springConstant;
-	ParticleSpring::restLength = restLength;
+template<class P>
+bool ParticleDragT<P>::isConcurrent() const {
+	return true;
 }
 
-void ParticleSpring::updateForce(Particle* particle, real duration) {
-	// Calculate the vector of the spring
-	Vector3 force;
+template<class P>
+unsigned ParticleDragT<P>::getInputs() const {
+	return FORCE_VELOCITY;
+}
+
+template<class P>
+ParticleSpringT<P>::ParticleSpringT(ParticleT<P>* other, Scalar springConstant, Scalar restLength) {
+	ParticleSpringT::other = other;
+	ParticleSpringT::springConstant = springConstant;
+	ParticleSpringT::restLength = restLength;
+}
 
-	particle->getPosition(&force);
-	force -= other->getPosition();
+template<class P>
+void ParticleSpringT<P>::updateForce(ParticleT<P>* particle, Scalar duration) {
+	// Calculate the vector of the spring, in the precision of the positions
+	Vector force(particle->getPosition() - other->getPosition());
 
 	// Calculate the magnitude of the force
-	real magnitude = force.magnitude();
+	Scalar magnitude = force.magnitude();
 	magnitude = real_abs(magnitude - restLength);
 	magnitude *= springConstant;
 
@@ -69,21 +277,35 @@ void ParticleSpring::updateForce(Particle* particle, real duration) {
 	particle->addForce(force);
 }
 
-ParticleAnchoredSpring::ParticleAnchoredSpring(Vector3* anchor, real springConstant, real restLength) {
-	ParticleAnchoredSpring::anchor = anchor;
-	ParticleAnchoredSpring::springConstant = springConstant;
-	ParticleAnchoredSpring::restLength = restLength;
+template<class P>
+bool ParticleSpringT<P>::isConcurrent() const {
+	return true;
+}
+
+template<class P>
+typename ParticleSpringT<P>::Scalar ParticleSpringT<P>::getStiffness() const {
+	return springConstant;
 }
 
-void ParticleAnchoredSpring::updateForce(Particle* particle, real duration) {
+template<class P>
+void ParticleSpringT<P>::remapParticles(const ParticleRemapT<P>& remap) {
+	other = remap.map(other);
+}
+
+template<class P>
+ParticleAnchoredSpringT<P>::ParticleAnchoredSpringT(PositionVector* anchor, Scalar springConstant, Scalar restLength) {
+	ParticleAnchoredSpringT::anchor = anchor;
+	ParticleAnchoredSpringT::springConstant = springConstant;
+	ParticleAnchoredSpringT::restLength = restLength;
+}
+
+template<class P>
+void ParticleAnchoredSpringT<P>::updateForce(ParticleT<P>* particle, Scalar duration) {
 	// Calculate the force
-	Vector3 force;
-	
-	particle->getPosition(&force);
-	force -= *anchor;
+	Vector force(particle->getPosition() - *anchor);
 
 	// Calculate the magnitude of the force
-	real magnitude = force.magnitude();
+	Scalar magnitude = force.magnitude();
 	magnitude = real_abs(magnitude - restLength);
 	magnitude *= springConstant;
 
@@ -93,21 +315,41 @@ void ParticleAnchoredSpring::updateForce(Particle* particle, real duration) {
 	particle->addForce(force);
 }
 
+template<class P>
+bool ParticleAnchoredSpringT<P>::isConcurrent() const {
+	return true;
+}
+
+template<class P>
+typename ParticleAnchoredSpringT<P>::Scalar ParticleAnchoredSpringT<P>::getStiffness() const {
+	return springConstant;
+}
+
+template<class P>
+unsigned ParticleAnchoredSpringT<P>::getInputs() const {
+	return FORCE_POSITION | FORCE_ANCHOR;
+}
+
+template<class P>
+const typename ParticleAnchoredSpringT<P>::PositionVector* ParticleAnchoredSpringT<P>::getAnchor() const {
+	return anchor;
+}
+
 
-ParticleBungee::ParticleBungee(Particle* other, real springConstant, real restLength) {
-	ParticleBungee::other = other;
-	ParticleBungee::springConstant = springConstant;
-	ParticleBungee::restLength = restLength;
+template<class P>
+ParticleBungeeT<P>::ParticleBungeeT(ParticleT<P>* other, Scalar springConstant, Scalar restLength) {
+	ParticleBungeeT::other = other;
+	ParticleBungeeT::springConstant = springConstant;
+	ParticleBungeeT::restLength = restLength;
 }
 
-void ParticleBungee::updateForce(Particle* particle, real duration) {
+template<class P>
+void ParticleBungeeT<P>::updateForce(ParticleT<P>* particle, Scalar duration) {
 	// Calculate the vector of the spring
-	Vector3 force;
-	particle->getPosition(&force);
-	force -= other->getPosition();
+	Vector force(particle->getPosition() - other->getPosition());
 
 	// Calculate the magnitude of the spring
-	real magnitude = force.magnitude();
+	Scalar magnitude = force.magnitude();
 	if (magnitude <= restLength) return;
 	magnitude = springConstant * real_abs(magnitude - restLength);
 
@@ -118,23 +360,40 @@ void ParticleBungee::updateForce(Particle* particle, real duration) {
 
 }
 
-ParticleBuoyancy::ParticleBuoyancy(real maxDepth, real volume, real waterHeight, real liquidDensity) {
-	ParticleBuoyancy::maxDepth = maxDepth;
-	ParticleBuoyancy::volume = volume;
-	ParticleBuoyancy::waterHeight = waterHeight;
-	ParticleBuoyancy::liquidDensity = liquidDensity;
+template<class P>
+bool ParticleBungeeT<P>::isConcurrent() const {
+	return true;
 }
 
-void ParticleBuoyancy::updateForce(Particle* particle, real duration) {
-	
+template<class P>
+typename ParticleBungeeT<P>::Scalar ParticleBungeeT<P>::getStiffness() const {
+	return springConstant;
+}
+
+template<class P>
+void ParticleBungeeT<P>::remapParticles(const ParticleRemapT<P>& remap) {
+	other = remap.map(other);
+}
+
+template<class P>
+ParticleBuoyancyT<P>::ParticleBuoyancyT(Scalar maxDepth, Scalar volume, Scalar waterHeight, Scalar liquidDensity) {
+	ParticleBuoyancyT::maxDepth = maxDepth;
+	ParticleBuoyancyT::volume = volume;
+	ParticleBuoyancyT::waterHeight = waterHeight;
+	ParticleBuoyancyT::liquidDensity = liquidDensity;
+}
+
+template<class P>
+void ParticleBuoyancyT<P>::updateForce(ParticleT<P>* particle, Scalar duration) {
+
 	// Calculate the depth of the particle
-	real depth = particle->getPosition().y;
+	Scalar depth = (Scalar)particle->getPosition().y;
 
 	// Completely out of the water
 	if (depth >= waterHeight + maxDepth) return;
-	Vector3 force(0, 0, 0);
+	Vector force(0, 0, 0);
 
-	if (depth <= waterHeight - maxDepth) 
+	if (depth <= waterHeight - maxDepth)
 	{
 		// Fully submerged
 		force.y = liquidDensity * volume;
@@ -142,39 +401,97 @@ void ParticleBuoyancy::updateForce(Particle* particle, real duration) {
 		return;
 	}
 
-	// The block is partially submerged
-	real d = (depth - waterHeight - maxDepth) / 2 * maxDepth;
+	// The block is partially submerged, from none of it at maxDepth above
+	// the water to all of it at maxDepth below
+	Scalar d = (waterHeight + maxDepth - depth) / (2 * maxDepth);
 	force.y = liquidDensity * volume * d;
 	particle->addForce(force);
 
 
 }
 
-ParticleFakeSpring::ParticleFakeSpring(Vector3* anchor, real springConstant, real damping) {
-	ParticleFakeSpring::anchor = anchor;
-	ParticleFakeSpring::springConstant = springConstant;
-	ParticleFakeSpring::damping = damping;
+template<class P>
+bool ParticleBuoyancyT<P>::isConcurrent() const {
+	return true;
 }
 
-void ParticleFakeSpring::updateForce(Particle* particle, real duration) {
-	if (!particle->hasFiniteMass()) return;
+template<class P>
+unsigned ParticleBuoyancyT<P>::getInputs() const {
+	return FORCE_POSITION;
+}
 
-	// Calculate the relative position of the particle to the anchor
-	Vector3 position;
-	position = particle->getPosition() - *anchor;
+template<class P>
+ParticleFakeSpringT<P>::ParticleFakeSpringT(PositionVector* anchor, Scalar springConstant, Scalar damping) {
+	ParticleFakeSpringT::anchor = anchor;
+	ParticleFakeSpringT::springConstant = springConstant;
+	ParticleFakeSpringT::damping = damping;
+}
+
+template<class P>
+void ParticleFakeSpringT<P>::updateForce(ParticleT<P>* particle, Scalar duration) {
+	updateForces(&particle, 1, duration);
+}
 
+template<class P>
+bool ParticleFakeSpringT<P>::isConcurrent() const {
+	return true;
+}
+
+template<class P>
+void ParticleFakeSpringT<P>::updateForces(ParticleT<P>* const* particles, unsigned count, Scalar duration) {
 	// Calculate the constant and check whether they are in bounds
-	real gamma = 0.5f * real_sqrt(4 * springConstant - damping * damping);
+	Scalar gamma = 0.5f * real_sqrt(4 * springConstant - damping * damping);
 	if (gamma == 0.0f) return;
-	Vector3 c = position * (damping / 2.0f * gamma) + particle->getVelocity() * (1.0f / gamma);
 
-	// Calculate the target position
+	// The terms that only depend on the spring and the duration
+	Scalar positionScale = damping / 2.0f * gamma;
+	Scalar velocityScale = 1.0f / gamma;
+	Scalar cosine = real_cos(gamma * duration);
+	Scalar sine = real_sin(gamma * duration);
+	Scalar decay = real_exp(-0.5f * damping * duration);
+	Scalar accelerationScale = 1.0f / duration * duration;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		ParticleT<P>* particle = particles[i];
+		if (!particle->hasFiniteMass()) continue;
+
+		// Calculate the relative position of the particle to the anchor
+		Vector position(particle->getPosition() - *anchor);
+		Vector velocity = particle->getVelocity();
+		Vector c = position * positionScale + velocity * velocityScale;
 
-	Vector3 finalPosition = (position * real_cos(gamma * duration) + c * real_sin(gamma * duration)) * real_exp(-0.5f * damping * duration);
+		// Calculate the target position
+		Vector finalPosition = (position * cosine + c * sine) * decay;
 
-	// Calculate the resulting acceleration and the force
-	Vector3 finalAcceleration = (finalPosition - position) * (1.0f / duration * duration) - particle->getVelocity() * duration;
+		// Calculate the resulting acceleration and the force
+		Vector finalAcceleration = (finalPosition - position) * accelerationScale - velocity * duration;
 
-	particle->addForce(finalAcceleration * particle->getMass());
-	
-}
\ No newline at end of file
+		particle->addForce(finalAcceleration * particle->getMass());
+	}
+}
+
+template<class P>
+typename ParticleFakeSpringT<P>::Scalar ParticleFakeSpringT<P>::getStiffness() const {
+	return springConstant;
+}
+
+/*
+* Instantiates a force generator class for every precision
+*/
+#define CYCLONE_INSTANTIATE(name) \
+	template class name<SinglePrecision>; \
+	template class name<DoublePrecision>; \
+	template class name<MixedPrecision>;
+
+namespace cyclone {
+	CYCLONE_INSTANTIATE(ParticleForceGeneratorT)
+	CYCLONE_INSTANTIATE(ParticleForceRegistryT)
+	CYCLONE_INSTANTIATE(ParticleGravityT)
+	CYCLONE_INSTANTIATE(ParticleDragT)
+	CYCLONE_INSTANTIATE(ParticleSpringT)
+	CYCLONE_INSTANTIATE(ParticleAnchoredSpringT)
+	CYCLONE_INSTANTIATE(ParticleBungeeT)
+	CYCLONE_INSTANTIATE(ParticleBuoyancyT)
+	CYCLONE_INSTANTIATE(ParticleFakeSpringT)
+}
@@ -0,0 +1,309 @@
+#include <include/pfield.h>
+#include <assert.h>
+#include <math.h>
+
+using namespace cyclone;
+
+/*
+* Rounds down the division of a node coordinate by the side of a block
+*/
+static int32_t blockOf(int node) {
+	return node >= 0 ? node / ParticleForceField::blockSide : -((-node - 1) / ParticleForceField::blockSide) - 1;
+}
+
+ParticleExplosionSource::ParticleExplosionSource(const Vector3& center, real radius, real strength) {
+	ParticleExplosionSource::center = center;
+	ParticleExplosionSource::radius = radius;
+	ParticleExplosionSource::strength = strength;
+}
+
+void ParticleExplosionSource::getBounds(Vector3* min, Vector3* max) const {
+	*min = center - Vector3(radius, radius, radius);
+	*max = center + Vector3(radius, radius, radius);
+}
+
+Vector3 ParticleExplosionSource::evaluate(const Vector3& position) const {
+	Vector3 direction = position - center;
+	real distance = direction.magnitude();
+	if (distance >= radius || distance == 0) return Vector3();
+
+	return direction * (strength * (1 - distance / radius) / distance);
+}
+
+ParticleWindSource::ParticleWindSource(const Vector3& min, const Vector3& max, const Vector3& acceleration) {
+	ParticleWindSource::min = min;
+	ParticleWindSource::max = max;
+	ParticleWindSource::acceleration = acceleration;
+}
+
+void ParticleWindSource::getBounds(Vector3* min, Vector3* max) const {
+	*min = ParticleWindSource::min;
+	*max = ParticleWindSource::max;
+}
+
+Vector3 ParticleWindSource::evaluate(const Vector3& position) const {
+	if (position.x < min.x || position.y < min.y || position.z < min.z) return Vector3();
+	if (position.x > max.x || position.y > max.y || position.z > max.z) return Vector3();
+	return acceleration;
+}
+
+ParticleVortexSource::ParticleVortexSource(const Vector3& center, real radius, real height, real strength) {
+	ParticleVortexSource::center = center;
+	ParticleVortexSource::radius = radius;
+	ParticleVortexSource::height = height;
+	ParticleVortexSource::strength = strength;
+}
+
+void ParticleVortexSource::getBounds(Vector3* min, Vector3* max) const {
+	*min = center - Vector3(radius, height, radius);
+	*max = center + Vector3(radius, height, radius);
+}
+
+Vector3 ParticleVortexSource::evaluate(const Vector3& position) const {
+	Vector3 offset = position - center;
+	if (real_abs(offset.y) > height) return Vector3();
+
+	real distance = real_sqrt(offset.x * offset.x + offset.z * offset.z);
+	if (distance >= radius || distance == 0) return Vector3();
+
+	// The tangent to the circle around the axis
+	real scale = strength * (1 - distance / radius) / distance;
+	return Vector3(-offset.z * scale, 0, offset.x * scale);
+}
+
+ParticleForceField::ParticleForceField(real spacing, const Vector3& origin) {
+	assert(spacing > 0);
+
+	ParticleForceField::spacing = spacing;
+	ParticleForceField::origin = origin;
+	ParticleForceField::stats = ParticleFieldStats();
+}
+
+void ParticleForceField::addSource(ParticleFieldSource* source) {
+	SourceEntry entry;
+	entry.source = source;
+	source->getBounds(&entry.min, &entry.max);
+	sources.push_back(entry);
+
+	markBlocks(entry.min, entry.max, true);
+}
+
+void ParticleForceField::removeSource(ParticleFieldSource* source) {
+	std::vector<SourceEntry>::iterator s = sources.begin();
+	for (; s != sources.end(); s++)
+	{
+		if (s->source == source)
+		{
+			Vector3 min = s->min, max = s->max;
+			sources.erase(s);
+			markBlocks(min, max, false);
+			return;
+		}
+	}
+}
+
+void ParticleForceField::markDirty(ParticleFieldSource* source) {
+	std::vector<SourceEntry>::iterator s = sources.begin();
+	for (; s != sources.end(); s++)
+	{
+		if (s->source != source) continue;
+
+		// Both where the source was and where it is now have changed
+		markBlocks(s->min, s->max, false);
+		source->getBounds(&s->min, &s->max);
+		markBlocks(s->min, s->max, true);
+		return;
+	}
+}
+
+void ParticleForceField::update() {
+	stats.lastBlocksUpdated = (unsigned)dirtyBlocks.size();
+	stats.blocksUpdated += dirtyBlocks.size();
+
+	std::vector<unsigned>::iterator d = dirtyBlocks.begin();
+	for (; d != dirtyBlocks.end(); d++)
+	{
+		Block& block = blocks[*d];
+		block.dirty = false;
+		if (computeBlock(block)) continue;
+
+		// No source touches the block anymore
+		blockMap.erase(blockKey(block.x, block.y, block.z));
+		freeBlocks.push_back(*d);
+	}
+	dirtyBlocks.clear();
+	stats.blocks = (unsigned)blockMap.size();
+}
+
+void ParticleForceField::sample(const Vector3* positions, Vector3* accelerations, unsigned count) {
+	if (!dirtyBlocks.empty()) update();
+
+	const real inverseSpacing = 1 / spacing;
+
+	// Particles close in memory are usually close in space, so the last block is kept
+	uint64_t lastKey = ~(uint64_t)0;
+	const Block* lastBlock = NULL;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		Vector3 grid = (positions[i] - origin) * inverseSpacing;
+		real fx = floor(grid.x), fy = floor(grid.y), fz = floor(grid.z);
+		int x = (int)fx, y = (int)fy, z = (int)fz;
+		real u = grid.x - fx, v = grid.y - fy, w = grid.z - fz;
+
+		int32_t bx = blockOf(x), by = blockOf(y), bz = blockOf(z);
+		uint64_t key = blockKey(bx, by, bz);
+		if (key != lastKey)
+		{
+			BlockMap::const_iterator found = blockMap.find(key);
+			lastBlock = found == blockMap.end() ? NULL : &blocks[found->second];
+			lastKey = key;
+		}
+		if (!lastBlock)
+		{
+			accelerations[i] = Vector3();
+			continue;
+		}
+
+		// The eight nodes of the cell
+		int lx = x - bx * blockSide, ly = y - by * blockSide, lz = z - bz * blockSide;
+		const Vector3* node = &lastBlock->nodes[(lz * blockNodeSide + ly) * blockNodeSide + lx];
+		const int dy = blockNodeSide, dz = blockNodeSide * blockNodeSide;
+
+		Vector3 x0 = node[0] + (node[1] - node[0]) * u;
+		Vector3 x1 = node[dy] + (node[dy + 1] - node[dy]) * u;
+		Vector3 x2 = node[dz] + (node[dz + 1] - node[dz]) * u;
+		Vector3 x3 = node[dz + dy] + (node[dz + dy + 1] - node[dz + dy]) * u;
+		Vector3 y0 = x0 + (x1 - x0) * v;
+		Vector3 y1 = x2 + (x3 - x2) * v;
+		accelerations[i] = y0 + (y1 - y0) * w;
+	}
+}
+
+void ParticleForceField::updateForce(Particle* particle, real duration) {
+	updateForces(&particle, 1, duration);
+}
+
+void ParticleForceField::updateForces(Particle* const* particles, unsigned count, real duration) {
+	const unsigned batchSize = 256;
+	Vector3 positions[batchSize];
+	Vector3 accelerations[batchSize];
+
+	for (unsigned start = 0; start < count; start += batchSize)
+	{
+		unsigned size = count - start < batchSize ? count - start : batchSize;
+		Particle* const* batch = particles + start;
+		for (unsigned i = 0; i < size; i++)
+		{
+			positions[i] = batch[i]->position;
+		}
+
+		sample(positions, accelerations, size);
+
+		for (unsigned i = 0; i < size; i++)
+		{
+			if (!batch[i]->hasFiniteMass()) continue;
+			batch[i]->addForce(accelerations[i] * batch[i]->getMass());
+		}
+	}
+}
+
+const ParticleFieldStats& ParticleForceField::getStats() const {
+	return stats;
+}
+
+void ParticleForceField::markBlocks(const Vector3& min, const Vector3& max, bool create) {
+	// The cells with a node within the box
+	int32_t minBlock[3], maxBlock[3];
+	const real* low = &min.x;
+	const real* high = &max.x;
+	const real* start = &origin.x;
+	for (unsigned a = 0; a < 3; a++)
+	{
+		minBlock[a] = blockOf((int)floor((low[a] - start[a]) / spacing) - 1);
+		maxBlock[a] = blockOf((int)floor((high[a] - start[a]) / spacing));
+	}
+
+	for (int32_t z = minBlock[2]; z <= maxBlock[2]; z++)
+	{
+		for (int32_t y = minBlock[1]; y <= maxBlock[1]; y++)
+		{
+			for (int32_t x = minBlock[0]; x <= maxBlock[0]; x++)
+			{
+				uint64_t key = blockKey(x, y, z);
+				BlockMap::iterator found = blockMap.find(key);
+
+				unsigned index;
+				if (found != blockMap.end())
+				{
+					index = found->second;
+				}
+				else
+				{
+					if (!create) continue;
+
+					if (freeBlocks.empty())
+					{
+						index = (unsigned)blocks.size();
+						blocks.push_back(Block());
+					}
+					else
+					{
+						index = freeBlocks.back();
+						freeBlocks.pop_back();
+					}
+					Block& block = blocks[index];
+					block.x = x;
+					block.y = y;
+					block.z = z;
+					block.dirty = false;
+					blockMap[key] = index;
+				}
+
+				if (blocks[index].dirty) continue;
+				blocks[index].dirty = true;
+				dirtyBlocks.push_back(index);
+			}
+		}
+	}
+	stats.blocks = (unsigned)blockMap.size();
+}
+
+bool ParticleForceField::computeBlock(Block& block) {
+	Vector3 blockMin = origin + Vector3((real)block.x, (real)block.y, (real)block.z) * (blockSide * spacing);
+	Vector3 blockMax = blockMin + Vector3(1, 1, 1) * (blockSide * spacing);
+
+	for (unsigned n = 0; n < blockNodes; n++)
+	{
+		block.nodes[n].clear();
+	}
+
+	bool touched = false;
+	std::vector<SourceEntry>::const_iterator s = sources.begin();
+	for (; s != sources.end(); s++)
+	{
+		if (s->max.x < blockMin.x || s->max.y < blockMin.y || s->max.z < blockMin.z) continue;
+		if (s->min.x > blockMax.x || s->min.y > blockMax.y || s->min.z > blockMax.z) continue;
+		touched = true;
+
+		unsigned n = 0;
+		for (int z = 0; z < blockNodeSide; z++)
+		{
+			for (int y = 0; y < blockNodeSide; y++)
+			{
+				for (int x = 0; x < blockNodeSide; x++, n++)
+				{
+					Vector3 position = blockMin + Vector3((real)x, (real)y, (real)z) * spacing;
+					block.nodes[n] += s->source->evaluate(position);
+				}
+			}
+		}
+	}
+	return touched;
+}
+
+uint64_t ParticleForceField::blockKey(int32_t x, int32_t y, int32_t z) {
+	// 21 bits per coordinate, offset to be positive
+	const uint64_t mask = (1 << 21) - 1;
+	return (((uint64_t)(x + (1 << 20)) & mask) << 42) | (((uint64_t)(y + (1 << 20)) & mask) << 21) | ((uint64_t)(z + (1 << 20)) & mask);
+}
@@ -0,0 +1,163 @@
+#include <include/pfile.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace cyclone;
+
+ParticleMappedFile::ParticleMappedFile() {
+	data = NULL;
+	size = 0;
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = NULL;
+#else
+	file = -1;
+#endif
+}
+
+ParticleMappedFile::~ParticleMappedFile() {
+	close();
+}
+
+#ifdef _WIN32
+
+bool ParticleMappedFile::open(const char* path) {
+	close();
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+	{
+		close();
+		return false;
+	}
+	size = (size_t)fileSize.QuadPart;
+
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping) data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data)
+	{
+		close();
+		return false;
+	}
+	return true;
+}
+
+bool ParticleMappedFile::create(const char* path, size_t size) {
+	close();
+	if (size == 0) return false;
+
+	file = CreateFileA(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+
+	ULARGE_INTEGER mappingSize;
+	mappingSize.QuadPart = size;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READWRITE, mappingSize.HighPart, mappingSize.LowPart, NULL);
+	if (mapping) data = MapViewOfFile(mapping, FILE_MAP_WRITE, 0, 0, 0);
+	if (!data)
+	{
+		close();
+		return false;
+	}
+
+	ParticleMappedFile::size = size;
+	return true;
+}
+
+void ParticleMappedFile::close() {
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+
+	data = NULL;
+	mapping = NULL;
+	file = INVALID_HANDLE_VALUE;
+	size = 0;
+}
+
+#else
+
+bool ParticleMappedFile::open(const char* path) {
+	close();
+
+	file = ::open(path, O_RDONLY);
+	if (file < 0) return false;
+
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size == 0)
+	{
+		close();
+		return false;
+	}
+	size = (size_t)status.st_size;
+
+	void* address = mmap(NULL, size, PROT_READ, MAP_SHARED, file, 0);
+	if (address == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	data = address;
+	return true;
+}
+
+bool ParticleMappedFile::create(const char* path, size_t size) {
+	close();
+	if (size == 0) return false;
+
+	file = ::open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if (file < 0) return false;
+
+	if (ftruncate(file, (off_t)size) != 0)
+	{
+		close();
+		return false;
+	}
+
+	void* address = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+	if (address == MAP_FAILED)
+	{
+		close();
+		return false;
+	}
+	data = address;
+	ParticleMappedFile::size = size;
+	return true;
+}
+
+void ParticleMappedFile::close() {
+	if (data) munmap(data, size);
+	if (file >= 0) ::close(file);
+
+	data = NULL;
+	file = -1;
+	size = 0;
+}
+
+#endif
+
+bool ParticleMappedFile::isOpen() const {
+	return data != NULL;
+}
+
+void* ParticleMappedFile::getData() {
+	return data;
+}
+
+const void* ParticleMappedFile::getData() const {
+	return data;
+}
+
+size_t ParticleMappedFile::getSize() const {
+	return size;
+}
@@ -0,0 +1,530 @@
+#include <include/pfluid.h>
+#include <assert.h>
+#include <math.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CYCLONE_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace cyclone;
+
+/*
+* The number of particles, and of cells, handed to a thread at a time
+*/
+static const unsigned particleGrain = 512;
+static const unsigned cellGrain = 8192;
+
+/*
+* The most distinct cells around a particle
+*/
+static const unsigned maxNeighborCells = 27;
+
+static const real pi = (real)3.14159265358979;
+
+#ifdef CYCLONE_SSE2
+
+/*
+* Returns the sum of the four lanes
+*/
+static inline float horizontalSum(__m128 value) {
+	__m128 high = _mm_movehl_ps(value, value);
+	value = _mm_add_ps(value, high);
+	value = _mm_add_ss(value, _mm_shuffle_ps(value, value, 1));
+	return _mm_cvtss_f32(value);
+}
+
+#endif
+
+/*
+* Adds the poly6 terms of the sorted particles from first to last to sum, and counts
+* the ones closer than the smoothing radius
+*/
+static void densityRun(const real* x, const real* y, const real* z, const real* mass, unsigned first, unsigned last,
+	real px, real py, real pz, real h2, real* sum, unsigned* inside) {
+	unsigned j = first;
+	real total = 0;
+	unsigned count = 0;
+
+#ifdef CYCLONE_SSE2
+	__m128 accumulator = _mm_setzero_ps();
+	__m128i counts = _mm_setzero_si128();
+	const __m128 px4 = _mm_set1_ps(px), py4 = _mm_set1_ps(py), pz4 = _mm_set1_ps(pz);
+	const __m128 h24 = _mm_set1_ps(h2), zero = _mm_setzero_ps();
+	for (; j + 4 <= last; j += 4)
+	{
+		__m128 dx = _mm_sub_ps(_mm_loadu_ps(x + j), px4);
+		__m128 dy = _mm_sub_ps(_mm_loadu_ps(y + j), py4);
+		__m128 dz = _mm_sub_ps(_mm_loadu_ps(z + j), pz4);
+		__m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+		__m128 t = _mm_max_ps(_mm_sub_ps(h24, r2), zero);
+		accumulator = _mm_add_ps(accumulator, _mm_mul_ps(_mm_loadu_ps(mass + j), _mm_mul_ps(t, _mm_mul_ps(t, t))));
+
+		// The comparison gives -1 in the lanes inside
+		counts = _mm_sub_epi32(counts, _mm_castps_si128(_mm_cmplt_ps(r2, h24)));
+	}
+	total = horizontalSum(accumulator);
+	unsigned lanes[4];
+	_mm_storeu_si128((__m128i*)lanes, counts);
+	count = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+	for (; j < last; j++)
+	{
+		real dx = x[j] - px, dy = y[j] - py, dz = z[j] - pz;
+		real r2 = dx * dx + dy * dy + dz * dz;
+		real t = h2 - r2;
+		t = t > 0 ? t : 0;
+		total += mass[j] * t * t * t;
+		count += r2 < h2 ? 1 : 0;
+	}
+
+	*sum += total;
+	*inside += count;
+}
+
+/*
+* Holds the sums of the force pass for a particle: the pressure and the viscosity terms
+*/
+struct FluidForceSums
+{
+	real ax, ay, az;
+	real bx, by, bz;
+};
+
+/*
+* Adds the spiky gradient and viscosity laplacian terms of the sorted particles from
+* first to last to the sums of the particle with the given state
+*/
+static void forceRun(const real* x, const real* y, const real* z, const real* vx, const real* vy, const real* vz,
+	const real* mass, const real* pressure, const real* volume, unsigned first, unsigned last,
+	real px, real py, real pz, real pvx, real pvy, real pvz, real ownPressure, real h, FluidForceSums* sums) {
+	const real h2 = h * h;
+	unsigned j = first;
+
+#ifdef CYCLONE_SSE2
+	__m128 ax = _mm_setzero_ps(), ay = _mm_setzero_ps(), az = _mm_setzero_ps();
+	__m128 bx = _mm_setzero_ps(), by = _mm_setzero_ps(), bz = _mm_setzero_ps();
+	const __m128 px4 = _mm_set1_ps(px), py4 = _mm_set1_ps(py), pz4 = _mm_set1_ps(pz);
+	const __m128 pvx4 = _mm_set1_ps(pvx), pvy4 = _mm_set1_ps(pvy), pvz4 = _mm_set1_ps(pvz);
+	const __m128 own4 = _mm_set1_ps(ownPressure);
+	const __m128 h4 = _mm_set1_ps(h), h24 = _mm_set1_ps(h2), zero = _mm_setzero_ps();
+	for (; j + 4 <= last; j += 4)
+	{
+		__m128 dx = _mm_sub_ps(px4, _mm_loadu_ps(x + j));
+		__m128 dy = _mm_sub_ps(py4, _mm_loadu_ps(y + j));
+		__m128 dz = _mm_sub_ps(pz4, _mm_loadu_ps(z + j));
+		__m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		// Lanes outside the radius, or on the particle itself, take r = h and are masked out
+		__m128 inside = _mm_and_ps(_mm_cmplt_ps(r2, h24), _mm_cmpgt_ps(r2, zero));
+		__m128 r = _mm_sqrt_ps(_mm_or_ps(_mm_and_ps(inside, r2), _mm_andnot_ps(inside, h24)));
+		__m128 t = _mm_sub_ps(h4, r);
+
+		__m128 push = _mm_mul_ps(_mm_loadu_ps(mass + j), _mm_add_ps(own4, _mm_loadu_ps(pressure + j)));
+		push = _mm_and_ps(inside, _mm_div_ps(_mm_mul_ps(push, _mm_mul_ps(t, t)), r));
+		ax = _mm_add_ps(ax, _mm_mul_ps(push, dx));
+		ay = _mm_add_ps(ay, _mm_mul_ps(push, dy));
+		az = _mm_add_ps(az, _mm_mul_ps(push, dz));
+
+		__m128 pull = _mm_and_ps(inside, _mm_mul_ps(_mm_loadu_ps(volume + j), t));
+		bx = _mm_add_ps(bx, _mm_mul_ps(pull, _mm_sub_ps(_mm_loadu_ps(vx + j), pvx4)));
+		by = _mm_add_ps(by, _mm_mul_ps(pull, _mm_sub_ps(_mm_loadu_ps(vy + j), pvy4)));
+		bz = _mm_add_ps(bz, _mm_mul_ps(pull, _mm_sub_ps(_mm_loadu_ps(vz + j), pvz4)));
+	}
+	sums->ax += horizontalSum(ax);
+	sums->ay += horizontalSum(ay);
+	sums->az += horizontalSum(az);
+	sums->bx += horizontalSum(bx);
+	sums->by += horizontalSum(by);
+	sums->bz += horizontalSum(bz);
+#endif
+
+	for (; j < last; j++)
+	{
+		real dx = px - x[j], dy = py - y[j], dz = pz - z[j];
+		real r2 = dx * dx + dy * dy + dz * dz;
+		bool inside = r2 < h2 && r2 > 0;
+		real r = real_sqrt(inside ? r2 : h2);
+		real t = h - r;
+
+		real push = inside ? mass[j] * (ownPressure + pressure[j]) * t * t / r : 0;
+		sums->ax += push * dx;
+		sums->ay += push * dy;
+		sums->az += push * dz;
+
+		real pull = inside ? volume[j] * t : 0;
+		sums->bx += pull * (vx[j] - pvx);
+		sums->by += pull * (vy[j] - pvy);
+		sums->bz += pull * (vz[j] - pvz);
+	}
+}
+
+ParticleFluid::ParticleFluid(real smoothingRadius, real restDensity, real stiffness, real viscosity, ParticleJobPool* jobs) {
+	assert(smoothingRadius > 0 && restDensity > 0);
+
+	ParticleFluid::jobs = jobs;
+	ParticleFluid::smoothingRadius = smoothingRadius;
+	ParticleFluid::restDensity = restDensity;
+	ParticleFluid::stiffness = stiffness;
+	ParticleFluid::viscosity = viscosity;
+	ParticleFluid::cellCount = 0;
+	ParticleFluid::cellFill = NULL;
+	ParticleFluid::cellFillSize = 0;
+	ParticleFluid::stats = ParticleFluidStats();
+	ParticleFluid::neighborCount = 0;
+	ParticleFluid::candidateCount = 0;
+}
+
+ParticleFluid::~ParticleFluid() {
+	delete[] cellFill;
+}
+
+void ParticleFluid::addParticle(Particle* particle) {
+	assert(particle->hasFiniteMass());
+	particles.push_back(particle);
+}
+
+void ParticleFluid::removeParticle(Particle* particle) {
+	Particles::iterator i = particles.begin();
+	for (; i != particles.end(); i++)
+	{
+		if (*i == particle)
+		{
+			*i = particles.back();
+			particles.pop_back();
+			return;
+		}
+	}
+}
+
+void ParticleFluid::applyForces(real duration) {
+	unsigned count = (unsigned)particles.size();
+	densities.resize(count);
+	stats = ParticleFluidStats();
+	if (count == 0) return;
+
+	// About two cells per particle keeps the hash collisions rare
+	unsigned cells = 1024;
+	while (cells < 2 * count) cells *= 2;
+	if (cells != cellFillSize)
+	{
+		delete[] cellFill;
+		cellFill = new std::atomic<unsigned>[cells];
+		for (unsigned c = 0; c < cells; c++) cellFill[c] = 0;
+		cellFillSize = cells;
+	}
+	cellCount = cells;
+
+	cellOf.resize(count);
+	cellStart.resize(cellCount + 1);
+	order.resize(count);
+	x.resize(count); y.resize(count); z.resize(count);
+	vx.resize(count); vy.resize(count); vz.resize(count);
+	mass.resize(count);
+	density.resize(count);
+	pressure.resize(count);
+	volume.resize(count);
+	neighborCount = 0;
+	candidateCount = 0;
+
+	// Count the particles of each cell
+	run(gatherJob, count, particleGrain);
+
+	// Turn the counts into the first slot of each cell
+	unsigned start = 0;
+	for (unsigned c = 0; c < cellCount; c++)
+	{
+		unsigned size = cellFill[c].load(std::memory_order_relaxed);
+		if (size > 0) stats.cells++;
+		cellStart[c] = start;
+		cellFill[c].store(start, std::memory_order_relaxed);
+		start += size;
+	}
+	cellStart[cellCount] = start;
+
+	// Place the particles in their cells, then sort each cell so the order doesn't depend on the threads
+	run(scatterJob, count, particleGrain);
+	run(sortCellsJob, cellCount, cellGrain);
+	run(copyJob, count, particleGrain);
+
+	run(densityJob, count, particleGrain);
+	run(forceJob, count, particleGrain);
+
+	stats.neighbors = neighborCount;
+	stats.candidates = candidateCount;
+	stats.minDensity = REAL_MAX;
+	stats.maxDensity = 0;
+	double total = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (density[i] < stats.minDensity) stats.minDensity = density[i];
+		if (density[i] > stats.maxDensity) stats.maxDensity = density[i];
+		total += density[i];
+	}
+	stats.averageDensity = (real)(total / count);
+}
+
+void ParticleFluid::remapParticles(const ParticleRemap& remap) {
+	Particles::iterator i = particles.begin();
+	for (; i != particles.end(); i++)
+	{
+		*i = remap.map(*i);
+	}
+}
+
+ParticleFluid::Particles& ParticleFluid::getParticles() {
+	return particles;
+}
+
+const std::vector<real>& ParticleFluid::getDensities() const {
+	return densities;
+}
+
+const ParticleFluidStats& ParticleFluid::getStats() const {
+	return stats;
+}
+
+void ParticleFluid::setSmoothingRadius(real smoothingRadius) {
+	assert(smoothingRadius > 0);
+	ParticleFluid::smoothingRadius = smoothingRadius;
+}
+
+real ParticleFluid::getSmoothingRadius() const {
+	return smoothingRadius;
+}
+
+void ParticleFluid::setRestDensity(real restDensity) {
+	assert(restDensity > 0);
+	ParticleFluid::restDensity = restDensity;
+}
+
+real ParticleFluid::getRestDensity() const {
+	return restDensity;
+}
+
+void ParticleFluid::setStiffness(real stiffness) {
+	ParticleFluid::stiffness = stiffness;
+}
+
+real ParticleFluid::getStiffness() const {
+	return stiffness;
+}
+
+void ParticleFluid::setViscosity(real viscosity) {
+	ParticleFluid::viscosity = viscosity;
+}
+
+real ParticleFluid::getViscosity() const {
+	return viscosity;
+}
+
+void ParticleFluid::setJobPool(ParticleJobPool* jobs) {
+	ParticleFluid::jobs = jobs;
+}
+
+unsigned ParticleFluid::hashCell(int cx, int cy, int cz) const {
+	unsigned hash = ((unsigned)cx * 73856093u) ^ ((unsigned)cy * 19349663u) ^ ((unsigned)cz * 83492791u);
+	return hash & (cellCount - 1);
+}
+
+unsigned ParticleFluid::neighborCells(int cx, int cy, int cz, unsigned* cells) const {
+	// Distinct cells can share a hash, and must only be visited once
+	unsigned found = 0;
+	for (int dz = -1; dz <= 1; dz++)
+	{
+		for (int dy = -1; dy <= 1; dy++)
+		{
+			for (int dx = -1; dx <= 1; dx++)
+			{
+				unsigned cell = hashCell(cx + dx, cy + dy, cz + dz);
+				unsigned k = 0;
+				while (k < found && cells[k] != cell) k++;
+				if (k == found) cells[found++] = cell;
+			}
+		}
+	}
+	return found;
+}
+
+void ParticleFluid::run(ParticleJob job, unsigned count, unsigned grain) {
+	if (jobs) jobs->run(job, this, count, grain);
+	else job(this, 0, count);
+}
+
+void ParticleFluid::gatherJob(void* context, unsigned begin, unsigned end) {
+	ParticleFluid* fluid = (ParticleFluid*)context;
+	real inverseSize = 1 / fluid->smoothingRadius;
+
+	for (unsigned i = begin; i < end; i++)
+	{
+		const Vector3& position = fluid->particles[i]->position;
+		unsigned cell = fluid->hashCell((int)floor(position.x * inverseSize), (int)floor(position.y * inverseSize), (int)floor(position.z * inverseSize));
+		fluid->cellOf[i] = cell;
+		fluid->cellFill[cell].fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void ParticleFluid::scatterJob(void* context, unsigned begin, unsigned end) {
+	ParticleFluid* fluid = (ParticleFluid*)context;
+
+	for (unsigned i = begin; i < end; i++)
+	{
+		unsigned slot = fluid->cellFill[fluid->cellOf[i]].fetch_add(1, std::memory_order_relaxed);
+		fluid->order[slot] = i;
+	}
+}
+
+void ParticleFluid::sortCellsJob(void* context, unsigned begin, unsigned end) {
+	ParticleFluid* fluid = (ParticleFluid*)context;
+	unsigned* order = &fluid->order[0];
+
+	for (unsigned c = begin; c < end; c++)
+	{
+		// Cells are small, an insertion sort is enough
+		unsigned first = fluid->cellStart[c], last = fluid->cellStart[c + 1];
+		for (unsigned i = first + 1; i < last; i++)
+		{
+			unsigned value = order[i];
+			unsigned j = i;
+			for (; j > first && order[j - 1] > value; j--) order[j] = order[j - 1];
+			order[j] = value;
+		}
+
+		// Ready for the next step
+		fluid->cellFill[c].store(0, std::memory_order_relaxed);
+	}
+}
+
+void ParticleFluid::copyJob(void* context, unsigned begin, unsigned end) {
+	ParticleFluid* fluid = (ParticleFluid*)context;
+
+	for (unsigned i = begin; i < end; i++)
+	{
+		const Particle* particle = fluid->particles[fluid->order[i]];
+		fluid->x[i] = particle->position.x;
+		fluid->y[i] = particle->position.y;
+		fluid->z[i] = particle->position.z;
+		fluid->vx[i] = particle->velocity.x;
+		fluid->vy[i] = particle->velocity.y;
+		fluid->vz[i] = particle->velocity.z;
+		fluid->mass[i] = particle->getMass();
+	}
+}
+
+void ParticleFluid::densityJob(void* context, unsigned begin, unsigned end) {
+	ParticleFluid* fluid = (ParticleFluid*)context;
+	const real h = fluid->smoothingRadius;
+	const real h2 = h * h;
+	const real poly6 = 315 / (64 * pi * h2 * h2 * h2 * h2 * h);
+	const real* x = &fluid->x[0];
+	const real* y = &fluid->y[0];
+	const real* z = &fluid->z[0];
+	const real* mass = &fluid->mass[0];
+	const unsigned* cellStart = &fluid->cellStart[0];
+	const real inverseSize = 1 / h;
+
+	unsigned cells[maxNeighborCells];
+	unsigned cellCount = 0;
+	int lastX = 0, lastY = 0, lastZ = 0;
+	unsigned long long neighbors = 0, candidates = 0;
+
+	for (unsigned i = begin; i < end; i++)
+	{
+		const real px = x[i], py = y[i], pz = z[i];
+
+		// Sorted particles come cell by cell, so the cells around them rarely change
+		int cx = (int)floor(px * inverseSize), cy = (int)floor(py * inverseSize), cz = (int)floor(pz * inverseSize);
+		if (cx != lastX || cy != lastY || cz != lastZ || i == begin)
+		{
+			cellCount = fluid->neighborCells(cx, cy, cz, cells);
+			lastX = cx;
+			lastY = cy;
+			lastZ = cz;
+		}
+
+		real sum = 0;
+		unsigned inside = 0;
+		for (unsigned c = 0; c < cellCount; c++)
+		{
+			unsigned first = cellStart[cells[c]], last = cellStart[cells[c] + 1];
+			densityRun(x, y, z, mass, first, last, px, py, pz, h2, &sum, &inside);
+			candidates += last - first;
+		}
+		neighbors += inside - 1;
+
+		real rho = poly6 * sum;
+		real p = fluid->stiffness * (rho - fluid->restDensity);
+		p = p > 0 ? p : 0;
+		fluid->density[i] = rho;
+		fluid->pressure[i] = p / (rho * rho);
+		fluid->volume[i] = mass[i] / rho;
+		fluid->densities[fluid->order[i]] = rho;
+	}
+
+	fluid->neighborCount.fetch_add(neighbors, std::memory_order_relaxed);
+	fluid->candidateCount.fetch_add(candidates, std::memory_order_relaxed);
+}
+
+void ParticleFluid::forceJob(void* context, unsigned begin, unsigned end) {
+	ParticleFluid* fluid = (ParticleFluid*)context;
+	const real h = fluid->smoothingRadius;
+	const real h2 = h * h;
+	const real gradientScale = 45 / (pi * h2 * h2 * h2);
+	const real viscosity = fluid->viscosity;
+	const real* x = &fluid->x[0];
+	const real* y = &fluid->y[0];
+	const real* z = &fluid->z[0];
+	const real* vx = &fluid->vx[0];
+	const real* vy = &fluid->vy[0];
+	const real* vz = &fluid->vz[0];
+	const real* mass = &fluid->mass[0];
+	const real* pressure = &fluid->pressure[0];
+	const real* volume = &fluid->volume[0];
+	const unsigned* cellStart = &fluid->cellStart[0];
+	const real inverseSize = 1 / h;
+
+	unsigned cells[maxNeighborCells];
+	unsigned cellCount = 0;
+	int lastX = 0, lastY = 0, lastZ = 0;
+
+	for (unsigned i = begin; i < end; i++)
+	{
+		const real px = x[i], py = y[i], pz = z[i];
+		const real pvx = vx[i], pvy = vy[i], pvz = vz[i];
+		const real ownPressure = pressure[i];
+
+		int cx = (int)floor(px * inverseSize), cy = (int)floor(py * inverseSize), cz = (int)floor(pz * inverseSize);
+		if (cx != lastX || cy != lastY || cz != lastZ || i == begin)
+		{
+			cellCount = fluid->neighborCells(cx, cy, cz, cells);
+			lastX = cx;
+			lastY = cy;
+			lastZ = cz;
+		}
+
+		// The pressure pushes along the spiky gradient, the viscosity pulls the velocities together
+		FluidForceSums sums = { 0, 0, 0, 0, 0, 0 };
+		for (unsigned c = 0; c < cellCount; c++)
+		{
+			unsigned first = cellStart[cells[c]], last = cellStart[cells[c] + 1];
+			forceRun(x, y, z, vx, vy, vz, mass, pressure, volume, first, last, px, py, pz, pvx, pvy, pvz, ownPressure, h, &sums);
+		}
+
+		real viscousScale = viscosity / fluid->density[i];
+		Vector3 acceleration(sums.ax + sums.bx * viscousScale, sums.ay + sums.by * viscousScale, sums.az + sums.bz * viscousScale);
+		fluid->particles[fluid->order[i]]->addForce(acceleration * (gradientScale * mass[i]));
+	}
+}
+
+ParticleFluidSubsystem::ParticleFluidSubsystem(ParticleWorld* world, ParticleFluid* fluid) {
+	ParticleFluidSubsystem::world = world;
+	ParticleFluidSubsystem::fluid = fluid;
+}
+
+void ParticleFluidSubsystem::step(real duration) {
+	world->startFrame();
+	world->applyForces(duration);
+	fluid->applyForces(duration);
+	world->integrate(duration);
+}
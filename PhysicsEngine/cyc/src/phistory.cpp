@@ -0,0 +1,158 @@
+#include <include/phistory.h>
+#include <assert.h>
+#include <math.h>
+
+using namespace cyclone;
+
+ParticleHistory::ParticleHistory(ParticleWorld* world, unsigned capacity, unsigned keyframeInterval, real quantum) {
+	assert(capacity > keyframeInterval && keyframeInterval > 0);
+	assert(quantum > 0);
+
+	ParticleHistory::world = world;
+	ParticleHistory::keyframeInterval = keyframeInterval;
+	ParticleHistory::quantum = quantum;
+	frames.resize(capacity);
+	clear();
+}
+
+void ParticleHistory::capture(unsigned frame) {
+	ParticleWorld::Particles& particles = world->getParticles();
+	assert(empty || frame == newest + 1);
+	assert(empty || reference.size() == particles.size() * 6);
+
+	// The first frame is always a keyframe, the next ones at the interval
+	bool keyframe = empty || frame % keyframeInterval == 0;
+	if (empty)
+	{
+		reference.assign(particles.size() * 6, 0);
+		oldest = frame;
+		empty = false;
+	}
+	else if (frame - oldest + 1 > frames.size())
+	{
+		// The ring is full, the oldest frame is overwritten
+		oldest++;
+	}
+	newest = frame;
+
+	Frame& slot = frames[frame % frames.size()];
+	slot.number = frame;
+	slot.keyframe = keyframe;
+	slot.records.clear();
+
+	for (unsigned i = 0; i < particles.size(); i++)
+	{
+		const Particle* particle = particles[i];
+		int32_t state[6] = {
+			quantize(particle->position.x), quantize(particle->position.y), quantize(particle->position.z),
+			quantize(particle->velocity.x), quantize(particle->velocity.y), quantize(particle->velocity.z)
+		};
+
+		int32_t* previous = &reference[i * 6];
+		bool changed = keyframe;
+		for (unsigned j = 0; j < 6 && !changed; j++)
+		{
+			changed = state[j] != previous[j];
+		}
+		if (!changed) continue;
+
+		Record record;
+		record.particle = i;
+		for (unsigned j = 0; j < 3; j++)
+		{
+			record.position[j] = state[j];
+			record.velocity[j] = state[j + 3];
+		}
+		slot.records.push_back(record);
+
+		for (unsigned j = 0; j < 6; j++)
+		{
+			previous[j] = state[j];
+		}
+	}
+}
+
+bool ParticleHistory::rewind(unsigned frame) {
+	if (!canRewind(frame)) return false;
+
+	// Start from the last keyframe before the frame
+	unsigned start = frame;
+	while (!frames[start % frames.size()].keyframe) start--;
+
+	for (unsigned f = start; f <= frame; f++)
+	{
+		const std::vector<Record>& records = frames[f % frames.size()].records;
+		std::vector<Record>::const_iterator r = records.begin();
+		for (; r != records.end(); r++)
+		{
+			int32_t* state = &reference[r->particle * 6];
+			for (unsigned j = 0; j < 3; j++)
+			{
+				state[j] = r->position[j];
+				state[j + 3] = r->velocity[j];
+			}
+		}
+	}
+
+	// Write the reconstructed state back to the particles
+	ParticleWorld::Particles& particles = world->getParticles();
+	for (unsigned i = 0; i < particles.size(); i++)
+	{
+		const int32_t* state = &reference[i * 6];
+		particles[i]->setPosition(state[0] * quantum, state[1] * quantum, state[2] * quantum);
+		particles[i]->setVelocity(state[3] * quantum, state[4] * quantum, state[5] * quantum);
+		particles[i]->clearAccumulator();
+	}
+
+	newest = frame;
+	return true;
+}
+
+bool ParticleHistory::resimulate(unsigned frame, unsigned steps, real duration, ParticleHistoryInput* input) {
+	if (!rewind(frame)) return false;
+
+	// Nothing is allocated in here once the frames have reached their working size
+	for (unsigned step = 1; step <= steps; step++)
+	{
+		if (input) input->applyInput(frame + step);
+		world->runPhysics(duration);
+		capture(frame + step);
+	}
+	return true;
+}
+
+void ParticleHistory::clear() {
+	oldest = 0;
+	newest = 0;
+	empty = true;
+}
+
+bool ParticleHistory::canRewind(unsigned frame) const {
+	if (empty) return false;
+	return frame <= newest && frame >= getOldestKeyframe();
+}
+
+unsigned ParticleHistory::getNewestFrame() const {
+	return newest;
+}
+
+unsigned ParticleHistory::getRecordCount() const {
+	if (empty) return 0;
+
+	unsigned count = 0;
+	for (unsigned f = oldest; f <= newest; f++)
+	{
+		count += (unsigned)frames[f % frames.size()].records.size();
+	}
+	return count;
+}
+
+unsigned ParticleHistory::getOldestKeyframe() const {
+	unsigned frame = oldest;
+	while (frame <= newest && !frames[frame % frames.size()].keyframe) frame++;
+	return frame;
+}
+
+int32_t ParticleHistory::quantize(real value) const {
+	return (int32_t)floor(value / quantum + (real)0.5);
+}
@@ -0,0 +1,187 @@
+#include <include/pjobs.h>
+#include <assert.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace cyclone;
+
+ParticleJobPool::ParticleJobPool(unsigned threads, bool pinned) {
+	if (threads == 0) threads = std::thread::hardware_concurrency();
+	if (threads == 0) threads = 1;
+
+	ParticleJobPool::job = NULL;
+	ParticleJobPool::context = NULL;
+	ParticleJobPool::count = 0;
+	ParticleJobPool::grain = 1;
+	ParticleJobPool::partitioned = false;
+	ParticleJobPool::next = 0;
+	ParticleJobPool::busy = 0;
+	ParticleJobPool::generation = 0;
+	ParticleJobPool::stopping = false;
+
+	// The workers are pinned, not the calling thread, which keeps its own affinity
+	std::vector<unsigned> processors;
+	if (pinned) getAllowedProcessors(&processors);
+	for (unsigned i = 1; i < threads; i++)
+	{
+		int processor = processors.empty() ? -1 : (int)processors[i % processors.size()];
+		workers.push_back(std::thread(&ParticleJobPool::workerLoop, this, i, processor));
+	}
+}
+
+ParticleJobPool::~ParticleJobPool() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	started.notify_all();
+
+	std::vector<std::thread>::iterator i = workers.begin();
+	for (; i != workers.end(); i++)
+	{
+		i->join();
+	}
+}
+
+void ParticleJobPool::run(ParticleJob job, void* context, unsigned count, unsigned grain) {
+	assert(grain > 0);
+	if (count == 0) return;
+
+	// Small jobs or a single thread don't wake the workers
+	if (workers.empty() || count <= grain)
+	{
+		job(context, 0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ParticleJobPool::job = job;
+		ParticleJobPool::context = context;
+		ParticleJobPool::count = count;
+		ParticleJobPool::grain = grain;
+		partitioned = false;
+	}
+	dispatch();
+}
+
+void ParticleJobPool::runStatic(ParticleJob job, void* context, unsigned count) {
+	if (count == 0) return;
+
+	if (workers.empty())
+	{
+		job(context, 0, count);
+		return;
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		ParticleJobPool::job = job;
+		ParticleJobPool::context = context;
+		ParticleJobPool::count = count;
+		partitioned = true;
+	}
+	dispatch();
+}
+
+void ParticleJobPool::dispatch() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		next = 0;
+		busy = (unsigned)workers.size();
+		generation++;
+	}
+	started.notify_all();
+
+	work(0);
+
+	// Wait for the workers to leave the job, so it can be replaced
+	std::unique_lock<std::mutex> lock(mutex);
+	finished.wait(lock, [this] { return busy == 0; });
+}
+
+unsigned ParticleJobPool::getThreadCount() const {
+	return (unsigned)workers.size() + 1;
+}
+
+void ParticleJobPool::work(unsigned index) {
+	if (partitioned)
+	{
+		unsigned threads = (unsigned)workers.size() + 1;
+		unsigned begin = (unsigned)((unsigned long long)count * index / threads);
+		unsigned end = (unsigned)((unsigned long long)count * (index + 1) / threads);
+		if (begin < end) job(context, begin, end);
+		return;
+	}
+
+	for (;;)
+	{
+		unsigned begin = next.fetch_add(grain);
+		if (begin >= count) return;
+
+		unsigned end = count - begin < grain ? count : begin + grain;
+		job(context, begin, end);
+	}
+}
+
+void ParticleJobPool::workerLoop(unsigned index, int processor) {
+	if (processor >= 0) pin((unsigned)processor);
+
+	unsigned seen = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			started.wait(lock, [this, seen] { return stopping || generation != seen; });
+			if (stopping) return;
+			seen = generation;
+		}
+
+		work(index);
+
+		if (busy.fetch_sub(1) == 1)
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			finished.notify_one();
+		}
+	}
+}
+
+void ParticleJobPool::getAllowedProcessors(std::vector<unsigned>* processors) {
+	processors->clear();
+
+#ifdef _WIN32
+	DWORD_PTR processMask, systemMask;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) return;
+	for (unsigned i = 0; i < sizeof(processMask) * 8; i++)
+	{
+		if (processMask & ((DWORD_PTR)1 << i)) processors->push_back(i);
+	}
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) != 0) return;
+	for (unsigned i = 0; i < CPU_SETSIZE; i++)
+	{
+		if (CPU_ISSET(i, &set)) processors->push_back(i);
+	}
+#endif
+}
+
+void ParticleJobPool::pin(unsigned processor) {
+#ifdef _WIN32
+	SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << processor);
+#else
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(processor, &set);
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#endif
+}
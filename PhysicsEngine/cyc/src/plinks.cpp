@@ -1,15 +1,23 @@
 #include <include/plinks.h>
 
-real ParticleLink::currentLength() const {
-	Vector3 relativePos =	particle[0]->getPosition() -
-							particle[1]->getPosition();
+template<class P>
+typename ParticleLinkT<P>::Scalar ParticleLinkT<P>::currentLength() const {
+	Vector relativePos(particle[0]->getPosition() -
+							particle[1]->getPosition());
 	return relativePos.magnitude();
 }
 
-unsigned ParticleCable::fillContact(ParticleContact* contact, unsigned limit) const {
+template<class P>
+void ParticleLinkT<P>::remapParticles(const ParticleRemapT<P>& remap) {
+	particle[0] = remap.map(particle[0]);
+	particle[1] = remap.map(particle[1]);
+}
+
+template<class P>
+unsigned ParticleCableT<P>::fillContact(ParticleContactT<P>* contact, unsigned limit) const {
 
 	//Find the length of the cable
-	real length = currentLength();
+	Scalar length = currentLength();
 
 	// Check if we are overextended
 	if (length < maxLength)
@@ -22,7 +30,7 @@ unsigned ParticleCable::fillContact(ParticleContact* contact, unsigned limit) co
 	contact->particle[1] = particle[1];
 
 	// Calculate the normal
-	Vector3 normal = particle[1]->getPosition() - particle[0]->getPosition();
+	Vector normal(particle[1]->getPosition() - particle[0]->getPosition());
 	normal.normalize();
 	contact->contactNormal = normal;
 
@@ -32,14 +40,20 @@ unsigned ParticleCable::fillContact(ParticleContact* contact, unsigned limit) co
 	return 1;
 }
 
-unsigned ParticleRod::fillContact(ParticleContact* contact, unsigned limit) const {
+template<class P>
+typename ParticleRodT<P>::Scalar ParticleRodT<P>::currentLength() const {
+	return ParticleLinkT<P>::currentLength();
+}
+
+template<class P>
+unsigned ParticleRodT<P>::fillContact(ParticleContactT<P>* contact, unsigned limit) const {
 
 	// Find the length of the rod
-	real currentLen = currentLength();
+	Scalar currentLen = currentLength();
 
 
 	// Check if we are overextended
-	if (currentLen = length)
+	if (currentLen == length)
 	{
 		return 0;
 	}
@@ -48,7 +62,7 @@ unsigned ParticleRod::fillContact(ParticleContact* contact, unsigned limit) cons
 	contact->particle[0] = particle[0];
 	contact->particle[1] = particle[1];
 
-	Vector3 normal = particle[1]->getPosition() - particle[0]->getPosition();
+	Vector normal(particle[1]->getPosition() - particle[0]->getPosition());
 	normal.normalize();
 	
 	// The contact normal depends on wheter we're extending or compressing
@@ -67,4 +81,16 @@ unsigned ParticleRod::fillContact(ParticleContact* contact, unsigned limit) cons
 	contact->restitution = 0;
 
 	return 1;
-}
\ No newline at end of file
+}
+
+namespace cyclone {
+	template class ParticleLinkT<SinglePrecision>;
+	template class ParticleLinkT<DoublePrecision>;
+	template class ParticleLinkT<MixedPrecision>;
+	template class ParticleCableT<SinglePrecision>;
+	template class ParticleCableT<DoublePrecision>;
+	template class ParticleCableT<MixedPrecision>;
+	template class ParticleRodT<SinglePrecision>;
+	template class ParticleRodT<DoublePrecision>;
+	template class ParticleRodT<MixedPrecision>;
+}
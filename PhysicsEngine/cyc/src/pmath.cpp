@@ -0,0 +1,366 @@
+#include <include/pmath.h>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CYCLONE_SSE2
+#include <emmintrin.h>
+#endif
+
+using namespace cyclone;
+
+/*
+* The constants of the polynomials, shared by the SSE2 and the scalar versions
+*/
+static const float expHigh = 88.3762626647949f;
+static const float expLow = -87.3365447504019f;
+static const float log2e = 1.44269504088896341f;
+static const float ln2High = 0.693359375f;
+static const float ln2Low = -2.12194440e-4f;
+static const float expCoefficient0 = 1.9875691500E-4f;
+static const float expCoefficient1 = 1.3981999507E-3f;
+static const float expCoefficient2 = 8.3334519073E-3f;
+static const float expCoefficient3 = 4.1665795894E-2f;
+static const float expCoefficient4 = 1.6666665459E-1f;
+static const float expCoefficient5 = 5.0000001201E-1f;
+
+static const float sqrtHalf = 0.707106781186547524f;
+static const float logCoefficient0 = 7.0376836292E-2f;
+static const float logCoefficient1 = -1.1514610310E-1f;
+static const float logCoefficient2 = 1.1676998740E-1f;
+static const float logCoefficient3 = -1.2420140846E-1f;
+static const float logCoefficient4 = 1.4249322787E-1f;
+static const float logCoefficient5 = -1.6668057665E-1f;
+static const float logCoefficient6 = 2.0000714765E-1f;
+static const float logCoefficient7 = -2.4999993993E-1f;
+static const float logCoefficient8 = 3.3333331174E-1f;
+
+static const float fourOverPi = 1.27323954473516f;
+static const float pi4High = 0.78515625f;
+static const float pi4Mid = 2.4187564849853515625e-4f;
+static const float pi4Low = 3.77489497744594108e-8f;
+static const float sinCoefficient0 = -1.9515295891E-4f;
+static const float sinCoefficient1 = 8.3321608736E-3f;
+static const float sinCoefficient2 = -1.6666654611E-1f;
+static const float cosCoefficient0 = 2.443315711809948E-005f;
+static const float cosCoefficient1 = -1.388731625493765E-003f;
+static const float cosCoefficient2 = 4.166664568298827E-002f;
+
+#ifdef CYCLONE_SSE2
+
+static void expBlock(const float* values, float* results) {
+	__m128 x = _mm_loadu_ps(values);
+	x = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(expLow)), _mm_set1_ps(expHigh));
+
+	// Split x into n ln2 + r, with |r| <= ln2 / 2
+	__m128 fx = _mm_add_ps(_mm_mul_ps(x, _mm_set1_ps(log2e)), _mm_set1_ps(0.5f));
+	__m128 n = _mm_cvtepi32_ps(_mm_cvttps_epi32(fx));
+	n = _mm_sub_ps(n, _mm_and_ps(_mm_cmpgt_ps(n, fx), _mm_set1_ps(1)));
+	x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(ln2High)));
+	x = _mm_sub_ps(x, _mm_mul_ps(n, _mm_set1_ps(ln2Low)));
+
+	__m128 z = _mm_mul_ps(x, x);
+	__m128 y = _mm_set1_ps(expCoefficient0);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(expCoefficient1));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(expCoefficient2));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(expCoefficient3));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(expCoefficient4));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(expCoefficient5));
+	y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, z), x), _mm_set1_ps(1));
+
+	// Scale by 2^n, built in the exponent bits
+	__m128i e = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(n), _mm_set1_epi32(127)), 23);
+	_mm_storeu_ps(results, _mm_mul_ps(y, _mm_castsi128_ps(e)));
+}
+
+static void logBlock(const float* values, float* results) {
+	__m128 x = _mm_max_ps(_mm_loadu_ps(values), _mm_set1_ps(FLT_MIN));
+
+	// Split x into a mantissa m in [0.5, 1) and an exponent e
+	__m128i bits = _mm_castps_si128(x);
+	__m128 e = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_srli_epi32(bits, 23), _mm_set1_epi32(126)));
+	x = _mm_or_ps(_mm_and_ps(x, _mm_castsi128_ps(_mm_set1_epi32(0x807FFFFF))), _mm_set1_ps(0.5f));
+
+	// Bring m to [sqrt(1/2), sqrt(2)) and take x = m - 1
+	__m128 small = _mm_cmplt_ps(x, _mm_set1_ps(sqrtHalf));
+	e = _mm_sub_ps(e, _mm_and_ps(small, _mm_set1_ps(1)));
+	x = _mm_add_ps(_mm_sub_ps(x, _mm_set1_ps(1)), _mm_and_ps(x, small));
+
+	__m128 z = _mm_mul_ps(x, x);
+	__m128 y = _mm_set1_ps(logCoefficient0);
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(logCoefficient1));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(logCoefficient2));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(logCoefficient3));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(logCoefficient4));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(logCoefficient5));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(logCoefficient6));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(logCoefficient7));
+	y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(logCoefficient8));
+	y = _mm_mul_ps(_mm_mul_ps(y, x), z);
+
+	y = _mm_add_ps(y, _mm_mul_ps(e, _mm_set1_ps(ln2Low)));
+	y = _mm_sub_ps(y, _mm_mul_ps(z, _mm_set1_ps(0.5f)));
+	x = _mm_add_ps(_mm_add_ps(x, y), _mm_mul_ps(e, _mm_set1_ps(ln2High)));
+	_mm_storeu_ps(results, x);
+}
+
+static void sinCosBlock(const float* values, float* sines, float* cosines) {
+	__m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x80000000));
+	__m128 x = _mm_loadu_ps(values);
+	__m128 sinSign = _mm_and_ps(x, signMask);
+	x = _mm_andnot_ps(signMask, x);
+
+	// Find the octant j, rounded up to even, and reduce x to [-pi/4, pi/4]
+	__m128i j = _mm_cvttps_epi32(_mm_mul_ps(x, _mm_set1_ps(fourOverPi)));
+	j = _mm_and_si128(_mm_add_epi32(j, _mm_set1_epi32(1)), _mm_set1_epi32(~1));
+	__m128 y = _mm_cvtepi32_ps(j);
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(pi4High)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(pi4Mid)));
+	x = _mm_sub_ps(x, _mm_mul_ps(y, _mm_set1_ps(pi4Low)));
+
+	sinSign = _mm_xor_ps(sinSign, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(j, _mm_set1_epi32(4)), 29)));
+	__m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(
+		_mm_andnot_si128(_mm_sub_epi32(j, _mm_set1_epi32(2)), _mm_set1_epi32(4)), 29));
+	__m128 sinPoly = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(j, _mm_set1_epi32(2)), _mm_setzero_si128()));
+
+	__m128 z = _mm_mul_ps(x, x);
+	__m128 c = _mm_set1_ps(cosCoefficient0);
+	c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(cosCoefficient1));
+	c = _mm_add_ps(_mm_mul_ps(c, z), _mm_set1_ps(cosCoefficient2));
+	c = _mm_mul_ps(_mm_mul_ps(c, z), z);
+	c = _mm_add_ps(_mm_sub_ps(c, _mm_mul_ps(z, _mm_set1_ps(0.5f))), _mm_set1_ps(1));
+
+	__m128 s = _mm_set1_ps(sinCoefficient0);
+	s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(sinCoefficient1));
+	s = _mm_add_ps(_mm_mul_ps(s, z), _mm_set1_ps(sinCoefficient2));
+	s = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(s, z), x), x);
+
+	// Odd octants swap the sine and cosine polynomials
+	__m128 sine = _mm_or_ps(_mm_and_ps(sinPoly, s), _mm_andnot_ps(sinPoly, c));
+	__m128 cosine = _mm_or_ps(_mm_and_ps(sinPoly, c), _mm_andnot_ps(sinPoly, s));
+	if (sines) _mm_storeu_ps(sines, _mm_xor_ps(sine, sinSign));
+	if (cosines) _mm_storeu_ps(cosines, _mm_xor_ps(cosine, cosSign));
+}
+
+static void rsqrtBlock(const float* values, float* results) {
+	__m128 x = _mm_loadu_ps(values);
+	__m128 y = _mm_rsqrt_ps(x);
+
+	// One Newton step takes the 12 bit estimate to about 22 bits
+	__m128 yyx = _mm_mul_ps(_mm_mul_ps(y, y), x);
+	y = _mm_mul_ps(_mm_mul_ps(y, _mm_set1_ps(0.5f)), _mm_sub_ps(_mm_set1_ps(3), yyx));
+	_mm_storeu_ps(results, y);
+}
+
+#else
+
+static float floatFromBits(uint32_t bits) {
+	float value;
+	memcpy(&value, &bits, sizeof(value));
+	return value;
+}
+
+static uint32_t bitsFromFloat(float value) {
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	return bits;
+}
+
+static float expScalar(float x) {
+	if (x < expLow) x = expLow;
+	if (x > expHigh) x = expHigh;
+
+	float n = floorf(x * log2e + 0.5f);
+	x = x - n * ln2High;
+	x = x - n * ln2Low;
+
+	float z = x * x;
+	float y = ((((expCoefficient0 * x + expCoefficient1) * x + expCoefficient2) * x + expCoefficient3) * x + expCoefficient4) * x + expCoefficient5;
+	y = y * z + x + 1;
+	return y * floatFromBits((uint32_t)((int32_t)n + 127) << 23);
+}
+
+static float logScalar(float x) {
+	if (!(x >= FLT_MIN)) x = FLT_MIN;
+
+	uint32_t bits = bitsFromFloat(x);
+	float e = (float)((int32_t)(bits >> 23) - 126);
+	x = floatFromBits((bits & 0x807FFFFF) | 0x3F000000);
+
+	if (x < sqrtHalf)
+	{
+		e -= 1;
+		x = x + x - 1;
+	}
+	else
+	{
+		x = x - 1;
+	}
+
+	float z = x * x;
+	float y = ((((((((logCoefficient0 * x + logCoefficient1) * x + logCoefficient2) * x + logCoefficient3) * x + logCoefficient4) * x + logCoefficient5) * x + logCoefficient6) * x + logCoefficient7) * x + logCoefficient8);
+	y = y * x * z;
+	y += e * ln2Low;
+	y -= z * 0.5f;
+	return x + y + e * ln2High;
+}
+
+static void sinCosScalar(float x, float* sine, float* cosine) {
+	bool negative = x < 0;
+	x = fabsf(x);
+
+	int32_t j = (int32_t)(x * fourOverPi);
+	j = (j + 1) & ~1;
+	float y = (float)j;
+	x = ((x - y * pi4High) - y * pi4Mid) - y * pi4Low;
+
+	float z = x * x;
+	float c = ((cosCoefficient0 * z + cosCoefficient1) * z + cosCoefficient2) * z * z - 0.5f * z + 1;
+	float s = ((sinCoefficient0 * z + sinCoefficient1) * z + sinCoefficient2) * z * x + x;
+
+	bool sinPoly = (j & 2) == 0;
+	float sinValue = sinPoly ? s : c;
+	float cosValue = sinPoly ? c : s;
+	if (((j & 4) != 0) != negative) sinValue = -sinValue;
+	if (((j - 2) & 4) == 0) cosValue = -cosValue;
+
+	if (sine) *sine = sinValue;
+	if (cosine) *cosine = cosValue;
+}
+
+static void expBlock(const float* values, float* results) {
+	for (unsigned i = 0; i < 4; i++) results[i] = expScalar(values[i]);
+}
+
+static void logBlock(const float* values, float* results) {
+	for (unsigned i = 0; i < 4; i++) results[i] = logScalar(values[i]);
+}
+
+static void sinCosBlock(const float* values, float* sines, float* cosines) {
+	for (unsigned i = 0; i < 4; i++) sinCosScalar(values[i], sines ? sines + i : NULL, cosines ? cosines + i : NULL);
+}
+
+static void rsqrtBlock(const float* values, float* results) {
+	for (unsigned i = 0; i < 4; i++) results[i] = 1.0f / sqrtf(values[i]);
+}
+
+#endif
+
+/*
+* Applies a block function to an array. The last values are copied to a block padded
+* with the given value, so they go through the same code as the others
+*/
+template<class Block>
+static void applyBlocks(const float* values, float* results, unsigned count, float padding, Block block) {
+	unsigned i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		block(values + i, results + i);
+	}
+	if (i == count) return;
+
+	float in[4] = { padding, padding, padding, padding };
+	float out[4];
+	memcpy(in, values + i, (count - i) * sizeof(float));
+	block(in, out);
+	memcpy(results + i, out, (count - i) * sizeof(float));
+}
+
+void cyclone::batchSin(const float* values, float* results, unsigned count) {
+	batchSinCos(values, results, NULL, count);
+}
+
+void cyclone::batchCos(const float* values, float* results, unsigned count) {
+	batchSinCos(values, NULL, results, count);
+}
+
+void cyclone::batchSinCos(const float* values, float* sines, float* cosines, unsigned count) {
+	unsigned i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		sinCosBlock(values + i, sines ? sines + i : NULL, cosines ? cosines + i : NULL);
+	}
+	if (i == count) return;
+
+	float in[4] = { 0, 0, 0, 0 };
+	float outSines[4], outCosines[4];
+	memcpy(in, values + i, (count - i) * sizeof(float));
+	sinCosBlock(in, outSines, outCosines);
+	if (sines) memcpy(sines + i, outSines, (count - i) * sizeof(float));
+	if (cosines) memcpy(cosines + i, outCosines, (count - i) * sizeof(float));
+}
+
+void cyclone::batchExp(const float* values, float* results, unsigned count) {
+	applyBlocks(values, results, count, 0, expBlock);
+}
+
+void cyclone::batchLog(const float* values, float* results, unsigned count) {
+	applyBlocks(values, results, count, 1, logBlock);
+}
+
+void cyclone::batchPow(const float* bases, float exponent, float* results, unsigned count) {
+	// Done in blocks so the logarithms stay in the cache for the exponentials
+	const unsigned blockSize = 256;
+	float logs[blockSize];
+	bool zero[blockSize];
+	for (unsigned start = 0; start < count; start += blockSize)
+	{
+		unsigned size = count - start < blockSize ? count - start : blockSize;
+
+		// The logarithm clamps its argument, so zero would give a small power instead of zero.
+		// The mask is taken before the exponentials since results may alias bases.
+		for (unsigned i = 0; i < size; i++)
+		{
+			zero[i] = !(bases[start + i] > 0);
+		}
+		batchLog(bases + start, logs, size);
+		for (unsigned i = 0; i < size; i++)
+		{
+			logs[i] *= exponent;
+		}
+		batchExp(logs, results + start, size);
+
+		for (unsigned i = 0; i < size; i++)
+		{
+			if (zero[i]) results[start + i] = 0;
+		}
+	}
+}
+
+void cyclone::batchRsqrt(const float* values, float* results, unsigned count) {
+	applyBlocks(values, results, count, 1, rsqrtBlock);
+}
+
+void cyclone::batchSin(const double* values, double* results, unsigned count) {
+	for (unsigned i = 0; i < count; i++) results[i] = sin(values[i]);
+}
+
+void cyclone::batchCos(const double* values, double* results, unsigned count) {
+	for (unsigned i = 0; i < count; i++) results[i] = cos(values[i]);
+}
+
+void cyclone::batchSinCos(const double* values, double* sines, double* cosines, unsigned count) {
+	for (unsigned i = 0; i < count; i++)
+	{
+		double value = values[i];
+		if (sines) sines[i] = sin(value);
+		if (cosines) cosines[i] = cos(value);
+	}
+}
+
+void cyclone::batchExp(const double* values, double* results, unsigned count) {
+	for (unsigned i = 0; i < count; i++) results[i] = exp(values[i]);
+}
+
+void cyclone::batchLog(const double* values, double* results, unsigned count) {
+	for (unsigned i = 0; i < count; i++) results[i] = log(values[i]);
+}
+
+void cyclone::batchPow(const double* bases, double exponent, double* results, unsigned count) {
+	for (unsigned i = 0; i < count; i++) results[i] = pow(bases[i], exponent);
+}
+
+void cyclone::batchRsqrt(const double* values, double* results, unsigned count) {
+	for (unsigned i = 0; i < count; i++) results[i] = 1 / sqrt(values[i]);
+}
@@ -0,0 +1,345 @@
+#include <include/pmemory.h>
+#include <assert.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace cyclone;
+
+/*
+* Rounds the given value up to a multiple of the given power of two
+*/
+static size_t alignUp(size_t value, size_t alignment) {
+	return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void* ParticlePages::allocate(size_t* size, bool hugePages) {
+#ifdef _WIN32
+	if (hugePages)
+	{
+		// Large pages need the lock pages privilege, without it the normal pages are used
+		size_t large = GetLargePageMinimum();
+		if (large > 0)
+		{
+			size_t rounded = alignUp(*size, large);
+			void* memory = VirtualAlloc(NULL, rounded, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+			if (memory)
+			{
+				*size = rounded;
+				return memory;
+			}
+		}
+	}
+
+	size_t rounded = alignUp(*size, 4096);
+	void* memory = VirtualAlloc(NULL, rounded, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	if (memory) *size = rounded;
+	return memory;
+#else
+	if (hugePages)
+	{
+		size_t rounded = alignUp(*size, hugePageSize);
+#ifdef MAP_HUGETLB
+		void* memory = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (memory != MAP_FAILED)
+		{
+			*size = rounded;
+			return memory;
+		}
+#endif
+
+		// No huge pages reserved: map one more huge page than needed, keep the aligned
+		// part, and ask for it to be backed with transparent huge pages
+		char* raw = (char*)mmap(NULL, rounded + hugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (raw == MAP_FAILED) return NULL;
+		char* aligned = (char*)alignUp((uintptr_t)raw, hugePageSize);
+		if (aligned > raw) munmap(raw, aligned - raw);
+		size_t tail = (raw + rounded + hugePageSize) - (aligned + rounded);
+		if (tail > 0) munmap(aligned + rounded, tail);
+#ifdef MADV_HUGEPAGE
+		madvise(aligned, rounded, MADV_HUGEPAGE);
+#endif
+		*size = rounded;
+		return aligned;
+	}
+
+	size_t rounded = alignUp(*size, (size_t)sysconf(_SC_PAGESIZE));
+	void* memory = mmap(NULL, rounded, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (memory == MAP_FAILED) return NULL;
+	*size = rounded;
+	return memory;
+#endif
+}
+
+void ParticlePages::release(void* memory, size_t size) {
+	if (!memory) return;
+#ifdef _WIN32
+	VirtualFree(memory, 0, MEM_RELEASE);
+#else
+	munmap(memory, size);
+#endif
+}
+
+void ParticleAllocationStats::operator+=(const ParticleAllocationStats& stats) {
+	bytesReserved += stats.bytesReserved;
+	bytesInUse += stats.bytesInUse;
+	peakBytesInUse += stats.peakBytesInUse;
+	allocations += stats.allocations;
+	deallocations += stats.deallocations;
+	systemAllocations += stats.systemAllocations;
+}
+
+ParticleBlockPool::ParticleBlockPool(size_t objectSize, unsigned objectsPerBlock) {
+	assert(objectsPerBlock > 0);
+
+	// Every object must be able to hold the free list link, and keep the next one aligned
+	if (objectSize < sizeof(void*)) objectSize = sizeof(void*);
+	ParticleBlockPool::objectSize = alignUp(objectSize, 16);
+	ParticleBlockPool::objectsPerBlock = objectsPerBlock;
+	ParticleBlockPool::freeList = NULL;
+	ParticleBlockPool::carveBlock = 0;
+	ParticleBlockPool::carveOffset = 0;
+	ParticleBlockPool::capacity = 0;
+	ParticleBlockPool::hugePages = false;
+	ParticleBlockPool::stats = ParticleAllocationStats();
+}
+
+ParticleBlockPool::~ParticleBlockPool() {
+	for (unsigned b = 0; b < blocks.size(); b++)
+	{
+		ParticlePages::release(blocks[b], blockSizes[b]);
+	}
+}
+
+void* ParticleBlockPool::allocate() {
+	void* object;
+	if (freeList)
+	{
+		// Pop the first free object
+		object = freeList;
+		freeList = *(void**)object;
+	}
+	else
+	{
+		// Take the next object never handed out, growing when every block is used up
+		while (carveBlock < blocks.size() && carveOffset + objectSize > blockSizes[carveBlock])
+		{
+			carveBlock++;
+			carveOffset = 0;
+		}
+		if (carveBlock == blocks.size()) grow();
+
+		object = blocks[carveBlock] + carveOffset;
+		carveOffset += objectSize;
+	}
+
+	stats.allocations++;
+	stats.bytesInUse += objectSize;
+	if (stats.bytesInUse > stats.peakBytesInUse) stats.peakBytesInUse = stats.bytesInUse;
+	return object;
+}
+
+void ParticleBlockPool::deallocate(void* object) {
+	if (!object) return;
+
+	// Push the object in front of the free list
+	*(void**)object = freeList;
+	freeList = object;
+
+	stats.deallocations++;
+	stats.bytesInUse -= objectSize;
+}
+
+void ParticleBlockPool::reserve(unsigned count) {
+	size_t inUse = stats.bytesInUse / objectSize;
+	while (capacity - inUse < count)
+	{
+		grow();
+	}
+}
+
+/*
+* Holds the parts of the blocks never handed out, for the first touch jobs, and the
+* item of the static job the first of them will be
+*/
+struct PoolTouch {
+	std::vector<char*> starts;
+	std::vector<size_t> counts;
+	size_t objectSize;
+	unsigned firstItem;
+};
+
+void ParticleBlockPool::firstTouch(ParticleJobPool* jobs, unsigned firstItem, unsigned count) {
+	PoolTouch touch;
+	touch.objectSize = objectSize;
+	touch.firstItem = firstItem;
+	size_t total = 0;
+	for (unsigned b = carveBlock; b < blocks.size() && total < count; b++)
+	{
+		size_t offset = b == carveBlock ? carveOffset : 0;
+		size_t objects = blockSizes[b] < offset ? 0 : (blockSizes[b] - offset) / objectSize;
+		if (objects > count - total) objects = count - total;
+		if (objects == 0) continue;
+		touch.starts.push_back(blocks[b] + offset);
+		touch.counts.push_back(objects);
+		total += objects;
+	}
+
+	// The static job covers the items before too, so each thread gets the same range it integrates
+	unsigned items = firstItem + (unsigned)total;
+	if (jobs) jobs->runStatic(touchJob, &touch, items);
+	else touchJob(&touch, 0, items);
+}
+
+void ParticleBlockPool::setHugePages(bool hugePages) {
+	ParticleBlockPool::hugePages = hugePages;
+}
+
+const ParticleAllocationStats& ParticleBlockPool::getStats() const {
+	return stats;
+}
+
+void ParticleBlockPool::grow() {
+	// The block is not written here, its objects are handed out in memory order as they are needed
+	size_t blockSize = objectSize * objectsPerBlock;
+	char* block = (char*)ParticlePages::allocate(&blockSize, hugePages);
+	if (!block) throw std::bad_alloc();
+	blocks.push_back(block);
+	blockSizes.push_back(blockSize);
+	capacity += blockSize / objectSize;
+
+	stats.bytesReserved += blockSize;
+	stats.systemAllocations++;
+}
+
+void ParticleBlockPool::touchJob(void* context, unsigned begin, unsigned end) {
+	PoolTouch* touch = (PoolTouch*)context;
+	if (end <= touch->firstItem) return;
+	begin = begin > touch->firstItem ? begin - touch->firstItem : 0;
+	end -= touch->firstItem;
+
+	// Find the objects of the range in the parts of the blocks
+	size_t first = 0;
+	for (unsigned p = 0; p < touch->starts.size() && first < end; p++)
+	{
+		size_t last = first + touch->counts[p];
+		size_t from = begin > first ? begin : first;
+		size_t to = end < last ? end : last;
+		if (from < to)
+		{
+			memset(touch->starts[p] + (from - first) * touch->objectSize, 0, (to - from) * touch->objectSize);
+		}
+		first = last;
+	}
+}
+
+ParticleArena::ParticleArena(size_t capacity) {
+	ParticleArena::memory = NULL;
+	ParticleArena::capacity = 0;
+	ParticleArena::offset = 0;
+	ParticleArena::used = 0;
+	ParticleArena::overflowBytes = 0;
+	ParticleArena::hugePages = false;
+	ParticleArena::bufferHugePages = false;
+	ParticleArena::stats = ParticleAllocationStats();
+
+	if (capacity > 0) replaceBuffer(capacity);
+}
+
+ParticleArena::~ParticleArena() {
+	// Freed directly, reset would grow the buffer only to release it
+	std::vector<char*>::iterator c = overflow.begin();
+	for (; c != overflow.end(); c++)
+	{
+		delete[] *c;
+	}
+	ParticlePages::release(memory, capacity);
+}
+
+void* ParticleArena::allocate(size_t size, size_t alignment) {
+	assert((alignment & (alignment - 1)) == 0);
+
+	stats.allocations++;
+
+	// Align the address, not the offset, the buffer itself may be less aligned
+	uintptr_t base = (uintptr_t)memory;
+	size_t start = alignUp(base + offset, alignment) - base;
+	if (memory && start + size <= capacity)
+	{
+		used += start + size - offset;
+		offset = start + size;
+	}
+	else
+	{
+		// Out of space, serve this from an overflow chunk until the next reset
+		char* chunk = new char[size + alignment];
+		overflow.push_back(chunk);
+		stats.systemAllocations++;
+		overflowBytes += size + alignment;
+		stats.bytesReserved += size + alignment;
+		used += size + alignment;
+
+		uintptr_t aligned = alignUp((uintptr_t)chunk, alignment);
+		stats.bytesInUse = used;
+		if (used > stats.peakBytesInUse) stats.peakBytesInUse = used;
+		return (void*)aligned;
+	}
+
+	stats.bytesInUse = used;
+	if (used > stats.peakBytesInUse) stats.peakBytesInUse = used;
+	return memory + start;
+}
+
+void ParticleArena::reset() {
+	if (!overflow.empty())
+	{
+		std::vector<char*>::iterator c = overflow.begin();
+		for (; c != overflow.end(); c++)
+		{
+			delete[] *c;
+		}
+		overflow.clear();
+		stats.bytesReserved -= overflowBytes;
+		overflowBytes = 0;
+
+		// Grow the main buffer so that the next step fits in it
+		replaceBuffer(capacity * 2 > used ? capacity * 2 : used);
+	}
+	else if (hugePages != bufferHugePages && capacity > 0)
+	{
+		replaceBuffer(capacity);
+	}
+
+	offset = 0;
+	used = 0;
+	stats.bytesInUse = 0;
+	stats.deallocations++;
+}
+
+const ParticleAllocationStats& ParticleArena::getStats() const {
+	return stats;
+}
+
+void ParticleArena::setHugePages(bool hugePages) {
+	ParticleArena::hugePages = hugePages;
+	if (used == 0 && capacity > 0 && hugePages != bufferHugePages) replaceBuffer(capacity);
+}
+
+void ParticleArena::replaceBuffer(size_t capacity) {
+	ParticlePages::release(memory, ParticleArena::capacity);
+
+	memory = (char*)ParticlePages::allocate(&capacity, hugePages);
+	if (!memory) throw std::bad_alloc();
+	ParticleArena::capacity = capacity;
+	bufferHugePages = hugePages;
+	stats.systemAllocations++;
+	stats.bytesReserved = capacity + overflowBytes;
+}
@@ -0,0 +1,170 @@
+#include <include/pmultirate.h>
+#include <algorithm>
+#include <assert.h>
+
+using namespace cyclone;
+
+ParticleMultirate::ParticleMultirate(ParticleWorld* world, unsigned maxLevel, real accuracy, real maxDisplacement) {
+	assert(maxLevel < 16);
+
+	ParticleMultirate::world = world;
+	ParticleMultirate::maxLevel = maxLevel;
+	ParticleMultirate::accuracy = accuracy;
+	ParticleMultirate::maxDisplacement = maxDisplacement;
+	ParticleMultirate::deepestLevel = 0;
+	ParticleMultirate::integrations = 0;
+
+	binParticles.resize(maxLevel + 1);
+	binRegistrations.resize(maxLevel + 1);
+}
+
+void ParticleMultirate::runPhysics(real duration) {
+	assert(duration > 0.0);
+
+	// Every bin starts a step here, so all the forces are evaluated at the same time
+	world->startFrame();
+	world->applyForces(duration);
+	assignBins(duration);
+
+	unsigned substeps = 1 << deepestLevel;
+	integrations = 0;
+
+	for (unsigned s = 0; s < substeps; s++)
+	{
+		// Evaluate the forces of every bin starting a step at this substep before integrating any
+		if (s > 0)
+		{
+			for (unsigned level = 1; level <= deepestLevel; level++)
+			{
+				if (s % (substeps >> level) != 0) continue;
+
+				real step = duration / (1 << level);
+				ParticleForceRegistry::Registry::iterator i = binRegistrations[level].begin();
+				for (; i != binRegistrations[level].end(); i++)
+				{
+					i->fg->updateForce(i->particle, step);
+				}
+			}
+		}
+
+		for (unsigned level = 0; level <= deepestLevel; level++)
+		{
+			if (s % (substeps >> level) != 0) continue;
+
+			real step = duration / (1 << level);
+			ParticleWorld::Particles::iterator p = binParticles[level].begin();
+			for (; p != binParticles[level].end(); p++)
+			{
+				(*p)->integrate(step);
+			}
+			integrations += (unsigned)binParticles[level].size();
+		}
+	}
+
+	world->resolveConstraints(duration);
+}
+
+unsigned ParticleMultirate::getLevel(unsigned index) const {
+	return levels[index];
+}
+
+unsigned ParticleMultirate::getBinSize(unsigned level) const {
+	return (unsigned)binParticles[level].size();
+}
+
+unsigned ParticleMultirate::getIntegrationCount() const {
+	return integrations;
+}
+
+void ParticleMultirate::assignBins(real duration) {
+	ParticleWorld::Particles& particles = world->getParticles();
+	ParticleForceRegistry::Registry& registrations = world->getForceRegistry().getRegistrations();
+
+	indices.clear();
+	stiffness.assign(particles.size(), 0);
+	levels.assign(particles.size(), 0);
+	// Every bin can take all the particles, so particles moving between bins don't allocate
+	for (unsigned level = 0; level <= maxLevel; level++)
+	{
+		binParticles[level].clear();
+		binParticles[level].reserve(particles.size());
+		binRegistrations[level].clear();
+		binRegistrations[level].reserve(registrations.size());
+	}
+
+	for (unsigned i = 0; i < particles.size(); i++)
+	{
+		indices.push_back(ParticleIndex(particles[i], i));
+	}
+	std::sort(indices.begin(), indices.end());
+
+	// Sum the stiffness of the springs acting on each particle
+	ParticleForceRegistry::Registry::iterator r = registrations.begin();
+	for (; r != registrations.end(); r++)
+	{
+		int index = findIndex(r->particle);
+		if (index >= 0) stiffness[index] += r->fg->getStiffness();
+	}
+
+	deepestLevel = 0;
+	for (unsigned i = 0; i < particles.size(); i++)
+	{
+		Particle* particle = particles[i];
+		real maxStep = duration;
+
+		// Don't travel further than the maximum displacement
+		real speed = particle->getVelocity().magnitude();
+		if (speed > 0 && maxDisplacement / speed < maxStep) maxStep = maxDisplacement / speed;
+
+		// Don't let the acceleration move the particle further than the maximum displacement
+		Vector3 totalAcceleration = particle->getAcceleration();
+		totalAcceleration.addScaledVector(particle->getAccumulatedForce(), particle->getInverseMass());
+		real acceleration = totalAcceleration.magnitude();
+		if (acceleration > 0)
+		{
+			real step = real_sqrt(2 * maxDisplacement / acceleration);
+			if (step < maxStep) maxStep = step;
+		}
+
+		// Cover only a fraction of the period of the springs
+		if (stiffness[i] > 0 && particle->getInverseMass() > 0)
+		{
+			real period = ((real)6.2831853) * real_sqrt(1 / (stiffness[i] * particle->getInverseMass()));
+			if (accuracy * period < maxStep) maxStep = accuracy * period;
+		}
+
+		unsigned level = levelFor(duration, maxStep);
+		levels[i] = level;
+		binParticles[level].push_back(particle);
+		if (level > deepestLevel) deepestLevel = level;
+	}
+
+	// Registrations follow the bin of their particle, those on particles
+	// outside the world are evaluated only at the start of the step
+	r = registrations.begin();
+	for (; r != registrations.end(); r++)
+	{
+		int index = findIndex(r->particle);
+		if (index >= 0) binRegistrations[levels[index]].push_back(*r);
+	}
+}
+
+unsigned ParticleMultirate::levelFor(real duration, real maxStep) const {
+	unsigned level = 0;
+	real step = duration;
+
+	while (step > maxStep && level < maxLevel)
+	{
+		step *= 0.5f;
+		level++;
+	}
+	return level;
+}
+
+int ParticleMultirate::findIndex(Particle* particle) const {
+	std::vector<ParticleIndex>::const_iterator found =
+		std::lower_bound(indices.begin(), indices.end(), ParticleIndex(particle, 0));
+
+	if (found == indices.end() || found->first != particle) return -1;
+	return (int)found->second;
+}
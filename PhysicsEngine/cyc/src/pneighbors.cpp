@@ -0,0 +1,281 @@
+#include <include/pneighbors.h>
+#include <assert.h>
+#include <math.h>
+
+using namespace cyclone;
+
+/*
+* Returns the cell of the given cell coordinates in a table of the given size, a power of two
+*/
+static unsigned hashCell(int cx, int cy, int cz, unsigned tableSize) {
+	unsigned hash = ((unsigned)cx * 73856093u) ^ ((unsigned)cy * 19349663u) ^ ((unsigned)cz * 83492791u);
+	return hash & (tableSize - 1);
+}
+
+ParticleNeighborList::ParticleNeighborList(real cutoff, real skin) {
+	assert(cutoff > 0 && skin >= 0);
+
+	ParticleNeighborList::cutoff = cutoff;
+	ParticleNeighborList::skin = skin;
+	ParticleNeighborList::changed = true;
+	ParticleNeighborList::stats = ParticleNeighborStats();
+	offsets.push_back(0);
+}
+
+void ParticleNeighborList::addParticle(Particle* particle) {
+	particles.push_back(particle);
+	changed = true;
+}
+
+void ParticleNeighborList::removeParticle(Particle* particle) {
+	Particles::iterator i = particles.begin();
+	for (; i != particles.end(); i++)
+	{
+		if (*i == particle)
+		{
+			*i = particles.back();
+			particles.pop_back();
+			changed = true;
+			return;
+		}
+	}
+}
+
+bool ParticleNeighborList::update() {
+	stats.updates++;
+
+	// Two particles each moving half the skin towards the other can just reach the cutoff
+	real limit = skin * 0.5f;
+	real limitSquared = limit * limit;
+	real maxSquared = 0;
+	if (!changed)
+	{
+		unsigned count = (unsigned)particles.size();
+		for (unsigned i = 0; i < count; i++)
+		{
+			Vector3 moved = particles[i]->position - buildPositions[i];
+			real squared = moved.squareMagnitude();
+			if (squared > maxSquared) maxSquared = squared;
+		}
+	}
+	stats.maxDisplacement = real_sqrt(maxSquared);
+
+	if (!changed && maxSquared <= limitSquared)
+	{
+		stats.updatesSinceBuild++;
+		return false;
+	}
+
+	build();
+	return true;
+}
+
+void ParticleNeighborList::build() {
+	unsigned count = (unsigned)particles.size();
+	real range = cutoff + skin;
+	real rangeSquared = range * range;
+	real inverseSize = 1 / range;
+
+	unsigned tableSize = 1024;
+	while (tableSize < 2 * count) tableSize *= 2;
+
+	// Counting sort of the particles by cell: the counts become the end of each cell,
+	// then filling backwards leaves the start of each cell and the particles in index order
+	cellStart.assign(tableSize + 1, 0);
+	cellOf.resize(count);
+	sorted.resize(count);
+	buildPositions.resize(count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		const Vector3& position = particles[i]->position;
+		buildPositions[i] = position;
+		cellOf[i] = hashCell((int)floor(position.x * inverseSize), (int)floor(position.y * inverseSize), (int)floor(position.z * inverseSize), tableSize);
+		cellStart[cellOf[i]]++;
+	}
+	for (unsigned c = 1; c <= tableSize; c++)
+	{
+		cellStart[c] += cellStart[c - 1];
+	}
+	for (unsigned i = count; i > 0; i--)
+	{
+		sorted[--cellStart[cellOf[i - 1]]] = i - 1;
+	}
+
+	offsets.resize(count + 1);
+	neighbors.clear();
+	for (unsigned i = 0; i < count; i++)
+	{
+		offsets[i] = (unsigned)neighbors.size();
+		const Vector3& position = buildPositions[i];
+		int cx = (int)floor(position.x * inverseSize);
+		int cy = (int)floor(position.y * inverseSize);
+		int cz = (int)floor(position.z * inverseSize);
+
+		// Distinct cells can share a hash, and must only be visited once
+		unsigned cells[27];
+		unsigned cellCount = 0;
+		for (int dz = -1; dz <= 1; dz++)
+		{
+			for (int dy = -1; dy <= 1; dy++)
+			{
+				for (int dx = -1; dx <= 1; dx++)
+				{
+					unsigned cell = hashCell(cx + dx, cy + dy, cz + dz, tableSize);
+					unsigned k = 0;
+					while (k < cellCount && cells[k] != cell) k++;
+					if (k == cellCount) cells[cellCount++] = cell;
+				}
+			}
+		}
+
+		for (unsigned c = 0; c < cellCount; c++)
+		{
+			unsigned first = cellStart[cells[c]], last = cellStart[cells[c] + 1];
+			for (unsigned s = first; s < last; s++)
+			{
+				unsigned j = sorted[s];
+				if (j <= i) continue;
+
+				Vector3 offset = buildPositions[j] - position;
+				if (offset.squareMagnitude() < rangeSquared) neighbors.push_back(j);
+			}
+		}
+	}
+	offsets[count] = (unsigned)neighbors.size();
+
+	changed = false;
+	stats.builds++;
+	stats.updatesSinceBuild = 0;
+	stats.pairs = (unsigned)neighbors.size();
+}
+
+void ParticleNeighborList::remapParticles(const ParticleRemap& remap) {
+	Particles::iterator i = particles.begin();
+	for (; i != particles.end(); i++)
+	{
+		*i = remap.map(*i);
+	}
+}
+
+ParticleNeighborList::Particles& ParticleNeighborList::getParticles() {
+	return particles;
+}
+
+const unsigned* ParticleNeighborList::getOffsets() const {
+	return &offsets[0];
+}
+
+const unsigned* ParticleNeighborList::getNeighbors() const {
+	return neighbors.empty() ? NULL : &neighbors[0];
+}
+
+real ParticleNeighborList::getCutoff() const {
+	return cutoff;
+}
+
+void ParticleNeighborList::setSkin(real skin) {
+	assert(skin >= 0);
+	ParticleNeighborList::skin = skin;
+	changed = true;
+}
+
+real ParticleNeighborList::getSkin() const {
+	return skin;
+}
+
+const ParticleNeighborStats& ParticleNeighborList::getStats() const {
+	return stats;
+}
+
+ParticleSphereContacts::ParticleSphereContacts(ParticleNeighborList* list, real radius, real restitution) {
+	assert(2 * radius <= list->getCutoff());
+
+	ParticleSphereContacts::list = list;
+	ParticleSphereContacts::radius = radius;
+	ParticleSphereContacts::restitution = restitution;
+	particle[0] = NULL;
+	particle[1] = NULL;
+}
+
+unsigned ParticleSphereContacts::fillContact(ParticleContact* contact, unsigned limit) const {
+	list->update();
+
+	const ParticleNeighborList::Particles& particles = list->getParticles();
+	const unsigned* offsets = list->getOffsets();
+	const unsigned* neighbors = list->getNeighbors();
+	const real diameter = 2 * radius;
+	unsigned used = 0;
+
+	unsigned count = (unsigned)particles.size();
+	for (unsigned i = 0; i < count; i++)
+	{
+		Particle* first = particles[i];
+		for (unsigned n = offsets[i]; n < offsets[i + 1]; n++)
+		{
+			Particle* second = particles[neighbors[n]];
+			Vector3 normal = first->position - second->position;
+			real distanceSquared = normal.squareMagnitude();
+			if (distanceSquared >= diameter * diameter || distanceSquared == 0) continue;
+
+			// We have run out of contacts to fill
+			if (used == limit) return used;
+
+			real distance = real_sqrt(distanceSquared);
+			contact->particle[0] = first;
+			contact->particle[1] = second;
+			contact->contactNormal = normal * (1 / distance);
+			contact->penetration = diameter - distance;
+			contact->restitution = restitution;
+			contact++;
+			used++;
+		}
+	}
+	return used;
+}
+
+void ParticleSphereContacts::remapParticles(const ParticleRemap& remap) {
+	list->remapParticles(remap);
+}
+
+ParticleNeighborForce::ParticleNeighborForce(ParticleNeighborList* list, real radius, real stiffness, real damping) {
+	assert(2 * radius <= list->getCutoff());
+
+	ParticleNeighborForce::list = list;
+	ParticleNeighborForce::radius = radius;
+	ParticleNeighborForce::stiffness = stiffness;
+	ParticleNeighborForce::damping = damping;
+}
+
+void ParticleNeighborForce::applyForces() {
+	list->update();
+
+	const ParticleNeighborList::Particles& particles = list->getParticles();
+	const unsigned* offsets = list->getOffsets();
+	const unsigned* neighbors = list->getNeighbors();
+	const real diameter = 2 * radius;
+
+	unsigned count = (unsigned)particles.size();
+	for (unsigned i = 0; i < count; i++)
+	{
+		Particle* first = particles[i];
+		for (unsigned n = offsets[i]; n < offsets[i + 1]; n++)
+		{
+			Particle* second = particles[neighbors[n]];
+			Vector3 normal = first->position - second->position;
+			real distanceSquared = normal.squareMagnitude();
+			if (distanceSquared >= diameter * diameter || distanceSquared == 0) continue;
+
+			real distance = real_sqrt(distanceSquared);
+			normal *= 1 / distance;
+
+			// The spring pushes on the overlap, the damper resists the approach
+			real approach = (first->velocity - second->velocity) * normal;
+			real magnitude = stiffness * (diameter - distance) - damping * approach;
+			if (magnitude <= 0) continue;
+
+			Vector3 force = normal * magnitude;
+			first->addForce(force);
+			second->addForce(force * -1);
+		}
+	}
+}
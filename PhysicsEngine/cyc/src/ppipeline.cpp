@@ -0,0 +1,419 @@
+#include <include/ppipeline.h>
+#include <assert.h>
+
+using namespace cyclone;
+
+/*
+* Records the particles a generator refers to, leaving them in place
+*/
+class RecordingRemap : public ParticleRemap
+{
+public:
+	std::vector<Particle*>* found;
+
+	virtual Particle* map(Particle* particle) const {
+		found->push_back(particle);
+		return particle;
+	}
+};
+
+ParticlePipeline::ParticlePipeline(ParticleWorld* world, ParticleJobPool* jobs, unsigned grain) {
+	assert(grain > 0);
+
+	ParticlePipeline::world = world;
+	ParticlePipeline::jobs = jobs;
+	ParticlePipeline::grain = grain;
+	ParticlePipeline::contacts = NULL;
+	ParticlePipeline::globalContactCount = 0;
+	ParticlePipeline::duration = 0;
+	ParticlePipeline::valid = false;
+	ParticlePipeline::particleCount = 0;
+	ParticlePipeline::registrationCount = 0;
+	ParticlePipeline::linkCount = 0;
+	ParticlePipeline::firstParticle = NULL;
+	stats = ParticlePipelineStats();
+}
+
+void ParticlePipeline::invalidate() {
+	valid = false;
+}
+
+void ParticlePipeline::runPhysics(real duration) {
+	ParticleWorld::Particles& particles = world->getParticles();
+	if (!valid || particles.size() != particleCount || (particleCount && particles[0] != firstParticle) ||
+		world->getForceRegistry().getRegistrations().size() != registrationCount || world->getLinks().size() != linkCount)
+	{
+		build();
+	}
+
+	world->startFrame();
+	contacts = world->getFrameArena().allocateArray<ParticleContact>((unsigned)links.size() + world->getMaxContacts());
+	globalContactCount = 0;
+	ParticlePipeline::duration = duration;
+	graph.run(jobs);
+
+	stats.contacts = globalContactCount;
+	std::vector<Span>::iterator s = spans.begin();
+	for (; s != spans.end(); s++)
+	{
+		stats.contacts += s->contactCount;
+	}
+}
+
+const ParticleTaskGraph& ParticlePipeline::getGraph() const {
+	return graph;
+}
+
+const ParticlePipelineStats& ParticlePipeline::getStats() const {
+	return stats;
+}
+
+void ParticlePipeline::build() {
+	ParticleWorld::Particles& particles = world->getParticles();
+	ParticleForceRegistry::Registry& registry = world->getForceRegistry().getRegistrations();
+	ParticleWorld::Links& worldLinks = world->getLinks();
+	unsigned count = (unsigned)particles.size();
+
+	indices.clear();
+	parents.resize(count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		indices[particles[i]] = i;
+		parents[i] = i;
+	}
+
+	// Join each particle with the particles its generators refer to. Registrations of
+	// particles outside the world or of generators that can't run concurrently are
+	// applied by the serial task
+	std::unordered_map<ParticleForceGenerator*, std::pair<unsigned, unsigned> > generators;
+	RecordingRemap remap;
+	remap.found = &referenced;
+	referenced.clear();
+	serialRegistrations.clear();
+	std::vector<unsigned> registrationParticles;
+	registrationParticles.reserve(registry.size());
+	ParticleForceRegistry::Registry::iterator r = registry.begin();
+	for (; r != registry.end(); r++)
+	{
+		std::unordered_map<Particle*, unsigned>::iterator p = indices.find(r->particle);
+		if (p == indices.end() || !r->fg->isConcurrent())
+		{
+			serialRegistrations.push_back(*r);
+			registrationParticles.push_back(count);
+			continue;
+		}
+		registrationParticles.push_back(p->second);
+
+		std::unordered_map<ParticleForceGenerator*, std::pair<unsigned, unsigned> >::iterator g = generators.find(r->fg);
+		if (g == generators.end())
+		{
+			unsigned first = (unsigned)referenced.size();
+			r->fg->remapParticles(remap);
+			g = generators.insert(std::make_pair(r->fg, std::make_pair(first, (unsigned)referenced.size()))).first;
+		}
+		for (unsigned i = g->second.first; i < g->second.second; i++)
+		{
+			std::unordered_map<Particle*, unsigned>::iterator other = indices.find(referenced[i]);
+			if (other == indices.end()) continue;
+			unsigned a = findIsland(p->second), b = findIsland(other->second);
+			if (a != b) parents[a] = b;
+		}
+	}
+
+	// Join the ends of the links, the others are global
+	globalLinks.clear();
+	ParticleWorld::Links islandLinks;
+	std::vector<unsigned> linkParticles;
+	ParticleWorld::Links::iterator l = worldLinks.begin();
+	for (; l != worldLinks.end(); l++)
+	{
+		std::unordered_map<Particle*, unsigned>::iterator a = indices.find((*l)->particle[0]);
+		std::unordered_map<Particle*, unsigned>::iterator b = indices.find((*l)->particle[1]);
+		if (a == indices.end() || b == indices.end())
+		{
+			globalLinks.push_back(*l);
+			continue;
+		}
+		unsigned first = findIsland(a->second), second = findIsland(b->second);
+		if (first != second) parents[first] = second;
+		islandLinks.push_back(*l);
+		linkParticles.push_back(a->second);
+	}
+
+	// Order the particles island after island, the islands by their first particle
+	std::vector<unsigned> islandSizes(count, 0);
+	std::vector<unsigned> islandOrder;
+	for (unsigned i = 0; i < count; i++)
+	{
+		unsigned island = findIsland(i);
+		if (islandSizes[island]++ == 0) islandOrder.push_back(island);
+	}
+	std::vector<unsigned> islandOffsets(count, 0);
+	unsigned offset = 0;
+	stats.largestIsland = 0;
+	std::vector<unsigned>::iterator o = islandOrder.begin();
+	for (; o != islandOrder.end(); o++)
+	{
+		islandOffsets[*o] = offset;
+		offset += islandSizes[*o];
+		if (islandSizes[*o] > stats.largestIsland) stats.largestIsland = islandSizes[*o];
+	}
+	std::vector<unsigned> positions(count);
+	ordered.resize(count);
+	for (unsigned i = 0; i < count; i++)
+	{
+		positions[i] = islandOffsets[findIsland(i)]++;
+		ordered[positions[i]] = particles[i];
+	}
+
+	// Group the islands, each group holding at least the grain of particles unless it is
+	// the last, and split the groups in chunks of about the grain
+	std::vector<unsigned> groupBounds(1, 0);
+	unsigned islandStart = 0;
+	for (o = islandOrder.begin(); o != islandOrder.end(); o++)
+	{
+		islandStart += islandSizes[*o];
+		if (islandStart - groupBounds.back() >= grain) groupBounds.push_back(islandStart);
+	}
+	if (groupBounds.back() != count) groupBounds.push_back(count);
+	unsigned groupCount = (unsigned)groupBounds.size() - 1;
+	std::vector<unsigned> groupOf(count);
+	for (unsigned g = 0; g < groupCount; g++)
+	{
+		for (unsigned i = groupBounds[g]; i < groupBounds[g + 1]; i++)
+		{
+			groupOf[i] = g;
+		}
+	}
+
+	// Sort the registrations by the position of their particle, keeping their order for a particle
+	std::vector<unsigned> registrationOffsets(count + 1, 0);
+	for (size_t i = 0; i < registrationParticles.size(); i++)
+	{
+		if (registrationParticles[i] != count) registrationOffsets[positions[registrationParticles[i]] + 1]++;
+	}
+	for (unsigned i = 0; i < count; i++)
+	{
+		registrationOffsets[i + 1] += registrationOffsets[i];
+	}
+	registrations.resize(registrationOffsets[count]);
+	std::vector<unsigned> fill(registrationOffsets.begin(), registrationOffsets.end() - 1);
+	for (size_t i = 0; i < registrationParticles.size(); i++)
+	{
+		if (registrationParticles[i] != count) registrations[fill[positions[registrationParticles[i]]]++] = registry[i];
+	}
+
+	// Sort the links by group, keeping their order in a group
+	std::vector<unsigned> linkOffsets(groupCount + 1, 0);
+	for (size_t i = 0; i < linkParticles.size(); i++)
+	{
+		linkOffsets[groupOf[positions[linkParticles[i]]] + 1]++;
+	}
+	for (unsigned g = 0; g < groupCount; g++)
+	{
+		linkOffsets[g + 1] += linkOffsets[g];
+	}
+	links.resize(linkParticles.size());
+	std::vector<unsigned> linkFill(linkOffsets.begin(), linkOffsets.end() - 1);
+	for (size_t i = 0; i < islandLinks.size(); i++)
+	{
+		links[linkFill[groupOf[positions[linkParticles[i]]]]++] = islandLinks[i];
+	}
+
+	// The spans of the chunks of each group, then of the groups, filled before the tasks
+	// point to them
+	std::vector<unsigned> chunkBounds;
+	std::vector<unsigned> groupChunks(groupCount + 1, 0);
+	for (unsigned g = 0; g < groupCount; g++)
+	{
+		unsigned size = groupBounds[g + 1] - groupBounds[g];
+		unsigned chunks = size / grain > 1 ? size / grain : 1;
+		for (unsigned c = 0; c < chunks; c++)
+		{
+			chunkBounds.push_back(groupBounds[g] + (unsigned)((unsigned long long)size * c / chunks));
+		}
+		groupChunks[g + 1] = groupChunks[g] + chunks;
+	}
+	chunkBounds.push_back(count);
+	unsigned chunkCount = groupChunks[groupCount];
+
+	spans.clear();
+	for (unsigned c = 0; c < chunkCount; c++)
+	{
+		Span span = { this, registrationOffsets[chunkBounds[c]], registrationOffsets[chunkBounds[c + 1]], 0, 0, 0 };
+		spans.push_back(span);
+	}
+	for (unsigned g = 0; g < groupCount; g++)
+	{
+		Span span = { this, 0, 0, linkOffsets[g], linkOffsets[g + 1], 0 };
+		spans.push_back(span);
+	}
+
+	// The graph of a step
+	graph.clear();
+	unsigned serial = 0;
+	bool hasSerial = !serialRegistrations.empty();
+	if (hasSerial) serial = graph.addTask(serialForcesJob, this, 0, (unsigned)serialRegistrations.size(), "serial forces");
+
+	std::vector<unsigned> lastTasks;
+	std::vector<unsigned> forceTasks;
+	std::vector<unsigned> integrateTasks;
+	for (unsigned g = 0; g < groupCount; g++)
+	{
+		forceTasks.clear();
+		integrateTasks.clear();
+		for (unsigned c = groupChunks[g]; c < groupChunks[g + 1]; c++)
+		{
+			unsigned task = graph.addTask(forcesJob, &spans[c], chunkBounds[c], chunkBounds[c + 1], "forces");
+			if (hasSerial) graph.addDependency(serial, task);
+			forceTasks.push_back(task);
+		}
+
+		// Every force of the group is final before any of its particles move
+		unsigned ready = forceTasks[0];
+		if (forceTasks.size() > 1)
+		{
+			ready = graph.addTask(NULL, NULL, 0, 0, "forces done");
+			for (size_t f = 0; f < forceTasks.size(); f++)
+			{
+				graph.addDependency(forceTasks[f], ready);
+			}
+		}
+		for (unsigned c = groupChunks[g]; c < groupChunks[g + 1]; c++)
+		{
+			unsigned task = graph.addTask(integrateJob, this, chunkBounds[c], chunkBounds[c + 1], "integrate");
+			graph.addDependency(ready, task);
+			integrateTasks.push_back(task);
+		}
+
+		Span* group = &spans[chunkCount + g];
+		if (group->linkBegin == group->linkEnd)
+		{
+			lastTasks.insert(lastTasks.end(), integrateTasks.begin(), integrateTasks.end());
+			continue;
+		}
+		unsigned contactTask = graph.addTask(contactsJob, group, group->linkBegin, group->linkEnd, "contacts");
+		for (size_t i = 0; i < integrateTasks.size(); i++)
+		{
+			graph.addDependency(integrateTasks[i], contactTask);
+		}
+		unsigned resolveTask = graph.addTask(resolveJob, group, group->linkBegin, group->linkEnd, "resolve");
+		graph.addDependency(contactTask, resolveTask);
+		lastTasks.push_back(resolveTask);
+	}
+
+	if (!globalLinks.empty())
+	{
+		unsigned task = graph.addTask(globalJob, this, 0, (unsigned)globalLinks.size(), "global contacts");
+		if (hasSerial) graph.addDependency(serial, task);
+		for (size_t i = 0; i < lastTasks.size(); i++)
+		{
+			graph.addDependency(lastTasks[i], task);
+		}
+	}
+
+	valid = true;
+	particleCount = count;
+	registrationCount = registry.size();
+	linkCount = worldLinks.size();
+	firstParticle = count ? particles[0] : NULL;
+
+	stats.islands = (unsigned)islandOrder.size();
+	stats.groups = groupCount;
+	stats.serialRegistrations = (unsigned)serialRegistrations.size();
+	stats.globalLinks = (unsigned)globalLinks.size();
+	stats.rebuilds++;
+}
+
+unsigned ParticlePipeline::findIsland(unsigned index) {
+	// Halve the path on the way up
+	while (parents[index] != index)
+	{
+		parents[index] = parents[parents[index]];
+		index = parents[index];
+	}
+	return index;
+}
+
+void ParticlePipeline::applyForces(const ParticleForceRegistry::ParticleForceRegistration* registrations, unsigned count) {
+	const unsigned batchSize = 64;
+	Particle* batch[batchSize];
+
+	unsigned i = 0;
+	while (i < count)
+	{
+		// Gather the run of registrations of the same generator
+		ParticleForceGenerator* fg = registrations[i].fg;
+		unsigned size = 0;
+		for (; i < count && registrations[i].fg == fg && size < batchSize; i++)
+		{
+			batch[size++] = registrations[i].particle;
+		}
+
+		if (size == 1) fg->updateForce(batch[0], duration);
+		else fg->updateForces(batch, size, duration);
+	}
+}
+
+void ParticlePipeline::resolve(ParticleContact* contacts, unsigned count) {
+	if (count == 0) return;
+
+	unsigned iterations = world->getIterations();
+	ParticleContactResolver resolver(iterations ? iterations : count * 2);
+	resolver.resolveContacts(contacts, count, duration);
+}
+
+void ParticlePipeline::serialForcesJob(void* context, unsigned begin, unsigned end) {
+	ParticlePipeline* pipeline = (ParticlePipeline*)context;
+	pipeline->applyForces(&pipeline->serialRegistrations[begin], end - begin);
+}
+
+void ParticlePipeline::forcesJob(void* context, unsigned begin, unsigned end) {
+	Span* span = (Span*)context;
+	if (span->registrationBegin == span->registrationEnd) return;
+
+	ParticlePipeline* pipeline = span->pipeline;
+	pipeline->applyForces(&pipeline->registrations[span->registrationBegin], span->registrationEnd - span->registrationBegin);
+}
+
+void ParticlePipeline::integrateJob(void* context, unsigned begin, unsigned end) {
+	ParticlePipeline* pipeline = (ParticlePipeline*)context;
+	ParticleWorld::integrateParticles(&pipeline->ordered[begin], end - begin, pipeline->duration);
+}
+
+void ParticlePipeline::contactsJob(void* context, unsigned begin, unsigned end) {
+	Span* span = (Span*)context;
+	ParticlePipeline* pipeline = span->pipeline;
+
+	// Each link of the group has room for a contact
+	unsigned limit = end - begin;
+	ParticleContact* next = pipeline->contacts + begin;
+	for (unsigned i = begin; i < end && limit > 0; i++)
+	{
+		unsigned used = pipeline->links[i]->fillContact(next, limit);
+		limit -= used;
+		next += used;
+	}
+	span->contactCount = end - begin - limit;
+}
+
+void ParticlePipeline::resolveJob(void* context, unsigned begin, unsigned end) {
+	Span* span = (Span*)context;
+	span->pipeline->resolve(span->pipeline->contacts + begin, span->contactCount);
+}
+
+void ParticlePipeline::globalJob(void* context, unsigned begin, unsigned end) {
+	ParticlePipeline* pipeline = (ParticlePipeline*)context;
+
+	unsigned limit = pipeline->world->getMaxContacts();
+	ParticleContact* first = pipeline->contacts + pipeline->links.size();
+	ParticleContact* next = first;
+	for (unsigned i = begin; i < end && limit > 0; i++)
+	{
+		unsigned used = pipeline->globalLinks[i]->fillContact(next, limit);
+		limit -= used;
+		next += used;
+	}
+	pipeline->globalContactCount = (unsigned)(next - first);
+	pipeline->resolve(first, pipeline->globalContactCount);
+}
@@ -0,0 +1,125 @@
+#include <include/pprofile.h>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
+using namespace cyclone;
+
+double ParticleProfileStats::getAverageTime(Phase phase) const {
+	return frames ? (double)totalTime[phase] / frames : 0;
+}
+
+double ParticleProfileStats::getAverageCount(Counter counter) const {
+	return frames ? (double)totalCount[counter] / frames : 0;
+}
+
+ParticleProfiler::ParticleProfiler(size_t maxEvents) {
+	ParticleProfiler::maxEvents = maxEvents;
+	events.reserve(maxEvents);
+	reset();
+}
+
+uint64_t ParticleProfiler::now() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void ParticleProfiler::beginFrame() {
+	stats.frames++;
+	memset(stats.lastTime, 0, sizeof(stats.lastTime));
+	memset(stats.lastCount, 0, sizeof(stats.lastCount));
+}
+
+void ParticleProfiler::recordPhase(ParticleProfileStats::Phase phase, uint64_t start, uint64_t end) {
+	uint64_t time = end - start;
+	stats.totalTime[phase] += time;
+	stats.lastTime[phase] += time;
+	if (time > stats.maxTime[phase]) stats.maxTime[phase] = time;
+
+	// The bucket is the position of the highest bit set
+	unsigned bucket = 0;
+	while (bucket + 1 < ParticleProfileStats::histogramBuckets && (time >> (bucket + 1)) != 0) bucket++;
+	stats.histogram[phase][bucket]++;
+
+	if (events.size() == maxEvents)
+	{
+		droppedEvents++;
+		return;
+	}
+	Event event = { start, time, (uint8_t)phase, 0 };
+	events.push_back(event);
+}
+
+void ParticleProfiler::recordCount(ParticleProfileStats::Counter counter, uint64_t value) {
+	stats.totalCount[counter] += value;
+	stats.lastCount[counter] += value;
+
+	if (events.size() == maxEvents)
+	{
+		droppedEvents++;
+		return;
+	}
+	Event event = { now(), value, (uint8_t)counter, 1 };
+	events.push_back(event);
+}
+
+const ParticleProfileStats& ParticleProfiler::getStats() const {
+	return stats;
+}
+
+size_t ParticleProfiler::getEventCount() const {
+	return events.size();
+}
+
+uint64_t ParticleProfiler::getDroppedEvents() const {
+	return droppedEvents;
+}
+
+void ParticleProfiler::reset() {
+	memset(&stats, 0, sizeof(stats));
+	events.clear();
+	droppedEvents = 0;
+	origin = now();
+}
+
+bool ParticleProfiler::exportTrace(const char* path) const {
+	FILE* file = fopen(path, "w");
+	if (!file) return false;
+
+	// Timestamps and durations are in microseconds in the trace format
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	for (size_t i = 0; i < events.size(); i++)
+	{
+		const Event& event = events[i];
+		double start = (double)(event.start - origin) / 1000;
+		if (event.isCounter)
+		{
+			const char* name = getCounterName((ParticleProfileStats::Counter)event.phase);
+			fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"cyclone\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":1,\"tid\":1,\"args\":{\"%s\":%llu}}",
+				i ? "," : "", name, start, name, (unsigned long long)event.value);
+		}
+		else
+		{
+			fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"cyclone\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":1}",
+				i ? "," : "", getPhaseName((ParticleProfileStats::Phase)event.phase), start, (double)event.value / 1000);
+		}
+	}
+	fprintf(file, "\n]}\n");
+
+	bool written = !ferror(file);
+	return fclose(file) == 0 && written;
+}
+
+const char* ParticleProfiler::getPhaseName(ParticleProfileStats::Phase phase) {
+	static const char* names[ParticleProfileStats::PhaseCount] = {
+		"forces", "integrate", "contacts", "resolve"
+	};
+	return names[phase];
+}
+
+const char* ParticleProfiler::getCounterName(ParticleProfileStats::Counter counter) {
+	static const char* names[ParticleProfileStats::CounterCount] = {
+		"registrations", "contactsGenerated", "contactsResolved", "iterations", "particlesResting", "forcesReused"
+	};
+	return names[counter];
+}
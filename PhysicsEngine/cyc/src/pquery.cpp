@@ -0,0 +1,548 @@
+#include <include/pquery.h>
+#include <assert.h>
+#include <math.h>
+#include <stdlib.h>
+
+using namespace cyclone;
+
+/*
+* The number of queries handed to a thread at a time
+*/
+static const unsigned queryGrain = 64;
+
+/*
+* Returns the key of a cell in the map, 21 bits per coordinate offset to be positive
+*/
+static uint64_t cellKey(int x, int y, int z) {
+	const uint64_t mask = (1 << 21) - 1;
+	return (((uint64_t)(x + (1 << 20)) & mask) << 42) | (((uint64_t)(y + (1 << 20)) & mask) << 21) | ((uint64_t)(z + (1 << 20)) & mask);
+}
+
+/*
+* The visitors of the radius queries: appending to a vector, counting, and writing to an array
+*/
+struct RadiusAppend {
+	std::vector<unsigned>* results;
+	unsigned count;
+	void operator()(unsigned index) { results->push_back(index); count++; }
+};
+
+struct RadiusCount {
+	unsigned count;
+	void operator()(unsigned) { count++; }
+};
+
+struct RadiusWrite {
+	unsigned* results;
+	void operator()(unsigned index) { *results++ = index; }
+};
+
+/*
+* Holds the arguments of the batched queries for the jobs
+*/
+struct QueryBatch {
+	const ParticleQueryIndex* index;
+	const Vector3* centers;
+	const real* radii;
+	unsigned* offsets;
+	unsigned* results;
+	unsigned k;
+	const ParticleRay* rays;
+	ParticleRayHit* hits;
+};
+
+ParticleQueryIndex::ParticleQueryIndex(real cellSize, real particleRadius) {
+	assert(cellSize > 0 && particleRadius >= 0 && particleRadius <= cellSize);
+
+	ParticleQueryIndex::cellSize = cellSize;
+	ParticleQueryIndex::particleRadius = particleRadius;
+	ParticleQueryIndex::stats = ParticleQueryStats();
+	for (unsigned a = 0; a < 3; a++)
+	{
+		minCell[a] = 1;
+		maxCell[a] = 0;
+	}
+}
+
+void ParticleQueryIndex::addParticle(Particle* particle) {
+	unsigned index = (unsigned)particles.size();
+	particles.push_back(particle);
+	cellOf.push_back(0);
+	slotOf.push_back(0);
+
+	const Vector3& position = particle->position;
+	int cell[3] = { cellCoordinate(position.x), cellCoordinate(position.y), cellCoordinate(position.z) };
+	insert(index, cellKey(cell[0], cell[1], cell[2]), position);
+
+	for (unsigned a = 0; a < 3; a++)
+	{
+		if (index == 0 || cell[a] < minCell[a]) minCell[a] = cell[a];
+		if (index == 0 || cell[a] > maxCell[a]) maxCell[a] = cell[a];
+	}
+	stats.cells = (unsigned)cells.size();
+}
+
+void ParticleQueryIndex::removeParticle(Particle* particle) {
+	unsigned count = (unsigned)particles.size();
+	for (unsigned i = 0; i < count; i++)
+	{
+		if (particles[i] != particle) continue;
+
+		erase(i);
+
+		// The last particle takes the index of the removed one
+		unsigned last = count - 1;
+		if (i != last)
+		{
+			particles[i] = particles[last];
+			cellOf[i] = cellOf[last];
+			slotOf[i] = slotOf[last];
+			cells[cellOf[i]].indices[slotOf[i]] = i;
+		}
+		particles.pop_back();
+		cellOf.pop_back();
+		slotOf.pop_back();
+		stats.cells = (unsigned)cells.size();
+		return;
+	}
+}
+
+void ParticleQueryIndex::update() {
+	unsigned count = (unsigned)particles.size();
+	stats.moved = 0;
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		const Vector3& position = particles[i]->position;
+		int cell[3] = { cellCoordinate(position.x), cellCoordinate(position.y), cellCoordinate(position.z) };
+		for (unsigned a = 0; a < 3; a++)
+		{
+			if (i == 0 || cell[a] < minCell[a]) minCell[a] = cell[a];
+			if (i == 0 || cell[a] > maxCell[a]) maxCell[a] = cell[a];
+		}
+
+		uint64_t key = cellKey(cell[0], cell[1], cell[2]);
+		if (key == cellOf[i])
+		{
+			// Still in its cell, only the position changes
+			Cell& current = cells[key];
+			unsigned slot = slotOf[i];
+			current.x[slot] = position.x;
+			current.y[slot] = position.y;
+			current.z[slot] = position.z;
+			continue;
+		}
+
+		erase(i);
+		insert(i, key, position);
+		stats.moved++;
+	}
+
+	if (count == 0)
+	{
+		for (unsigned a = 0; a < 3; a++)
+		{
+			minCell[a] = 1;
+			maxCell[a] = 0;
+		}
+	}
+	stats.cells = (unsigned)cells.size();
+}
+
+void ParticleQueryIndex::remapParticles(const ParticleRemap& remap) {
+	Particles::iterator i = particles.begin();
+	for (; i != particles.end(); i++)
+	{
+		*i = remap.map(*i);
+	}
+}
+
+ParticleQueryIndex::Particles& ParticleQueryIndex::getParticles() {
+	return particles;
+}
+
+template<class Visitor>
+void ParticleQueryIndex::visitRadius(const Vector3& center, real radius, Visitor& visitor) const {
+	if (particles.empty()) return;
+
+	// The cells overlapping the sphere, within the cells holding particles
+	int low[3], high[3];
+	const real* c = &center.x;
+	for (unsigned a = 0; a < 3; a++)
+	{
+		low[a] = cellCoordinate(c[a] - radius);
+		high[a] = cellCoordinate(c[a] + radius);
+		if (low[a] < minCell[a]) low[a] = minCell[a];
+		if (high[a] > maxCell[a]) high[a] = maxCell[a];
+		if (low[a] > high[a]) return;
+	}
+
+	const real radiusSquared = radius * radius;
+	for (int z = low[2]; z <= high[2]; z++)
+	{
+		for (int y = low[1]; y <= high[1]; y++)
+		{
+			for (int x = low[0]; x <= high[0]; x++)
+			{
+				const Cell* cell = findCell(x, y, z);
+				if (!cell) continue;
+
+				const real* px = &cell->x[0];
+				const real* py = &cell->y[0];
+				const real* pz = &cell->z[0];
+				unsigned size = (unsigned)cell->indices.size();
+				for (unsigned s = 0; s < size; s++)
+				{
+					real dx = px[s] - center.x, dy = py[s] - center.y, dz = pz[s] - center.z;
+					if (dx * dx + dy * dy + dz * dz <= radiusSquared) visitor(cell->indices[s]);
+				}
+			}
+		}
+	}
+}
+
+unsigned ParticleQueryIndex::queryRadius(const Vector3& center, real radius, std::vector<unsigned>* results) const {
+	RadiusAppend visitor = { results, 0 };
+	visitRadius(center, radius, visitor);
+	return visitor.count;
+}
+
+unsigned ParticleQueryIndex::queryNearest(const Vector3& center, unsigned k, unsigned* results, real* distances) const {
+	if (k == 0 || particles.empty()) return 0;
+
+	// The best particles so far, nearest first, with their squared distances
+	const unsigned stackLimit = 64;
+	real stackSquared[stackLimit];
+	std::vector<real> heapSquared;
+	real* bestSquared = stackSquared;
+	if (k > stackLimit)
+	{
+		heapSquared.resize(k);
+		bestSquared = &heapSquared[0];
+	}
+	unsigned found = 0;
+
+	int home[3] = { cellCoordinate(center.x), cellCoordinate(center.y), cellCoordinate(center.z) };
+
+	// The rings of cells around the home cell that can hold particles, from the first one
+	// reaching the cells holding particles to the last one covering them all
+	int firstRing = 0, lastRing = 0;
+	for (unsigned a = 0; a < 3; a++)
+	{
+		int below = home[a] - minCell[a], above = maxCell[a] - home[a];
+		if (-below > firstRing) firstRing = -below;
+		if (-above > firstRing) firstRing = -above;
+		if (below > lastRing) lastRing = below;
+		if (above > lastRing) lastRing = above;
+	}
+
+	for (int ring = firstRing; ring <= lastRing; ring++)
+	{
+		// Only the part of the ring within the cells holding particles is visited
+		int low[3], high[3];
+		for (unsigned a = 0; a < 3; a++)
+		{
+			low[a] = home[a] - ring < minCell[a] ? minCell[a] : home[a] - ring;
+			high[a] = home[a] + ring > maxCell[a] ? maxCell[a] : home[a] + ring;
+		}
+
+		for (int z = low[2]; z <= high[2]; z++)
+		{
+			for (int y = low[1]; y <= high[1]; y++)
+			{
+				// Inside the ring only the first and last cells of a row are on it
+				bool inside = z != home[2] - ring && z != home[2] + ring && y != home[1] - ring && y != home[1] + ring;
+				int step = inside && ring > 0 ? 2 * ring : 1;
+				for (int x = home[0] - ring; x <= home[0] + ring; x += step)
+				{
+					if (x < low[0])
+					{
+						// Skip to the first cell of the row within the cells holding particles
+						if (!inside) x = low[0];
+						else continue;
+					}
+					if (x > high[0]) break;
+
+					const Cell* cell = findCell(x, y, z);
+					if (!cell) continue;
+
+					unsigned size = (unsigned)cell->indices.size();
+					for (unsigned s = 0; s < size; s++)
+					{
+						real dx = cell->x[s] - center.x, dy = cell->y[s] - center.y, dz = cell->z[s] - center.z;
+						real squared = dx * dx + dy * dy + dz * dz;
+						if (found == k && squared >= bestSquared[k - 1]) continue;
+
+						// Insert in order, dropping the farthest when full
+						unsigned position = found < k ? found++ : k - 1;
+						while (position > 0 && bestSquared[position - 1] > squared)
+						{
+							bestSquared[position] = bestSquared[position - 1];
+							results[position] = results[position - 1];
+							position--;
+						}
+						bestSquared[position] = squared;
+						results[position] = cell->indices[s];
+					}
+				}
+			}
+		}
+
+		// Particles beyond this ring are at least ring cells away
+		real reach = ring * cellSize;
+		if (found == k && bestSquared[k - 1] <= reach * reach) break;
+	}
+
+	if (distances)
+	{
+		for (unsigned i = 0; i < found; i++) distances[i] = real_sqrt(bestSquared[i]);
+	}
+	return found;
+}
+
+bool ParticleQueryIndex::raycast(const ParticleRay& ray, ParticleRayHit* hit) const {
+	hit->particle = none;
+	hit->distance = ray.maxDistance;
+	if (particles.empty()) return false;
+
+	real length = ray.direction.magnitude();
+	if (length == 0) return false;
+	Vector3 direction = ray.direction * (1 / length);
+
+	// Clip the ray to the cells holding particles, one cell wider for the spheres on their edges
+	real enter = 0, leave = ray.maxDistance;
+	const real* origin = &ray.origin.x;
+	const real* d = &direction.x;
+	for (unsigned a = 0; a < 3; a++)
+	{
+		real low = (minCell[a] - 1) * cellSize, high = (maxCell[a] + 2) * cellSize;
+		if (d[a] == 0)
+		{
+			if (origin[a] < low || origin[a] > high) return false;
+			continue;
+		}
+		real t0 = (low - origin[a]) / d[a], t1 = (high - origin[a]) / d[a];
+		if (t0 > t1) { real swap = t0; t0 = t1; t1 = swap; }
+		if (t0 > enter) enter = t0;
+		if (t1 < leave) leave = t1;
+	}
+	if (enter > leave) return false;
+
+	// Walk the cells along the ray (Amanatides and Woo). A sphere hit in a cell has its
+	// center in that cell or a neighbor, so the neighbors of each cell are tested too,
+	// skipping those already tested as neighbors of the previous cell
+	Vector3 start = ray.origin + direction * enter;
+	int cell[3], step[3], previous[3];
+	real next[3], delta[3];
+	const real* s = &start.x;
+	for (unsigned a = 0; a < 3; a++)
+	{
+		cell[a] = cellCoordinate(s[a]);
+		if (d[a] > 0)
+		{
+			step[a] = 1;
+			next[a] = enter + ((cell[a] + 1) * cellSize - s[a]) / d[a];
+			delta[a] = cellSize / d[a];
+		}
+		else if (d[a] < 0)
+		{
+			step[a] = -1;
+			next[a] = enter + (cell[a] * cellSize - s[a]) / d[a];
+			delta[a] = -cellSize / d[a];
+		}
+		else
+		{
+			step[a] = 0;
+			next[a] = REAL_MAX;
+			delta[a] = REAL_MAX;
+		}
+		previous[a] = cell[a] + 1000;
+	}
+
+	real cellEnter = enter;
+	while (cellEnter <= leave && cellEnter <= hit->distance)
+	{
+		for (int z = cell[2] - 1; z <= cell[2] + 1; z++)
+		{
+			for (int y = cell[1] - 1; y <= cell[1] + 1; y++)
+			{
+				for (int x = cell[0] - 1; x <= cell[0] + 1; x++)
+				{
+					bool tested = abs(x - previous[0]) <= 1 && abs(y - previous[1]) <= 1 && abs(z - previous[2]) <= 1;
+					if (tested) continue;
+
+					const Cell* found = findCell(x, y, z);
+					if (found) raycastCell(*found, ray.origin, direction, hit);
+				}
+			}
+		}
+
+		// Step into the next cell along the axis crossed first
+		previous[0] = cell[0];
+		previous[1] = cell[1];
+		previous[2] = cell[2];
+		unsigned axis = next[0] < next[1] ? (next[0] < next[2] ? 0 : 2) : (next[1] < next[2] ? 1 : 2);
+		cellEnter = next[axis];
+		cell[axis] += step[axis];
+		next[axis] += delta[axis];
+	}
+
+	return hit->particle != none;
+}
+
+void ParticleQueryIndex::queryRadius(const Vector3* centers, const real* radii, unsigned count,
+	std::vector<unsigned>* offsets, std::vector<unsigned>* results, ParticleJobPool* jobs) const {
+	offsets->assign(count + 1, 0);
+	QueryBatch batch = QueryBatch();
+	batch.index = this;
+	batch.centers = centers;
+	batch.radii = radii;
+	batch.offsets = &(*offsets)[0];
+
+	// Count the results of each query, then write them where the counts put them
+	if (jobs) jobs->run(countRadiusJob, &batch, count, queryGrain);
+	else countRadiusJob(&batch, 0, count);
+
+	for (unsigned i = 0; i < count; i++)
+	{
+		batch.offsets[i + 1] += batch.offsets[i];
+	}
+
+	results->resize(batch.offsets[count]);
+	if (results->empty()) return;
+	batch.results = &(*results)[0];
+	if (jobs) jobs->run(fillRadiusJob, &batch, count, queryGrain);
+	else fillRadiusJob(&batch, 0, count);
+}
+
+void ParticleQueryIndex::queryNearest(const Vector3* centers, unsigned count, unsigned k, unsigned* results, ParticleJobPool* jobs) const {
+	QueryBatch batch = QueryBatch();
+	batch.index = this;
+	batch.centers = centers;
+	batch.results = results;
+	batch.k = k;
+
+	if (jobs) jobs->run(nearestJob, &batch, count, queryGrain);
+	else nearestJob(&batch, 0, count);
+}
+
+void ParticleQueryIndex::raycast(const ParticleRay* rays, unsigned count, ParticleRayHit* hits, ParticleJobPool* jobs) const {
+	QueryBatch batch = QueryBatch();
+	batch.index = this;
+	batch.rays = rays;
+	batch.hits = hits;
+
+	if (jobs) jobs->run(raycastJob, &batch, count, queryGrain);
+	else raycastJob(&batch, 0, count);
+}
+
+const ParticleQueryStats& ParticleQueryIndex::getStats() const {
+	return stats;
+}
+
+int ParticleQueryIndex::cellCoordinate(real value) const {
+	return (int)floor(value / cellSize);
+}
+
+void ParticleQueryIndex::insert(unsigned index, uint64_t key, const Vector3& position) {
+	Cell& cell = cells[key];
+	cellOf[index] = key;
+	slotOf[index] = (unsigned)cell.indices.size();
+	cell.indices.push_back(index);
+	cell.x.push_back(position.x);
+	cell.y.push_back(position.y);
+	cell.z.push_back(position.z);
+}
+
+void ParticleQueryIndex::erase(unsigned index) {
+	Cells::iterator found = cells.find(cellOf[index]);
+	Cell& cell = found->second;
+	unsigned slot = slotOf[index];
+	unsigned last = (unsigned)cell.indices.size() - 1;
+
+	// The last particle of the cell takes the slot
+	if (slot != last)
+	{
+		unsigned moved = cell.indices[last];
+		cell.indices[slot] = moved;
+		cell.x[slot] = cell.x[last];
+		cell.y[slot] = cell.y[last];
+		cell.z[slot] = cell.z[last];
+		slotOf[moved] = slot;
+	}
+	cell.indices.pop_back();
+	cell.x.pop_back();
+	cell.y.pop_back();
+	cell.z.pop_back();
+
+	if (cell.indices.empty()) cells.erase(found);
+}
+
+const ParticleQueryIndex::Cell* ParticleQueryIndex::findCell(int x, int y, int z) const {
+	Cells::const_iterator found = cells.find(cellKey(x, y, z));
+	return found == cells.end() ? NULL : &found->second;
+}
+
+void ParticleQueryIndex::raycastCell(const Cell& cell, const Vector3& origin, const Vector3& direction, ParticleRayHit* hit) const {
+	const real radiusSquared = particleRadius * particleRadius;
+	const real* px = &cell.x[0];
+	const real* py = &cell.y[0];
+	const real* pz = &cell.z[0];
+	unsigned size = (unsigned)cell.indices.size();
+
+	for (unsigned s = 0; s < size; s++)
+	{
+		// The distance along the ray to the nearest point to the center, and the squared
+		// distance from the center to the ray
+		real mx = px[s] - origin.x, my = py[s] - origin.y, mz = pz[s] - origin.z;
+		real along = mx * direction.x + my * direction.y + mz * direction.z;
+		real squared = mx * mx + my * my + mz * mz;
+		real discriminant = along * along - squared + radiusSquared;
+		if (discriminant < 0) continue;
+
+		// A ray starting inside a sphere hits it right away
+		real t = squared <= radiusSquared ? 0 : along - real_sqrt(discriminant);
+		if (t < 0 || t > hit->distance) continue;
+		if (t == hit->distance && cell.indices[s] > hit->particle) continue;
+
+		hit->distance = t;
+		hit->particle = cell.indices[s];
+	}
+}
+
+void ParticleQueryIndex::countRadiusJob(void* context, unsigned begin, unsigned end) {
+	QueryBatch* batch = (QueryBatch*)context;
+	for (unsigned i = begin; i < end; i++)
+	{
+		RadiusCount visitor = { 0 };
+		batch->index->visitRadius(batch->centers[i], batch->radii[i], visitor);
+		batch->offsets[i + 1] = visitor.count;
+	}
+}
+
+void ParticleQueryIndex::fillRadiusJob(void* context, unsigned begin, unsigned end) {
+	QueryBatch* batch = (QueryBatch*)context;
+	for (unsigned i = begin; i < end; i++)
+	{
+		RadiusWrite visitor = { batch->results + batch->offsets[i] };
+		batch->index->visitRadius(batch->centers[i], batch->radii[i], visitor);
+	}
+}
+
+void ParticleQueryIndex::nearestJob(void* context, unsigned begin, unsigned end) {
+	QueryBatch* batch = (QueryBatch*)context;
+	for (unsigned i = begin; i < end; i++)
+	{
+		unsigned* results = batch->results + (size_t)i * batch->k;
+		unsigned found = batch->index->queryNearest(batch->centers[i], batch->k, results);
+		for (unsigned j = found; j < batch->k; j++) results[j] = none;
+	}
+}
+
+void ParticleQueryIndex::raycastJob(void* context, unsigned begin, unsigned end) {
+	QueryBatch* batch = (QueryBatch*)context;
+	for (unsigned i = begin; i < end; i++)
+	{
+		batch->index->raycast(batch->rays[i], &batch->hits[i]);
+	}
+}
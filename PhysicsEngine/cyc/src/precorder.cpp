@@ -0,0 +1,307 @@
+#include <include/precorder.h>
+#include <assert.h>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+
+using namespace cyclone;
+
+/*
+* Quantizes a value to an integer multiple of the quantum, clamping it to the range of int32
+*/
+static int32_t quantize(double value, double quantum) {
+	double steps = floor(value / quantum + 0.5);
+	if (steps > 2147483647.0) return 2147483647;
+	if (steps < -2147483648.0) return (-2147483647 - 1);
+	return (int32_t)steps;
+}
+
+/*
+* Appends the zigzag varint encoding of a signed difference
+*/
+static void writeVarint(std::vector<unsigned char>& buffer, int64_t value) {
+	uint64_t zigzag = ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+	while (zigzag >= 0x80)
+	{
+		buffer.push_back((unsigned char)(zigzag | 0x80));
+		zigzag >>= 7;
+	}
+	buffer.push_back((unsigned char)zigzag);
+}
+
+/*
+* Reads a zigzag varint, advancing the cursor. Returns false if it runs past the end
+*/
+static bool readVarint(const unsigned char*& cursor, const unsigned char* end, int64_t* value) {
+	uint64_t zigzag = 0;
+	unsigned shift = 0;
+	while (cursor < end && shift < 64)
+	{
+		unsigned char byte = *cursor++;
+		zigzag |= (uint64_t)(byte & 0x7F) << shift;
+		if (!(byte & 0x80))
+		{
+			*value = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+			return true;
+		}
+		shift += 7;
+	}
+	return false;
+}
+
+ParticleRecorder::ParticleRecorder(unsigned ringFrames, unsigned chunkFrames) : published(0), consumed(0), stopping(false) {
+	assert(ringFrames > 0 && chunkFrames > 0);
+
+	ParticleRecorder::ringFrames = ringFrames;
+	ParticleRecorder::chunkFrames = chunkFrames;
+	ParticleRecorder::particles = NULL;
+	ParticleRecorder::fields = 0;
+	ParticleRecorder::valuesPerFrame = 0;
+	ParticleRecorder::dropped = 0;
+	ParticleRecorder::steps = 0;
+	ParticleRecorder::previousStep = 0;
+	ParticleRecorder::output = NULL;
+}
+
+ParticleRecorder::~ParticleRecorder() {
+	stop();
+}
+
+bool ParticleRecorder::start(const char* path, ParticleWorld::Particles* particles, unsigned fields, double quantum) {
+	stop();
+	assert(quantum > 0);
+
+	output = fopen(path, "wb");
+	if (!output) return false;
+
+	ParticleRecorder::particles = particles;
+	ParticleRecorder::fields = fields;
+
+	unsigned components = 0;
+	if (fields & ParticleRecordingFormat::RECORD_POSITION) components += 3;
+	if (fields & ParticleRecordingFormat::RECORD_VELOCITY) components += 3;
+	valuesPerFrame = components * (unsigned)particles->size();
+
+	memset(&header, 0, sizeof(header));
+	header.version = ParticleRecordingFormat::version;
+	header.fields = fields;
+	header.valuesPerFrame = valuesPerFrame;
+	header.particleCount = (uint32_t)particles->size();
+	header.quantum = quantum;
+
+	// The magic is only written when the recording is complete
+	fwrite(&header, sizeof(header), 1, output);
+
+	ring.assign((size_t)ringFrames * valuesPerFrame, 0);
+	ringSteps.assign(ringFrames, 0);
+	steps = 0;
+	previousStep = 0;
+	previous.assign(valuesPerFrame, 0);
+	chunk.clear();
+	index.clear();
+	published.store(0);
+	consumed.store(0);
+	stopping.store(false);
+	dropped = 0;
+
+	writer = std::thread(&ParticleRecorder::writeFrames, this);
+	return true;
+}
+
+bool ParticleRecorder::record() {
+	if (!output) return false;
+	assert(particles->size() == header.particleCount);
+
+	// Every step is counted, so the writer knows which ones were dropped
+	uint32_t step = steps++;
+	unsigned frame = published.load(std::memory_order_relaxed);
+	if (frame - consumed.load(std::memory_order_acquire) >= ringFrames)
+	{
+		dropped++;
+		return false;
+	}
+
+	ringSteps[frame % ringFrames] = step;
+
+	real* values = &ring[(size_t)(frame % ringFrames) * valuesPerFrame];
+	bool position = (fields & ParticleRecordingFormat::RECORD_POSITION) != 0;
+	bool velocity = (fields & ParticleRecordingFormat::RECORD_VELOCITY) != 0;
+
+	ParticleWorld::Particles::const_iterator p = particles->begin();
+	for (; p != particles->end(); p++)
+	{
+		if (position)
+		{
+			const Vector3& value = (*p)->position;
+			values[0] = value.x;
+			values[1] = value.y;
+			values[2] = value.z;
+			values += 3;
+		}
+		if (velocity)
+		{
+			const Vector3& value = (*p)->velocity;
+			values[0] = value.x;
+			values[1] = value.y;
+			values[2] = value.z;
+			values += 3;
+		}
+	}
+
+	// Publish the frame to the writer
+	published.store(frame + 1, std::memory_order_release);
+	return true;
+}
+
+void ParticleRecorder::stop() {
+	if (!output) return;
+
+	stopping.store(true, std::memory_order_release);
+	writer.join();
+
+	flushChunk();
+
+	// Write the index, aligned so it can be read in place, and complete the header
+	long position = ftell(output);
+	static const char padding[8] = { 0 };
+	long aligned = (position + 7) & ~7L;
+	fwrite(padding, 1, aligned - position, output);
+	if (!index.empty()) fwrite(&index[0], sizeof(ParticleRecordingFormat::ChunkEntry), index.size(), output);
+
+	header.magic = ParticleRecordingFormat::magic;
+	header.chunkCount = (uint32_t)index.size();
+	header.indexOffset = (uint64_t)aligned;
+	fseek(output, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, output);
+
+	fclose(output);
+	output = NULL;
+}
+
+bool ParticleRecorder::isRecording() const {
+	return output != NULL;
+}
+
+unsigned ParticleRecorder::getDroppedFrames() const {
+	return dropped;
+}
+
+void ParticleRecorder::writeFrames() {
+	while (true)
+	{
+		unsigned frame = consumed.load(std::memory_order_relaxed);
+		if (frame == published.load(std::memory_order_acquire))
+		{
+			// Only stop once everything published has been written
+			if (stopping.load(std::memory_order_acquire) && frame == published.load(std::memory_order_acquire)) return;
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+			continue;
+		}
+
+		encodeFrame(ringSteps[frame % ringFrames], &ring[(size_t)(frame % ringFrames) * valuesPerFrame]);
+
+		// Release the slot to the simulation
+		consumed.store(frame + 1, std::memory_order_release);
+	}
+}
+
+void ParticleRecorder::encodeFrame(uint32_t step, const real* values) {
+	bool first = chunk.empty();
+	writeVarint(chunk, first ? (int64_t)step : (int64_t)step - previousStep);
+	previousStep = step;
+
+	for (unsigned i = 0; i < valuesPerFrame; i++)
+	{
+		int32_t quantized = quantize(values[i], header.quantum);
+		int64_t delta = first ? (int64_t)quantized : (int64_t)quantized - previous[i];
+		writeVarint(chunk, delta);
+		previous[i] = quantized;
+	}
+
+	header.frameCount++;
+	if (header.frameCount % chunkFrames == 0) flushChunk();
+}
+
+void ParticleRecorder::flushChunk() {
+	if (chunk.empty()) return;
+
+	ParticleRecordingFormat::ChunkEntry entry;
+	entry.offset = (uint64_t)ftell(output);
+	entry.size = chunk.size();
+	entry.frameCount = header.frameCount % chunkFrames == 0 ? chunkFrames : header.frameCount % chunkFrames;
+	entry.firstFrame = header.frameCount - entry.frameCount;
+	index.push_back(entry);
+
+	fwrite(&chunk[0], 1, chunk.size(), output);
+	chunk.clear();
+}
+
+ParticleRecording::ParticleRecording() {
+	header = NULL;
+	index = NULL;
+}
+
+bool ParticleRecording::open(const char* path) {
+	header = NULL;
+	index = NULL;
+	if (!file.open(path)) return false;
+
+	const ParticleRecordingFormat::Header* candidate = (const ParticleRecordingFormat::Header*)file.getData();
+	if (file.getSize() < sizeof(*candidate) ||
+		candidate->magic != ParticleRecordingFormat::magic ||
+		candidate->version != ParticleRecordingFormat::version ||
+		candidate->indexOffset + candidate->chunkCount * sizeof(ParticleRecordingFormat::ChunkEntry) > file.getSize())
+	{
+		file.close();
+		return false;
+	}
+
+	header = candidate;
+	index = (const ParticleRecordingFormat::ChunkEntry*)((const char*)file.getData() + header->indexOffset);
+	values.assign(header->valuesPerFrame, 0);
+	return true;
+}
+
+const ParticleRecordingFormat::Header* ParticleRecording::getHeader() const {
+	return header;
+}
+
+bool ParticleRecording::readFrame(unsigned frame, real* output, unsigned* step) {
+	if (!header || frame >= header->frameCount) return false;
+
+	// Find the chunk holding the frame
+	unsigned low = 0, high = header->chunkCount;
+	while (high - low > 1)
+	{
+		unsigned middle = (low + high) / 2;
+		if (index[middle].firstFrame <= frame) low = middle;
+		else high = middle;
+	}
+	const ParticleRecordingFormat::ChunkEntry& entry = index[low];
+	if (entry.offset + entry.size > file.getSize()) return false;
+
+	// Decode the chunk up to the frame
+	const unsigned char* cursor = (const unsigned char*)file.getData() + entry.offset;
+	const unsigned char* end = cursor + entry.size;
+	int64_t frameStep = 0;
+	for (unsigned f = entry.firstFrame; f <= frame; f++)
+	{
+		int64_t delta;
+		if (!readVarint(cursor, end, &delta)) return false;
+		frameStep = f == entry.firstFrame ? delta : frameStep + delta;
+
+		for (unsigned i = 0; i < header->valuesPerFrame; i++)
+		{
+			int64_t delta;
+			if (!readVarint(cursor, end, &delta)) return false;
+			values[i] = (int32_t)(f == entry.firstFrame ? delta : values[i] + delta);
+		}
+	}
+
+	for (unsigned i = 0; i < header->valuesPerFrame; i++)
+	{
+		output[i] = (real)(values[i] * header->quantum);
+	}
+	if (step) *step = (unsigned)frameStep;
+	return true;
+}
@@ -0,0 +1,171 @@
+#include <include/preorder.h>
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+
+using namespace cyclone;
+
+/*
+* Number of steps timed after a reorder to measure its gain
+*/
+static const unsigned measuredSteps = 8;
+
+/*
+* Returns the current time in seconds
+*/
+static double now() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/*
+* Spreads the lowest 10 bits of the value so that there are two zero bits between each of them
+*/
+static unsigned spreadBits(unsigned value) {
+	value &= 0x3FF;
+	value = (value | (value << 16)) & 0x030000FF;
+	value = (value | (value << 8)) & 0x0300F00F;
+	value = (value | (value << 4)) & 0x030C30C3;
+	value = (value | (value << 2)) & 0x09249249;
+	return value;
+}
+
+ParticleMortonReorder::ParticleMortonReorder(ParticleWorld* world, unsigned interval, unsigned minInterval, unsigned maxInterval) {
+	assert(minInterval > 0 && minInterval <= interval && interval <= maxInterval);
+
+	ParticleMortonReorder::world = world;
+	ParticleMortonReorder::minInterval = minInterval;
+	ParticleMortonReorder::maxInterval = maxInterval;
+	ParticleMortonReorder::stepsSinceReorder = 0;
+	ParticleMortonReorder::stepTimeSinceReorder = 0;
+	ParticleMortonReorder::recentStepTime = 0;
+	ParticleMortonReorder::timestep = NULL;
+	ParticleMortonReorder::stats = ParticleReorderStats();
+	stats.interval = interval;
+}
+
+void ParticleMortonReorder::runPhysics(real duration) {
+	double start = now();
+	world->runPhysics(duration);
+	double stepTime = now() - start;
+
+	stepsSinceReorder++;
+	stepTimeSinceReorder += stepTime;
+
+	// Keep a moving average of the step time, to know the cost right before the next reorder
+	recentStepTime = stepsSinceReorder == 1 && stats.reorders == 0 ? stepTime : recentStepTime * 0.9 + stepTime * 0.1;
+
+	if (stepsSinceReorder == measuredSteps && stats.reorders > 0)
+	{
+		stats.stepTimeAfter = stepTimeSinceReorder / measuredSteps;
+		adaptInterval();
+	}
+
+	if (stepsSinceReorder >= stats.interval)
+	{
+		reorder();
+	}
+}
+
+void ParticleMortonReorder::setTimestep(ParticleTimestep* timestep) {
+	ParticleMortonReorder::timestep = timestep;
+}
+
+void ParticleMortonReorder::reorder() {
+	double start = now();
+
+	ParticleWorld::Particles& particles = world->getParticles();
+	unsigned count = (unsigned)particles.size();
+	if (count < 2) return;
+
+	// Find the bounds of the particles to scale their position to the code range
+	Vector3 min = particles[0]->getPosition();
+	Vector3 max = min;
+	for (unsigned i = 1; i < count; i++)
+	{
+		Vector3 position = particles[i]->getPosition();
+		if (position.x < min.x) min.x = position.x;
+		if (position.y < min.y) min.y = position.y;
+		if (position.z < min.z) min.z = position.z;
+		if (position.x > max.x) max.x = position.x;
+		if (position.y > max.y) max.y = position.y;
+		if (position.z > max.z) max.z = position.z;
+	}
+
+	Vector3 extent = max - min;
+	Vector3 scale(
+		extent.x > 0 ? 1023 / extent.x : 0,
+		extent.y > 0 ? 1023 / extent.y : 0,
+		extent.z > 0 ? 1023 / extent.z : 0);
+
+	codes.clear();
+	slots.clear();
+	for (unsigned i = 0; i < count; i++)
+	{
+		Vector3 cell = (particles[i]->getPosition() - min).componentProduct(scale);
+		codes.push_back(ParticleCode(mortonCode((unsigned)cell.x, (unsigned)cell.y, (unsigned)cell.z), i));
+		slots.push_back(particles[i]);
+	}
+	std::sort(codes.begin(), codes.end());
+	std::sort(slots.begin(), slots.end());
+
+	// Copy the particles out in code order, then back in address order
+	scratch.clear();
+	moves.clear();
+	for (unsigned i = 0; i < count; i++)
+	{
+		Particle* from = particles[codes[i].second];
+		scratch.push_back(*from);
+		moves.push_back(ParticleMove(from, slots[i]));
+	}
+	for (unsigned i = 0; i < count; i++)
+	{
+		*slots[i] = scratch[i];
+	}
+	std::sort(moves.begin(), moves.end());
+
+	world->remapParticles(*this);
+
+	// The particle list follows the memory order too, so iterating it walks memory forward
+	for (unsigned i = 0; i < count; i++)
+	{
+		particles[i] = slots[i];
+	}
+	if (timestep) timestep->remapParticles(*this);
+
+	stats.reorders++;
+	stats.stepTimeBefore = recentStepTime;
+	stats.lastReorderTime = now() - start;
+	stepsSinceReorder = 0;
+	stepTimeSinceReorder = 0;
+}
+
+Particle* ParticleMortonReorder::map(Particle* particle) const {
+	std::vector<ParticleMove>::const_iterator found =
+		std::lower_bound(moves.begin(), moves.end(), ParticleMove(particle, (Particle*)NULL));
+
+	if (found == moves.end() || found->first != particle) return particle;
+	return found->second;
+}
+
+const ParticleReorderStats& ParticleMortonReorder::getStats() const {
+	return stats;
+}
+
+unsigned ParticleMortonReorder::mortonCode(unsigned x, unsigned y, unsigned z) {
+	return (spreadBits(x) << 2) | (spreadBits(y) << 1) | spreadBits(z);
+}
+
+void ParticleMortonReorder::adaptInterval() {
+	// The locality decays over the interval, so on average about half of the gain is kept
+	double gain = stats.stepTimeBefore - stats.stepTimeAfter;
+	double saved = gain * stats.interval * 0.5;
+
+	if (saved < stats.lastReorderTime)
+	{
+		stats.interval = std::min(stats.interval * 2, maxInterval);
+	}
+	else if (saved > stats.lastReorderTime * 4)
+	{
+		stats.interval = std::max(stats.interval / 2, minInterval);
+	}
+}
@@ -0,0 +1,250 @@
+#include <include/pscene.h>
+#include <stdio.h>
+#include <string.h>
+
+using namespace cyclone;
+
+/*
+* Rounds the given offset up to the section alignment
+*/
+static uint64_t alignSection(uint64_t offset) {
+	return (offset + ParticleScene::alignment - 1) & ~(uint64_t)(ParticleScene::alignment - 1);
+}
+
+bool ParticleScene::compile(const char* textPath, const char* binaryPath) {
+	std::vector<char> binary;
+	if (!parse(textPath, binary)) return false;
+
+	ParticleMappedFile output;
+	if (!output.create(binaryPath, binary.size())) return false;
+	memcpy(output.getData(), &binary[0], binary.size());
+	output.close();
+	return true;
+}
+
+bool ParticleScene::load(const char* binaryPath, ParticleWorld& world) {
+	if (!isEmpty()) return false;
+
+	ParticleMappedFile input;
+	if (!input.open(binaryPath)) return false;
+	if (!validate(input.getData(), input.getSize())) return false;
+
+	populate(input.getData(), world);
+	return true;
+}
+
+bool ParticleScene::loadText(const char* textPath, ParticleWorld& world) {
+	if (!isEmpty()) return false;
+
+	std::vector<char> binary;
+	if (!parse(textPath, binary)) return false;
+	if (!validate(&binary[0], binary.size())) return false;
+
+	populate(&binary[0], world);
+	return true;
+}
+
+bool ParticleScene::isEmpty() const {
+	return springs.empty() && cables.empty() && rods.empty();
+}
+
+std::vector<ParticleSpring>& ParticleScene::getSprings() {
+	return springs;
+}
+
+std::vector<ParticleCable>& ParticleScene::getCables() {
+	return cables;
+}
+
+std::vector<ParticleRod>& ParticleScene::getRods() {
+	return rods;
+}
+
+bool ParticleScene::parse(const char* textPath, std::vector<char>& binary) {
+	FILE* input = fopen(textPath, "r");
+	if (!input) return false;
+
+	std::vector<ParticleRecord> particles;
+	std::vector<EdgeRecord> edges[3];
+
+	char line[512];
+	bool valid = true;
+	while (valid && fgets(line, sizeof(line), input))
+	{
+		char* comment = strchr(line, '#');
+		if (comment) *comment = 0;
+
+		char type[16];
+		if (sscanf(line, "%15s", type) != 1) continue;
+
+		double values[8];
+		if (strcmp(type, "particle") == 0)
+		{
+			valid = sscanf(line, "%*s %lf %lf %lf %lf %lf %lf %lf %lf",
+				&values[0], &values[1], &values[2], &values[3],
+				&values[4], &values[5], &values[6], &values[7]) == 8;
+
+			ParticleRecord record;
+			for (unsigned i = 0; i < 3; i++)
+			{
+				record.position[i] = (real)values[i];
+				record.velocity[i] = (real)values[i + 3];
+			}
+			record.inverseMass = values[6] == 0 ? 0 : (real)(1.0 / values[6]);
+			record.damping = (real)values[7];
+			particles.push_back(record);
+			continue;
+		}
+
+		// Every other element links two particles
+		unsigned kind;
+		if (strcmp(type, "spring") == 0) kind = 0;
+		else if (strcmp(type, "cable") == 0) kind = 1;
+		else if (strcmp(type, "rod") == 0) kind = 2;
+		else
+		{
+			valid = false;
+			break;
+		}
+
+		unsigned a, b;
+		values[1] = 0;
+		int read = sscanf(line, "%*s %u %u %lf %lf", &a, &b, &values[0], &values[1]);
+		valid = read == 4 || (kind == 2 && read == 3);
+
+		EdgeRecord record;
+		record.particle[0] = a;
+		record.particle[1] = b;
+		record.parameter[0] = (real)values[0];
+		record.parameter[1] = (real)values[1];
+		edges[kind].push_back(record);
+	}
+	fclose(input);
+	if (!valid) return false;
+
+	Header header;
+	memset(&header, 0, sizeof(header));
+	header.magic = magic;
+	header.version = version;
+	header.realSize = sizeof(real);
+	header.particleCount = (uint32_t)particles.size();
+	header.springCount = (uint32_t)edges[0].size();
+	header.cableCount = (uint32_t)edges[1].size();
+	header.rodCount = (uint32_t)edges[2].size();
+	header.particleOffset = alignSection(sizeof(Header));
+	header.springOffset = alignSection(header.particleOffset + header.particleCount * sizeof(ParticleRecord));
+	header.cableOffset = alignSection(header.springOffset + header.springCount * sizeof(EdgeRecord));
+	header.rodOffset = alignSection(header.cableOffset + header.cableCount * sizeof(EdgeRecord));
+	header.fileSize = alignSection(header.rodOffset + header.rodCount * sizeof(EdgeRecord));
+
+	binary.assign((size_t)header.fileSize, 0);
+	memcpy(&binary[0], &header, sizeof(header));
+	if (!particles.empty()) memcpy(&binary[(size_t)header.particleOffset], &particles[0], particles.size() * sizeof(ParticleRecord));
+
+	uint64_t offsets[3] = { header.springOffset, header.cableOffset, header.rodOffset };
+	for (unsigned kind = 0; kind < 3; kind++)
+	{
+		if (!edges[kind].empty()) memcpy(&binary[(size_t)offsets[kind]], &edges[kind][0], edges[kind].size() * sizeof(EdgeRecord));
+	}
+	return true;
+}
+
+bool ParticleScene::validate(const void* data, size_t size) {
+	const Header* header = (const Header*)data;
+	if (size < sizeof(Header) ||
+		header->magic != magic ||
+		header->version != version ||
+		header->realSize != sizeof(real) ||
+		header->fileSize > size ||
+		header->particleOffset + header->particleCount * sizeof(ParticleRecord) > header->fileSize ||
+		header->springOffset + header->springCount * sizeof(EdgeRecord) > header->fileSize ||
+		header->cableOffset + header->cableCount * sizeof(EdgeRecord) > header->fileSize ||
+		header->rodOffset + header->rodCount * sizeof(EdgeRecord) > header->fileSize)
+	{
+		return false;
+	}
+
+	// Every edge must link particles of the scene
+	uint64_t offsets[3] = { header->springOffset, header->cableOffset, header->rodOffset };
+	uint32_t counts[3] = { header->springCount, header->cableCount, header->rodCount };
+	for (unsigned kind = 0; kind < 3; kind++)
+	{
+		const EdgeRecord* edges = (const EdgeRecord*)((const char*)data + offsets[kind]);
+		for (uint32_t i = 0; i < counts[kind]; i++)
+		{
+			if (edges[i].particle[0] >= header->particleCount || edges[i].particle[1] >= header->particleCount) return false;
+		}
+	}
+	return true;
+}
+
+void ParticleScene::populate(const void* data, ParticleWorld& world) {
+	const Header* header = (const Header*)data;
+	const char* base = (const char*)data;
+
+	// The arrays are only sized once, so the pointers given to the world stay valid
+	springs.reserve(header->springCount * 2);
+	cables.reserve(header->cableCount);
+	rods.reserve(header->rodCount);
+
+	ParticleWorld::Particles& particles = world.getParticles();
+	unsigned first = (unsigned)particles.size();
+	world.reserveParticles(header->particleCount);
+
+	const ParticleRecord* particleRecords = (const ParticleRecord*)(base + header->particleOffset);
+	for (uint32_t i = 0; i < header->particleCount; i++)
+	{
+		const ParticleRecord& record = particleRecords[i];
+		Particle* particle = world.createParticle();
+		particle->setPosition(record.position[0], record.position[1], record.position[2]);
+		particle->setVelocity(record.velocity[0], record.velocity[1], record.velocity[2]);
+		particle->setAcceleration(0, 0, 0);
+		particle->setInverseMass(record.inverseMass);
+		particle->setDamping(record.damping);
+	}
+
+	// Each spring edge acts on both of its ends
+	ParticleForceRegistry& registry = world.getForceRegistry();
+	registry.getRegistrations().reserve(registry.getRegistrations().size() + header->springCount * 2);
+
+	const EdgeRecord* springRecords = (const EdgeRecord*)(base + header->springOffset);
+	for (uint32_t i = 0; i < header->springCount; i++)
+	{
+		const EdgeRecord& record = springRecords[i];
+		Particle* a = particles[first + record.particle[0]];
+		Particle* b = particles[first + record.particle[1]];
+
+		springs.push_back(ParticleSpring(b, record.parameter[0], record.parameter[1]));
+		registry.add(a, &springs.back());
+		springs.push_back(ParticleSpring(a, record.parameter[0], record.parameter[1]));
+		registry.add(b, &springs.back());
+	}
+
+	ParticleWorld::Links& links = world.getLinks();
+	links.reserve(links.size() + header->cableCount + header->rodCount);
+
+	const EdgeRecord* cableRecords = (const EdgeRecord*)(base + header->cableOffset);
+	for (uint32_t i = 0; i < header->cableCount; i++)
+	{
+		const EdgeRecord& record = cableRecords[i];
+		cables.push_back(ParticleCable());
+		ParticleCable& cable = cables.back();
+		cable.particle[0] = particles[first + record.particle[0]];
+		cable.particle[1] = particles[first + record.particle[1]];
+		cable.maxLength = record.parameter[0];
+		cable.restitution = record.parameter[1];
+		links.push_back(&cable);
+	}
+
+	const EdgeRecord* rodRecords = (const EdgeRecord*)(base + header->rodOffset);
+	for (uint32_t i = 0; i < header->rodCount; i++)
+	{
+		const EdgeRecord& record = rodRecords[i];
+		rods.push_back(ParticleRod());
+		ParticleRod& rod = rods.back();
+		rod.particle[0] = particles[first + record.particle[0]];
+		rod.particle[1] = particles[first + record.particle[1]];
+		rod.length = record.parameter[0];
+		links.push_back(&rod);
+	}
+}
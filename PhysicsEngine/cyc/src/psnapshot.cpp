@@ -0,0 +1,248 @@
+#include <include/psnapshot.h>
+#include <algorithm>
+#include <string.h>
+#include <utility>
+
+using namespace cyclone;
+
+/*
+* Rounds the given offset up to the section alignment
+*/
+static uint64_t alignSection(uint64_t offset) {
+	return (offset + ParticleSnapshot::alignment - 1) & ~(uint64_t)(ParticleSnapshot::alignment - 1);
+}
+
+/*
+* Looks up the index of a pointer in a table sorted by pointer. Returns false if it is missing
+*/
+template<class T>
+static bool findIndex(const std::vector<std::pair<T*, uint32_t> >& table, T* pointer, uint32_t* index) {
+	typename std::vector<std::pair<T*, uint32_t> >::const_iterator found =
+		std::lower_bound(table.begin(), table.end(), std::pair<T*, uint32_t>(pointer, 0));
+
+	if (found == table.end() || found->first != pointer) return false;
+	*index = found->second;
+	return true;
+}
+
+ParticleSnapshot::ParticleSnapshot() {
+	header = NULL;
+}
+
+bool ParticleSnapshot::save(const char* path, ParticleWorld& world, const Generators& generators) {
+	ParticleWorld::Particles& particles = world.getParticles();
+	ParticleForceRegistry::Registry& registrations = world.getForceRegistry().getRegistrations();
+	ParticleWorld::Links& links = world.getLinks();
+
+	// Build the tables to turn pointers into indices
+	std::vector<std::pair<Particle*, uint32_t> > particleIndices;
+	particleIndices.reserve(particles.size());
+	for (uint32_t i = 0; i < particles.size(); i++)
+	{
+		particleIndices.push_back(std::make_pair(particles[i], i));
+	}
+	std::sort(particleIndices.begin(), particleIndices.end());
+
+	std::vector<std::pair<ParticleForceGenerator*, uint32_t> > generatorIndices;
+	generatorIndices.reserve(generators.size());
+	for (uint32_t i = 0; i < generators.size(); i++)
+	{
+		generatorIndices.push_back(std::make_pair(generators[i], i));
+	}
+	std::sort(generatorIndices.begin(), generatorIndices.end());
+
+	Header layout;
+	memset(&layout, 0, sizeof(layout));
+	layout.magic = magic;
+	layout.version = version;
+	layout.realSize = sizeof(real);
+	layout.particleCount = (uint32_t)particles.size();
+	layout.registrationCount = (uint32_t)registrations.size();
+	layout.linkCount = (uint32_t)links.size();
+	layout.iterations = world.getIterations();
+	layout.maxContacts = world.getMaxContacts();
+	layout.particleOffset = alignSection(sizeof(Header));
+	layout.registrationOffset = alignSection(layout.particleOffset + layout.particleCount * sizeof(ParticleRecord));
+	layout.linkOffset = alignSection(layout.registrationOffset + layout.registrationCount * sizeof(RegistrationRecord));
+	layout.fileSize = alignSection(layout.linkOffset + layout.linkCount * sizeof(LinkRecord));
+
+	ParticleMappedFile output;
+	if (!output.create(path, (size_t)layout.fileSize)) return false;
+	char* data = (char*)output.getData();
+
+	// Leave the magic out until everything is written, so a failed save is never a valid file
+	Header* written = (Header*)data;
+	*written = layout;
+	written->magic = 0;
+
+	ParticleRecord* particleRecords = (ParticleRecord*)(data + layout.particleOffset);
+	for (uint32_t i = 0; i < layout.particleCount; i++)
+	{
+		const Particle* particle = particles[i];
+		ParticleRecord& record = particleRecords[i];
+		record.position = particle->getPosition();
+		record.velocity = particle->getVelocity();
+		record.acceleration = particle->getAcceleration();
+		record.forceAccum = particle->getAccumulatedForce();
+		record.inverseMass = particle->getInverseMass();
+		record.damping = particle->getDamping();
+		record.pad[0] = record.pad[1] = 0;
+	}
+
+	RegistrationRecord* registrationRecords = (RegistrationRecord*)(data + layout.registrationOffset);
+	for (uint32_t i = 0; i < layout.registrationCount; i++)
+	{
+		RegistrationRecord& record = registrationRecords[i];
+		if (!findIndex(particleIndices, registrations[i].particle, &record.particle)) return false;
+		if (!findIndex(generatorIndices, registrations[i].fg, &record.generator)) return false;
+	}
+
+	LinkRecord* linkRecords = (LinkRecord*)(data + layout.linkOffset);
+	for (uint32_t i = 0; i < layout.linkCount; i++)
+	{
+		LinkRecord& record = linkRecords[i];
+		if (ParticleCable* cable = dynamic_cast<ParticleCable*>(links[i]))
+		{
+			record.type = LINK_CABLE;
+			record.length = cable->maxLength;
+			record.restitution = cable->restitution;
+		}
+		else if (ParticleRod* rod = dynamic_cast<ParticleRod*>(links[i]))
+		{
+			record.type = LINK_ROD;
+			record.length = rod->length;
+			record.restitution = 0;
+		}
+		else return false;
+
+		if (!findIndex(particleIndices, links[i]->particle[0], &record.particle[0])) return false;
+		if (!findIndex(particleIndices, links[i]->particle[1], &record.particle[1])) return false;
+	}
+
+	written->magic = magic;
+	output.close();
+	return true;
+}
+
+bool ParticleSnapshot::open(const char* path) {
+	close();
+	if (!file.open(path)) return false;
+
+	const Header* candidate = (const Header*)file.getData();
+	bool valid = file.getSize() >= sizeof(Header) &&
+		candidate->magic == magic &&
+		candidate->version == version &&
+		candidate->realSize == sizeof(real) &&
+		candidate->fileSize <= file.getSize() &&
+		candidate->particleOffset + candidate->particleCount * sizeof(ParticleRecord) <= candidate->fileSize &&
+		candidate->registrationOffset + candidate->registrationCount * sizeof(RegistrationRecord) <= candidate->fileSize &&
+		candidate->linkOffset + candidate->linkCount * sizeof(LinkRecord) <= candidate->fileSize;
+
+	if (!valid)
+	{
+		file.close();
+		return false;
+	}
+
+	header = candidate;
+	return true;
+}
+
+void ParticleSnapshot::close() {
+	header = NULL;
+	file.close();
+}
+
+bool ParticleSnapshot::restore(ParticleWorld& world, const Generators& generators) const {
+	if (!header) return false;
+
+	ParticleWorld::Particles& particles = world.getParticles();
+	ParticleWorld::Links& links = world.getLinks();
+	if (particles.size() > header->particleCount || links.size() != header->linkCount) return false;
+
+	// Check everything before touching the world, so a mismatch leaves it untouched
+	const RegistrationRecord* registrationRecords = getRegistrations();
+	for (uint32_t i = 0; i < header->registrationCount; i++)
+	{
+		if (registrationRecords[i].particle >= header->particleCount) return false;
+		if (registrationRecords[i].generator >= generators.size()) return false;
+	}
+
+	const LinkRecord* linkRecords = getLinks();
+	for (uint32_t i = 0; i < header->linkCount; i++)
+	{
+		const LinkRecord& record = linkRecords[i];
+		if (record.particle[0] >= header->particleCount || record.particle[1] >= header->particleCount) return false;
+		if (record.type == LINK_CABLE && !dynamic_cast<ParticleCable*>(links[i])) return false;
+		if (record.type == LINK_ROD && !dynamic_cast<ParticleRod*>(links[i])) return false;
+		if (record.type != LINK_CABLE && record.type != LINK_ROD) return false;
+	}
+
+	world.reserveParticles(header->particleCount - (unsigned)particles.size());
+	while (particles.size() < header->particleCount)
+	{
+		world.createParticle();
+	}
+
+	const ParticleRecord* particleRecords = getParticles();
+	for (uint32_t i = 0; i < header->particleCount; i++)
+	{
+		const ParticleRecord& record = particleRecords[i];
+		Particle* particle = particles[i];
+		particle->setPosition(record.position);
+		particle->setVelocity(record.velocity);
+		particle->setAcceleration(record.acceleration);
+		particle->setInverseMass(record.inverseMass);
+		particle->setDamping(record.damping);
+		particle->clearAccumulator();
+		particle->addForce(record.forceAccum);
+	}
+
+	ParticleForceRegistry& registry = world.getForceRegistry();
+	registry.clear();
+	registry.getRegistrations().reserve(header->registrationCount);
+	for (uint32_t i = 0; i < header->registrationCount; i++)
+	{
+		registry.add(particles[registrationRecords[i].particle], generators[registrationRecords[i].generator]);
+	}
+
+	for (uint32_t i = 0; i < header->linkCount; i++)
+	{
+		const LinkRecord& record = linkRecords[i];
+		links[i]->particle[0] = particles[record.particle[0]];
+		links[i]->particle[1] = particles[record.particle[1]];
+
+		if (record.type == LINK_CABLE)
+		{
+			ParticleCable* cable = (ParticleCable*)links[i];
+			cable->maxLength = record.length;
+			cable->restitution = record.restitution;
+		}
+		else
+		{
+			((ParticleRod*)links[i])->length = record.length;
+		}
+	}
+
+	world.setIterations(header->iterations);
+	return true;
+}
+
+const ParticleSnapshot::Header* ParticleSnapshot::getHeader() const {
+	return header;
+}
+
+const ParticleSnapshot::ParticleRecord* ParticleSnapshot::getParticles() const {
+	if (!header) return NULL;
+	return (const ParticleRecord*)((const char*)header + header->particleOffset);
+}
+
+const ParticleSnapshot::RegistrationRecord* ParticleSnapshot::getRegistrations() const {
+	if (!header) return NULL;
+	return (const RegistrationRecord*)((const char*)header + header->registrationOffset);
+}
+
+const ParticleSnapshot::LinkRecord* ParticleSnapshot::getLinks() const {
+	if (!header) return NULL;
+	return (const LinkRecord*)((const char*)header + header->linkOffset);
+}
@@ -0,0 +1,118 @@
+#include <include/pstate.h>
+#include <assert.h>
+
+using namespace cyclone;
+
+ParticleStatePublisher::ParticleStatePublisher(ParticleWorld* world, unsigned frameCount) {
+	assert(frameCount >= 2 && frameCount <= maxFrames);
+
+	ParticleStatePublisher::world = world;
+	ParticleStatePublisher::frameCount = frameCount;
+	ParticleStatePublisher::latest = NULL;
+	ParticleStatePublisher::steps = 0;
+	ParticleStatePublisher::time = 0;
+	ParticleStatePublisher::skipped = 0;
+	subscribers[0] = 0;
+	subscribers[1] = 0;
+
+	for (unsigned f = 0; f < maxFrames; f++)
+	{
+		frames[f].step = 0;
+		frames[f].time = 0;
+		frames[f].fields = 0;
+		frames[f].count = 0;
+		frames[f].readers = 0;
+	}
+}
+
+void ParticleStatePublisher::subscribe(unsigned fields) {
+	if (fields & STATE_POSITION) subscribers[0]++;
+	if (fields & STATE_VELOCITY) subscribers[1]++;
+}
+
+void ParticleStatePublisher::unsubscribe(unsigned fields) {
+	if (fields & STATE_POSITION) subscribers[0]--;
+	if (fields & STATE_VELOCITY) subscribers[1]--;
+}
+
+bool ParticleStatePublisher::publish(real duration) {
+	steps++;
+	time += duration;
+
+	// A frame that is neither the latest nor read. A reader that grabs it after the check
+	// finds it isn't the latest anymore and lets it go without reading it
+	ParticleStateFrame* current = latest.load();
+	ParticleStateFrame* frame = NULL;
+	for (unsigned f = 0; f < frameCount && !frame; f++)
+	{
+		if (&frames[f] != current && frames[f].readers.load() == 0) frame = &frames[f];
+	}
+	if (!frame)
+	{
+		skipped++;
+		return false;
+	}
+
+	const ParticleWorld::Particles& particles = world->getParticles();
+	unsigned count = (unsigned)particles.size();
+	unsigned fields = 0;
+	if (subscribers[0].load(std::memory_order_relaxed) > 0) fields |= STATE_POSITION;
+	if (subscribers[1].load(std::memory_order_relaxed) > 0) fields |= STATE_VELOCITY;
+
+	if (fields & STATE_POSITION)
+	{
+		frame->positions.resize(count);
+		for (unsigned i = 0; i < count; i++) frame->positions[i] = particles[i]->position;
+	}
+	if (fields & STATE_VELOCITY)
+	{
+		frame->velocities.resize(count);
+		for (unsigned i = 0; i < count; i++) frame->velocities[i] = particles[i]->velocity;
+	}
+
+	frame->step = steps;
+	frame->time = time;
+	frame->fields = fields;
+	frame->count = count;
+	latest.store(frame);
+	return true;
+}
+
+void ParticleStatePublisher::step(real duration) {
+	publish(duration);
+}
+
+const ParticleStateFrame* ParticleStatePublisher::acquire() {
+	for (;;)
+	{
+		ParticleStateFrame* frame = latest.load();
+		if (!frame) return NULL;
+
+		// The frame is only safe if it is still the latest once marked as read
+		frame->readers++;
+		if (latest.load() == frame) return frame;
+		frame->readers--;
+	}
+}
+
+void ParticleStatePublisher::release(const ParticleStateFrame* frame) {
+	if (!frame) return;
+	const_cast<ParticleStateFrame*>(frame)->readers--;
+}
+
+unsigned long long ParticleStatePublisher::getSkipped() const {
+	return skipped;
+}
+
+ParticleStateView::ParticleStateView(ParticleStatePublisher* publisher) {
+	ParticleStateView::publisher = publisher;
+	ParticleStateView::frame = publisher->acquire();
+}
+
+ParticleStateView::~ParticleStateView() {
+	publisher->release(frame);
+}
+
+const ParticleStateFrame* ParticleStateView::get() const {
+	return frame;
+}
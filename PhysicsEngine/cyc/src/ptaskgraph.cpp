@@ -0,0 +1,275 @@
+#include <include/ptaskgraph.h>
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+using namespace cyclone;
+
+ParticleTaskGraph::ParticleTaskGraph() {
+	ParticleTaskGraph::built = false;
+	ParticleTaskGraph::pendingCapacity = 0;
+	ParticleTaskGraph::remaining = 0;
+	ParticleTaskGraph::queueCount = 0;
+	ParticleTaskGraph::origin = 0;
+	ParticleTaskGraph::steals = 0;
+	stats = ParticleTaskGraphStats();
+}
+
+unsigned ParticleTaskGraph::addTask(ParticleJob job, void* context, unsigned begin, unsigned end, const char* name) {
+	Task task = { job, context, begin, end, name };
+	tasks.push_back(task);
+	built = false;
+	return (unsigned)tasks.size() - 1;
+}
+
+void ParticleTaskGraph::addDependency(unsigned before, unsigned after) {
+	assert(before < after && after < tasks.size());
+
+	edges.push_back(before);
+	edges.push_back(after);
+	built = false;
+}
+
+void ParticleTaskGraph::clear() {
+	tasks.clear();
+	edges.clear();
+	criticalPath.clear();
+	built = false;
+}
+
+void ParticleTaskGraph::run(ParticleJobPool* jobs) {
+	unsigned count = (unsigned)tasks.size();
+	timings.resize(count);
+	if (!built) build();
+
+	unsigned threads = jobs ? jobs->getThreadCount() : 1;
+	steals = 0;
+	origin = now();
+
+	if (threads == 1)
+	{
+		// The tasks are added after their dependencies, so their order is a valid one
+		for (unsigned i = 0; i < count; i++)
+		{
+			const Task& task = tasks[i];
+			timings[i].start = now();
+			if (task.job) task.job(task.context, task.begin, task.end);
+			timings[i].end = now();
+			timings[i].thread = 0;
+		}
+		measure(now());
+		return;
+	}
+
+	if (pendingCapacity < count)
+	{
+		pending.reset(new std::atomic<unsigned>[count]);
+		pendingCapacity = count;
+	}
+	if (queueCount != threads)
+	{
+		queues.reset(new Queue[threads]);
+		queueCount = threads;
+	}
+	for (unsigned t = 0; t < threads; t++)
+	{
+		queues[t].tasks.resize(count);
+		queues[t].front = 0;
+		queues[t].back = 0;
+		queues[t].lock.clear();
+	}
+
+	// The tasks with no dependency are spread over the threads
+	unsigned next = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		pending[i].store(dependencies[i], std::memory_order_relaxed);
+		if (dependencies[i] == 0)
+		{
+			Queue& queue = queues[next];
+			queue.tasks[queue.back++] = i;
+			next = (next + 1) % threads;
+		}
+	}
+	remaining = count;
+
+	jobs->runStatic(workerJob, this, threads);
+	measure(now());
+}
+
+unsigned ParticleTaskGraph::getTaskCount() const {
+	return (unsigned)tasks.size();
+}
+
+const ParticleTaskGraph::Task& ParticleTaskGraph::getTask(unsigned index) const {
+	return tasks[index];
+}
+
+const std::vector<unsigned>& ParticleTaskGraph::getCriticalPath() const {
+	return criticalPath;
+}
+
+const ParticleTaskGraphStats& ParticleTaskGraph::getStats() const {
+	return stats;
+}
+
+bool ParticleTaskGraph::exportTrace(const char* path) const {
+	FILE* file = fopen(path, "w");
+	if (!file) return false;
+
+	std::vector<bool> critical(timings.size(), false);
+	std::vector<unsigned>::const_iterator c = criticalPath.begin();
+	for (; c != criticalPath.end(); c++)
+	{
+		critical[*c] = true;
+	}
+
+	// Timestamps and durations are in microseconds in the trace format
+	fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	bool first = true;
+	for (size_t i = 0; i < timings.size() && i < tasks.size(); i++)
+	{
+		const Task& task = tasks[i];
+		if (!task.job) continue;
+
+		const Timing& timing = timings[i];
+		fprintf(file, "%s\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%u,%s\"args\":{\"task\":%u,\"begin\":%u,\"end\":%u}}",
+			first ? "" : ",", task.name, critical[i] ? "critical" : "task",
+			(double)(timing.start - origin) / 1000, (double)(timing.end - timing.start) / 1000,
+			timing.thread + 1, critical[i] ? "\"cname\":\"terrible\"," : "", (unsigned)i, task.begin, task.end);
+		first = false;
+	}
+	fprintf(file, "\n]}\n");
+
+	bool written = !ferror(file);
+	return fclose(file) == 0 && written;
+}
+
+void ParticleTaskGraph::build() {
+	unsigned count = (unsigned)tasks.size();
+	dependencies.assign(count, 0);
+	successorOffsets.assign(count + 1, 0);
+	for (size_t e = 0; e < edges.size(); e += 2)
+	{
+		successorOffsets[edges[e] + 1]++;
+		dependencies[edges[e + 1]]++;
+	}
+	for (unsigned i = 0; i < count; i++)
+	{
+		successorOffsets[i + 1] += successorOffsets[i];
+	}
+
+	std::vector<unsigned> fill(successorOffsets.begin(), successorOffsets.end() - 1);
+	successors.resize(edges.size() / 2);
+	for (size_t e = 0; e < edges.size(); e += 2)
+	{
+		successors[fill[edges[e]]++] = edges[e + 1];
+	}
+	built = true;
+}
+
+void ParticleTaskGraph::execute(unsigned index, unsigned thread) {
+	const Task& task = tasks[index];
+	timings[index].start = now();
+	if (task.job) task.job(task.context, task.begin, task.end);
+	timings[index].end = now();
+	timings[index].thread = thread;
+
+	Queue& queue = queues[thread];
+	for (unsigned s = successorOffsets[index]; s < successorOffsets[index + 1]; s++)
+	{
+		unsigned successor = successors[s];
+		if (pending[successor].fetch_sub(1, std::memory_order_acq_rel) != 1) continue;
+
+		while (queue.lock.test_and_set(std::memory_order_acquire)) {}
+		queue.tasks[queue.back++] = successor;
+		queue.lock.clear(std::memory_order_release);
+	}
+	remaining.fetch_sub(1, std::memory_order_acq_rel);
+}
+
+bool ParticleTaskGraph::take(unsigned thread, unsigned* task) {
+	// The newest task of the thread
+	Queue& own = queues[thread];
+	while (own.lock.test_and_set(std::memory_order_acquire)) {}
+	bool found = own.back > own.front;
+	if (found) *task = own.tasks[--own.back];
+	own.lock.clear(std::memory_order_release);
+	if (found) return true;
+
+	// The oldest task of another thread
+	for (unsigned i = 1; i < queueCount; i++)
+	{
+		Queue& other = queues[(thread + i) % queueCount];
+		while (other.lock.test_and_set(std::memory_order_acquire)) {}
+		found = other.back > other.front;
+		if (found) *task = other.tasks[other.front++];
+		other.lock.clear(std::memory_order_release);
+		if (found)
+		{
+			steals.fetch_add(1, std::memory_order_relaxed);
+			return true;
+		}
+	}
+	return false;
+}
+
+void ParticleTaskGraph::workerJob(void* context, unsigned begin, unsigned end) {
+	ParticleTaskGraph* graph = (ParticleTaskGraph*)context;
+
+	// Each thread of the pool is given its own index
+	unsigned thread = begin;
+	unsigned task;
+	while (graph->remaining.load(std::memory_order_acquire) != 0)
+	{
+		if (graph->take(thread, &task)) graph->execute(task, thread);
+		else std::this_thread::yield();
+	}
+}
+
+void ParticleTaskGraph::measure(uint64_t end) {
+	unsigned count = (unsigned)tasks.size();
+	stats.tasks = count;
+	stats.steals = steals.load();
+	stats.wallTime = end - origin;
+	stats.workTime = 0;
+	stats.criticalTime = 0;
+	criticalPath.clear();
+	if (count == 0) return;
+
+	// The longest chain ending at each task, in an order where dependencies come first
+	std::vector<uint64_t> longest(count, 0);
+	std::vector<unsigned> parent(count, count);
+	unsigned last = 0;
+	for (unsigned i = 0; i < count; i++)
+	{
+		uint64_t time = timings[i].end - timings[i].start;
+		stats.workTime += time;
+		longest[i] += time;
+		if (longest[i] > longest[last]) last = i;
+
+		for (unsigned s = successorOffsets[i]; s < successorOffsets[i + 1]; s++)
+		{
+			unsigned successor = successors[s];
+			if (longest[i] > longest[successor] || parent[successor] == count)
+			{
+				longest[successor] = longest[i];
+				parent[successor] = i;
+			}
+		}
+	}
+	stats.criticalTime = longest[last];
+
+	for (unsigned i = last; i != count; i = parent[i])
+	{
+		criticalPath.push_back(i);
+	}
+	std::reverse(criticalPath.begin(), criticalPath.end());
+}
+
+uint64_t ParticleTaskGraph::now() {
+	return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
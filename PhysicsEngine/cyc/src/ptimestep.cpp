@@ -0,0 +1,198 @@
+#include <include/ptimestep.h>
+#include <assert.h>
+#include <algorithm>
+#include <utility>
+
+using namespace cyclone;
+
+ParticleDynamicsSubsystem::ParticleDynamicsSubsystem(ParticleWorld* world) {
+	ParticleDynamicsSubsystem::world = world;
+}
+
+void ParticleDynamicsSubsystem::step(real duration) {
+	world->startFrame();
+	world->applyForces(duration);
+	world->integrate(duration);
+}
+
+ParticleConstraintSubsystem::ParticleConstraintSubsystem(ParticleWorld* world) {
+	ParticleConstraintSubsystem::world = world;
+}
+
+void ParticleConstraintSubsystem::step(real duration) {
+	world->resolveConstraints(duration);
+}
+
+ParticleTimestep::ParticleTimestep(real fixedDuration, unsigned maxSteps) {
+	assert(fixedDuration > 0.0);
+	assert(maxSteps > 0);
+
+	ParticleTimestep::fixedDuration = fixedDuration;
+	ParticleTimestep::maxSteps = maxSteps;
+	ParticleTimestep::accumulator = 0;
+	ParticleTimestep::droppedTime = 0;
+	ParticleTimestep::ticks = 1;
+	ParticleTimestep::interpolated = NULL;
+}
+
+void ParticleTimestep::add(ParticleSubsystem* subsystem, unsigned substeps) {
+	assert(substeps > 0);
+
+	SubsystemRegistration registration;
+	registration.subsystem = subsystem;
+	registration.substeps = substeps;
+	subsystems.push_back(registration);
+	updateTicks();
+}
+
+void ParticleTimestep::remove(ParticleSubsystem* subsystem) {
+	Subsystems::iterator i = subsystems.begin();
+	for (; i != subsystems.end(); i++)
+	{
+		if (i->subsystem == subsystem)
+		{
+			subsystems.erase(i);
+			updateTicks();
+			return;
+		}
+	}
+}
+
+void ParticleTimestep::setInterpolatedParticles(ParticleWorld::Particles* particles) {
+	interpolated = particles;
+	previousPositions.clear();
+	previousParticles.clear();
+
+	if (!interpolated) return;
+
+	// Until the first step the previous position is the current one
+	previousPositions.reserve(interpolated->size());
+	previousParticles.reserve(interpolated->size());
+	ParticleWorld::Particles::iterator p = interpolated->begin();
+	for (; p != interpolated->end(); p++)
+	{
+		previousPositions.push_back((*p)->getPosition());
+		previousParticles.push_back(*p);
+	}
+}
+
+void ParticleTimestep::remapParticles(const ParticleRemap& remap) {
+	if (!interpolated) return;
+	assert(previousPositions.size() == interpolated->size());
+
+	// Find the previous position of each particle where it lives now
+	std::vector<std::pair<Particle*, unsigned> > moved;
+	moved.reserve(previousParticles.size());
+	for (unsigned i = 0; i < previousParticles.size(); i++)
+	{
+		moved.push_back(std::make_pair(remap.map(previousParticles[i]), i));
+	}
+	std::sort(moved.begin(), moved.end());
+
+	std::vector<Vector3> positions(previousPositions.size());
+	for (unsigned i = 0; i < positions.size(); i++)
+	{
+		Particle* particle = (*interpolated)[i];
+		std::vector<std::pair<Particle*, unsigned> >::iterator found =
+			std::lower_bound(moved.begin(), moved.end(), std::make_pair(particle, 0u));
+
+		// A particle that wasn't in the list starts from where it is
+		if (found != moved.end() && found->first == particle) positions[i] = previousPositions[found->second];
+		else positions[i] = particle->getPosition();
+		previousParticles[i] = particle;
+	}
+	previousPositions.swap(positions);
+}
+
+unsigned ParticleTimestep::advance(real frameDuration) {
+	if (frameDuration > 0) accumulator += frameDuration;
+
+	// Find out how many steps fit, and drop what is over the cap
+	unsigned steps = (unsigned)(accumulator / fixedDuration);
+	if (steps > maxSteps)
+	{
+		real kept = accumulator - steps * fixedDuration;
+		steps = maxSteps;
+		droppedTime += accumulator - kept - steps * fixedDuration;
+		accumulator = kept + steps * fixedDuration;
+	}
+
+	for (unsigned i = 0; i < steps; i++)
+	{
+		// Only the state before the last step is needed to interpolate
+		if (interpolated && i == steps - 1)
+		{
+			assert(previousPositions.size() == interpolated->size());
+			for (unsigned j = 0; j < previousPositions.size(); j++)
+			{
+				previousPositions[j] = (*interpolated)[j]->getPosition();
+				previousParticles[j] = (*interpolated)[j];
+			}
+		}
+
+		runStep();
+		accumulator -= fixedDuration;
+	}
+
+	// Guard against rounding leaving a tiny negative remainder
+	if (accumulator < 0) accumulator = 0;
+
+	return steps;
+}
+
+real ParticleTimestep::getInterpolationAlpha() const {
+	real alpha = accumulator / fixedDuration;
+	return alpha > 1 ? 1 : alpha;
+}
+
+Vector3 ParticleTimestep::getInterpolatedPosition(unsigned index) const {
+	assert(interpolated && index < previousPositions.size());
+
+	Vector3 previous = previousPositions[index];
+	Vector3 current = (*interpolated)[index]->getPosition();
+
+	previous.addScaledVector(current - previous, getInterpolationAlpha());
+	return previous;
+}
+
+real ParticleTimestep::getFixedDuration() const {
+	return fixedDuration;
+}
+
+real ParticleTimestep::getDroppedTime() const {
+	return droppedTime;
+}
+
+void ParticleTimestep::runStep() {
+	// Every subsystem runs at the ticks that are multiple of its period,
+	// so that faster subsystems interleave with the slower ones
+	for (unsigned tick = 0; tick < ticks; tick++)
+	{
+		Subsystems::iterator i = subsystems.begin();
+		for (; i != subsystems.end(); i++)
+		{
+			unsigned period = ticks / i->substeps;
+			if (tick % period != 0) continue;
+
+			i->subsystem->step(fixedDuration / i->substeps);
+		}
+	}
+}
+
+void ParticleTimestep::updateTicks() {
+	ticks = 1;
+
+	Subsystems::iterator i = subsystems.begin();
+	for (; i != subsystems.end(); i++)
+	{
+		// Least common multiple through the greatest common divisor
+		unsigned a = ticks, b = i->substeps;
+		while (b != 0)
+		{
+			unsigned t = a % b;
+			a = b;
+			b = t;
+		}
+		ticks = ticks / a * i->substeps;
+	}
+}
@@ -0,0 +1,308 @@
+#include <include/pworld.h>
+#include <include/pmath.h>
+#include <algorithm>
+
+using namespace cyclone;
+
+const real ParticleWorld::restingSpeed = 0.01f;
+
+ParticleWorld::ParticleWorld(unsigned maxContacts, unsigned iterations) :
+	resolver(iterations), frameArena(maxContacts * sizeof(ParticleContact) + 1024) {
+	ParticleWorld::maxContacts = maxContacts;
+	ParticleWorld::contacts = NULL;
+	ParticleWorld::contactCount = 0;
+	ParticleWorld::calculateIterations = (iterations == 0);
+	ParticleWorld::profiler = NULL;
+	ParticleWorld::jobs = NULL;
+}
+
+ParticleWorld::~ParticleWorld() {
+	GeneratorPools::iterator g = generatorPools.begin();
+	for (; g != generatorPools.end(); g++)
+	{
+		delete g->second;
+	}
+}
+
+Particle* ParticleWorld::createParticle() {
+	Particle* particle = particlePool.create();
+	particles.push_back(particle);
+	return particle;
+}
+
+void ParticleWorld::destroyParticle(Particle* particle) {
+	// Remove every registration of the particle
+	ParticleForceRegistry::Registry& registrations = registry.getRegistrations();
+	ParticleForceRegistry::Registry::iterator r = registrations.begin();
+	while (r != registrations.end())
+	{
+		if (r->particle == particle) r = registrations.erase(r);
+		else r++;
+	}
+
+	Particles::iterator p = particles.begin();
+	for (; p != particles.end(); p++)
+	{
+		if (*p == particle)
+		{
+			particles.erase(p);
+			break;
+		}
+	}
+
+	particlePool.destroy(particle);
+}
+
+void ParticleWorld::releaseParticle(Particle* particle) {
+	particlePool.destroy(particle);
+}
+
+void ParticleWorld::reserveParticles(unsigned count) {
+	particlePool.reserve(count);
+
+	// The new particles go at the end of the list, integrated by the threads of their range
+	if (jobs) particlePool.firstTouch(jobs, (unsigned)particles.size(), count);
+	particles.reserve(particles.size() + count);
+}
+
+void ParticleWorld::setJobPool(ParticleJobPool* jobs) {
+	ParticleWorld::jobs = jobs;
+}
+
+void ParticleWorld::setHugePages(bool hugePages) {
+	particlePool.setHugePages(hugePages);
+	frameArena.setHugePages(hugePages);
+}
+
+void ParticleWorld::remapParticles(const ParticleRemap& remap) {
+	Particles::iterator p = particles.begin();
+	for (; p != particles.end(); p++)
+	{
+		*p = remap.map(*p);
+	}
+
+	// A generator can be registered more than once, but must be remapped only once
+	remapGenerators.clear();
+	ParticleForceRegistry::Registry& registrations = registry.getRegistrations();
+	ParticleForceRegistry::Registry::iterator r = registrations.begin();
+	for (; r != registrations.end(); r++)
+	{
+		r->particle = remap.map(r->particle);
+		remapGenerators.push_back(r->fg);
+	}
+	std::sort(remapGenerators.begin(), remapGenerators.end());
+	std::vector<ParticleForceGenerator*>::iterator last = std::unique(remapGenerators.begin(), remapGenerators.end());
+	std::vector<ParticleForceGenerator*>::iterator g = remapGenerators.begin();
+	for (; g != last; g++)
+	{
+		(*g)->remapParticles(remap);
+	}
+
+	Links::iterator l = links.begin();
+	for (; l != links.end(); l++)
+	{
+		(*l)->remapParticles(remap);
+	}
+
+	for (unsigned i = 0; i < contactCount; i++)
+	{
+		contacts[i].particle[0] = remap.map(contacts[i].particle[0]);
+		if (contacts[i].particle[1]) contacts[i].particle[1] = remap.map(contacts[i].particle[1]);
+	}
+}
+
+void ParticleWorld::startFrame() {
+	CYCLONE_PROFILE_FRAME(profiler);
+
+	// Everything allocated in the last frame is gone
+	frameArena.reset();
+	contacts = NULL;
+	contactCount = 0;
+
+	Particles::iterator p = particles.begin();
+	for (; p != particles.end(); p++)
+	{
+		(*p)->clearAccumulator();
+	}
+}
+
+void ParticleWorld::applyForces(real duration) {
+	CYCLONE_PROFILE_SCOPE(profiler, PhaseForces);
+	CYCLONE_PROFILE_COUNT(profiler, CounterRegistrations, registry.getRegistrations().size());
+	registry.updateForces(duration);
+	CYCLONE_PROFILE_COUNT(profiler, CounterForcesReused, registry.getStats().hits);
+}
+
+/*
+* Holds the particles integrated by the jobs
+*/
+struct IntegrateBatch {
+	Particle* const* particles;
+	real duration;
+};
+
+void ParticleWorld::integrateJob(void* context, unsigned begin, unsigned end) {
+	IntegrateBatch* integrate = (IntegrateBatch*)context;
+	integrateParticles(integrate->particles + begin, end - begin, integrate->duration);
+}
+
+void ParticleWorld::integrateParticles(Particle* const* particles, unsigned count, real duration) {
+	// The drag factors damping^duration are computed a batch at a time with the vectorized pow
+	const unsigned batchSize = 256;
+	real dampings[batchSize];
+	real dragFactors[batchSize];
+	for (unsigned start = 0; start < count; start += batchSize)
+	{
+		unsigned size = std::min(batchSize, count - start);
+		Particle* const* batch = particles + start;
+		for (unsigned i = 0; i < size; i++)
+		{
+			dampings[i] = batch[i]->damping;
+		}
+		batchPow(dampings, duration, dragFactors, size);
+		for (unsigned i = 0; i < size; i++)
+		{
+			batch[i]->integrate(duration, dragFactors[i]);
+		}
+	}
+}
+
+void ParticleWorld::integrate(real duration) {
+	{
+		CYCLONE_PROFILE_SCOPE(profiler, PhaseIntegrate);
+
+		if (!particles.empty())
+		{
+			IntegrateBatch batch = { &particles[0], duration };
+			if (jobs) jobs->runStatic(integrateJob, &batch, (unsigned)particles.size());
+			else integrateJob(&batch, 0, (unsigned)particles.size());
+		}
+	}
+
+	// Counted outside of the timed phase, it isn't part of the integration
+#ifdef CYCLONE_PROFILE
+	if (profiler)
+	{
+		unsigned resting = 0;
+		Particles::iterator p = particles.begin();
+		for (; p != particles.end(); p++)
+		{
+			if ((*p)->velocity.squareMagnitude() < restingSpeed * restingSpeed) resting++;
+		}
+		profiler->recordCount(ParticleProfileStats::CounterParticlesResting, resting);
+	}
+#endif
+}
+
+unsigned ParticleWorld::generateContacts() {
+	CYCLONE_PROFILE_SCOPE(profiler, PhaseContacts);
+	// Left uninitialized, the links write every field of the contacts they fill
+	contacts = (ParticleContact*)frameArena.allocate(sizeof(ParticleContact) * maxContacts, 16);
+
+	unsigned limit = maxContacts;
+	ParticleContact* nextContact = contacts;
+
+	Links::iterator l = links.begin();
+	for (; l != links.end(); l++)
+	{
+		// We have run out of contacts to fill
+		if (limit == 0) break;
+
+		unsigned used = (*l)->fillContact(nextContact, limit);
+		limit -= used;
+		nextContact += used;
+	}
+
+	// Return the number of contacts used
+	contactCount = maxContacts - limit;
+	CYCLONE_PROFILE_COUNT(profiler, CounterContactsGenerated, contactCount);
+	return contactCount;
+}
+
+void ParticleWorld::resolveConstraints(real duration) {
+	unsigned usedContacts = generateContacts();
+	if (usedContacts == 0) return;
+
+	CYCLONE_PROFILE_SCOPE(profiler, PhaseResolve);
+	if (calculateIterations) resolver.setIterations(usedContacts * 2);
+	resolver.resolveContacts(contacts, usedContacts, duration);
+	CYCLONE_PROFILE_COUNT(profiler, CounterContactsResolved, resolver.getContactsResolved());
+	CYCLONE_PROFILE_COUNT(profiler, CounterIterations, resolver.getIterationsUsed());
+}
+
+void ParticleWorld::runPhysics(real duration) {
+	startFrame();
+	applyForces(duration);
+	integrate(duration);
+	resolveConstraints(duration);
+}
+
+ParticleWorld::Particles& ParticleWorld::getParticles() {
+	return particles;
+}
+
+ParticleWorld::Links& ParticleWorld::getLinks() {
+	return links;
+}
+
+ParticleForceRegistry& ParticleWorld::getForceRegistry() {
+	return registry;
+}
+
+ParticleContactResolver& ParticleWorld::getContactResolver() {
+	return resolver;
+}
+
+void ParticleWorld::setIterations(unsigned iterations) {
+	calculateIterations = (iterations == 0);
+	resolver.setIterations(iterations);
+}
+
+unsigned ParticleWorld::getIterations() const {
+	return calculateIterations ? 0 : resolver.getIterations();
+}
+
+unsigned ParticleWorld::getMaxContacts() const {
+	return maxContacts;
+}
+
+ParticleContact* ParticleWorld::getContacts() {
+	return contacts;
+}
+
+unsigned ParticleWorld::getContactCount() const {
+	return contactCount;
+}
+
+ParticleArena& ParticleWorld::getFrameArena() {
+	return frameArena;
+}
+
+ParticleAllocationStats ParticleWorld::getAllocationStats() const {
+	ParticleAllocationStats stats = particlePool.getStats();
+	stats += frameArena.getStats();
+
+	GeneratorPools::const_iterator g = generatorPools.begin();
+	for (; g != generatorPools.end(); g++)
+	{
+		stats += g->second->getStats();
+	}
+	return stats;
+}
+
+void ParticleWorld::setProfiler(ParticleProfiler* profiler) {
+	ParticleWorld::profiler = profiler;
+}
+
+ParticleProfiler* ParticleWorld::getProfiler() {
+	return profiler;
+}
+
+ParticleBlockPool* ParticleWorld::getGeneratorPool(const std::type_info& type, size_t size) {
+	GeneratorPools::iterator found = generatorPools.find(std::type_index(type));
+	if (found != generatorPools.end()) return found->second;
+
+	ParticleBlockPool* pool = new ParticleBlockPool(size, 256);
+	generatorPools[std::type_index(type)] = pool;
+	return pool;
+}